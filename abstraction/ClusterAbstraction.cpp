@@ -29,6 +29,11 @@
 #include <cfloat>
 #include <cmath>
 #include <limits>
+#include <algorithm>
+#include <thread>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 using namespace GraphAbstractionConstants;
 
@@ -60,15 +65,14 @@ public:
 		return heuristic(node1, node2);
 	}
 
+	// the corridor is kept sorted instead of being marked in node labels, so
+	// searches in different clusters can run at the same time
 	void setCorridor(std::vector<node *> &corr)
 	{
 		corridor = corr;
+		std::sort(corridor.begin(), corridor.end());
 		if (corr.size() > 0)
-		{
 			corridorLevel = aMap->GetAbstractionLevel(corr[0]);
-			for (unsigned int x = 0; x < corridor.size(); x++)
-				corridor[x]->SetLabelL(kTemporaryLabel, x);
-		}
 	}
 	
 	bool inCorridor(uint32_t nodeID)
@@ -77,13 +81,7 @@ public:
 			return true;
 		node *n = aMap->GetAbstractGraph(level)->GetNode(nodeID);
 		node *parent = aMap->GetNthParent(n, corridorLevel);
-		if (parent)
-		{
-			unsigned int loc = parent->GetLabelL(kTemporaryLabel);
-			if ((loc < corridor.size()) && (corridor[loc] == parent))
-				return true;
-		}
-		return false;
+		return (parent != 0) && std::binary_search(corridor.begin(), corridor.end(), parent);
 	}
 private:
 	GraphAbstraction *aMap;
@@ -106,14 +104,22 @@ void Cluster::AddNode(int n)
 /**
 * create a cluster abstraction for the given map. Clusters are square, 
  * with height = width = clustersize. 
+ *
+ * If cacheDir is given, the results of the searches are loaded from (or
+ * saved to) a file there named for the map contents and cluster size.
  */ 
-ClusterAbstraction::ClusterAbstraction(Map *map, int _clusterSize)
-:MapAbstraction(map),clusterSize(_clusterSize)
+ClusterAbstraction::ClusterAbstraction(Map *map, int _clusterSize, const char *_cacheDir)
+:MapAbstraction(map),clusterSize(_clusterSize),cacheDir(_cacheDir?_cacheDir:"")
 {
 	abstractions.push_back(GetMapGraph(map));
 	createClustersAndEntrances();
 	linkEntrancesAndClusters();
+	bool cached = (cacheDir.size() > 0) && loadCache();
 	createAbstractGraph();
+	if ((cacheDir.size() > 0) && !cached)
+		saveCache();
+	parentChoices.clear();
+	clusterPaths.clear();
 }
 
 ClusterAbstraction::~ClusterAbstraction()
@@ -197,6 +203,12 @@ void ClusterAbstraction::createAbstractGraph()
 	abstractions.push_back(new Graph());
 	Graph *g = abstractions[1];
 	
+	// GetNodeLoc stores the location of a node in its labels the first time
+	// it is called; doing that for every map node now means the parallel
+	// searches only read the map graph
+	for (int x = 0; x < abstractions[0]->GetNumNodes(); x++)
+		GetNodeLoc(abstractions[0]->GetNode(x));
+	
 	addAbsNodes(g);
 	setUpParents(g);
 	computeClusterPaths(g);
@@ -538,74 +550,45 @@ void ClusterAbstraction::addAbsNodes(Graph* g)
  * there is a path that only uses nodes inside the cluster. If there is, add an edge to the abstract
  * Graph with the path distance as its weight and cache the path in the hash map.  
  * 
- * can make this more efficient?
+ * The searches only read the graph, so they run for all clusters in parallel
+ * (unless they were loaded from the cache); the edges are then added in order.
  */
 void ClusterAbstraction::computeClusterPaths(Graph* g)
-{//int total=0;
-	Map* map = MapAbstraction::GetMap();
+{
 	if (verbose) std::cout<<"computing cluster paths\n";
-	for (unsigned int i=0; i<clusters.size(); i++)
+	uint32_t numMapNodes = abstractions[0]->GetNumNodes();
+	std::vector<bool> needed(clusters.size(), true);
+	if (clusterPaths.size() == clusters.size())
 	{
-		Cluster& c = clusters[i];
-		
-		std::vector<node*> corridor; 
-		for (int l=0; l<c.GetNumNodes(); l++)
+		for (unsigned int i=0; i<clusters.size(); i++)
 		{
-			corridor.push_back(g->GetNode(c.getIthNodeNum(l)));
+			unsigned int n = clusters[i].GetNumNodes();
+			needed[i] = (clusterPaths[i].size() != n*(n-1)/2);
+			for (unsigned int j=0; !needed[i] && j<clusterPaths[i].size(); j++)
+				for (unsigned int k=0; k<clusterPaths[i][j].size(); k++)
+					if (clusterPaths[i][j][k] >= numMapNodes)
+						needed[i] = true;
 		}
-		for (unsigned int j=0; j < c.parents.size(); j++)
-			corridor.push_back(c.parents[j]);
-		
-		//int num = 0;
+	}
+	else {
+		clusterPaths.resize(0);
+		clusterPaths.resize(clusters.size());
+	}
+	std::vector<node*> noDummies;
+	runClusterWorkers(false, noDummies, needed);
+
+	for (unsigned int i=0; i<clusters.size(); i++)
+	{
+		Cluster& c = clusters[i];
+		int which = 0;
 		for (int j=0; j<c.GetNumNodes(); j++)
 		{
 			for (int k=j+1; k<c.GetNumNodes();k++)
 			{
-				
-				// find bottom level nodes
-				node* absStart = g->GetNode(c.getIthNodeNum(j));
-				node* absGoal = g->GetNode(c.getIthNodeNum(k));
-				
-				// find start/end coordinates (same in abstract and bottom level)
-				double startx = absStart->GetLabelF(kXCoordinate);	
-				double starty = absStart->GetLabelF(kYCoordinate);
-				double startz = absStart->GetLabelF(kZCoordinate);
-				
-				double goalx = absGoal->GetLabelF(kXCoordinate);
-				double goaly = absGoal->GetLabelF(kYCoordinate);
-				double goalz = absGoal->GetLabelF(kZCoordinate);
-				
-				point3d s(startx,starty,startz);
-				point3d gl(goalx,goaly,goalz);
-				
-				int px;
-				int py;
-				
-				map->GetPointFromCoordinate(s,px,py);
-				
-				node* start = GetNodeFromMap(px,py);
-				
-				map->GetPointFromCoordinate(gl,px,py);
-				
-				node* goal = GetNodeFromMap(px,py);
-				
-				int startnum = c.getIthNodeNum(j);
-				int goalnum = c.getIthNodeNum(k);
-				
-				//find path
-//				corridorAStar astar;
-//				astar.setCorridor(&corridor);
-//				path* p = astar.GetPath(static_cast<MapAbstraction*>(this), start, goal);
-
-				GenericAStar astar;
-				ClusterSearchEnvironment cse(this, GetAbstractionLevel(start));
-				cse.setCorridor(corridor);
-				std::vector<uint32_t> resultPath;
-				astar.GetPath(&cse, start->GetNum(), goal->GetNum(),
-											resultPath);
+				std::vector<uint32_t> &resultPath = clusterPaths[i][which++];
 				path *p = 0;
 				for (unsigned int x = 0; x < resultPath.size(); x++)
-					p = new path(GetAbstractGraph(start)->GetNode(resultPath[x]), p);
+					p = new path(abstractions[0]->GetNode(resultPath[x]), p);
 
 				if (p!=0)
 				{
@@ -613,7 +596,7 @@ void ClusterAbstraction::computeClusterPaths(Graph* g)
 					double dist = distance(p); 
 					
 					//create edge
-					edge* newedge = new edge(startnum, goalnum, dist);
+					edge* newedge = new edge(c.getIthNodeNum(j), c.getIthNodeNum(k), dist);
 					g->AddEdge(newedge);
 					
 					//store path
@@ -624,6 +607,224 @@ void ClusterAbstraction::computeClusterPaths(Graph* g)
 	}
 }
 
+/*
+ * Find the path between each pair of entrances of a cluster, restricted to
+ * the cluster; pairPaths gets one (possibly empty) path per pair.
+ */
+void ClusterAbstraction::findClusterPaths(int cluster, std::vector<std::vector<uint32_t> > &pairPaths)
+{
+	Map* map = MapAbstraction::GetMap();
+	Graph* g = abstractions[1];
+	Cluster& c = clusters[cluster];
+	
+	std::vector<node*> corridor; 
+	for (int l=0; l<c.GetNumNodes(); l++)
+	{
+		corridor.push_back(g->GetNode(c.getIthNodeNum(l)));
+	}
+	for (unsigned int j=0; j < c.parents.size(); j++)
+		corridor.push_back(c.parents[j]);
+	ClusterSearchEnvironment cse(this, 0);
+	cse.setCorridor(corridor);
+	
+	pairPaths.resize(0);
+	for (int j=0; j<c.GetNumNodes(); j++)
+	{
+		for (int k=j+1; k<c.GetNumNodes();k++)
+		{
+			// find bottom level nodes
+			node* absStart = g->GetNode(c.getIthNodeNum(j));
+			node* absGoal = g->GetNode(c.getIthNodeNum(k));
+			
+			// find start/end coordinates (same in abstract and bottom level)
+			point3d s(absStart->GetLabelF(kXCoordinate), absStart->GetLabelF(kYCoordinate), absStart->GetLabelF(kZCoordinate));
+			point3d gl(absGoal->GetLabelF(kXCoordinate), absGoal->GetLabelF(kYCoordinate), absGoal->GetLabelF(kZCoordinate));
+			
+			int px;
+			int py;
+			map->GetPointFromCoordinate(s,px,py);
+			node* start = GetNodeFromMap(px,py);
+			map->GetPointFromCoordinate(gl,px,py);
+			node* goal = GetNodeFromMap(px,py);
+			
+			GenericAStar astar;
+			pairPaths.resize(pairPaths.size()+1);
+			astar.GetPath(&cse, start->GetNum(), goal->GetNum(), pairPaths.back());
+		}
+	}
+}
+
+/*
+ * Runs findClusterParents or findClusterPaths for every cluster marked as
+ * needed, spreading the clusters over all hardware threads.
+ */
+void ClusterAbstraction::runClusterWorkers(bool parents, const std::vector<node*> &dummies,
+										   const std::vector<bool> &needed)
+{
+	int numThreads = std::max(1u, std::thread::hardware_concurrency());
+	std::atomic<int> next(0);
+	std::vector<std::thread*> threads(numThreads);
+	for (int x = 0; x < numThreads; x++)
+		threads[x] = new std::thread(&ClusterAbstraction::clusterWorker, this, parents, &next, &dummies, &needed);
+	for (int x = 0; x < numThreads; x++)
+	{
+		threads[x]->join();
+		delete threads[x];
+		threads[x] = 0;
+	}
+}
+
+void ClusterAbstraction::clusterWorker(bool parents, std::atomic<int> *next,
+									   const std::vector<node*> *dummies, const std::vector<bool> *needed)
+{
+	for (int i = (*next)++; i < (int)clusters.size(); i = (*next)++)
+	{
+		if (!(*needed)[i])
+			continue;
+		if (parents)
+			findClusterParents(i, (*dummies)[i], parentChoices[i]);
+		else
+			findClusterPaths(i, clusterPaths[i]);
+	}
+}
+
+static const char cacheMagic[8] = "HOGHPA1";
+
+static inline void HashValue(uint64_t &hash, long value)
+{
+	for (unsigned int x = 0; x < sizeof(value); x++, value >>= 8)
+		hash = (hash^(uint8_t)value)*0x100000001b3ull;
+}
+
+/**
+ * The cache file is named for a hash (64-bit FNV-1a) of the map size and the
+ * split and terrain of every tile, and for the cluster size.
+ */
+std::string ClusterAbstraction::getCacheFileName() const
+{
+	Map *map = GetMap();
+	uint64_t hash = 0xcbf29ce484222325ull;
+	HashValue(hash, map->GetMapWidth());
+	HashValue(hash, map->GetMapHeight());
+	for (long y = 0; y < map->GetMapHeight(); y++)
+	{
+		for (long x = 0; x < map->GetMapWidth(); x++)
+		{
+			HashValue(hash, map->GetSplit(x, y));
+			HashValue(hash, map->GetTerrainType(x, y, kLeftSide));
+			HashValue(hash, map->GetTerrainType(x, y, kRightSide));
+		}
+	}
+	char name[64];
+	sprintf(name, "/hpa-%016llx-%d.dat", (unsigned long long)hash, clusterSize);
+	return cacheDir+name;
+}
+
+static bool ReadCacheVector(FILE *f, std::vector<int> &v)
+{
+	uint32_t count;
+	if (fread(&count, sizeof(count), 1, f) != 1)
+		return false;
+	v.resize(count);
+	return (count == 0) || (fread(&v[0], sizeof(int), count, f) == count);
+}
+
+static bool ReadCacheVector(FILE *f, std::vector<uint32_t> &v)
+{
+	uint32_t count;
+	if (fread(&count, sizeof(count), 1, f) != 1)
+		return false;
+	v.resize(count);
+	return (count == 0) || (fread(&v[0], sizeof(uint32_t), count, f) == count);
+}
+
+template <typename T>
+static void WriteCacheVector(FILE *f, const std::vector<T> &v)
+{
+	uint32_t count = v.size();
+	fwrite(&count, sizeof(count), 1, f);
+	if (count > 0)
+		fwrite(&v[0], sizeof(T), count, f);
+}
+
+/**
+ * Loads the parent choices and cluster paths found by an earlier build of
+ * the same map. Anything that doesn't match this map is found again when
+ * the abstraction is built.
+ */
+bool ClusterAbstraction::loadCache()
+{
+	std::string fname = getCacheFileName();
+	FILE *f = fopen(fname.c_str(), "r");
+	if (f == 0)
+		return false;
+	char magic[8];
+	uint32_t numClusters;
+	bool ok = (fread(magic, sizeof(magic), 1, f) == 1) && (memcmp(magic, cacheMagic, sizeof(magic)) == 0) &&
+		(fread(&numClusters, sizeof(numClusters), 1, f) == 1) && (numClusters == clusters.size());
+	if (ok)
+	{
+		parentChoices.resize(numClusters);
+		clusterPaths.resize(numClusters);
+	}
+	for (uint32_t x = 0; ok && x < numClusters; x++)
+		ok = ReadCacheVector(f, parentChoices[x]);
+	for (uint32_t x = 0; ok && x < numClusters; x++)
+	{
+		uint32_t numPairs;
+		ok = (fread(&numPairs, sizeof(numPairs), 1, f) == 1);
+		if (ok)
+			clusterPaths[x].resize(numPairs);
+		for (uint32_t y = 0; ok && y < numPairs; y++)
+			ok = ReadCacheVector(f, clusterPaths[x][y]);
+	}
+	fclose(f);
+	if (!ok)
+	{
+		printf("Ignoring invalid HPA* cache file '%s'\n", fname.c_str());
+		parentChoices.clear();
+		clusterPaths.clear();
+	}
+	return ok;
+}
+
+/**
+ * Writes to a temporary file first and then renames it, so that processes
+ * building the same map at once never see a partial file.
+ */
+void ClusterAbstraction::saveCache() const
+{
+	std::string fname = getCacheFileName();
+	char suffix[64];
+	sprintf(suffix, ".%d.%p.tmp", (int)getpid(), (void*)this);
+	std::string tmpName = fname+suffix;
+	FILE *f = fopen(tmpName.c_str(), "w+");
+	if (f == 0)
+	{
+		printf("Unable to write HPA* cache file '%s'\n", tmpName.c_str());
+		return;
+	}
+	uint32_t numClusters = clusters.size();
+	fwrite(cacheMagic, sizeof(cacheMagic), 1, f);
+	fwrite(&numClusters, sizeof(numClusters), 1, f);
+	for (uint32_t x = 0; x < numClusters; x++)
+		WriteCacheVector(f, parentChoices[x]);
+	for (uint32_t x = 0; x < numClusters; x++)
+	{
+		uint32_t numPairs = clusterPaths[x].size();
+		fwrite(&numPairs, sizeof(numPairs), 1, f);
+		for (uint32_t y = 0; y < numPairs; y++)
+			WriteCacheVector(f, clusterPaths[x][y]);
+	}
+	bool ok = (ferror(f) == 0);
+	fclose(f);
+	if (!ok || rename(tmpName.c_str(), fname.c_str()) != 0)
+	{
+		printf("Unable to write HPA* cache file '%s'\n", fname.c_str());
+		remove(tmpName.c_str());
+	}
+}
+
 /**
 * given a cluster row and column (NOT map row/column), return the cluster's ID.
  */
@@ -751,113 +952,48 @@ void ClusterAbstraction::setUpParents(Graph* g)
 	
 	int numNodesAfter = g->GetNumNodes();
 	
-	for (unsigned int i=0; i<clusters.size(); i++)
+	// Find the closest entrance of each node (searching in all clusters in
+	// parallel, unless the choices were loaded from the cache) and then build
+	// the nodes into those parents in order
+	std::vector<bool> needed(clusters.size(), true);
+	if (parentChoices.size() == clusters.size())
 	{
-		
-		Cluster& c = clusters[i];
-		//Create the corridor
-		std::vector<node*> corridor; 
-		corridor.push_back(dummies[i]);
-		
-		for (int l=0; l<c.GetNumNodes(); l++)
+		for (unsigned int i=0; i<clusters.size(); i++)
 		{
-			corridor.push_back(g->GetNode(c.getIthNodeNum(l)));
+			Cluster& c = clusters[i];
+			needed[i] = ((int)parentChoices[i].size() != dummies[i]->GetLabelL(kNumAbstractedNodes));
+			for (unsigned int j=0; !needed[i] && j<parentChoices[i].size(); j++)
+			{
+				int k;
+				for (k=0; k<c.GetNumNodes() && c.getIthNodeNum(k) != parentChoices[i][j]; k++)
+				{}
+				needed[i] = (parentChoices[i][j] != -1) && (k == c.GetNumNodes());
+			}
 		}
-		
-//		corridorAStar astar;
-//		astar.setCorridor(&corridor);	
-		
-		// 		std::cout<<"corridor has: "<<std::endl;
-		// 		for (unsigned int bla = 0; bla<corridor.size(); bla++)
-		// 			std::cout<<corridor[bla]<<" ("<<corridor[bla]->GetLabelL(kNumAbstractedNodes)<<") ";
-		// 		std::cout<<std::endl;
-		
-		//Find parent for each node 
+	}
+	else {
+		parentChoices.resize(0);
+		parentChoices.resize(clusters.size());
+	}
+	runClusterWorkers(true, dummies, needed);
+	
+	for (unsigned int i=0; i<clusters.size(); i++)
+	{
+		Cluster& c = clusters[i];
+		int which = 0;
 		for (int x=c.getHOrig(); x<c.getHOrig()+c.getWidth(); x++)
 		{
 			for (int y=c.getVOrig(); y<c.getVOrig()+c.GetHeight(); y++)
 			{
 				if (map->GetNodeNum(x,y) >= 0)
 				{
-					node* mnode = GetNodeFromMap(x,y);
-					
-					// reset minimum 
-					double minDist = DBL_MAX;
-					node* entrance = 0;
-					
-					//for every abstract (entrance node) in this cluster
-					for (int k=0; k<c.GetNumNodes(); k++)
-					{
-						//get the entrance
-						int nodenum = c.getIthNodeNum(k);
-						
-						node* n = g->GetNode(nodenum);						
-						node* low = getLowLevelNode(n);	
-						
-						if (low==mnode)
-						{
-							entrance = n;
-							break;
-						}
-						
-						//See if there's a path within this cluster
-//						astar.setCorridor(&corridor);
-//						path* p = astar.GetPath(static_cast<MapAbstraction*>(this),low,mnode);
-						GenericAStar astar;
-						ClusterSearchEnvironment cse(this, GetAbstractionLevel(low));
-						cse.setCorridor(corridor);
-						std::vector<uint32_t> resultPath;
-						astar.GetPath(&cse, low->GetNum(), mnode->GetNum(),
-													resultPath);
-						path *p = 0;
-						for (unsigned int t = 0; t < resultPath.size(); t++)
-							p = new path(GetAbstractGraph(low)->GetNode(resultPath[t]), p);
-						
-						if (p!=0)
-						{
-							// 								std::cout<<"corridor has: "<<std::endl;
-							// 								for (unsigned int bla = 0; bla<corridor.size(); bla++)
-							// 									std::cout<<corridor[bla]<<" ("<<corridor[bla]->GetLabelL(kNumAbstractedNodes)<<") ";
-							// 								std::cout<<std::endl;
-							// 							}
-							
-							// find distance to this point 
-							point3d s(n->GetLabelF(kXCoordinate),n->GetLabelF(kYCoordinate),-1);
-							int px;
-							int py;
-							map->GetPointFromCoordinate(s,px,py);
-							
-							// calculate the distance to this entrance
-							
-							double dist = distance(p);
-							
-							if (dist<minDist)
-							{
-								
-								minDist=dist;  
-								entrance=n;
-								
-							}
-							delete p;
-					}
+					int entrance = parentChoices[i][which++];
+					if (entrance != -1)
+						buildNodeIntoParent(GetNodeFromMap(x,y), g->GetNode(entrance));
 				}
-					
-					//std::cout<<entrance<<std::endl;
-					if (entrance)
-					{
-						
-						point3d s(entrance->GetLabelF(kXCoordinate),entrance->GetLabelF(kYCoordinate),-1);
-						int px;
-						int py;
-						map->GetPointFromCoordinate(s,px,py);
-						buildNodeIntoParent(mnode, entrance);
-					}
-					//					else
-					//std::cout<<" no parent\n";
-			}//end if (not out of bounds)
-		}    
+			}
+		}
 	}
-}
 // 	for (unsigned int i=0;i<dummies.size(); i++){
 // 		// make sure no node has a dummy for a parent
 // 		for (int j=0; j<dummies[i]->GetLabelL(kNumAbstractedNodes); j++){
@@ -920,6 +1056,76 @@ for (unsigned int i=dummies.size()-1;i>0; --i)
 }
 }
 
+/**
+ * For each node of a cluster (in the order setUpParents visits them), find
+ * the entrance with the shortest path to it within the cluster, or -1.
+ */
+void ClusterAbstraction::findClusterParents(int cluster, node *dummy, std::vector<int> &entrances)
+{
+	Map* map = MapAbstraction::GetMap();
+	Graph* g = abstractions[1];
+	Cluster& c = clusters[cluster];
+	//Create the corridor
+	std::vector<node*> corridor; 
+	corridor.push_back(dummy);
+	for (int l=0; l<c.GetNumNodes(); l++)
+	{
+		corridor.push_back(g->GetNode(c.getIthNodeNum(l)));
+	}
+	ClusterSearchEnvironment cse(this, 0);
+	cse.setCorridor(corridor);
+	
+	entrances.resize(0);
+	for (int x=c.getHOrig(); x<c.getHOrig()+c.getWidth(); x++)
+	{
+		for (int y=c.getVOrig(); y<c.getVOrig()+c.GetHeight(); y++)
+		{
+			if (map->GetNodeNum(x,y) < 0)
+				continue;
+			node* mnode = GetNodeFromMap(x,y);
+			
+			// reset minimum 
+			double minDist = DBL_MAX;
+			int entrance = -1;
+			
+			//for every abstract (entrance node) in this cluster
+			for (int k=0; k<c.GetNumNodes(); k++)
+			{
+				//get the entrance
+				int nodenum = c.getIthNodeNum(k);
+				node* low = getLowLevelNode(g->GetNode(nodenum));	
+				
+				if (low==mnode)
+				{
+					entrance = nodenum;
+					break;
+				}
+				
+				//See if there's a path within this cluster
+				GenericAStar astar;
+				std::vector<uint32_t> resultPath;
+				astar.GetPath(&cse, low->GetNum(), mnode->GetNum(), resultPath);
+				path *p = 0;
+				for (unsigned int t = 0; t < resultPath.size(); t++)
+					p = new path(abstractions[0]->GetNode(resultPath[t]), p);
+				
+				if (p!=0)
+				{
+					// calculate the distance to this entrance
+					double dist = distance(p);
+					if (dist<minDist)
+					{
+						minDist=dist;  
+						entrance=nodenum;
+					}
+					delete p;
+				}
+			}
+			entrances.push_back(entrance);
+		}
+	}
+}
+
 /**
 * 'borrowed' from MapSectorAbstraction.cpp
  */
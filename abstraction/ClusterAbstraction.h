@@ -28,6 +28,8 @@
 #define CLUSTERABSTRACTION_H
 
 #include <vector>
+#include <string>
+#include <atomic>
 #include <ext/hash_map>
 
 #include "MapAbstraction.h"
@@ -136,10 +138,10 @@ private:
  */
 class ClusterAbstraction : public MapAbstraction {
 public:
-  ClusterAbstraction(Map *map, int _clusterSize);
+  ClusterAbstraction(Map *map, int _clusterSize, const char *cacheDir = 0);
   ~ClusterAbstraction();
 	MapAbstraction* Clone(Map* map)
-	{ return new ClusterAbstraction(map, clusterSize); }
+	{ return new ClusterAbstraction(map, clusterSize, (cacheDir.size() > 0)?cacheDir.c_str():0); }
 
 	int getClusterSize() { return clusterSize; };  
   bool Pathable(node* start, node* goal);
@@ -172,6 +174,14 @@ private:
   void linkEntrancesAndClusters();
   void addAbsNodes(Graph* g);
   void computeClusterPaths(Graph* g);
+  void findClusterPaths(int cluster, std::vector<std::vector<uint32_t> > &pairPaths);
+  void findClusterParents(int cluster, node *dummy, std::vector<int> &entrances);
+  void runClusterWorkers(bool parents, const std::vector<node*> &dummies, const std::vector<bool> &needed);
+  void clusterWorker(bool parents, std::atomic<int> *next,
+										 const std::vector<node*> *dummies, const std::vector<bool> *needed);
+  std::string getCacheFileName() const;
+  bool loadCache();
+  void saveCache() const;
   void addEntrance(Entrance e);
   int getClusterId(int row, int col) const;
 
@@ -186,6 +196,13 @@ private:
   clusterUtil::PathLookupTable paths;
   clusterUtil::PathLookupTable temp;
 		std::vector<path*> newPaths;
+  std::string cacheDir;
+  // results of the searches made while building, by cluster: the entrance
+  // chosen as parent of each map node, and the path between each pair of
+  // entrances (as map node numbers). Loaded from the cache or computed in
+  // parallel, and freed once the abstraction is built.
+  std::vector<std::vector<int> > parentChoices;
+  std::vector<std::vector<std::vector<uint32_t> > > clusterPaths;
   int nodeExists(const Cluster& c,double x,double y, Graph* g);
   void setUpParents(Graph* g);
 
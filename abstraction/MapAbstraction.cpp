@@ -329,67 +329,12 @@ Graph *GetMapGraph(Map *m)
 {
 //	return GraphSearchConstants::GetGraph(m);
 	// printf("Getting Graph representation of world\n");
-	char name[32];
 	Graph *g = new Graph();
-	node *n;
 	for (int y = 0; y < m->GetMapHeight(); y++)
 	{
 		for (int x = 0; x < m->GetMapWidth(); x++)
 		{
-			Tile &currTile = m->GetTile(x, y);
-			currTile.tile1.node = kNoGraphNode;
-			currTile.tile2.node = kNoGraphNode;
-			
-			if (m->AdjacentEdges(x, y, kInternalEdge))
-			{
-				if (m->GetTerrainType(x, y) == kOutOfBounds)
-					continue;
-				sprintf(name, "(%d, %d)", x, y);
-				currTile.tile1.node = g->AddNode(n = new node(name));
-				n->SetLabelL(kAbstractionLevel, 0); // level in abstraction tree
-				n->SetLabelL(kNumAbstractedNodes, 1); // number of abstracted nodes
-				n->SetLabelL(kParent, -1); // parent of this node in abstraction hierarchy
-				n->SetLabelF(kXCoordinate, kUnknownPosition);
-				n->SetLabelL(kNodeBlocked, 0);
-				n->SetLabelL(kFirstData, x);
-				n->SetLabelL(kFirstData+1, y);
-				n->SetLabelL(kFirstData+2, kNone);
-			}
-			else {
-				if (m->GetTerrainType(x, y, kLeftEdge) != kOutOfBounds)
-				{
-					sprintf(name, "(%d/%d)", x, y);
-					currTile.tile1.node = g->AddNode(n = new node(name));
-					n->SetLabelL(kAbstractionLevel, 0); // level in abstraction tree
-					n->SetLabelL(kNumAbstractedNodes, 1); // number of abstracted nodes
-					n->SetLabelL(kParent, -1); // parent of this node in abstraction hierarchy
-					n->SetLabelF(kXCoordinate, kUnknownPosition);
-					n->SetLabelL(kNodeBlocked, 0);
-					n->SetLabelL(kFirstData, x);
-					n->SetLabelL(kFirstData+1, y);
-					if (currTile.split == kForwardSplit)
-						n->SetLabelL(kFirstData+2, kTopLeft);
-					else
-						n->SetLabelL(kFirstData+2, kBottomLeft);
-				}
-				
-				if (m->GetTerrainType(x, y, kRightEdge) != kOutOfBounds)
-				{
-					sprintf(name, "(%d\\%d)", x, y);
-					currTile.tile2.node = g->AddNode(n = new node(name));
-					n->SetLabelL(kAbstractionLevel, 0); // level in abstraction tree
-					n->SetLabelL(kNumAbstractedNodes, 1); // number of abstracted nodes
-					n->SetLabelL(kParent, -1); // parent of this node in abstraction hierarchy
-					n->SetLabelF(kXCoordinate, kUnknownPosition);
-					n->SetLabelL(kNodeBlocked, 0);
-					n->SetLabelL(kFirstData, x);
-					n->SetLabelL(kFirstData+1, y);
-					if (currTile.split == kForwardSplit)
-						n->SetLabelL(kFirstData+2, kBottomRight);
-					else
-						n->SetLabelL(kFirstData+2, kTopRight);
-				}
-			}
+			AddMapNodes(m, g, x, y);
 		}
 	}
 	for (int y = 0; y < m->GetMapHeight(); y++)
@@ -433,6 +378,73 @@ Graph *GetMapGraph(Map *m)
 	return g;
 }
 
+/**
+ * AddMapNodes(map, Graph, x, y)
+ *
+ * This is a helper function for GetMapGraph that adds the Graph node(s) for
+ * the tile at (x, y) (none for out of bounds tiles) and sets their numbers in
+ * the map.
+ */
+void AddMapNodes(Map *m, Graph *g, int x, int y)
+{
+	char name[32];
+	node *n;
+	Tile &currTile = m->GetTile(x, y);
+	currTile.tile1.node = kNoGraphNode;
+	currTile.tile2.node = kNoGraphNode;
+	
+	if (m->AdjacentEdges(x, y, kInternalEdge))
+	{
+		if (m->GetTerrainType(x, y) == kOutOfBounds)
+			return;
+		sprintf(name, "(%d, %d)", x, y);
+		currTile.tile1.node = g->AddNode(n = new node(name));
+		n->SetLabelL(kAbstractionLevel, 0); // level in abstraction tree
+		n->SetLabelL(kNumAbstractedNodes, 1); // number of abstracted nodes
+		n->SetLabelL(kParent, -1); // parent of this node in abstraction hierarchy
+		n->SetLabelF(kXCoordinate, kUnknownPosition);
+		n->SetLabelL(kNodeBlocked, 0);
+		n->SetLabelL(kFirstData, x);
+		n->SetLabelL(kFirstData+1, y);
+		n->SetLabelL(kFirstData+2, kNone);
+	}
+	else {
+		if (m->GetTerrainType(x, y, kLeftEdge) != kOutOfBounds)
+		{
+			sprintf(name, "(%d/%d)", x, y);
+			currTile.tile1.node = g->AddNode(n = new node(name));
+			n->SetLabelL(kAbstractionLevel, 0); // level in abstraction tree
+			n->SetLabelL(kNumAbstractedNodes, 1); // number of abstracted nodes
+			n->SetLabelL(kParent, -1); // parent of this node in abstraction hierarchy
+			n->SetLabelF(kXCoordinate, kUnknownPosition);
+			n->SetLabelL(kNodeBlocked, 0);
+			n->SetLabelL(kFirstData, x);
+			n->SetLabelL(kFirstData+1, y);
+			if (currTile.split == kForwardSplit)
+				n->SetLabelL(kFirstData+2, kTopLeft);
+			else
+				n->SetLabelL(kFirstData+2, kBottomLeft);
+		}
+		
+		if (m->GetTerrainType(x, y, kRightEdge) != kOutOfBounds)
+		{
+			sprintf(name, "(%d\\%d)", x, y);
+			currTile.tile2.node = g->AddNode(n = new node(name));
+			n->SetLabelL(kAbstractionLevel, 0); // level in abstraction tree
+			n->SetLabelL(kNumAbstractedNodes, 1); // number of abstracted nodes
+			n->SetLabelL(kParent, -1); // parent of this node in abstraction hierarchy
+			n->SetLabelF(kXCoordinate, kUnknownPosition);
+			n->SetLabelL(kNodeBlocked, 0);
+			n->SetLabelL(kFirstData, x);
+			n->SetLabelL(kFirstData+1, y);
+			if (currTile.split == kForwardSplit)
+				n->SetLabelL(kFirstData+2, kBottomRight);
+			else
+				n->SetLabelL(kFirstData+2, kTopRight);
+		}
+	}
+}
+
 /**
 * AddMapEdges(map, Graph, x, y)
  *
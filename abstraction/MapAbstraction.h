@@ -74,6 +74,7 @@ private:
 };
 
 Graph *GetMapGraph(Map *m);
+void AddMapNodes(Map *m, Graph *g, int x, int y);
 void AddMapEdges(Map *m, Graph *g, int x, int y);
 
 #endif
@@ -27,6 +27,7 @@
 
 #include "MapSectorAbstraction.h"
 #include "Graph.h"
+#include <algorithm>
 
 using namespace GraphAbstractionConstants;
 
@@ -102,10 +103,395 @@ void MapSectorAbstraction::AddEdge(edge *, unsigned int)
 	assert(false);
 }
 
+void MapSectorAbstraction::MarkTileChanged(int x, int y)
+{
+	if ((x < 0) || (y < 0) || (x >= GetMap()->GetMapWidth()) || (y >= GetMap()->GetMapHeight()))
+		return;
+	changedTiles.push_back(std::pair<int, int>(x, y));
+}
+
 /** This must be called after any of the above add/remove operations. But the
-operations can be stacked followed by a single RepairAbstraction call. */
+operations can be stacked followed by a single RepairAbstraction call.
+
+Changed tiles (see MarkTileChanged) are repaired from the bottom up:
+ 1. The map graph is rebuilt around the changed tiles. A parent that loses a
+    child or an edge between its children is marked as affected, as are two
+    parents in one quadrant that gain an edge between their children.
+ 2. At each level the affected nodes are removed, and so is any node whose
+    children are connected to, and in the same quadrant as, a child without
+    a parent. The children without parents are abstracted again, which gives
+    the connected pieces of each quadrant as buildAbstraction does, and the
+    new parents are handled the same way at the next level.
+ 3. Levels are added or removed at the top, as buildAbstraction would.
+The edges between parents are kept up to date as the edges below come and
+go, so the work at each level is limited to the pieces that changed. The
+result is the abstraction that buildAbstraction gives for the new map, up
+to the numbering of the nodes. */
 void MapSectorAbstraction::RepairAbstraction()
 {
+	if (changedTiles.size() == 0)
+		return;
+
+	int width = GetMap()->GetMapWidth();
+	std::vector<int> tiles;
+	for (unsigned int x = 0; x < changedTiles.size(); x++)
+		tiles.push_back(changedTiles[x].second*width+changedTiles[x].first);
+	changedTiles.resize(0);
+	std::sort(tiles.begin(), tiles.end());
+	tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+
+	affectedNodes.resize(0);
+	affectedNodes.resize(abstractions.size());
+	// the nodes of the current level that need a parent
+	std::vector<node *> orphans;
+	// 1.
+	repairTiles(tiles, orphans);
+	// 2.
+	for (unsigned int level = 1; level < abstractions.size(); level++)
+		regroupNodes(level, orphans);
+	affectedNodes.resize(0);
+	// 3.
+	repairLevels();
+}
+
+/**
+ * Replaces the nodes of the given tiles (y*width+x) in the map graph, and
+ * the edges that depend on them, which all join two tiles within one step
+ * of a changed tile. The new nodes are added to orphans.
+ */
+void MapSectorAbstraction::repairTiles(std::vector<int> &tiles, std::vector<node *> &orphans)
+{
+	Map *m = GetMap();
+	Graph *g = abstractions[0];
+	int width = m->GetMapWidth(), height = m->GetMapHeight();
+	std::vector<int> near;
+	for (unsigned int x = 0; x < tiles.size(); x++)
+	{
+		int tx = tiles[x]%width, ty = tiles[x]/width;
+		for (int dy = -1; dy <= 1; dy++)
+			for (int dx = -1; dx <= 1; dx++)
+				if ((tx+dx >= 0) && (tx+dx < width) && (ty+dy >= 0) && (ty+dy < height))
+					near.push_back((ty+dy)*width+tx+dx);
+	}
+	std::sort(near.begin(), near.end());
+	near.erase(std::unique(near.begin(), near.end()), near.end());
+
+	// remove the edges between nearby tiles
+	std::vector<edge *> edges;
+	for (unsigned int x = 0; x < near.size(); x++)
+	{
+		Tile &t = m->GetTile(near[x]%width, near[x]/width);
+		long tileNodes[2] = { t.tile1.node, t.tile2.node };
+		for (int y = 0; y < 2; y++)
+		{
+			if (tileNodes[y] == kNoGraphNode)
+				continue;
+			node *n = g->GetNode(tileNodes[y]);
+			edges.resize(0);
+			edge_iterator ei = n->getEdgeIter();
+			for (edge *e = n->edgeIterNext(ei); e; e = n->edgeIterNext(ei))
+			{
+				node *other = g->GetNode((e->getFrom() == n->GetNum())?e->getTo():e->getFrom());
+				if (std::binary_search(near.begin(), near.end(),
+															 other->GetLabelL(kFirstData+1)*width+other->GetLabelL(kFirstData)))
+					edges.push_back(e);
+			}
+			for (unsigned int z = 0; z < edges.size(); z++)
+			{
+				removeEdgeFromParent(edges[z], 0);
+				g->RemoveEdge(edges[z]);
+				delete edges[z];
+			}
+		}
+	}
+
+	// replace the nodes of the changed tiles
+	for (unsigned int x = 0; x < tiles.size(); x++)
+	{
+		Tile &t = m->GetTile(tiles[x]%width, tiles[x]/width);
+		if (t.tile2.node != kNoGraphNode)
+			removeAbstractNode(g->GetNode(t.tile2.node), orphans);
+		if (t.tile1.node != kNoGraphNode)
+			removeAbstractNode(g->GetNode(t.tile1.node), orphans);
+		int first = g->GetNumNodes();
+		AddMapNodes(m, g, tiles[x]%width, tiles[x]/width);
+		for (int y = first; y < g->GetNumNodes(); y++)
+			orphans.push_back(g->GetNode(y));
+	}
+
+	// add back the edges between nearby tiles; AddMapEdges also adds edges
+	// to tiles further away, which are still there
+	for (unsigned int x = 0; x < near.size(); x++)
+	{
+		int first = g->GetNumEdges();
+		AddMapEdges(m, g, near[x]%width, near[x]/width);
+		edges.resize(0);
+		for (int y = first; y < g->GetNumEdges(); y++)
+			edges.push_back(g->GetEdge(y));
+		for (unsigned int y = 0; y < edges.size(); y++)
+		{
+			node *from = g->GetNode(edges[y]->getFrom());
+			node *to = g->GetNode(edges[y]->getTo());
+			if (std::binary_search(near.begin(), near.end(), from->GetLabelL(kFirstData+1)*width+from->GetLabelL(kFirstData)) &&
+					std::binary_search(near.begin(), near.end(), to->GetLabelL(kFirstData+1)*width+to->GetLabelL(kFirstData)))
+			{
+				addEdgeToParent(edges[y], 0);
+			}
+			else {
+				g->RemoveEdge(edges[y]);
+				delete edges[y];
+			}
+		}
+	}
+}
+
+/**
+ * Gives parents at absLevel to the orphans (nodes at absLevel-1 without a
+ * parent), after removing the affected nodes at absLevel and any others
+ * that must be merged with the orphans. On return orphans holds the new
+ * parents.
+ */
+void MapSectorAbstraction::regroupNodes(unsigned int absLevel, std::vector<node *> &orphans)
+{
+	Graph *g = abstractions[absLevel];
+	Graph *children = abstractions[absLevel-1];
+
+	// removing a node only marks nodes one level up, so these all stay valid
+	std::vector<node *> &affected = affectedNodes[absLevel];
+	std::sort(affected.begin(), affected.end());
+	affected.erase(std::unique(affected.begin(), affected.end()), affected.end());
+	for (unsigned int x = 0; x < affected.size(); x++)
+		removeAbstractNode(affected[x], orphans);
+	affected.resize(0);
+
+	// a neighbor in the same quadrant will be in the same parent, so its
+	// current parent is taken apart too (which can add more orphans)
+	for (unsigned int x = 0; x < orphans.size(); x++)
+	{
+		node *orphan = orphans[x];
+		int quadrant = getQuadrant(orphan);
+		neighbor_iterator ni = orphan->getNeighborIter();
+		for (long tmp = orphan->nodeNeighborNext(ni); tmp != -1; tmp = orphan->nodeNeighborNext(ni))
+		{
+			node *next = children->GetNode(tmp);
+			long parent = next->GetLabelL(kParent);
+			if ((parent != -1) && (getQuadrant(next) == quadrant))
+				removeAbstractNode(g->GetNode(parent), orphans);
+		}
+	}
+
+	unsigned int firstNew = g->GetNumNodes();
+	std::vector<node *> parents;
+	for (unsigned int x = 0; x < orphans.size(); x++)
+	{
+		if (orphans[x]->GetLabelL(kParent) == -1)
+		{
+			parents.push_back(addParentNode(g, orphans[x]));
+			abstractionBFS(orphans[x], parents.back(), getQuadrant(orphans[x]));
+		}
+	}
+
+	for (unsigned int x = 0; x < orphans.size(); x++)
+	{
+		node *next = orphans[x];
+		edge_iterator ei = next->getEdgeIter();
+		for (edge *e = next->edgeIterNext(ei); e; e = next->edgeIterNext(ei))
+		{
+			unsigned int other = (e->getFrom() == next->GetNum())?e->getTo():e->getFrom();
+			// edges between two new parents are seen from both ends
+			if ((children->GetNode(other)->GetLabelL(kParent) >= (long)firstNew) &&
+					(e->getFrom() != next->GetNum()))
+				continue;
+			addEdgeToParent(e, absLevel-1);
+		}
+	}
+	assert(affected.size() == 0);
+	orphans.swap(parents);
+}
+
+/** Adds or removes levels at the top so the last level is the first without edges */
+void MapSectorAbstraction::repairLevels()
+{
+	unsigned int top = 0;
+	while ((top+1 < abstractions.size()) && (abstractions[top]->GetNumEdges() > 0))
+		top++;
+	if (top+1 < abstractions.size())
+	{
+		while (abstractions.size() > top+1)
+		{
+			delete abstractions.back();
+			abstractions.pop_back();
+		}
+		node_iterator ni = abstractions[top]->getNodeIter();
+		for (node *n = abstractions[top]->nodeIterNext(ni); n; n = abstractions[top]->nodeIterNext(ni))
+			n->SetLabelL(kParent, -1);
+	}
+	while (abstractions.back()->GetNumEdges() > 0)
+	{
+		Graph *g = new Graph();
+		addNodes(g);
+		addEdges(g);
+		abstractions.push_back(g);
+	}
+}
+
+/**
+ * Removes a node and its edges, taking them out of the level above. The
+ * children of the node are added to orphans.
+ */
+void MapSectorAbstraction::removeAbstractNode(node *n, std::vector<node *> &orphans)
+{
+	unsigned int absLevel = GetAbstractionLevel(n);
+	Graph *g = abstractions[absLevel];
+	std::vector<edge *> edges;
+	edge_iterator ei = n->getEdgeIter();
+	for (edge *e = n->edgeIterNext(ei); e; e = n->edgeIterNext(ei))
+		edges.push_back(e);
+	for (unsigned int x = 0; x < edges.size(); x++)
+	{
+		removeEdgeFromParent(edges[x], absLevel);
+		g->RemoveEdge(edges[x]);
+		delete edges[x];
+	}
+	if (absLevel > 0)
+	{
+		for (int x = 0; x < n->GetLabelL(kNumAbstractedNodes); x++)
+		{
+			node *child = GetNthChild(n, x);
+			child->SetLabelL(kParent, -1);
+			orphans.push_back(child);
+		}
+	}
+	removeFromParent(n);
+	unsigned int oldID;
+	node *moved = g->RemoveNode(n, oldID);
+	if (moved)
+		renameNode(moved, oldID);
+	delete n;
+}
+
+/** Takes n out of its parent, which is marked as affected **/
+void MapSectorAbstraction::removeFromParent(node *n)
+{
+	long parent = n->GetLabelL(kParent);
+	if (parent == -1)
+		return;
+	unsigned int absLevel = GetAbstractionLevel(n);
+	node *p = abstractions[absLevel+1]->GetNode(parent);
+	long count = p->GetLabelL(kNumAbstractedNodes);
+	for (int x = 0; x < count; x++)
+	{
+		if (p->GetLabelL(kFirstData+x) == n->GetNum())
+		{
+			p->SetLabelL(kFirstData+x, p->GetLabelL(kFirstData+count-1));
+			break;
+		}
+	}
+	p->SetLabelL(kNumAbstractedNodes, count-1);
+	p->SetLabelF(kXCoordinate, kUnknownPosition);
+	n->SetLabelL(kParent, -1);
+	affectedNodes[absLevel+1].push_back(p);
+}
+
+/** Updates the references to a node that the Graph moved from oldID **/
+void MapSectorAbstraction::renameNode(node *n, unsigned int oldID)
+{
+	unsigned int absLevel = GetAbstractionLevel(n);
+	if (absLevel == 0)
+	{
+		Tile &t = GetMap()->GetTile(n->GetLabelL(kFirstData), n->GetLabelL(kFirstData+1));
+		long corner = n->GetLabelL(kFirstData+2);
+		if ((corner == kBottomRight) || (corner == kTopRight))
+			t.tile2.node = n->GetNum();
+		else
+			t.tile1.node = n->GetNum();
+	}
+	else {
+		for (int x = 0; x < n->GetLabelL(kNumAbstractedNodes); x++)
+			GetNthChild(n, x)->SetLabelL(kParent, n->GetNum());
+	}
+	long parent = n->GetLabelL(kParent);
+	if (parent != -1)
+	{
+		node *p = abstractions[absLevel+1]->GetNode(parent);
+		for (int x = 0; x < p->GetLabelL(kNumAbstractedNodes); x++)
+		{
+			if (p->GetLabelL(kFirstData+x) == (long)oldID)
+			{
+				p->SetLabelL(kFirstData+x, n->GetNum());
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * Adds e (at absLevel) to the edge between the parents of its ends, creating
+ * it if needed. If the ends are in the same quadrant but not the same parent
+ * the parents must be merged, so both are marked as affected instead.
+ */
+void MapSectorAbstraction::addEdgeToParent(edge *e, unsigned int absLevel)
+{
+	if (absLevel+1 >= abstractions.size())
+		return;
+	Graph *g = abstractions[absLevel];
+	node *fromNode = g->GetNode(e->getFrom()), *toNode = g->GetNode(e->getTo());
+	long from = fromNode->GetLabelL(kParent);
+	long to = toNode->GetLabelL(kParent);
+	if ((from == -1) || (to == -1) || (from == to))
+		return;
+	Graph *aGraph = abstractions[absLevel+1];
+	if (getQuadrant(fromNode) == getQuadrant(toNode))
+	{
+		affectedNodes[absLevel+1].push_back(aGraph->GetNode(from));
+		affectedNodes[absLevel+1].push_back(aGraph->GetNode(to));
+		return;
+	}
+	edge *f = aGraph->FindEdge(from, to);
+	if (f)
+	{
+		f->SetLabelL(kEdgeCapacity, f->GetLabelL(kEdgeCapacity)+1);
+		return;
+	}
+	f = new edge(from, to, h(aGraph->GetNode(from), aGraph->GetNode(to)));
+	f->SetLabelL(kEdgeCapacity, 1);
+	aGraph->AddEdge(f);
+	addEdgeToParent(f, absLevel+1);
+}
+
+/**
+ * Removes e (at absLevel) from the edge between the parents of its ends,
+ * removing that edge when it is empty. If both ends have the same parent it
+ * may come apart, so the parent is marked as affected.
+ */
+void MapSectorAbstraction::removeEdgeFromParent(edge *e, unsigned int absLevel)
+{
+	if (absLevel+1 >= abstractions.size())
+		return;
+	Graph *g = abstractions[absLevel];
+	node *fromNode = g->GetNode(e->getFrom()), *toNode = g->GetNode(e->getTo());
+	long from = fromNode->GetLabelL(kParent);
+	long to = toNode->GetLabelL(kParent);
+	if ((from == -1) || (to == -1))
+		return;
+	Graph *aGraph = abstractions[absLevel+1];
+	if (from == to)
+	{
+		affectedNodes[absLevel+1].push_back(aGraph->GetNode(from));
+		return;
+	}
+	// an edge within a quadrant between different parents was never added (see addEdgeToParent)
+	if (getQuadrant(fromNode) == getQuadrant(toNode))
+		return;
+	edge *f = aGraph->FindEdge(from, to);
+	assert(f != 0);
+	f->SetLabelL(kEdgeCapacity, f->GetLabelL(kEdgeCapacity)-1);
+	if (f->GetLabelL(kEdgeCapacity) == 0)
+	{
+		removeEdgeFromParent(f, absLevel+1);
+		aGraph->RemoveEdge(f);
+		delete f;
+	}
 }
 
 void MapSectorAbstraction::buildAbstraction()
@@ -130,18 +516,24 @@ void MapSectorAbstraction::addNodes(Graph *g)
 		// if it isn't abstracted, do a bfs according to the quadrant and abstract these nodes together
 		if (next->GetLabelL(kParent) == -1)
 		{
-			node *parent;
-			g->AddNode(parent = new node("??"));
-			parent->SetLabelL(kAbstractionLevel, next->GetLabelL(kAbstractionLevel)+1); // level in abstraction tree
-			parent->SetLabelL(kNumAbstractedNodes, 0); // number of abstracted nodes
-			parent->SetLabelL(kParent, -1); // parent of this node in abstraction hierarchy
-			parent->SetLabelF(kXCoordinate, kUnknownPosition);
-			parent->SetLabelL(kNodeBlocked, 0);
-			abstractionBFS(next, parent, getQuadrant(next));
+			abstractionBFS(next, addParentNode(g, next), getQuadrant(next));
 		}
 	}
 }
 
+/** Adds an empty node to g, one level above child **/
+node *MapSectorAbstraction::addParentNode(Graph *g, node *child)
+{
+	node *parent;
+	g->AddNode(parent = new node("??"));
+	parent->SetLabelL(kAbstractionLevel, child->GetLabelL(kAbstractionLevel)+1); // level in abstraction tree
+	parent->SetLabelL(kNumAbstractedNodes, 0); // number of abstracted nodes
+	parent->SetLabelL(kParent, -1); // parent of this node in abstraction hierarchy
+	parent->SetLabelF(kXCoordinate, kUnknownPosition);
+	parent->SetLabelL(kNodeBlocked, 0);
+	return parent;
+}
+
 void MapSectorAbstraction::addEdges(Graph *aGraph)
 {
 	Graph *g = abstractions.back();
@@ -173,7 +565,7 @@ void MapSectorAbstraction::abstractionBFS(node *which, node *parent, int quadran
 	neighbor_iterator ni = which->getNeighborIter();
 	for (long tmp = which->nodeNeighborNext(ni); tmp != -1; tmp = which->nodeNeighborNext(ni))
 	{
-		abstractionBFS(abstractions.back()->GetNode(tmp), parent, quadrant);
+		abstractionBFS(abstractions[GetAbstractionLevel(which)]->GetNode(tmp), parent, quadrant);
 	}
 }
 
@@ -196,7 +588,12 @@ int MapSectorAbstraction::getQuadrant(node *which)
 	int xloc = child->GetLabelL(kFirstData); // x loc in map
 	int yloc = child->GetLabelL(kFirstData+1); // y loc in map
 
-	int level = which->GetLabelL(kAbstractionLevel);
+	return getQuadrant(xloc, yloc, which->GetLabelL(kAbstractionLevel));
+}
+
+/** The quadrant that map location (xloc, yloc) is in when abstracting the given level **/
+int MapSectorAbstraction::getQuadrant(int xloc, int yloc, int level)
+{
 //	int absSectorSize = (int)pow((double)sectorSize, (double)level+1);
 	int absSectorSize = (int)sectorSize*pow((double)sectorMultiplier, (double)level);
 	
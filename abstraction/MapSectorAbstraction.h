@@ -26,6 +26,8 @@
  */
 
 #include "MapAbstraction.h"
+#include <vector>
+#include <utility>
 
 #ifndef MAPSectorABSTRACTION_H
 #define MAPSectorABSTRACTION_H
@@ -56,16 +58,35 @@ public:
 	/** This must be called after any of the above add/remove operations. But the
 		operations can be stacked followed by a single RepairAbstraction call. */
   virtual void RepairAbstraction();	
+
+	/** Call after changing the terrain of tile (x, y) in the map. The next
+		RepairAbstraction call rebuilds, at every level, only the nodes whose
+		part of a sector changed, and patches the edges into them. */
+	void MarkTileChanged(int x, int y);
 private:
 	void buildAbstraction();
 	void buildNodeIntoParent(node *n, node *parent);
 	void abstractionBFS(node *which, node *parent, int quadrant);
 	int getQuadrant(node *which);
+	int getQuadrant(int x, int y, int level);
 	
 	void addEdges(Graph *g);
 	void addNodes(Graph *g);
+	node *addParentNode(Graph *g, node *child);
+
+	void repairTiles(std::vector<int> &tiles, std::vector<node *> &orphans);
+	void regroupNodes(unsigned int absLevel, std::vector<node *> &orphans);
+	void repairLevels();
+	void removeAbstractNode(node *n, std::vector<node *> &orphans);
+	void removeFromParent(node *n);
+	void renameNode(node *n, unsigned int oldID);
+	void addEdgeToParent(edge *e, unsigned int absLevel);
+	void removeEdgeFromParent(edge *e, unsigned int absLevel);
 	
 	int sectorSize, sectorMultiplier;
+	std::vector<std::pair<int, int> > changedTiles;
+	/** affectedNodes[level] holds the nodes that must be rebuilt during a repair */
+	std::vector<std::vector<node *> > affectedNodes;
 };
 
 #endif
@@ -213,7 +213,7 @@ path *aStar::extractPathToStart(Graph *_g, node *goalNode)
 	path *p = 0;
 	SearchNode n = closedList[goalNode];
 	do {
-		if (n.currNode && n.prevNode)
+		if (markPath && n.currNode && n.prevNode)
 			_g->FindEdge(n.currNode->GetNum(), n.prevNode->GetNum())->setMarked(true);
 		p = new path(n.currNode, p);
 		n = closedList[n.prevNode];
@@ -95,7 +95,7 @@ public:
 
 class aStar : public SearchAlgorithm {
 public:
-	aStar() {}
+	aStar() { markPath = true; }
 	virtual ~aStar() {}
 	path *GetPath(GraphAbstraction *aMap, node *from, node *to, reservationProvider *rp = 0);
 	virtual const char *GetName();
@@ -108,6 +108,8 @@ public:
 	uint64_t GetNodesTouched() { return nodesTouched; }
 	void resetNodeCount() { nodesExpanded = nodesTouched = 0; }
 	int getMemoryUsage();
+	/** Marks the edges of each path found so they are drawn; units that search the same abstraction at once must turn this off */
+	void SetMarkPath(bool val) { markPath = val; }
 private:
 	//	long nodesTouched, nodesExpanded;
 	inline node *ABSNode(node *n) { return abstr->GetNthParent(n, absLevel); }
@@ -127,6 +129,7 @@ private:
 	GraphAbstraction *abstr;
 	AStar3Util::Corridor eligibleNodes;
 	int absLevel;
+	bool markPath;
 	//	AStarHeuristic *abstraction;
 };
 
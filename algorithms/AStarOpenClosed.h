@@ -30,8 +30,8 @@
 
 #include <cassert>
 #include <vector>
-#include <ext/hash_map>
 #include <stdint.h>
+#include "FlatHashMap.h"
 
 struct AHash64 {
 	size_t operator()(const uint64_t &x) const
@@ -67,6 +67,8 @@ public:
 	AStarOpenClosed();
 	~AStarOpenClosed();
 	void Reset();
+	/** Pre-allocates space for the expected number of states **/
+	void Reserve(size_t expected);
 	uint64_t AddOpenNode(const state &val, uint64_t hash, double g, double h, uint64_t parent=kTAStarNoNode);
 	uint64_t AddClosedNode(state &val, uint64_t hash, double g, double h, uint64_t parent=kTAStarNoNode);
 	void KeyChanged(uint64_t objKey);
@@ -89,7 +91,7 @@ private:
 
 	std::vector<uint64_t> theHeap;
 	// storing the element id; looking up with...hash?
-	typedef __gnu_cxx::hash_map<uint64_t, uint64_t, AHash64> IndexTable;
+	typedef FlatHashMap<uint64_t, uint64_t> IndexTable;
 	IndexTable table;
 	std::vector<dataStructure > elements;
 };
@@ -116,6 +118,13 @@ void AStarOpenClosed<state, CmpKey, dataStructure>::Reset()
 	theHeap.resize(0);
 }
 
+template<typename state, typename CmpKey, class dataStructure>
+void AStarOpenClosed<state, CmpKey, dataStructure>::Reserve(size_t expected)
+{
+	table.reserve(expected);
+	elements.reserve(expected);
+}
+
 /**
  * Add object into open list.
  */
@@ -148,7 +157,7 @@ uint64_t AStarOpenClosed<state, CmpKey, dataStructure>::AddClosedNode(state &val
 	elements.push_back(dataStructure(val, g, h, parent, 0, kClosedList));
 	if (parent == kTAStarNoNode)
 		elements.back().parentID = elements.size()-1;
-	table[hash] = elements.size(); // hashing to element list location
+	table[hash] = elements.size()-1; // hashing to element list location
 	return elements.size()-1;
 }
 
@@ -5,12 +5,29 @@
 //  Created by Nathan Sturtevant on 1/16/12.
 //  Copyright (c) 2012 University of Denver. All rights reserved.
 //
+//  A drop-in replacement for AStarOpenClosed for domains where g and h are
+//  multiples of a fixed cost unit (unit-cost puzzles, 4-connected grids, or
+//  octile grids with a rational diagonal cost such as 1.5). Open nodes are
+//  kept in buckets indexed first by f and then by g, so adding, removing and
+//  re-prioritizing a node are all O(1), and the node with the lowest f (ties
+//  broken towards higher g, as in AStarCompare) is found without comparisons.
+//  Each bucket is an intrusive list threaded through a per-element array, so
+//  buckets need no memory of their own beyond their list head.
+//
+//  Costs are converted to bucket indices by multiplying by the resolution
+//  (see SetCostResolution). The first time a node's costs aren't multiples
+//  of 1/resolution (weighted A* f-costs, for instance), the open nodes are
+//  moved to a binary heap ordered by CmpKey, as in AStarOpenClosed, and the
+//  heap is used until the next Reset, so nodes are still expanded in order.
+//
 
 #ifndef hog2_glut_BucketOpenClosed_h
 #define hog2_glut_BucketOpenClosed_h
 
 #include "AStarOpenClosed.h"
-#include <list>
+#include "FPUtil.h"
+#include <cmath>
+#include <stdio.h>
 
 template<typename state, typename CmpKey, class dataStructure = AStarOpenClosedData<state> >
 class BucketOpenClosed {
@@ -18,37 +35,59 @@ public:
 	BucketOpenClosed();
 	~BucketOpenClosed();
 	void Reset();
+	/** Pre-allocates space for the expected number of states **/
+	void Reserve(size_t expected);
+	/**
+	 Sets the number of buckets per unit of cost; costs must be multiples of
+	 1/resolution. Use 2 for octile grids with a diagonal cost of 1.5.
+	 **/
+	void SetCostResolution(unsigned int r) { assert(OpenSize() == 0 && r > 0); resolution = r; }
+	unsigned int GetCostResolution() const { return resolution; }
 	uint64_t AddOpenNode(const state &val, uint64_t hash, double g, double h, uint64_t parent=kTAStarNoNode);
 	uint64_t AddClosedNode(state &val, uint64_t hash, double g, double h, uint64_t parent=kTAStarNoNode);
 	void KeyChanged(uint64_t objKey);
-	//void IncreaseKey(uint64_t objKey);
 	dataLocation Lookup(uint64_t hashKey, uint64_t &objKey) const;
 	inline dataStructure &Lookup(uint64_t objKey) { return elements[objKey]; }
 	inline const dataStructure &Lookat(uint64_t objKey) const { return elements[objKey]; }
 	uint64_t Peek() const;
 	uint64_t Close();
 	void Reopen(uint64_t objKey);
-	
+
 	uint64_t GetOpenItem(unsigned int which);
 	size_t OpenSize() const { return openCount; }
 	size_t ClosedSize() const { return size()-OpenSize(); }
 	size_t size() const { return elements.size(); }
-	//	void verifyData();
+	/** True if a cost didn't fit the buckets and the open list is a heap until the next Reset **/
+	bool UsingHeap() const { return useHeap; }
 	void Print();
 private:
-	void FindNewMin();
-	uint64_t Add(uint64_t key, uint64_t fCost);
-	void Remove(uint64_t key, uint64_t fCost);
-	int openCount;
-	int minBucket, minSubBucket;
-	struct qData {
-		qData() { fCost = -1; }
-		std::vector<uint64_t> entries;
-		int fCost;
+	struct fBucket {
+		fBucket() :count(0), maxG(0) {}
+		std::vector<uint64_t> byG; // head of the list for each g
+		size_t count;
+		size_t maxG; // highest non-empty g bucket when count > 0
 	};
-	std::vector<qData> pQueue;
-	// storing the element id; looking up with...hash?
-	typedef __gnu_cxx::hash_map<uint64_t, uint64_t, AHash64> IndexTable;
+	struct bucketLink {
+		uint64_t next, prev;
+		uint32_t f, g;
+	};
+	// bucket indices beyond this also go to the heap, rather than allocating millions of buckets
+	static const uint32_t maxBucket = 1<<20;
+	bool FitsBuckets(double cost) const;
+	uint32_t CostToBucket(double cost) const;
+	void Add(uint64_t objKey);
+	void Remove(uint64_t objKey);
+	void MoveToHeap();
+	bool HeapifyUp(size_t index);
+	void HeapifyDown(size_t index);
+	bool useHeap;
+	std::vector<uint64_t> theHeap;
+	size_t openCount;
+	size_t minF; // lowest non-empty f bucket when openCount > 0
+	unsigned int resolution;
+	std::vector<fBucket> buckets;
+	std::vector<bucketLink> links; // list links and bucket of each open element
+	typedef FlatHashMap<uint64_t, uint64_t> IndexTable;
 	IndexTable table;
 	std::vector<dataStructure > elements;
 };
@@ -57,7 +96,9 @@ template<typename state, typename CmpKey, class dataStructure>
 BucketOpenClosed<state, CmpKey, dataStructure>::BucketOpenClosed()
 {
 	openCount = 0;
-	minBucket = -1;
+	minF = 0;
+	resolution = 1;
+	useHeap = false;
 }
 
 template<typename state, typename CmpKey, class dataStructure>
@@ -71,28 +112,34 @@ BucketOpenClosed<state, CmpKey, dataStructure>::~BucketOpenClosed()
 template<typename state, typename CmpKey, class dataStructure>
 void BucketOpenClosed<state, CmpKey, dataStructure>::Reset()
 {
+	// keep the bucket memory for the next search; only buckets that still
+	// hold open nodes need to be emptied
+	for (size_t x = minF; openCount > 0 && x < buckets.size(); x++)
+	{
+		if (buckets[x].count == 0)
+			continue;
+		for (size_t y = 0; y <= buckets[x].maxG; y++)
+			buckets[x].byG[y] = kTAStarNoNode;
+		openCount -= buckets[x].count;
+		buckets[x].count = 0;
+		buckets[x].maxG = 0;
+	}
 	openCount = 0;
-	minBucket = -1;
+	minF = 0;
+	useHeap = false;
+	theHeap.resize(0);
 	table.clear();
 	elements.clear();
-	pQueue.resize(0);
-	pQueue.resize(3);
+	links.clear();
 }
 
-//inline uint64_t compactGH(uint64_t g, uint64_t h)
-//{
-//	return (g<<32)|h;
-//}
-//
-//inline uint64_t extractG(uint64_t value)
-//{
-//	return value>>32;
-//}
-//
-//inline uint64_t extractH(uint64_t value)
-//{
-//	return (value)&0xFFFFFFFF;
-//}
+template<typename state, typename CmpKey, class dataStructure>
+void BucketOpenClosed<state, CmpKey, dataStructure>::Reserve(size_t expected)
+{
+	table.reserve(expected);
+	elements.reserve(expected);
+	links.reserve(expected);
+}
 
 /**
  * Add object into open list.
@@ -106,16 +153,12 @@ uint64_t BucketOpenClosed<state, CmpKey, dataStructure>::AddOpenNode(const state
 		//return -1; // TODO: find correct id and return
 		assert(false);
 	}
-	openCount++;
-	uint64_t newg = g;
-	uint64_t newh = h;
-	uint64_t loc = Add(elements.size(), newg+newh);
-	elements.push_back(dataStructure(val, g, h, parent, loc, kOpenList));
+	elements.push_back(dataStructure(val, g, h, parent, 0, kOpenList));
+	links.resize(elements.size());
 	if (parent == kTAStarNoNode)
 		elements.back().parentID = elements.size()-1;
 	table[hash] = elements.size()-1; // hashing to element list location
-	FindNewMin();
-	//printf("Added node to buckets %llu/%llu\n", newg+newh, newh);
+	Add(elements.size()-1);
 	return elements.size()-1;
 }
 
@@ -128,45 +171,29 @@ uint64_t BucketOpenClosed<state, CmpKey, dataStructure>::AddClosedNode(state &va
 	// should do lookup here...
 	assert(table.find(hash) == table.end());
 	elements.push_back(dataStructure(val, g, h, parent, 0, kClosedList));
+	links.resize(elements.size());
 	if (parent == kTAStarNoNode)
 		elements.back().parentID = elements.size()-1;
-	table[hash] = elements.size(); // hashing to element list location
+	table[hash] = elements.size()-1; // hashing to element list location
 	return elements.size()-1;
 }
 
 /**
- * Indicate that the key for a particular object has changed.
+ * Indicate that the key for a particular object has changed. Either
+ * direction is allowed.
  */
 template<typename state, typename CmpKey, class dataStructure>
 void BucketOpenClosed<state, CmpKey, dataStructure>::KeyChanged(uint64_t val)
 {
-//	uint64_t g, h;
-//	g = extractG(elements[val].openLocation);
-//	h = extractH(elements[val].openLocation);
-	//printf("-----\nChanging key of [%llu][%llu] to [%1.0f][%1.0f]\n", g+h, h, elements[val].g+elements[val].h, elements[val].h);
-	//Print();
-	Remove(val, elements[val].openLocation);
-//	int len = pQueue[g+h][0].size();
-//	pQueue[g+h][0].remove(val);
-//	assert(pQueue[g+h][0].size() == len-1);
-//	int len = pQueue[g+h][h].size();
-//	pQueue[g+h][h].remove(val);
-//	assert(pQueue[g+h][h].size() == len-1);
-	
-//	g = elements[val].g;
-//	h = elements[val].h;
-//	elements[val].openLocation = compactGH(g, h);
-//	if (pQueue.size() < (g+h+1))
-//		pQueue.resize((int)(g+h+1));
-//	if (pQueue[g+h].size() < /*h+*/1)
-//		pQueue[g+h].resize((int)/*h+*/1);
-//	pQueue[g+h][0].push_back(val);
-	elements[val].openLocation = Add(val, elements[val].g+elements[val].h);
-	//pQueue[g+h][h].push_back(val);
-	//printf("Removed and re-added node to buckets %llu/%llu\n", g+h, h);
-
-//	FindNewMin();
-	//Print();
+	assert(elements[val].where == kOpenList);
+	if (useHeap)
+	{
+		if (!HeapifyUp(elements[val].openLocation))
+			HeapifyDown(elements[val].openLocation);
+		return;
+	}
+	Remove(val);
+	Add(val);
 }
 
 /**
@@ -193,12 +220,11 @@ template<typename state, typename CmpKey, class dataStructure>
 uint64_t BucketOpenClosed<state, CmpKey, dataStructure>::Peek() const
 {
 	assert(OpenSize() != 0);
-
-	assert(pQueue[minBucket].entries.size() > 0);
-	return pQueue[minBucket].entries.back();
-//	assert(pQueue[minBucket][minSubBucket].size() > 0);
-//	return pQueue[minBucket][minSubBucket].front();
-//	return theHeap[0];
+	if (useHeap)
+		return theHeap[0];
+	const fBucket &b = buckets[minF];
+	assert(b.byG[b.maxG] != kTAStarNoNode);
+	return b.byG[b.maxG];
 }
 
 /**
@@ -208,17 +234,9 @@ template<typename state, typename CmpKey, class dataStructure>
 uint64_t BucketOpenClosed<state, CmpKey, dataStructure>::Close()
 {
 	assert(OpenSize() != 0);
-	assert(pQueue[minBucket].entries.size() > 0);
-	openCount--;
-	
-	uint64_t ans = pQueue[minBucket].entries.back();
-	pQueue[minBucket].entries.pop_back();
-	if (pQueue[minBucket].entries.size() == 0)
-		pQueue[minBucket].fCost = -1;
+	uint64_t ans = Peek();
+	Remove(ans);
 	elements[ans].where = kClosedList;
-	//printf("Removed item from %llu/%llu\n", minBucket, minSubBucket);
-	FindNewMin();
-	
 	return ans;
 }
 
@@ -228,46 +246,10 @@ uint64_t BucketOpenClosed<state, CmpKey, dataStructure>::Close()
 template<typename state, typename CmpKey, class dataStructure>
 void BucketOpenClosed<state, CmpKey, dataStructure>::Reopen(uint64_t objKey)
 {
-	openCount++;
-	uint64_t g, h;
-	g = elements[objKey].g;
-	h = elements[objKey].h;
 	assert(elements[objKey].where == kClosedList);
 	elements[objKey].reopened = true;
 	elements[objKey].where = kOpenList;
-	elements[objKey].openLocation = Add(objKey, g+h);
-}
-
-template<typename state, typename CmpKey, class dataStructure>
-void BucketOpenClosed<state, CmpKey, dataStructure>::FindNewMin()
-{
-	//assert(OpenSize() > 0);
-	if (OpenSize() == 0)
-	{ minBucket = -1; return; }
-
-	minBucket = -1;
-	for (int x = 0; x < pQueue.size(); x++)
-	{
-		while (pQueue[x].entries.size() > 0 && pQueue[x].entries.back() == -1)
-		{
-			pQueue[x].entries.pop_back();
-		}
-		if (pQueue[x].entries.size() == 0)
-		{
-			pQueue[x].fCost = -1;
-		}
-		else {
-			if (minBucket == -1)
-			{
-				minBucket = x;
-				continue;
-			}
-			else {
-				if (pQueue[x].fCost < pQueue[minBucket].fCost)
-					minBucket = x;
-			}
-		}
-	}
+	Add(objKey);
 }
 
 template<typename state, typename CmpKey, class dataStructure>
@@ -281,7 +263,6 @@ uint64_t BucketOpenClosed<state, CmpKey, dataStructure>::GetOpenItem(unsigned in
 				return x;
 			which--;
 		}
-		return -1;
 	}
 	return -1;
 }
@@ -289,15 +270,24 @@ uint64_t BucketOpenClosed<state, CmpKey, dataStructure>::GetOpenItem(unsigned in
 template<typename state, typename CmpKey, class dataStructure>
 void BucketOpenClosed<state, CmpKey, dataStructure>::Print()
 {
-	int cnt = 0;
-	printf("**pQueue[%d] items [%d, %d]:\n", OpenSize(), minBucket, minSubBucket);
-	for (unsigned int x = 0; x < pQueue.size(); x++)
+	size_t cnt = 0;
+	if (useHeap)
+	{
+		printf("**%lu open items in the heap\n", (unsigned long)OpenSize());
+		return;
+	}
+	printf("**%lu open items; min f bucket %lu\n", (unsigned long)OpenSize(), (unsigned long)minF);
+	for (size_t x = 0; x < buckets.size(); x++)
 	{
-		for (unsigned int y = 0; y < pQueue[x].size(); y++)
+		for (size_t y = 0; y < buckets[x].byG.size(); y++)
 		{
-			if (pQueue[x][y].size() > 0)
-				printf("**[%d][%d] has %d elements\n", x, y, pQueue[x][y].size());
-			cnt += pQueue[x][y].size();
+			size_t items = 0;
+			for (uint64_t i = buckets[x].byG[y]; i != kTAStarNoNode; i = links[i].next)
+				items++;
+			if (items > 0)
+				printf("**[f=%1.2f][g=%1.2f] has %lu elements\n", (double)x/resolution, (double)y/resolution,
+					   (unsigned long)items);
+			cnt += items;
 		}
 	}
 	if (cnt != OpenSize())
@@ -307,51 +297,188 @@ void BucketOpenClosed<state, CmpKey, dataStructure>::Print()
 }
 
 template<typename state, typename CmpKey, class dataStructure>
-uint64_t BucketOpenClosed<state, CmpKey, dataStructure>::Add(uint64_t key, uint64_t fCost)
+bool BucketOpenClosed<state, CmpKey, dataStructure>::FitsBuckets(double cost) const
+{
+	double scaled = cost*resolution;
+	if (!(scaled >= 0 && scaled < maxBucket))
+		return false;
+	return fequal(floor(scaled+0.5), scaled);
+}
+
+template<typename state, typename CmpKey, class dataStructure>
+uint32_t BucketOpenClosed<state, CmpKey, dataStructure>::CostToBucket(double cost) const
+{
+	double scaled = cost*resolution;
+	uint32_t bucket = (uint32_t)floor(scaled+0.5);
+	assert(cost >= 0 && fequal(bucket, scaled));
+	return bucket;
+}
+
+/**
+ * Push an element onto the list for its current f- and g-cost, or onto the
+ * heap once a cost hasn't fit the buckets.
+ */
+template<typename state, typename CmpKey, class dataStructure>
+void BucketOpenClosed<state, CmpKey, dataStructure>::Add(uint64_t objKey)
+{
+	dataStructure &d = elements[objKey];
+	if (!useHeap && !(FitsBuckets(d.g) && FitsBuckets(d.h)))
+		MoveToHeap();
+	if (useHeap)
+	{
+		d.openLocation = theHeap.size();
+		theHeap.push_back(objKey);
+		HeapifyUp(theHeap.size()-1);
+		openCount++;
+		return;
+	}
+	uint32_t g = CostToBucket(d.g);
+	uint32_t f = g+CostToBucket(d.h);
+	if (f >= buckets.size())
+		buckets.resize(f+1);
+	fBucket &b = buckets[f];
+	if (g >= b.byG.size())
+		b.byG.resize(g+1, kTAStarNoNode);
+	bucketLink &l = links[objKey];
+	l.f = f;
+	l.g = g;
+	l.prev = kTAStarNoNode;
+	l.next = b.byG[g];
+	if (l.next != kTAStarNoNode)
+		links[l.next].prev = objKey;
+	b.byG[g] = objKey;
+
+	if (b.count == 0 || g > b.maxG)
+		b.maxG = g;
+	b.count++;
+	if (openCount == 0 || f < minF)
+		minF = f;
+	openCount++;
+}
+
+/**
+ * Unlink an element from its bucket.
+ */
+template<typename state, typename CmpKey, class dataStructure>
+void BucketOpenClosed<state, CmpKey, dataStructure>::Remove(uint64_t objKey)
 {
-	for (int x = 0; x < pQueue.size(); x++)
+	if (useHeap)
 	{
-		if (pQueue[x].fCost == fCost)
-		{
-			pQueue[x].entries.push_back(key);
-			FindNewMin();
-			return pQueue[x].entries.size()-1;
-		}
+		size_t index = elements[objKey].openLocation;
+		theHeap[index] = theHeap.back();
+		elements[theHeap[index]].openLocation = index;
+		theHeap.pop_back();
+		openCount--;
+		if (index < theHeap.size() && !HeapifyUp(index))
+			HeapifyDown(index);
+		return;
+	}
+	const bucketLink &l = links[objKey];
+	fBucket &b = buckets[l.f];
+	if (l.prev == kTAStarNoNode)
+	{
+		assert(b.byG[l.g] == objKey);
+		b.byG[l.g] = l.next;
+	}
+	else
+		links[l.prev].next = l.next;
+	if (l.next != kTAStarNoNode)
+		links[l.next].prev = l.prev;
+
+	b.count--;
+	openCount--;
+	if (b.count > 0)
+	{
+		while (b.byG[b.maxG] == kTAStarNoNode)
+			b.maxG--;
+	}
+	else if (openCount > 0 && l.f == minF)
+	{
+		while (buckets[minF].count == 0)
+			minF++;
 	}
-	for (int x = 0; x < pQueue.size(); x++)
+}
+
+/**
+ * Moves every open node from the buckets to the heap; used from then on
+ * until the next Reset.
+ */
+template<typename state, typename CmpKey, class dataStructure>
+void BucketOpenClosed<state, CmpKey, dataStructure>::MoveToHeap()
+{
+	theHeap.resize(0);
+	for (size_t x = minF; openCount > 0 && x < buckets.size(); x++)
 	{
-		if (pQueue[x].fCost == -1)
+		if (buckets[x].count == 0)
+			continue;
+		for (size_t y = 0; y <= buckets[x].maxG; y++)
 		{
-			pQueue[x].fCost = fCost;
-			pQueue[x].entries.push_back(key);
-			FindNewMin();
-			return pQueue[x].entries.size()-1;
+			for (uint64_t i = buckets[x].byG[y]; i != kTAStarNoNode; i = links[i].next)
+				theHeap.push_back(i);
+			buckets[x].byG[y] = kTAStarNoNode;
 		}
+		openCount -= buckets[x].count;
+		buckets[x].count = 0;
+		buckets[x].maxG = 0;
+	}
+	assert(openCount == 0);
+	openCount = theHeap.size();
+	minF = 0;
+	useHeap = true;
+	for (size_t x = 0; x < theHeap.size(); x++)
+		elements[theHeap[x]].openLocation = x;
+	for (size_t x = theHeap.size()/2; x > 0; x--)
+		HeapifyDown(x-1);
+}
+
+/**
+ * Moves a node up the heap. Returns true if the node was moved, false otherwise.
+ */
+template<typename state, typename CmpKey, class dataStructure>
+bool BucketOpenClosed<state, CmpKey, dataStructure>::HeapifyUp(size_t index)
+{
+	CmpKey compare;
+	bool moved = false;
+	while (index > 0)
+	{
+		size_t parent = (index-1)/2;
+		if (!compare(elements[theHeap[parent]], elements[theHeap[index]]))
+			break;
+		std::swap(theHeap[parent], theHeap[index]);
+		elements[theHeap[parent]].openLocation = parent;
+		elements[theHeap[index]].openLocation = index;
+		index = parent;
+		moved = true;
 	}
-	assert(!"No space found to insert element");
+	return moved;
 }
 
 template<typename state, typename CmpKey, class dataStructure>
-void BucketOpenClosed<state, CmpKey, dataStructure>::Remove(uint64_t key, uint64_t location)
+void BucketOpenClosed<state, CmpKey, dataStructure>::HeapifyDown(size_t index)
 {
-	for (int x = 0; x < pQueue.size(); x++)
+	CmpKey compare;
+	size_t count = theHeap.size();
+	while (true)
 	{
-		if (pQueue[x].entries.size() > location && pQueue[x].entries[location] == key)
-		{
-			if (location == pQueue[x].entries.size()-1)
-			{
-				pQueue[x].entries.pop_back();
-			}
-			else {
-				pQueue[x].entries[location] = -1;
-				if (pQueue[x].entries.size() == 1)
-					pQueue[x].fCost = -1;
-			}
-			FindNewMin();
+		size_t child1 = index*2+1;
+		size_t child2 = index*2+2;
+		size_t which;
+		// find smallest child
+		if (child1 >= count)
 			return;
-		}
+		else if (child2 >= count)
+			which = child1;
+		else if (!(compare(elements[theHeap[child1]], elements[theHeap[child2]])))
+			which = child1;
+		else
+			which = child2;
+		if (compare(elements[theHeap[which]], elements[theHeap[index]]))
+			return;
+		std::swap(theHeap[which], theHeap[index]);
+		elements[theHeap[which]].openLocation = which;
+		elements[theHeap[index]].openLocation = index;
+		index = which;
 	}
-	assert(!"Element not found to remove");
 }
 
 #endif
@@ -34,26 +34,20 @@ void CBSUnit::OpenGLDraw(const MapEnvironment *me, const SimulationInfo<xyLoc,tD
 	me->GLDrawPath(myPath);
 }
 
-//struct CBSTreeNode {
-//	std::vector< std::vector<xyLoc> > paths;
-//	constraint c;
-//	unsigned int parent;
-//	bool closed;
-//};
-
-//	bool planFinished;
-//	Map2DConstrainedEnvironment *m2e;
-//	std::vector<CBSTreeNode> tree;
-
 CBSGroup::CBSGroup(MapEnvironment *me)
 {
 	this->me = me;
 	m2e = new Map2DConstrainedEnvironment(me->GetMap());
 	planFinished = false;
+	planFound = false;
+	verbose = true;
 	time = 0;
 	tree.resize(1);
 	tree[0].parent = 0;
+	tree[0].depth = 0;
+	tree[0].cost = 0;
 	bestNode = 0;
+	loadedNode = 0;
 	overlay = new MapOverlay(me->GetMap());
 	overlay->SetTransparentValue(-1);
 	overlay->SetColorMap(1);
@@ -67,6 +61,12 @@ CBSGroup::CBSGroup(MapEnvironment *me)
 	}
 }
 
+CBSGroup::~CBSGroup()
+{
+	delete m2e;
+	delete overlay;
+}
+
 bool CBSGroup::MakeMove(Unit<xyLoc, tDirection, MapEnvironment> *u, MapEnvironment *e, SimulationInfo<xyLoc,tDirection,MapEnvironment> *si, tDirection& a)
 {
 	if (planFinished && si->GetSimulationTime() > time)
@@ -92,10 +92,11 @@ void CBSGroup::ExpandOneCBSNode()
 	if (!found)
 	{
 		planFinished = true;
-		for (unsigned int x = 0; x < tree[bestNode].paths.size(); x++)
+		planFound = true;
+		for (unsigned int x = 0; x < loadedPaths.size(); x++)
 		{
 			CBSUnit *unit = (CBSUnit*)GetMember(x);
-			unit->SetPath(tree[bestNode].paths[x]);
+			unit->SetPath(paths[loadedPaths[x]]);
 		}
 		return;
 	}
@@ -108,32 +109,39 @@ void CBSGroup::ExpandOneCBSNode()
 	unsigned long last = tree.size();
 	tree.resize(last+2);
 	
-	tree[last] = tree[bestNode];
 	tree[last].con = c1;
-	tree[last].parent = bestNode;
-
-	tree[last+1] = tree[bestNode];
 	tree[last+1].con = c2;
-	tree[last+1].parent = bestNode;
+	for (unsigned long x = last; x < last+2; x++)
+	{
+		tree[x].parent = bestNode;
+		tree[x].depth = tree[bestNode].depth+1;
+		tree[x].prevPath = loadedPaths[tree[x].con.unit1];
+	}
 	
 	tree[bestNode].closed = true;
 	
 	Replan(last);
 	Replan(last+1);
 	
-	double bestCost = 100000000;
-	for (unsigned int x = 0; x < tree.size(); x++)
+	if (open.empty())
 	{
-		double cost = 0;
-		for (int y = 0; y < tree[x].paths.size(); y++)
-			cost += me->GetPathLength(tree[x].paths[y]);
-		if (cost < bestCost && tree[x].closed == false)
-		{
-			bestNode = x;
-			bestCost = cost;
-		}
+		if (verbose)
+			std::cout << "No solution found" << std::endl;
+		planFinished = true;
+		return;
 	}
-	std::cout << "New best node " << bestNode << std::endl;
+	bestNode = open.top().second;
+	open.pop();
+	LoadNode(bestNode);
+	if (verbose)
+		std::cout << "New best node " << bestNode << std::endl;
+}
+
+bool CBSGroup::Plan(unsigned int limit)
+{
+	for (unsigned int x = 0; x < limit && !planFinished; x++)
+		ExpandOneCBSNode();
+	return planFound;
 }
 
 void CBSGroup::UpdateLocation(Unit<xyLoc, tDirection, MapEnvironment> *u, MapEnvironment *e, xyLoc &loc, bool success, SimulationInfo<xyLoc,tDirection,MapEnvironment> *si)
@@ -152,17 +160,35 @@ void CBSGroup::AddUnit(Unit<xyLoc, tDirection, MapEnvironment> *u)
 	c->GetGoal(goal.l);
 	start.t = 0;
 	goal.t = 0;
-	tree[0].paths.resize(GetNumMembers());
 	astar.GetPath(m2e, start, goal, thePath);
-	for (unsigned int x = 0; x < thePath.size(); x++)
+	unsigned int path = AddPath(thePath);
+	tree[0].cost += pathLengths[path];
+	LoadNode(0);
+	loadedPaths.push_back(path);
+	AddToOccupancy(loadedPaths.size()-1);
+}
+
+/** Stores a path and returns its index in paths **/
+unsigned int CBSGroup::AddPath(const std::vector<xytLoc> &p)
+{
+	paths.resize(paths.size()+1);
+	for (unsigned int x = 0; x < p.size(); x++)
 	{
-		tree[0].paths.back().push_back(thePath[x].l);
+		paths.back().push_back(p[x].l);
 	}
+	pathLengths.push_back(me->GetPathLength(paths.back()));
+	return paths.size()-1;
 }
 
 void CBSGroup::Replan(int location)
 {
 	int theUnit = tree[location].con.unit1;
+	CBSUnit *c = (CBSUnit*)GetMember(theUnit);
+	xytLoc start, goal;
+	c->GetStart(start.l);
+	c->GetGoal(goal.l);
+	start.t = 0;
+
 	m2e->ClearConstraints();
 	int tempLocation = location;
 	while (tempLocation != 0)
@@ -170,74 +196,238 @@ void CBSGroup::Replan(int location)
 		if (theUnit == tree[tempLocation].con.unit1)
 			m2e->AddConstraint(tree[tempLocation].con.c);
 		tempLocation = tree[tempLocation].parent;
-		// todo find constarints on agents goal here
 	}
+	// the agent can't stop at its goal until the constraints there have passed
+	int64_t lastBlocked = m2e->GetLastBlockedTime(goal.l);
+	if (lastBlocked == kNeverFree) // another agent stays there; there is no plan
+		thePath.resize(0);
+	else {
+		goal.t = lastBlocked+1;
+		astar.GetPath(m2e, start, goal, thePath);
+	}
+	if (thePath.size() == 0)
+	{
+		tree[location].path = tree[location].prevPath;
+		tree[location].closed = true;
+		return;
+	}
+	tree[location].path = AddPath(thePath);
+	tree[location].cost = tree[tree[location].parent].cost-pathLengths[tree[location].prevPath]+pathLengths[tree[location].path];
+	open.push(openEntry(tree[location].cost, location));
+}
 
-	CBSUnit *c = (CBSUnit*)GetMember(theUnit);
-	xytLoc start, goal;
-	c->GetStart(start.l);
-	c->GetGoal(goal.l);
-	start.t = 0;
-	goal.t = 0; // TODO: find the true goal time
+static inline uint64_t SpaceTimeKey(const xyLoc &l, uint64_t t)
+{
+	return ((uint64_t)l.x<<48)|((uint64_t)l.y<<32)|t;
+}
 
-	astar.GetPath(m2e, start, goal, thePath);
-	tree[location].paths[theUnit].resize(0);
-	for (unsigned int x = 0; x < thePath.size(); x++)
+static inline uint64_t SpaceKey(const xyLoc &l)
+{
+	return ((uint64_t)l.x<<16)|l.y;
+}
+
+/**
+ * Makes the paths of node location the loaded ones, by walking up from it
+ * and from the loaded node to their common ancestor; only the agents that
+ * were replanned on the way have their paths replaced in the occupancy.
+ */
+void CBSGroup::LoadNode(unsigned int location)
+{
+	if (location == loadedNode)
+		return;
+	std::vector<unsigned int> target(loadedPaths);
+	std::vector<unsigned int> down;
+	std::vector<int> changed;
+	unsigned int from = loadedNode, to = location;
+	while (from != to)
+	{
+		if (tree[from].depth >= tree[to].depth)
+		{
+			target[tree[from].con.unit1] = tree[from].prevPath;
+			changed.push_back(tree[from].con.unit1);
+			from = tree[from].parent;
+		}
+		else {
+			down.push_back(to);
+			to = tree[to].parent;
+		}
+	}
+	for (int x = (int)down.size()-1; x >= 0; x--)
 	{
-		tree[location].paths[theUnit].push_back(thePath[x].l);
+		target[tree[down[x]].con.unit1] = tree[down[x]].path;
+		changed.push_back(tree[down[x]].con.unit1);
 	}
+	std::sort(changed.begin(), changed.end());
+	changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+	unsigned int count = 0;
+	for (unsigned int x = 0; x < changed.size(); x++)
+	{
+		if (target[changed[x]] != loadedPaths[changed[x]])
+			changed[count++] = changed[x];
+	}
+	changed.resize(count);
+	for (unsigned int x = 0; x < changed.size(); x++)
+		RemoveFromOccupancy(changed[x]);
+	// each pair of changed agents is checked once, when the second is added
+	for (unsigned int x = 0; x < changed.size(); x++)
+	{
+		loadedPaths[changed[x]] = target[changed[x]];
+		AddToOccupancy(changed[x]);
+	}
+	loadedNode = location;
 }
 
-bool CBSGroup::FindFirstConflict(int location, conflict &c1, conflict &c2)
+/** Adds the loaded path of agent to the occupancy, recording its conflicts with the paths there **/
+void CBSGroup::AddToOccupancy(int agent)
 {
-	for (int x = 0; x < GetNumMembers(); x++)
+	const std::vector<xyLoc> &p = paths[loadedPaths[agent]];
+	int length = p.size();
+	if (length == 0)
+		return;
+	std::unordered_map<uint64_t, std::vector<int> >::const_iterator i;
+	for (int t = 0; t < length; t++)
 	{
-		for (int y = x+1; y < GetNumMembers(); y++)
+		i = occupancy.find(SpaceTimeKey(p[t], t));
+		if (i != occupancy.end())
+		{
+			for (unsigned int x = 0; x < i->second.size(); x++)
+				AddConflict(agent, i->second[x], p[t], p[t], t, false);
+		}
+		i = parked.find(SpaceKey(p[t]));
+		if (i != parked.end())
+		{
+			for (unsigned int x = 0; x < i->second.size(); x++)
+			{
+				if ((int)paths[loadedPaths[i->second[x]]].size() <= t)
+					AddConflict(agent, i->second[x], p[t], p[t], t, false);
+			}
+		}
+		// another agent moving the opposite way along the same edge
+		if ((t+1 < length) && !(p[t] == p[t+1]))
 		{
-			int maxLength = (tree[location].paths[x].size() > tree[location].paths[y].size())?tree[location].paths[x].size():tree[location].paths[y].size();
-			for (int z = 0; z+1 < maxLength; z++)
+			i = occupancy.find(SpaceTimeKey(p[t+1], t));
+			if (i != occupancy.end())
 			{
-				int a1time = min(z, tree[location].paths[x].size()-1);
-				int a2time = min(z, tree[location].paths[y].size()-1);
-				if (tree[location].paths[x][a1time] == tree[location].paths[y][a2time])
+				for (unsigned int x = 0; x < i->second.size(); x++)
 				{
-					c1.unit1 = x;
-					c2.unit1 = y;
-					c1.c.loc.l = tree[location].paths[x][a1time];
-					c2.c.loc.l = tree[location].paths[y][a2time];
-					c1.c.loc.t = z;
-					c2.c.loc.t = z;
-					c1.c.dir = kTeleport;
-					c2.c.dir = kTeleport;
-					std::cout << "State conflict found between " << x << " and " << y << " at " << c1.c.loc.l << std::endl;
-					return true;
+					const std::vector<xyLoc> &other = paths[loadedPaths[i->second[x]]];
+					if ((t+1 < (int)other.size()) && (other[t+1] == p[t]))
+						AddConflict(agent, i->second[x], p[t], p[t+1], t, true);
 				}
-				if (z >= tree[location].paths[x].size() ||
-					z >= tree[location].paths[y].size())
-					continue;
-				
-				if (tree[location].paths[x][z] == tree[location].paths[y][z+1] &&
-					tree[location].paths[x][z+1] == tree[location].paths[y][z])
-				{
-					c1.unit1 = x;
-					c2.unit1 = y;
-					c1.c.loc.l = tree[location].paths[x][z];
-					c2.c.loc.l = tree[location].paths[y][z];
-					c1.c.loc.t = z;
-					c2.c.loc.t = z;
+			}
+		}
+	}
+	// agents that come to the goal after this one is parked there
+	int maxLength = 0;
+	for (unsigned int x = 0; x < loadedPaths.size(); x++)
+		maxLength = std::max(maxLength, (int)paths[loadedPaths[x]].size());
+	for (int t = length; t < maxLength; t++)
+	{
+		i = occupancy.find(SpaceTimeKey(p[length-1], t));
+		if (i != occupancy.end())
+		{
+			for (unsigned int x = 0; x < i->second.size(); x++)
+				AddConflict(agent, i->second[x], p[length-1], p[length-1], t, false);
+		}
+	}
 
-					c1.c.dir = me->GetAction(tree[location].paths[x][z], tree[location].paths[y][z]);
-					c2.c.dir = me->GetAction(tree[location].paths[y][z], tree[location].paths[x][z]);
-					
-					std::cout << "Edge conflict found between " << x << " and " << y << " at " << c1.c.loc.l << " and " << c2.c.loc.l << std::endl;
+	for (int t = 0; t < length; t++)
+		occupancy[SpaceTimeKey(p[t], t)].push_back(agent);
+	parked[SpaceKey(p[length-1])].push_back(agent);
+}
 
-					return true;
-				}
-			}
+static void RemoveAgent(std::unordered_map<uint64_t, std::vector<int> > &table, uint64_t key, int agent)
+{
+	std::unordered_map<uint64_t, std::vector<int> >::iterator i = table.find(key);
+	assert(i != table.end());
+	std::vector<int> &agents = i->second;
+	for (unsigned int x = 0; x < agents.size(); x++)
+	{
+		if (agents[x] == agent)
+		{
+			agents[x] = agents.back();
+			agents.pop_back();
+			break;
 		}
 	}
-	
-	return false;
+	if (agents.size() == 0)
+		table.erase(i);
+}
+
+void CBSGroup::RemoveFromOccupancy(int agent)
+{
+	const std::vector<xyLoc> &p = paths[loadedPaths[agent]];
+	if (p.size() == 0)
+		return;
+	for (unsigned int t = 0; t < p.size(); t++)
+		RemoveAgent(occupancy, SpaceTimeKey(p[t], t), agent);
+	RemoveAgent(parked, SpaceKey(p.back()), agent);
+}
+
+/**
+ * Records a conflict between the loaded paths of two agents: both at from1
+ * at time, or (for an edge conflict) agent1 moving from from1 to from2
+ * while agent2 moves from from2 to from1 between time and time+1.
+ */
+void CBSGroup::AddConflict(int agent1, int agent2, xyLoc from1, xyLoc from2, int time, bool edgeConflict)
+{
+	CBSConflict c;
+	c.c1.unit1 = agent1;
+	c.c2.unit1 = agent2;
+	c.path1 = loadedPaths[agent1];
+	c.path2 = loadedPaths[agent2];
+	if (!edgeConflict)
+	{
+		c.c1.c.loc = xytLoc(from1, time);
+		c.c2.c.loc = xytLoc(from1, time);
+		c.c1.c.dir = kTeleport;
+		c.c2.c.dir = kTeleport;
+	}
+	else {
+		// each agent may not arrive at the other's location by this move
+		c.c1.c.loc = xytLoc(from2, time+1);
+		c.c2.c.loc = xytLoc(from1, time+1);
+		c.c1.c.dir = me->GetAction(from1, from2);
+		c.c2.c.dir = me->GetAction(from2, from1);
+	}
+	conflicts.push_back(c);
+}
+
+/**
+ * Loads the paths of node location and returns its earliest conflict, after
+ * dropping the recorded conflicts of paths that are no longer loaded.
+ */
+bool CBSGroup::FindFirstConflict(int location, conflict &c1, conflict &c2)
+{
+	LoadNode(location);
+	int best = -1;
+	unsigned int count = 0;
+	for (unsigned int x = 0; x < conflicts.size(); x++)
+	{
+		const CBSConflict &c = conflicts[x];
+		if ((loadedPaths[c.c1.unit1] != c.path1) || (loadedPaths[c.c2.unit1] != c.path2))
+			continue;
+		conflicts[count] = c;
+		if ((best == -1) || (c.c1.c.loc.t < conflicts[best].c1.c.loc.t) ||
+			((c.c1.c.loc.t == conflicts[best].c1.c.loc.t) &&
+			 (std::min(c.c1.unit1, c.c2.unit1) < std::min(conflicts[best].c1.unit1, conflicts[best].c2.unit1))))
+			best = count;
+		count++;
+	}
+	conflicts.resize(count);
+	if (best == -1)
+		return false;
+
+	c1 = conflicts[best].c1;
+	c2 = conflicts[best].c2;
+	if (!verbose)
+		return true;
+	if (c1.c.dir == kTeleport)
+		std::cout << "State conflict found between " << c1.unit1 << " and " << c2.unit1 << " at " << c1.c.loc.l << std::endl;
+	else
+		std::cout << "Edge conflict found between " << c1.unit1 << " and " << c2.unit1 << " at " << c2.c.loc.l << " and " << c1.c.loc.l << std::endl;
+	return true;
 }
 
 void CBSGroup::OpenGLDraw(const MapEnvironment *me, const SimulationInfo<xyLoc,tDirection,MapEnvironment> *)  const
@@ -256,18 +446,19 @@ void CBSGroup::OpenGLDraw(const MapEnvironment *me, const SimulationInfo<xyLoc,t
 //	}
 
 	glLineWidth(2.0);
-	for (unsigned int x = 0; x < tree[bestNode].paths.size(); x++)
+	for (unsigned int x = 0; x < loadedPaths.size(); x++)
 	{
+		const std::vector<xyLoc> &path = paths[loadedPaths[x]];
 		CBSUnit *unit = (CBSUnit*)GetMember(x);
 		unit->GetColor(r, g, b);
 		m2e->SetColor(r, g, b);
-		for (unsigned int y = 0; y+1 < tree[bestNode].paths[x].size(); y++)
+		for (unsigned int y = 0; y+1 < path.size(); y++)
 		{
-			xytLoc a(tree[bestNode].paths[x][y], y);
-			xytLoc b(tree[bestNode].paths[x][y+1], y+1);
+			xytLoc a(path[y], y);
+			xytLoc b(path[y+1], y+1);
 			m2e->GLDrawLine(a, b);
 		}
-		//me->GLDrawPath(tree[bestNode].paths[x]);
+		//me->GLDrawPath(path);
 	}
 	glLineWidth(1.0);
 	if (overlay)
@@ -10,6 +10,8 @@
 #define __hog2_glut__CBSUnits__
 
 #include <iostream>
+#include <queue>
+#include <unordered_map>
 #include "Unit.h"
 #include "UnitGroup.h"
 #include "Map2DEnvironment.h"
@@ -41,37 +43,87 @@ struct conflict {
 	int unit1;
 };
 
+/**
+ * A node of the constraint tree. Only the agent that was replanned in this
+ * node (con.unit1) has a new path; every other agent has the path it had in
+ * the parent. Paths are held once, in CBSGroup::paths.
+ */
 struct CBSTreeNode {
 	CBSTreeNode() { closed = false; }
 	
-	std::vector< std::vector<xyLoc> > paths;
 	conflict con;
 	unsigned int parent;
+	unsigned int depth;
+	unsigned int path; // index of con.unit1's path in this node
+	unsigned int prevPath; // and in the parent
+	double cost; // sum of the path lengths of all agents
 	bool closed;
 };
 
+/** Two agents whose paths (indices into CBSGroup::paths) collide; c1 and c2 resolve it **/
+struct CBSConflict {
+	conflict c1, c2;
+	unsigned int path1, path2;
+};
+
 class CBSGroup : public UnitGroup<xyLoc, tDirection, MapEnvironment>
 {
 public:
 	CBSGroup(MapEnvironment *me);
+	~CBSGroup();
 	bool MakeMove(Unit<xyLoc, tDirection, MapEnvironment> *u, MapEnvironment *e, SimulationInfo<xyLoc,tDirection,MapEnvironment> *si, tDirection& a);
 	void UpdateLocation(Unit<xyLoc, tDirection, MapEnvironment> *u, MapEnvironment *e, xyLoc &loc, bool success, SimulationInfo<xyLoc,tDirection,MapEnvironment> *si);
+	// the group plans for all of its units at once
+	bool CanThinkInParallel(Unit<xyLoc, tDirection, MapEnvironment> *) { return false; }
 	void AddUnit(Unit<xyLoc, tDirection, MapEnvironment> *u);
 	void OpenGLDraw(const MapEnvironment *, const SimulationInfo<xyLoc,tDirection,MapEnvironment> *)  const;
+
+	/** Expands up to limit CBS nodes without a simulation; true once a conflict-free plan is found **/
+	bool Plan(unsigned int limit);
+	/** The sum of the path lengths of the loaded node **/
+	double GetPlanCost() const { return tree[loadedNode].cost; }
+	const std::vector<xyLoc> &GetPlanPath(int agent) const { return paths[loadedPaths[agent]]; }
+	void SetVerbose(bool v) { verbose = v; }
 private:
+	typedef std::pair<double, unsigned int> openEntry;
+
 	void ExpandOneCBSNode();
 	void Replan(int location);
 	bool FindFirstConflict(int location, conflict &c1, conflict &c2);
+	unsigned int AddPath(const std::vector<xytLoc> &p);
+
+	void LoadNode(unsigned int location);
+	void AddToOccupancy(int agent);
+	void RemoveFromOccupancy(int agent);
+	void AddConflict(int agent1, int agent2, xyLoc from1, xyLoc from2, int time, bool edgeConflict);
 	
-	bool planFinished;
+	bool planFinished, planFound;
+	bool verbose;
 	Map2DConstrainedEnvironment *m2e;
 	MapEnvironment *me;
 	std::vector<CBSTreeNode> tree;
+	/** open nodes by cost, then by index **/
+	std::priority_queue<openEntry, std::vector<openEntry>, std::greater<openEntry> > open;
+	std::vector<std::vector<xyLoc> > paths;
+	std::vector<double> pathLengths;
 	std::vector<xytLoc> thePath;
 	TemplateAStar<xytLoc, tDirection, Map2DConstrainedEnvironment> astar;
 	double time;
 	unsigned int bestNode;
 	MapOverlay *overlay;
+
+	/**
+	 * The paths of loadedNode, and a space-time index of where they are:
+	 * occupancy holds the agents at (x, y, t) up to the end of their paths,
+	 * and parked the agents that stay at (x, y) after their path ends. When
+	 * a different node is loaded only the agents whose paths differ are
+	 * removed and added again, and conflicts are found as they are added.
+	 */
+	unsigned int loadedNode;
+	std::vector<unsigned int> loadedPaths;
+	std::unordered_map<uint64_t, std::vector<int> > occupancy;
+	std::unordered_map<uint64_t, std::vector<int> > parked;
+	std::vector<CBSConflict> conflicts;
 };
 
 
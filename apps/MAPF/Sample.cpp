@@ -40,6 +40,7 @@
 #include "MNAgentPuzzle.h"
 #include "Map2DConstrainedEnvironment.h"
 #include "CBSUnits.h"
+#include "Timer.h"
 
 MNAgentEnvironment env;
 MNAgentPuzzleState start(4, 4);
@@ -160,6 +161,8 @@ void InstallHandlers()
 	InstallKeyboardHandler(MyRandomUnitKeyHandler, "Add A* Unit", "Deploys a simple a* unit", kNoModifier, 'a');
 
 	InstallCommandLineHandler(MyCLHandler, "-map", "-map filename", "Selects the default map to be loaded.");
+	InstallCommandLineHandler(MyCLHandler, "-cbsCheck", "-cbsCheck instances", "Compares CBS with a leaf-scanning CBS on random instances, then exits");
+	InstallCommandLineHandler(MyCLHandler, "-prioritizedCheck", "-prioritizedCheck instances agents", "Plans agents in priority order through a shared reservation table and checks for conflicts, then exits");
 
 	
 	InstallWindowHandler(MyWindowHandler);
@@ -220,6 +223,20 @@ int MyCLHandler(char *argument[], int maxNumArgs)
 
 		return 2;
 	}
+	else if (strcmp(argument[0], "-cbsCheck") == 0)
+	{
+		if (maxNumArgs <= 1)
+			return 0;
+		CBSCheck(atoi(argument[1]));
+		exit(0);
+	}
+	else if (strcmp(argument[0], "-prioritizedCheck") == 0)
+	{
+		if (maxNumArgs <= 2)
+			return 0;
+		PrioritizedCheck(atoi(argument[1]), atoi(argument[2]));
+		exit(0);
+	}
 	return 2; //ignore typos
 }
 
@@ -303,3 +320,373 @@ bool MyClickHandler(unsigned long windowID, int, int, point3d loc, tButtonType b
 	return false;
 }
 
+
+/**
+ * Counts the pairs of agents that are at the same place at the same time,
+ * swap places in one move, or that come to where another agent has stopped.
+ * Agents stay at the end of their paths.
+ */
+static int CountConflicts(const std::vector<std::vector<xyLoc> > &paths)
+{
+	int count = 0;
+	unsigned int maxLength = 0;
+	for (unsigned int x = 0; x < paths.size(); x++)
+		maxLength = std::max(maxLength, (unsigned int)paths[x].size());
+	for (unsigned int x = 0; x < paths.size(); x++)
+	{
+		for (unsigned int y = x+1; y < paths.size(); y++)
+		{
+			const std::vector<xyLoc> &a = paths[x], &b = paths[y];
+			if (a.size() == 0 || b.size() == 0)
+				continue;
+			for (unsigned int t = 0; t < maxLength; t++)
+			{
+				const xyLoc &a1 = a[std::min(t, (unsigned int)a.size()-1)];
+				const xyLoc &b1 = b[std::min(t, (unsigned int)b.size()-1)];
+				if (a1 == b1)
+				{
+					count++;
+					break;
+				}
+				if (t+1 >= maxLength)
+					continue;
+				const xyLoc &a2 = a[std::min(t+1, (unsigned int)a.size()-1)];
+				const xyLoc &b2 = b[std::min(t+1, (unsigned int)b.size()-1)];
+				if (a1 == b2 && a2 == b1)
+				{
+					count++;
+					break;
+				}
+			}
+		}
+	}
+	return count;
+}
+
+struct LeafScanNode {
+	std::vector<std::vector<xyLoc> > paths;
+	conflict con;
+	unsigned int parent;
+	double cost;
+	bool closed;
+};
+
+/**
+ * CBS as it was before the constraint tree shared its paths: every node
+ * holds all of the paths, the best node is found by scanning all of them,
+ * and conflicts by walking every pair of paths. Returns false if no plan
+ * was found within limit expansions.
+ */
+static bool LeafScanCBS(MapEnvironment *me, const std::vector<xyLoc> &starts, const std::vector<xyLoc> &goals,
+				 unsigned int limit, double &cost)
+{
+	Map2DConstrainedEnvironment m2e(me->GetMap());
+	TemplateAStar<xytLoc, tDirection, Map2DConstrainedEnvironment> search;
+	std::vector<xytLoc> path;
+	std::vector<LeafScanNode> tree(1);
+	tree[0].parent = 0;
+	tree[0].cost = 0;
+	tree[0].closed = false;
+	tree[0].paths.resize(starts.size());
+	for (unsigned int x = 0; x < starts.size(); x++)
+	{
+		search.GetPath(&m2e, xytLoc(starts[x], 0), xytLoc(goals[x], 0), path);
+		for (unsigned int y = 0; y < path.size(); y++)
+			tree[0].paths[x].push_back(path[y].l);
+		tree[0].cost += me->GetPathLength(tree[0].paths[x]);
+	}
+
+	for (unsigned int expansions = 0; expansions < limit; expansions++)
+	{
+		int best = -1;
+		for (unsigned int x = 0; x < tree.size(); x++)
+		{
+			if (!tree[x].closed && (best == -1 || tree[x].cost < tree[best].cost))
+				best = x;
+		}
+		if (best == -1)
+			return false;
+
+		const std::vector<std::vector<xyLoc> > &p = tree[best].paths;
+		unsigned int maxLength = 0;
+		for (unsigned int x = 0; x < p.size(); x++)
+			maxLength = std::max(maxLength, (unsigned int)p[x].size());
+		conflict c[2];
+		bool found = false;
+		// the earliest conflict, between the lowest numbered agents, as CBSGroup chooses
+		for (unsigned int t = 0; t < maxLength && !found; t++)
+		{
+			for (unsigned int x = 0; x < p.size() && !found; x++)
+			{
+				for (unsigned int y = x+1; y < p.size() && !found; y++)
+				{
+					const xyLoc &a = p[x][std::min(t, (unsigned int)p[x].size()-1)];
+					const xyLoc &b = p[y][std::min(t, (unsigned int)p[y].size()-1)];
+					c[0].unit1 = x;
+					c[1].unit1 = y;
+					if (a == b)
+					{
+						c[0].c.loc = xytLoc(a, t);
+						c[1].c.loc = xytLoc(a, t);
+						c[0].c.dir = c[1].c.dir = kTeleport;
+						found = true;
+					}
+					else if (t+1 < p[x].size() && t+1 < p[y].size() &&
+							 p[x][t+1] == b && p[y][t+1] == a)
+					{
+						// neither agent may arrive where the other was by this move
+						c[0].c.loc = xytLoc(b, t+1);
+						c[1].c.loc = xytLoc(a, t+1);
+						c[0].c.dir = me->GetAction(a, b);
+						c[1].c.dir = me->GetAction(b, a);
+						found = true;
+					}
+				}
+			}
+		}
+		if (!found)
+		{
+			cost = tree[best].cost;
+			return true;
+		}
+		tree[best].closed = true;
+
+		for (int which = 0; which < 2; which++)
+		{
+			LeafScanNode n;
+			n.paths = tree[best].paths;
+			n.con = c[which];
+			n.parent = best;
+			n.closed = false;
+			int unit = n.con.unit1;
+			m2e.ClearConstraints();
+			m2e.AddConstraint(n.con.c);
+			for (unsigned int x = best; x != 0; x = tree[x].parent)
+			{
+				if (tree[x].con.unit1 == unit)
+					m2e.AddConstraint(tree[x].con.c);
+			}
+			xytLoc start(starts[unit], 0), goal(goals[unit], 0);
+			goal.t = m2e.GetLastBlockedTime(goals[unit])+1;
+			search.GetPath(&m2e, start, goal, path);
+			if (path.size() == 0)
+				continue;
+			n.paths[unit].resize(0);
+			for (unsigned int y = 0; y < path.size(); y++)
+				n.paths[unit].push_back(path[y].l);
+			n.cost = 0;
+			for (unsigned int x = 0; x < n.paths.size(); x++)
+				n.cost += me->GetPathLength(n.paths[x]);
+			tree.push_back(n);
+		}
+	}
+	return false;
+}
+
+/** Marks the ground cells that can be reached from l on four-connected moves **/
+static void MarkReachable(Map *m, xyLoc l, std::vector<bool> &reached)
+{
+	std::vector<xyLoc> stack(1, l);
+	reached.assign(m->GetMapWidth()*m->GetMapHeight(), false);
+	reached[l.y*m->GetMapWidth()+l.x] = true;
+	while (stack.size() > 0)
+	{
+		xyLoc next = stack.back();
+		stack.pop_back();
+		const int dx[4] = {1, -1, 0, 0}, dy[4] = {0, 0, 1, -1};
+		for (int d = 0; d < 4; d++)
+		{
+			xyLoc n(next.x+dx[d], next.y+dy[d]);
+			if (!m->CanStep(next.x, next.y, n.x, n.y) || reached[n.y*m->GetMapWidth()+n.x])
+				continue;
+			reached[n.y*m->GetMapWidth()+n.x] = true;
+			stack.push_back(n);
+		}
+	}
+}
+
+/**
+ * Plans random instances on small random maps with CBSGroup and with
+ * LeafScanCBS, checking that both find plans of the same cost and that the
+ * plan of CBSGroup has no conflicts. Instances that LeafScanCBS doesn't
+ * solve within its node limit are skipped.
+ */
+void CBSCheck(int instances)
+{
+	const unsigned int limit = 2000;
+	int errors = 0, skipped = 0;
+	srandom(1234);
+	for (int i = 0; i < instances; i++)
+	{
+		Map *m = new Map(8, 8);
+		for (int x = 0; x < 8; x++)
+			for (int y = 0; y < 8; y++)
+				if (random()%6 == 0)
+					m->SetTerrainType(x, y, kOutOfBounds);
+		MapEnvironment *e = new MapEnvironment(m);
+		e->SetFourConnected();
+
+		// all starts and goals in the part of the map reachable from the first start
+		std::vector<xyLoc> cells;
+		for (int x = 0; x < 8; x++)
+			for (int y = 0; y < 8; y++)
+				if (m->GetTerrainType(x, y) == kGround)
+					cells.push_back(xyLoc(x, y));
+		std::vector<bool> reached;
+		MarkReachable(m, cells[random()%cells.size()], reached);
+		std::vector<xyLoc> usable;
+		for (unsigned int x = 0; x < cells.size(); x++)
+			if (reached[cells[x].y*8+cells[x].x])
+				usable.push_back(cells[x]);
+		unsigned int agents = 2+random()%5;
+		if (usable.size() < 2*agents)
+		{
+			i--;
+			delete e;
+			delete m;
+			continue;
+		}
+		std::vector<xyLoc> starts, goals;
+		std::random_shuffle(usable.begin(), usable.end(), [](int n) { return (int)(random()%n); });
+		for (unsigned int x = 0; x < agents; x++)
+		{
+			starts.push_back(usable[x]);
+			goals.push_back(usable[agents+x]);
+		}
+
+		CBSGroup *group = new CBSGroup(e);
+		group->SetVerbose(false);
+		std::vector<CBSUnit *> units;
+		for (unsigned int x = 0; x < agents; x++)
+		{
+			units.push_back(new CBSUnit(starts[x], goals[x]));
+			group->AddUnit(units.back());
+		}
+		double leafCost = 0;
+		bool found = group->Plan(limit);
+		bool leafFound = LeafScanCBS(e, starts, goals, limit, leafCost);
+		if (!leafFound)
+		{
+			skipped++;
+		}
+		else if (!found)
+		{
+			printf("Instance %d (%u agents): no plan, leaf scan %1.1f\n", i, agents, leafCost);
+			errors++;
+		}
+		else {
+			std::vector<std::vector<xyLoc> > plan;
+			for (unsigned int x = 0; x < agents; x++)
+				plan.push_back(group->GetPlanPath(x));
+			int conflicts = CountConflicts(plan);
+			if (!fequal(group->GetPlanCost(), leafCost) || conflicts != 0)
+			{
+				printf("Instance %d (%u agents): cost %1.1f, leaf scan %1.1f, %d conflicts\n",
+					   i, agents, group->GetPlanCost(), leafCost, conflicts);
+				errors++;
+			}
+		}
+		for (unsigned int x = 0; x < agents; x++)
+			delete units[x];
+		delete group;
+		delete e;
+		delete m;
+	}
+	printf("%d instances, %d skipped, %d errors\n", instances, skipped, errors);
+}
+
+/**
+ * Plans agents one at a time, in priority order, on random 64x64 maps. Each
+ * agent is planned with its own Map2DConstrainedEnvironment sharing one
+ * ConstraintTable, and reserves its path there for the agents that follow.
+ * An agent whose goal is taken for good, or that finds no path within the
+ * time limit, isn't planned. Every planned path must be made of legal moves
+ * from its start to its goal, and no two may have a vertex, swap or parked
+ * conflict.
+ */
+void PrioritizedCheck(int instances, int agents)
+{
+	const int size = 64;
+	const uint32_t timeLimit = 4*size;
+	int errors = 0, totalPlanned = 0, totalFailed = 0;
+	double totalTime = 0;
+	srandom(4321);
+	for (int i = 0; i < instances; i++)
+	{
+		Map *m = new Map(size, size);
+		for (int x = 0; x < size; x++)
+			for (int y = 0; y < size; y++)
+				if (random()%8 == 0)
+					m->SetTerrainType(x, y, kOutOfBounds);
+		MapEnvironment *e = new MapEnvironment(m);
+		e->SetFourConnected();
+
+		// all starts and goals in the part of the map reachable from the first start
+		std::vector<xyLoc> usable;
+		std::vector<bool> reached;
+		do {
+			usable.resize(0);
+			xyLoc first(random()%size, random()%size);
+			if (m->GetTerrainType(first.x, first.y) != kGround)
+				continue;
+			MarkReachable(m, first, reached);
+			for (int x = 0; x < size; x++)
+				for (int y = 0; y < size; y++)
+					if (reached[y*size+x])
+						usable.push_back(xyLoc(x, y));
+		} while (usable.size() < 2*(unsigned int)agents);
+		std::random_shuffle(usable.begin(), usable.end(), [](int n) { return (int)(random()%n); });
+
+		ConstraintTable reservations;
+		Map2DConstrainedEnvironment m2e(m);
+		m2e.SetReservationTable(&reservations);
+		m2e.SetTimeLimit(timeLimit);
+		TemplateAStar<xytLoc, tDirection, Map2DConstrainedEnvironment> search;
+		std::vector<xytLoc> path;
+		std::vector<std::vector<xyLoc> > plan;
+		int failed = 0, bad = 0;
+		Timer t;
+		t.StartTimer();
+		for (int x = 0; x < agents; x++)
+		{
+			xyLoc start = usable[x], goal = usable[agents+x];
+			int64_t blocked = m2e.GetLastBlockedTime(goal);
+			path.resize(0);
+			if (blocked != kNeverFree)
+				search.GetPath(&m2e, xytLoc(start, 0), xytLoc(goal, (uint32_t)(blocked+1)), path);
+			if (path.size() == 0)
+			{
+				failed++;
+				continue;
+			}
+			reservations.ReservePath(path);
+			plan.resize(plan.size()+1);
+			for (unsigned int y = 0; y < path.size(); y++)
+			{
+				plan.back().push_back(path[y].l);
+				if (path[y].t != y || (y > 0 && !(path[y].l == path[y-1].l) &&
+									   !m->CanStep(path[y-1].l.x, path[y-1].l.y, path[y].l.x, path[y].l.y)))
+				{
+					bad++;
+					break;
+				}
+			}
+			if (!(path[0].l == start) || !(path.back().l == goal))
+				bad++;
+		}
+		double elapsed = t.EndTimer();
+		int conflicts = CountConflicts(plan);
+		if (conflicts != 0 || bad != 0)
+		{
+			printf("Instance %d: %d conflicts, %d illegal paths\n", i, conflicts, bad);
+			errors++;
+		}
+		totalPlanned += plan.size();
+		totalFailed += failed;
+		totalTime += elapsed;
+		delete e;
+		delete m;
+	}
+	printf("%d instances of %d agents, %d agents planned, %d not planned, %1.3fs, %d errors\n",
+		   instances, agents, totalPlanned, totalFailed, totalTime, errors);
+}
@@ -75,6 +75,7 @@ void RunScalingTest(int size, int which, float weight);
 void RunTankScalingTest(int size, int which, float weight);
 void RunWorkMeasureTest();
 void RunSTPTest(int which);
+void LearnedHeuristicTest(int size);
 
 void RunBigScenario(char *name, int which);
 
@@ -190,6 +191,7 @@ void InstallHandlers()
 	InstallCommandLineHandler(MyCLHandler, "-scaleTestTank", "-scaleTestTank <size> <which> <weight>", "Run a scaling test with local minima <size>.");
 	InstallCommandLineHandler(MyCLHandler, "-STPTest", "-STPTest", "Run a STP test.");
 	InstallCommandLineHandler(MyCLHandler, "-flrta2", "-flrta2", "Tests flrta2");
+	InstallCommandLineHandler(MyCLHandler, "-learnedHeuristicCheck", "-learnedHeuristicCheck <size>", "Checks LRTA* and LSS-LRTA* learning in their own, a shared and a parallel shared store, then exits");
 	
 	InstallWindowHandler(MyWindowHandler);
 
@@ -346,6 +348,13 @@ int MyCLHandler(char *argument[], int maxNumArgs)
 	{
 		RunScalingTest(30, 7, 1.0);
 	}
+	else if (strcmp(argument[0], "-learnedHeuristicCheck") == 0)
+	{
+		if (maxNumArgs <= 1)
+			return 0;
+		LearnedHeuristicTest(atoi(argument[1]));
+		exit(0);
+	}
 	return 2; //ignore typos
 }
 
@@ -1813,3 +1822,271 @@ void RunSTPTest(int which)
 	}
 	exit(0);
 }
+
+#include <thread>
+
+typedef LearnedHeuristic<xyLoc, MapEnvironment> GridLearnedHeuristic;
+
+/**
+ * Moves from start to goal with alg, following each path it returns as a
+ * LearningUnit does. Returns the distance moved, or -1 if the goal wasn't
+ * reached within maxMoves moves.
+ */
+template <class algorithm>
+double RunLearningTrial(algorithm *alg, MapEnvironment *me, xyLoc start, const xyLoc &goal, int maxMoves)
+{
+	std::vector<xyLoc> thePath;
+	double moved = 0;
+	for (int x = 0; x < maxMoves && !(start == goal); x++)
+	{
+		if (thePath.size() <= 1)
+			alg->GetPath(me, start, goal, thePath);
+		moved += me->GCost(start, thePath[thePath.size()-2]);
+		start = thePath[thePath.size()-2];
+		thePath.pop_back();
+	}
+	return (start == goal)?moved:-1;
+}
+
+/**
+ * Runs trials trials from start for each algorithm in algs, one thread per
+ * algorithm, recording the distance moved in each trial.
+ */
+template <class algorithm>
+void RunParallelTrials(std::vector<algorithm *> &algs, MapEnvironment *me, const std::vector<xyLoc> &starts,
+					   const xyLoc &goal, int trials, int maxMoves, std::vector<std::vector<double> > &moved)
+{
+	std::vector<std::thread> threads;
+	moved.resize(algs.size());
+	for (unsigned int x = 0; x < algs.size(); x++)
+	{
+		moved[x].resize(trials);
+		threads.push_back(std::thread([&, x]() {
+			for (int t = 0; t < trials; t++)
+				moved[x][t] = RunLearningTrial(algs[x], me, starts[x], goal, maxMoves);
+		}));
+	}
+	for (unsigned int x = 0; x < threads.size(); x++)
+		threads[x].join();
+}
+
+/**
+ * Checks one algorithm: each start is run for several trials with the
+ * agent's own (hashed) store and, from the same random seed, with a dense
+ * store set by SetLearnedHeuristic; the distances moved, the amount learned
+ * and the learned values must be the same. Then one agent per start shares a
+ * dense store while thinking in parallel. Each agent only counts what its
+ * Raise adds to the store, so together they must have learned exactly what
+ * the store holds, and every learned h-cost must stay admissible. All costs
+ * are multiples of 0.5, so the sums are exact.
+ */
+template <class algorithm>
+int CheckLearnedHeuristic(const char *name, algorithm *(*make)(), MapEnvironment *me, Map *map,
+						  const std::vector<xyLoc> &starts, const xyLoc &goal, const std::vector<double> &dist)
+{
+	const int trials = 10;
+	int maxMoves = 20*map->GetMapWidth()*map->GetMapHeight();
+	int errors = 0;
+	Timer t;
+	t.StartTimer();
+	for (unsigned int x = 0; x < starts.size(); x++)
+	{
+		GridLearnedHeuristic shared;
+		shared.SetAllowDense(true);
+		algorithm *own = make(), *other = make();
+		other->SetLearnedHeuristic(&shared);
+		for (int trial = 0; trial < trials; trial++)
+		{
+			srandom(101*x+trial);
+			double ownMoved = RunLearningTrial(own, me, starts[x], goal, maxMoves);
+			srandom(101*x+trial);
+			double sharedMoved = RunLearningTrial(other, me, starts[x], goal, maxMoves);
+			if (ownMoved < 0 || ownMoved != sharedMoved || own->GetAmountLearned() != other->GetAmountLearned())
+			{
+				printf("%s ERROR: start %d trial %d moved %1.1f learning %1.1f in its own store, %1.1f learning %1.1f in a shared store\n",
+					   name, x, trial, ownMoved, own->GetAmountLearned(), sharedMoved, other->GetAmountLearned());
+				errors++;
+				break;
+			}
+		}
+		if (own->GetLearnedHeuristic()->IsDense() || !shared.IsDense())
+		{
+			printf("%s ERROR: own store %s dense, shared store %s dense\n", name,
+				   own->GetLearnedHeuristic()->IsDense()?"is":"isn't", shared.IsDense()?"is":"isn't");
+			errors++;
+		}
+		int different = 0;
+		for (int y = 0; y < map->GetMapHeight(); y++)
+			for (int z = 0; z < map->GetMapWidth(); z++)
+				if (own->GetLearnedHeuristic()->Get(me, xyLoc(z, y)) != shared.Get(me, xyLoc(z, y)))
+					different++;
+		if (different > 0)
+		{
+			printf("%s ERROR: start %d has %d states learned differently in its own and a shared store\n", name, x, different);
+			errors++;
+		}
+		delete own;
+		delete other;
+	}
+	double serialTime = t.EndTimer();
+
+	GridLearnedHeuristic shared;
+	shared.SetAllowDense(true);
+	std::vector<algorithm *> algs;
+	for (unsigned int x = 0; x < starts.size(); x++)
+	{
+		algs.push_back(make());
+		algs.back()->SetLearnedHeuristic(&shared);
+	}
+	std::vector<std::vector<double> > moved;
+	t.StartTimer();
+	RunParallelTrials(algs, me, starts, goal, trials, maxMoves, moved);
+	double parallelTime = t.EndTimer();
+	int unfinished = 0, inadmissible = 0;
+	double agentLearning = 0, storeLearning = 0;
+	for (unsigned int x = 0; x < algs.size(); x++)
+	{
+		for (int trial = 0; trial < trials; trial++)
+			if (moved[x][trial] < 0)
+				unfinished++;
+		agentLearning += algs[x]->GetAmountLearned();
+		delete algs[x];
+	}
+	for (int y = 0; y < map->GetMapHeight(); y++)
+	{
+		for (int x = 0; x < map->GetMapWidth(); x++)
+		{
+			xyLoc s(x, y);
+			double learned = shared.Get(me, s);
+			storeLearning += learned;
+			if (map->GetTerrainType(x, y) == kGround && fgreater(learned+me->HCost(s, goal), dist[y*map->GetMapWidth()+x]))
+				inadmissible++;
+		}
+	}
+	if (unfinished > 0 || inadmissible > 0 || agentLearning != storeLearning)
+	{
+		printf("%s ERROR: parallel shared store: %d unfinished trials, %d inadmissible states, agents learned %1.1f, store holds %1.1f\n",
+			   name, unfinished, inadmissible, agentLearning, storeLearning);
+		errors++;
+	}
+	printf("%s: %d starts x %d trials, own and shared stores %1.3fs; %d threads sharing a store %1.3fs, learned %1.1f\n",
+		   name, (int)starts.size(), trials, serialTime, (int)starts.size(), parallelTime, storeLearning);
+	return errors;
+}
+
+/**
+ * Has 4 threads raise the values of the same few states in a dense store at
+ * once. Each value must end up as the largest one raised to, and what the
+ * threads count as raised must add up to what the store holds.
+ */
+int CheckParallelRaise(MapEnvironment *me)
+{
+	const int numThreads = 4, numStates = 8, raises = 200000;
+	GridLearnedHeuristic store;
+	store.SetAllowDense(true);
+	std::vector<double> raised(numThreads, 0);
+	std::vector<std::thread> threads;
+	// start together, so that the threads raise the same values at once
+	std::atomic<int> waiting(numThreads);
+	for (int x = 0; x < numThreads; x++)
+	{
+		threads.push_back(std::thread([&, x]() {
+			waiting--;
+			while (waiting.load() > 0)
+				std::this_thread::yield();
+			for (int y = 0; y < raises; y++)
+			{
+				double val = 0.5*(y*numThreads+x)/numStates;
+				double old = store.Raise(me, xyLoc(y%numStates, 0), val);
+				if (old < val)
+					raised[x] += val-old;
+			}
+		}));
+	}
+	for (int x = 0; x < numThreads; x++)
+		threads[x].join();
+	int errors = 0;
+	double total = 0, stored = 0;
+	for (int x = 0; x < numThreads; x++)
+		total += raised[x];
+	for (int x = 0; x < numStates; x++)
+	{
+		double largest = 0.5*((raises-numStates+x)*numThreads+numThreads-1)/numStates;
+		double val = store.Get(me, xyLoc(x, 0));
+		stored += val;
+		if (val != largest)
+			errors++;
+	}
+	if (errors > 0 || total != stored)
+	{
+		printf("Raise ERROR: %d states below the largest value raised to, threads raised %1.1f, store holds %1.1f\n", errors, total, stored);
+		return 1;
+	}
+	printf("Raise: %d threads raising %d states %d times each, store holds %1.1f\n", numThreads, numStates, raises/numStates, stored);
+	return 0;
+}
+
+LRTAStar<xyLoc, tDirection, MapEnvironment> *MakeLRTAStar()
+{ return new LRTAStar<xyLoc, tDirection, MapEnvironment>(); }
+LSSLRTAStar<xyLoc, tDirection, MapEnvironment> *MakeLSSLRTAStar()
+{ return new LSSLRTAStar<xyLoc, tDirection, MapEnvironment>(10); }
+
+/**
+ * Checks the learned heuristic stores of LRTA* and LSS-LRTA* on a size x size
+ * map with the local minimum of RunScalingTest and random obstacles. Agents
+ * start from 8 open locations and all head to the same goal, so that they
+ * can share what they learn.
+ */
+void LearnedHeuristicTest(int size)
+{
+	Map *map = new Map(size, size);
+	map->SetTerrainType(1, size-2, size-2, size-2, kOutOfBounds);
+	map->SetTerrainType(size-2, 1, size-2, size-2, kOutOfBounds);
+	srandom(1234);
+	for (int x = 0; x < size*size/8; x++)
+		map->SetTerrainType(random()%size, random()%(size-4), kOutOfBounds);
+	MapEnvironment *me = new MapEnvironment(map, false);
+	me->SetDiagonalCost(1.5);
+	xyLoc goal(size-1, size-1);
+	map->SetTerrainType(goal.x, goal.y, kGround);
+
+	// the distance of each location to the goal
+	std::vector<double> dist(size*size, DBL_MAX);
+	std::priority_queue<std::pair<double, int>, std::vector<std::pair<double, int> >, std::greater<std::pair<double, int> > > q;
+	std::vector<xyLoc> succ;
+	dist[goal.y*size+goal.x] = 0;
+	q.push(std::make_pair(0.0, goal.y*size+goal.x));
+	while (q.size() > 0)
+	{
+		std::pair<double, int> next = q.top();
+		q.pop();
+		if (next.first > dist[next.second])
+			continue;
+		xyLoc s(next.second%size, next.second/size);
+		me->GetSuccessors(s, succ);
+		for (unsigned int x = 0; x < succ.size(); x++)
+		{
+			double d = next.first+me->GCost(s, succ[x]);
+			if (d < dist[succ[x].y*size+succ[x].x])
+			{
+				dist[succ[x].y*size+succ[x].x] = d;
+				q.push(std::make_pair(d, succ[x].y*size+succ[x].x));
+			}
+		}
+	}
+	std::vector<xyLoc> starts;
+	while (starts.size() < 8)
+	{
+		xyLoc s(random()%size, random()%size);
+		if (map->GetTerrainType(s.x, s.y) == kGround && dist[s.y*size+s.x] != DBL_MAX && !(s == goal))
+			starts.push_back(s);
+	}
+
+	int errors = 0;
+	errors += CheckLearnedHeuristic("LRTA*", MakeLRTAStar, me, map, starts, goal, dist);
+	errors += CheckLearnedHeuristic("LSS-LRTA*", MakeLSSLRTAStar, me, map, starts, goal, dist);
+	errors += CheckParallelRaise(me);
+	printf("%d errors\n", errors);
+	delete me;
+	delete map;
+}
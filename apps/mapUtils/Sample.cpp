@@ -391,8 +391,7 @@ void buildProblemSet()
 	GraphDistanceHeuristic gdh(g);
 	gdh.SetPlacement(kFarPlacement);
 	// make things go fast; we're doing tons of searches, so use a good heuristic
-	for (unsigned int x = 0; x < 30; x++)
-		gdh.AddHeuristic();
+	gdh.AddHeuristics(30);
 	GraphEnvironment *ge = new GraphEnvironment(&map, g, &gdh);
 	ge->SetDirected(true);
 	
@@ -37,6 +37,15 @@
 #include "MapSectorAbstraction.h"
 //#include "ContractionHierarchy.h"
 #include "MapGenerators.h"
+#include "BucketOpenClosed.h"
+#include "ScenarioLoader.h"
+#include "Timer.h"
+#include "FloydWarshall.h"
+#include "GenericSearchUnit.h"
+#include "SearchUnit.h"
+#include "MapCliqueAbstraction.h"
+#include <float.h>
+#include <limits>
 
 bool mouseTracking = false;
 bool runningSearch1 = false;
@@ -118,6 +127,10 @@ void InstallHandlers()
 	InstallCommandLineHandler(MyCLHandler, "-map", "-map filename", "Selects the default map to be loaded.");
 	InstallCommandLineHandler(MyCLHandler, "-convert", "-map file1 file2", "Converts a map and saves as file2, then exits");
 	InstallCommandLineHandler(MyCLHandler, "-size", "-batch integer", "If size is set, we create a square maze with the x and y dimensions specified.");
+	InstallCommandLineHandler(MyCLHandler, "-openListBench", "-openListBench scenario", "Compares heap and bucket open lists on a scenario file, then exits");
+	InstallCommandLineHandler(MyCLHandler, "-frozenGraphBench", "-frozenGraphBench scenario", "Compares A* on a map graph before and after it is frozen, then exits");
+	InstallCommandLineHandler(MyCLHandler, "-parallelThink", "-parallelThink map", "Checks that units thinking on 1-4 threads end up in the same places, then exits");
+	InstallCommandLineHandler(MyCLHandler, "-floydWarshallCheck", "-floydWarshallCheck graphs", "Checks the blocked Floyd-Warshall and all-pairs Dijkstra against a plain triple loop, then exits");
 
 	
 	InstallWindowHandler(MyWindowHandler);
@@ -287,9 +300,333 @@ int MyCLHandler(char *argument[], int maxNumArgs)
 		assert( mazeSize > 0 );
 		return 2;
 	}
+	else if (strcmp(argument[0], "-openListBench") == 0)
+	{
+		if (maxNumArgs <= 1)
+			return 0;
+		OpenListBenchmark(argument[1]);
+		exit(0);
+	}
+	else if (strcmp(argument[0], "-frozenGraphBench") == 0)
+	{
+		if (maxNumArgs <= 1)
+			return 0;
+		FrozenGraphBenchmark(argument[1]);
+		exit(0);
+	}
+	else if (strcmp(argument[0], "-parallelThink") == 0)
+	{
+		if (maxNumArgs <= 1)
+			return 0;
+		ParallelThinkTest(argument[1]);
+		exit(0);
+	}
+	else if (strcmp(argument[0], "-floydWarshallCheck") == 0)
+	{
+		if (maxNumArgs <= 1)
+			return 0;
+		FloydWarshallCheck(atoi(argument[1]));
+		exit(0);
+	}
 	return 2; //ignore typos
 }
 
+/**
+ * Runs every problem in the scenario with A* using a binary heap and then
+ * with the bucket open list. Diagonal moves cost 1.5 so that all costs
+ * are multiples of 1/2 and fit the buckets exactly.
+ */
+void OpenListBenchmark(const char *scenario)
+{
+	ScenarioLoader sl(scenario);
+	if (sl.GetNumExperiments() == 0)
+	{
+		printf("No experiments in '%s'\n", scenario);
+		return;
+	}
+	Experiment e = sl.GetNthExperiment(0);
+	Map *map = new Map(e.GetMapName());
+	map->Scale(e.GetXScale(), e.GetYScale());
+	MapEnvironment env(map);
+	env.SetDiagonalCost(1.5);
+
+	TemplateAStar<xyLoc, tDirection, MapEnvironment> heapSearch;
+	TemplateAStar<xyLoc, tDirection, MapEnvironment, BucketOpenClosed<xyLoc, AStarCompare<xyLoc> > > bucketSearch;
+	bucketSearch.openClosedList.SetCostResolution(2);
+
+	std::vector<xyLoc> thePath;
+	double heapTime = 0, bucketTime = 0;
+	uint64_t heapNodes = 0, bucketNodes = 0;
+	Timer t;
+	for (int x = 0; x < sl.GetNumExperiments(); x++)
+	{
+		e = sl.GetNthExperiment(x);
+		xyLoc start(e.GetStartX(), e.GetStartY()), goal(e.GetGoalX(), e.GetGoalY());
+
+		t.StartTimer();
+		heapSearch.GetPath(&env, start, goal, thePath);
+		heapTime += t.EndTimer();
+		heapNodes += heapSearch.GetNodesExpanded();
+		double heapCost = env.GetPathLength(thePath);
+
+		t.StartTimer();
+		bucketSearch.GetPath(&env, start, goal, thePath);
+		bucketTime += t.EndTimer();
+		bucketNodes += bucketSearch.GetNodesExpanded();
+		double bucketCost = env.GetPathLength(thePath);
+
+		if (!fequal(heapCost, bucketCost))
+			printf("Error: problem %d has cost %1.1f with the heap but %1.1f with buckets\n", x, heapCost, bucketCost);
+	}
+	printf("%d problems on %s\n", sl.GetNumExperiments(), e.GetMapName());
+	printf("heap:   %1.3fs %llu nodes expanded\n", heapTime, (unsigned long long)heapNodes);
+	printf("bucket: %1.3fs %llu nodes expanded\n", bucketTime, (unsigned long long)bucketNodes);
+	delete map;
+}
+
+/**
+ * Runs every problem in the scenario with A* on the map's graph, then
+ * freezes the graph and runs them again. The frozen searches must find the
+ * same paths. The frozen graph is also searched with a straight-line
+ * heuristic from the snapshot's coordinates, which must find the same costs.
+ */
+void FrozenGraphBenchmark(const char *scenario)
+{
+	ScenarioLoader sl(scenario);
+	if (sl.GetNumExperiments() == 0)
+	{
+		printf("No experiments in '%s'\n", scenario);
+		return;
+	}
+	Experiment e = sl.GetNthExperiment(0);
+	Map *map = new Map(e.GetMapName());
+	map->Scale(e.GetXScale(), e.GetYScale());
+	Graph *g = GraphSearchConstants::GetGraph(map);
+	GraphMapHeuristic octile(map, g);
+	GraphEnvironment env(map, g, &octile);
+	env.SetDirected(true);
+
+	TemplateAStar<graphState, graphMove, GraphEnvironment> astar, lineSearch;
+	std::vector<std::vector<graphState> > paths(sl.GetNumExperiments());
+	std::vector<double> costs(sl.GetNumExperiments());
+	std::vector<graphState> thePath;
+	double graphTime = 0, frozenTime = 0, lineTime = 0;
+	uint64_t graphNodes = 0, frozenNodes = 0, lineNodes = 0;
+	int errors = 0;
+	Timer t;
+	for (int x = 0; x < sl.GetNumExperiments(); x++)
+	{
+		e = sl.GetNthExperiment(x);
+		graphState start = map->GetNodeNum(e.GetStartX(), e.GetStartY());
+		graphState goal = map->GetNodeNum(e.GetGoalX(), e.GetGoalY());
+		t.StartTimer();
+		astar.GetPath(&env, start, goal, paths[x]);
+		graphTime += t.EndTimer();
+		graphNodes += astar.GetNodesExpanded();
+		costs[x] = env.GetPathLength(paths[x]);
+	}
+
+	env.FreezeGraph();
+	GraphCSRStraightLineHeuristic line(g, env.GetCSR(), map->GetCoordinateScale());
+	GraphEnvironment lineEnv(map, g, &line);
+	lineEnv.SetDirected(true);
+	lineEnv.FreezeGraph();
+	for (int x = 0; x < sl.GetNumExperiments(); x++)
+	{
+		e = sl.GetNthExperiment(x);
+		graphState start = map->GetNodeNum(e.GetStartX(), e.GetStartY());
+		graphState goal = map->GetNodeNum(e.GetGoalX(), e.GetGoalY());
+		t.StartTimer();
+		astar.GetPath(&env, start, goal, thePath);
+		frozenTime += t.EndTimer();
+		frozenNodes += astar.GetNodesExpanded();
+		if ((thePath != paths[x]) || !fequal(env.GetPathLength(thePath), costs[x]))
+		{
+			printf("Error: problem %d has cost %1.2f on the graph but %1.2f frozen\n", x, costs[x], env.GetPathLength(thePath));
+			errors++;
+		}
+
+		t.StartTimer();
+		lineSearch.GetPath(&lineEnv, start, goal, thePath);
+		lineTime += t.EndTimer();
+		lineNodes += lineSearch.GetNodesExpanded();
+		if (!fequal(lineEnv.GetPathLength(thePath), costs[x]))
+		{
+			printf("Error: problem %d has cost %1.2f on the graph but %1.2f with the straight-line heuristic\n", x, costs[x], lineEnv.GetPathLength(thePath));
+			errors++;
+		}
+	}
+	printf("%d problems on %s, %d errors\n", sl.GetNumExperiments(), e.GetMapName(), errors);
+	printf("graph:         %1.3fs %llu nodes expanded\n", graphTime, (unsigned long long)graphNodes);
+	printf("frozen:        %1.3fs %llu nodes expanded\n", frozenTime, (unsigned long long)frozenNodes);
+	printf("straight-line: %1.3fs %llu nodes expanded\n", lineTime, (unsigned long long)lineNodes);
+	delete g;
+	delete map;
+}
+
+/**
+ * Picks count distinct open start locations and an open goal for each.
+ * Returns false if the map doesn't have enough open locations.
+ */
+bool GetThinkProblems(Map *map, int count, std::vector<xyLoc> &starts, std::vector<xyLoc> &goals)
+{
+	int width = map->GetMapWidth(), height = map->GetMapHeight();
+	int open = 0;
+	for (int x = 0; x < width; x++)
+		for (int y = 0; y < height; y++)
+			if (map->GetTerrainType(x, y) == kGround)
+				open++;
+	if (open < count)
+		return false;
+
+	std::vector<bool> used(width*height, false);
+	starts.resize(0);
+	goals.resize(0);
+	srandom(7);
+	while ((int)starts.size() < count)
+	{
+		xyLoc s(random()%width, random()%height);
+		if ((map->GetTerrainType(s.x, s.y) != kGround) || used[s.y*width+s.x])
+			continue;
+		xyLoc g(random()%width, random()%height);
+		if (map->GetTerrainType(g.x, g.y) != kGround)
+			continue;
+		used[s.y*width+s.x] = true;
+		starts.push_back(s);
+		goals.push_back(g);
+	}
+	return true;
+}
+
+/**
+ * Steps the simulation with the settings that make the result independent
+ * of timing, then returns where each unit ended up.
+ */
+template <class environment>
+void RunThinkSimulation(UnitSimulation<xyLoc, tDirection, environment> &sim, int threads, int steps, std::vector<xyLoc> &locs)
+{
+	sim.SetStepType(kMinTime);
+	sim.SetThinkingPenalty(0);
+	sim.SetLogStats(false);
+	sim.SetNumThreads(threads);
+	for (int x = 0; x < steps; x++)
+		sim.StepTime(1.0);
+	locs.resize(sim.GetNumUnits());
+	for (unsigned int x = 0; x < sim.GetNumUnits(); x++)
+		sim.GetUnit(x)->GetLocation(locs[x]);
+}
+
+/**
+ * GenericSearchUnits running TemplateAStar, with units blocking each other.
+ */
+void RunGenericThinkUnits(Map *map, const std::vector<xyLoc> &starts, const std::vector<xyLoc> &goals,
+						  int threads, int steps, std::vector<xyLoc> &locs)
+{
+	MapEnvironment env(map, true);
+	std::vector<TemplateAStar<xyLoc, tDirection, MapEnvironment> *> searches;
+	UnitMapSimulation sim(&env);
+	for (unsigned int x = 0; x < starts.size(); x++)
+	{
+		xyLoc start = starts[x], goal = goals[x];
+		searches.push_back(new TemplateAStar<xyLoc, tDirection, MapEnvironment>());
+		GenericSearchUnit<xyLoc, tDirection, MapEnvironment> *u;
+		u = new GenericSearchUnit<xyLoc, tDirection, MapEnvironment>(start, goal, searches.back());
+		u->SetSpeed(1);
+		u->SetThinkInParallel(true);
+		env.GetOccupancyInfo()->SetStateOccupied(start, true);
+		sim.AddUnit(u);
+	}
+	RunThinkSimulation(sim, threads, steps, locs);
+	sim.ClearAllUnits();
+	for (unsigned int x = 0; x < searches.size(); x++)
+		delete searches[x];
+}
+
+/**
+ * SearchUnits running aStar on the abstraction, each following a target
+ * unit that sits on its goal. The targets aren't part of the simulation.
+ */
+void RunAbsThinkUnits(MapAbstraction *abs, const std::vector<xyLoc> &starts, const std::vector<xyLoc> &goals,
+					  int threads, int steps, std::vector<xyLoc> &locs)
+{
+	AbsMapEnvironment env(abs);
+	std::vector<SearchUnit *> targets;
+	UnitAbsMapSimulation sim(&env);
+	for (unsigned int x = 0; x < starts.size(); x++)
+	{
+		aStar *search = new aStar();
+		search->SetMarkPath(false);
+		targets.push_back(new SearchUnit(goals[x].x, goals[x].y, 0, 0));
+		SearchUnit *u = new SearchUnit(starts[x].x, starts[x].y, targets.back(), search);
+		u->SetSpeed(1);
+		u->SetThinkInParallel(true);
+		sim.AddUnit(u);
+	}
+	RunThinkSimulation(sim, threads, steps, locs);
+	sim.ClearAllUnits();
+	for (unsigned int x = 0; x < targets.size(); x++)
+		delete targets[x];
+}
+
+/**
+ * Runs 300 units on the map with 1 to 4 threads thinking in parallel and
+ * checks that every unit ends up in the same place as with 1 thread. This
+ * is done for GenericSearchUnit and for SearchUnit. praStar units aren't
+ * tested, as praStar labels the nodes of the shared abstraction and can't
+ * think in parallel.
+ */
+void ParallelThinkTest(const char *mapName)
+{
+	const int numUnits = 300, numSteps = 60;
+	Map *map = new Map(mapName);
+	std::vector<xyLoc> starts, goals;
+	if (!GetThinkProblems(map, numUnits, starts, goals))
+	{
+		printf("Map '%s' has fewer than %d open locations\n", mapName, numUnits);
+		delete map;
+		return;
+	}
+	MapCliqueAbstraction *abs = new MapCliqueAbstraction(new Map(mapName));
+
+	int errors = 0;
+	std::vector<xyLoc> serial, locs;
+	Timer t;
+	for (int type = 0; type < 2; type++)
+	{
+		for (int threads = 1; threads <= 4; threads++)
+		{
+			t.StartTimer();
+			if (type == 0)
+				RunGenericThinkUnits(map, starts, goals, threads, numSteps, locs);
+			else
+				RunAbsThinkUnits(abs, starts, goals, threads, numSteps, locs);
+			double elapsed = t.EndTimer();
+
+			int atGoal = 0, different = 0;
+			for (unsigned int x = 0; x < locs.size(); x++)
+			{
+				if (locs[x] == goals[x])
+					atGoal++;
+				if ((threads > 1) && !(locs[x] == serial[x]))
+					different++;
+			}
+			printf("%s, %d thread(s): %1.3fs, %d of %d units at their goals",
+				   (type == 0)?"GenericSearchUnit":"SearchUnit", threads, elapsed, atGoal, numUnits);
+			if (different > 0)
+			{
+				printf(" ERROR: %d units in different locations than with 1 thread", different);
+				errors++;
+			}
+			printf("\n");
+			if (threads == 1)
+				serial = locs;
+		}
+	}
+	printf("%d errors\n", errors);
+	delete abs;
+	delete map;
+}
+
 void MyDisplayHandler(unsigned long windowID, tKeyboardModifier mod, char key)
 {
 	switch (key)
@@ -531,3 +868,110 @@ bool MyClickHandler(unsigned long windowID, int, int, point3d loc, tButtonType b
 	}
 	return false;
 }
+
+/** Counts the entries of a row-major matrix that differ from the reference **/
+template <typename T>
+static int CountMismatches(const std::vector<T> &lengths, const std::vector<double> &reference,
+						   int n, T infinity)
+{
+	if (lengths.size() != (size_t)n*n)
+		return n*n;
+	int mismatches = 0;
+	for (int x = 0; x < n; x++)
+	{
+		for (int y = 0; y < n; y++)
+		{
+			double expected = (x == y)?0:reference[x*n+y];
+			T value = (expected == DBL_MAX)?infinity:(T)expected;
+			if (lengths[x*n+y] != value)
+				mismatches++;
+		}
+	}
+	return mismatches;
+}
+
+/**
+ * Builds random undirected graphs with integer weights, so that every path
+ * length is exact in float and uint16_t, and two components, so that some
+ * pairs are unreachable. Their sizes cover the edges of the 64-node tiles.
+ * The blocked Floyd-Warshall (on 1 and 4 threads) and AllPairsDijkstra must
+ * match a plain triple loop exactly, as must the legacy interface, which
+ * keeps the shortest cycle through each node on the diagonal.
+ */
+void FloydWarshallCheck(int graphs)
+{
+	const int sizes[] = {1, 2, 63, 64, 65, 128, 129};
+	const int numSizes = sizeof(sizes)/sizeof(sizes[0]);
+	int errors = 0;
+	srandom(18);
+	for (int which = 0; which < graphs; which++)
+	{
+		int n = (which < numSizes)?sizes[which]:(int)(40+random()%211);
+		int split = (n*3+3)/4;
+		Graph *g = new Graph();
+		for (int x = 0; x < n; x++)
+			g->AddNode(new node(""));
+		for (int x = 0; x < 2*n && n > 1; x++)
+		{
+			int from = random()%n;
+			int first = (from < split)?0:split, size = (from < split)?split:(n-split);
+			int to = first+random()%size;
+			if (to != from)
+				g->AddEdge(new edge(from, to, 1+random()%20));
+		}
+
+		// the diagonal is left at infinity, so it ends up as the shortest cycle
+		std::vector<double> reference((size_t)n*n, DBL_MAX);
+		for (int x = 0; x < g->GetNumEdges(); x++)
+		{
+			edge *e = g->GetEdge(x);
+			int from = e->getFrom(), to = e->getTo();
+			reference[from*n+to] = std::min(reference[from*n+to], e->GetWeight());
+			reference[to*n+from] = std::min(reference[to*n+from], e->GetWeight());
+		}
+		for (int k = 0; k < n; k++)
+			for (int x = 0; x < n; x++)
+				for (int y = 0; y < n; y++)
+					if (reference[x*n+k] != DBL_MAX && reference[k*n+y] != DBL_MAX &&
+						reference[x*n+k]+reference[k*n+y] < reference[x*n+y])
+						reference[x*n+y] = reference[x*n+k]+reference[k*n+y];
+
+		std::vector<std::vector<double> > legacy;
+		FloydWarshall(g, legacy);
+		int legacyMismatches = 0;
+		for (int x = 0; x < n; x++)
+			for (int y = 0; y < n; y++)
+				if (legacy[x][y] != ((reference[x*n+y] == DBL_MAX)?1e10:reference[x*n+y]))
+					legacyMismatches++;
+
+		std::vector<float> floatLengths;
+		std::vector<uint16_t> shortLengths;
+		const float floatInf = std::numeric_limits<float>::infinity();
+		int mismatches[6];
+		FloydWarshall(g, floatLengths, 1);
+		mismatches[0] = CountMismatches(floatLengths, reference, n, floatInf);
+		FloydWarshall(g, floatLengths, 4);
+		mismatches[1] = CountMismatches(floatLengths, reference, n, floatInf);
+		FloydWarshall(g, shortLengths, 4);
+		mismatches[2] = CountMismatches(shortLengths, reference, n, (uint16_t)UINT16_MAX);
+		AllPairsDijkstra(g, floatLengths, 3);
+		mismatches[3] = CountMismatches(floatLengths, reference, n, floatInf);
+		AllPairsDijkstra(g, shortLengths, 2);
+		mismatches[4] = CountMismatches(shortLengths, reference, n, (uint16_t)UINT16_MAX);
+		mismatches[5] = legacyMismatches;
+
+		const char *names[6] = {"float", "float/4 threads", "uint16", "Dijkstra float",
+			"Dijkstra uint16", "legacy"};
+		for (int x = 0; x < 6; x++)
+		{
+			if (mismatches[x] > 0)
+			{
+				printf("Error: graph %d (%d nodes): %s has %d of %d entries wrong\n",
+					   which, n, names[x], mismatches[x], n*n);
+				errors++;
+			}
+		}
+		delete g;
+	}
+	printf("%d graphs, %d errors\n", graphs, errors);
+}
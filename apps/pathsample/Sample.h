@@ -31,5 +31,9 @@ void MyDisplayHandler(unsigned long windowID, tKeyboardModifier, char key);
 void MyPathfindingKeyHandler(unsigned long windowID, tKeyboardModifier, char key);
 void MyRandomUnitKeyHandler(unsigned long windowID, tKeyboardModifier, char key);
 int MyCLHandler(char *argument[], int maxNumArgs);
+void OpenListBenchmark(const char *scenario);
+void FrozenGraphBenchmark(const char *scenario);
+void ParallelThinkTest(const char *mapName);
+void FloydWarshallCheck(int graphs);
 bool MyClickHandler(unsigned long windowID, int x, int y, point3d loc, tButtonType, tMouseEventType);
 void InstallHandlers();
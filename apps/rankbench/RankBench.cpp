@@ -0,0 +1,263 @@
+//
+//  RankBench.cpp
+//  hog2 glut
+//
+//  Benchmarks the shared permutation ranking functions in PermutationRanking.h
+//  against the loops the environments used before (which are kept here as the
+//  reference), and checks that both produce identical ranks, since pattern
+//  databases on disk depend on them.
+//
+//  usage: rankbench [-count n] [-seed s]
+//
+//  Prints one line per test: the test, the time per call of the reference and
+//  the shared version, and whether every result matched.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "PermutationRanking.h"
+#include "Timer.h"
+
+/** Returns n!/k!, computed the way PermutationPuzzleEnvironment::buildCaches did **/
+static uint64_t ReferenceUpperk(int n, int k)
+{
+	uint64_t value = 1;
+	for (int i = n; i > k; i--)
+		value *= i;
+	return value;
+}
+
+/** The quadratic Lehmer ranking previously used by PermutationPuzzleEnvironment **/
+static uint64_t ReferencePartialRank(const int *items, int k, int n)
+{
+	int locs[maxRankItems];
+	memcpy(locs, items, k*sizeof(int));
+	uint64_t hashVal = 0;
+	int numEntriesLeft = n;
+	for (int x = 0; x < k; x++)
+	{
+		hashVal += locs[x]*ReferenceUpperk(numEntriesLeft-1, n-k);
+		numEntriesLeft--;
+		for (int y = x; y < k; y++)
+		{
+			if (locs[y] > locs[x])
+				locs[y]--;
+		}
+	}
+	return hashVal;
+}
+
+static void ReferencePartialUnrank(uint64_t hashVal, int *items, int k, int n)
+{
+	int numEntriesLeft = n-k+1;
+	for (int x = k-1; x >= 0; x--)
+	{
+		items[x] = hashVal%numEntriesLeft;
+		hashVal /= numEntriesLeft;
+		numEntriesLeft++;
+		for (int y = x+1; y < k; y++)
+		{
+			if (items[y] >= items[x])
+				items[y]++;
+		}
+	}
+}
+
+/** The Myrvold-Ruskey ranking previously used by RubiksCorner and RubikEdge **/
+static uint64_t ReferenceMRRank(int n, uint64_t perm, uint64_t dual)
+{
+	int ss[16];
+	int ssLoc = 0;
+	for (int i = n; i > 1; i--)
+	{
+		int s = GetPackedItem(perm, i-1);
+		ss[ssLoc++] = s;
+		int d = GetPackedItem(dual, i-1);
+		int a = GetPackedItem(perm, i-1), b = GetPackedItem(perm, d);
+		SetPackedItem(perm, i-1, b);
+		SetPackedItem(perm, d, a);
+		a = GetPackedItem(dual, s);
+		b = GetPackedItem(dual, i-1);
+		SetPackedItem(dual, s, b);
+		SetPackedItem(dual, i-1, a);
+	}
+	uint64_t result = 0;
+	int cnt = 2;
+	for (int i = ssLoc-1; i >= 0; i--)
+	{
+		result *= cnt;
+		result += ss[i];
+		cnt++;
+	}
+	return result;
+}
+
+/** The loop previously used by Fling::binomialSum **/
+static uint64_t ReferenceBinomialSum(int n1, int n2, int k)
+{
+	uint64_t result = 0;
+	for (int x = n1; x > n2; x--)
+		result += BinomialCoefficient(x, k);
+	return result;
+}
+
+struct rankTest {
+	const char *name;
+	int k, n;
+};
+
+static void Report(const char *test, const char *name, int k, int n, double refTime, double newTime, int count, bool same)
+{
+	printf("%-7s %-16s k=%2d n=%2d  reference %7.1f ns  shared %7.1f ns  %5.2fx  %s\n",
+		   test, name, k, n, 1e9*refTime/count, 1e9*newTime/count, refTime/newTime, same?"identical":"MISMATCH");
+}
+
+static bool TestPartial(const char *name, int k, int n, int count, std::mt19937_64 &r)
+{
+	std::vector<int> items(count*k);
+	std::vector<int> base(n);
+	for (int x = 0; x < n; x++)
+		base[x] = x;
+	for (int x = 0; x < count; x++)
+	{
+		std::shuffle(base.begin(), base.end(), r);
+		std::copy(base.begin(), base.begin()+k, &items[x*k]);
+	}
+	std::vector<uint64_t> ref(count), ranks(count);
+	Timer t;
+
+	t.StartTimer();
+	for (int x = 0; x < count; x++)
+		ref[x] = ReferencePartialRank(&items[x*k], k, n);
+	double refTime = t.EndTimer();
+	t.StartTimer();
+	for (int x = 0; x < count; x++)
+		ranks[x] = RankPartialPermutation(&items[x*k], k, n);
+	double newTime = t.EndTimer();
+	bool same = (ref == ranks);
+	Report("rank", name, k, n, refTime, newTime, count, same);
+
+	std::vector<int> out1(count*k), out2(count*k);
+	t.StartTimer();
+	for (int x = 0; x < count; x++)
+		ReferencePartialUnrank(ranks[x], &out1[x*k], k, n);
+	refTime = t.EndTimer();
+	t.StartTimer();
+	for (int x = 0; x < count; x++)
+		UnrankPartialPermutation(ranks[x], &out2[x*k], k, n);
+	newTime = t.EndTimer();
+	bool sameUnrank = (out1 == out2 && out2 == items);
+	Report("unrank", name, k, n, refTime, newTime, count, sameUnrank);
+	return same && sameUnrank;
+}
+
+static bool TestMR(int n, int count, std::mt19937_64 &r)
+{
+	std::vector<uint64_t> perms(count), duals(count);
+	std::vector<int> base(n);
+	for (int x = 0; x < n; x++)
+		base[x] = x;
+	for (int x = 0; x < count; x++)
+	{
+		std::shuffle(base.begin(), base.end(), r);
+		perms[x] = duals[x] = 0;
+		for (int y = 0; y < n; y++)
+		{
+			SetPackedItem(perms[x], y, base[y]);
+			SetPackedItem(duals[x], base[y], y);
+		}
+	}
+	std::vector<uint64_t> ref(count), ranks(count);
+	Timer t;
+	t.StartTimer();
+	for (int x = 0; x < count; x++)
+		ref[x] = ReferenceMRRank(n, perms[x], duals[x]);
+	double refTime = t.EndTimer();
+	t.StartTimer();
+	for (int x = 0; x < count; x++)
+		ranks[x] = MRRankPacked(n, perms[x], duals[x]);
+	double newTime = t.EndTimer();
+	bool same = (ref == ranks);
+	for (int x = 0; x < count && same; x++)
+	{
+		uint64_t perm = 0;
+		for (int y = 0; y < n; y++)
+			SetPackedItem(perm, y, y);
+		MRUnrankPacked(n, ranks[x], perm);
+		same = (perm == perms[x]);
+	}
+	Report("rank", "Myrvold-Ruskey", n, n, refTime, newTime, count, same);
+	return same;
+}
+
+static bool TestBinomialSum(int n, int count, std::mt19937_64 &r)
+{
+	std::vector<int> args(3*count);
+	for (int x = 0; x < count; x++)
+	{
+		args[3*x+0] = r()%n;
+		args[3*x+1] = r()%n;
+		args[3*x+2] = r()%14;
+	}
+	uint64_t refSum = 0, newSum = 0;
+	bool same = true;
+	Timer t;
+	t.StartTimer();
+	for (int x = 0; x < count; x++)
+		refSum += ReferenceBinomialSum(args[3*x], args[3*x+1], args[3*x+2]);
+	double refTime = t.EndTimer();
+	t.StartTimer();
+	for (int x = 0; x < count; x++)
+	{
+		int n1 = args[3*x], n2 = args[3*x+1], k = args[3*x+2];
+		if (n1 > n2)
+			newSum += BinomialCoefficient(n1+1, k+1)-BinomialCoefficient(n2+1, k+1);
+	}
+	double newTime = t.EndTimer();
+	same = (refSum == newSum);
+	Report("sum", "binomials", 14, n, refTime, newTime, count, same);
+	return same;
+}
+
+int main(int argc, char **argv)
+{
+	int count = 1000000;
+	uint64_t seed = 1;
+	for (int x = 1; x < argc; x++)
+	{
+		if (strcmp(argv[x], "-count") == 0 && x+1 < argc)
+			count = atoi(argv[++x]);
+		else if (strcmp(argv[x], "-seed") == 0 && x+1 < argc)
+			seed = strtoull(argv[++x], 0, 10);
+		else {
+			printf("usage: %s [-count n] [-seed s]\n", argv[0]);
+			exit(0);
+		}
+	}
+	std::mt19937_64 r(seed);
+	const rankTest tests[] = {
+		{"TopSpin/Pancake", 12, 12},
+		{"15-puzzle", 16, 16},
+		{"max", 20, 20},
+		{"15-puzzle PDB", 8, 16},
+		{"24-puzzle PDB", 6, 25},
+		{"24-puzzle PDB", 8, 25},
+		{"Pancake PDB", 10, 40},
+	};
+	bool ok = true;
+	for (unsigned int x = 0; x < sizeof(tests)/sizeof(tests[0]); x++)
+		ok = TestPartial(tests[x].name, tests[x].k, tests[x].n, count, r) && ok;
+	ok = TestMR(8, count, r) && ok;
+	ok = TestMR(12, count, r) && ok;
+	ok = TestBinomialSum(56, count, r) && ok;
+	if (!ok)
+	{
+		printf("Error: the shared ranking functions don't match the reference\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,255 @@
+//
+//  RepairBench.cpp
+//  hog2 glut
+//
+//  Benchmarks the incremental repair of MapSectorAbstraction and
+//  MinimalSectorAbstraction when terrain changes. Random tiles of a map are
+//  toggled between ground and out of bounds (like doors or destructible
+//  walls); after each batch of toggles both abstractions are repaired, and
+//  the time per repair is compared with building each abstraction again.
+//  At the end the repaired abstractions are checked against new ones built
+//  from the final map.
+//
+//  usage: repairbench [-toggles n] [-batch n] [-sector n] [-seed s] file.map
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "Map.h"
+#include "MapSectorAbstraction.h"
+#include "MinimalSectorAbstraction.h"
+#include "Timer.h"
+
+using namespace GraphAbstractionConstants;
+
+struct edgeKey {
+	long from, to, capacity;
+	double weight;
+	bool operator<(const edgeKey &e) const
+	{ return (from < e.from) || ((from == e.from) && (to < e.to)); }
+};
+
+/**
+ * Describes one level of the abstraction independently of node numbers: each
+ * node is named by the smallest tile under it, and is listed with the names
+ * of its children. Returns false if a parent and child don't refer to each
+ * other, or a tile doesn't refer to its node.
+ */
+static bool DescribeLevel(MapSectorAbstraction *msa, unsigned int level, std::vector<long> &names,
+						  std::vector<std::vector<long> > &nodes, std::vector<edgeKey> &edges)
+{
+	Map *m = msa->GetMap();
+	Graph *g = msa->GetAbstractGraph(level);
+	std::vector<long> childNames(names);
+	names.assign(g->GetNumNodes(), LONG_MAX);
+	nodes.resize(0);
+	for (int x = 0; x < g->GetNumNodes(); x++)
+	{
+		node *n = g->GetNode(x);
+		std::vector<long> desc;
+		if (level == 0)
+		{
+			long tx = n->GetLabelL(kFirstData), ty = n->GetLabelL(kFirstData+1);
+			long corner = n->GetLabelL(kFirstData+2);
+			if (m->GetNodeNum(tx, ty, (tCorner)corner) != x)
+				return false;
+			names[x] = (ty*m->GetMapWidth()+tx)*8+corner;
+		}
+		else {
+			for (int y = 0; y < msa->GetNumChildren(n); y++)
+			{
+				node *child = msa->GetNthChild(n, y);
+				if (child->GetLabelL(kParent) != x)
+					return false;
+				desc.push_back(childNames[child->GetNum()]);
+				names[x] = std::min(names[x], childNames[child->GetNum()]);
+			}
+		}
+		std::sort(desc.begin(), desc.end());
+		desc.insert(desc.begin(), names[x]);
+		nodes.push_back(desc);
+	}
+	std::sort(nodes.begin(), nodes.end());
+	edges.resize(0);
+	for (int x = 0; x < g->GetNumEdges(); x++)
+	{
+		edge *e = g->GetEdge(x);
+		edgeKey k;
+		k.from = std::min(names[e->getFrom()], names[e->getTo()]);
+		k.to = std::max(names[e->getFrom()], names[e->getTo()]);
+		k.capacity = e->GetLabelL(kEdgeCapacity);
+		k.weight = e->GetWeight();
+		edges.push_back(k);
+	}
+	std::sort(edges.begin(), edges.end());
+	return true;
+}
+
+static bool SameAbstraction(MapSectorAbstraction *a, MapSectorAbstraction *b)
+{
+	if (a->getNumAbstractGraphs() != b->getNumAbstractGraphs())
+	{
+		printf("%u levels after repair, %u after building\n", a->getNumAbstractGraphs(), b->getNumAbstractGraphs());
+		return false;
+	}
+	std::vector<long> aNames, bNames;
+	for (unsigned int level = 0; level < a->getNumAbstractGraphs(); level++)
+	{
+		std::vector<std::vector<long> > aNodes, bNodes;
+		std::vector<edgeKey> aEdges, bEdges;
+		if (!DescribeLevel(a, level, aNames, aNodes, aEdges) || !DescribeLevel(b, level, bNames, bNodes, bEdges))
+		{
+			printf("Level %u: inconsistent parent, child or tile links\n", level);
+			return false;
+		}
+		if (aNodes != bNodes)
+		{
+			printf("Level %u: nodes differ (%d after repair, %d after building)\n", level,
+				   (int)aNodes.size(), (int)bNodes.size());
+			return false;
+		}
+		bool same = (aEdges.size() == bEdges.size());
+		for (unsigned int x = 0; same && x < aEdges.size(); x++)
+		{
+			same = ((aEdges[x].from == bEdges[x].from) && (aEdges[x].to == bEdges[x].to) &&
+					(aEdges[x].capacity == bEdges[x].capacity) &&
+					(fabs(aEdges[x].weight-bEdges[x].weight) < 1e-6));
+		}
+		if (!same)
+		{
+			printf("Level %u: edges differ (%d after repair, %d after building)\n", level,
+				   (int)aEdges.size(), (int)bEdges.size());
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool SameAbstraction(MinimalSectorAbstraction *a, MinimalSectorAbstraction *b)
+{
+	if (a->GetNumSectors() != b->GetNumSectors())
+		return false;
+	std::vector<tempEdgeData> aEdges, bEdges;
+	for (int x = 0; x < a->GetNumSectors(); x++)
+	{
+		if (a->GetNumRegions(x) != b->GetNumRegions(x))
+		{
+			printf("Sector %d: %d regions after repair, %d after building\n", x,
+				   a->GetNumRegions(x), b->GetNumRegions(x));
+			return false;
+		}
+		for (int y = 0; y < a->GetNumRegions(x); y++)
+		{
+			unsigned int ax, ay, bx, by;
+			a->GetXYLocation(x, y, ax, ay);
+			b->GetXYLocation(x, y, bx, by);
+			a->GetNeighbors(x, y, aEdges);
+			b->GetNeighbors(x, y, bEdges);
+			if ((ax != bx) || (ay != by) || (aEdges != bEdges))
+			{
+				printf("Sector %d region %d differs\n", x, y);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	int toggles = 1000;
+	int batch = 1;
+	int sectors = 16;
+	unsigned int seed = 1;
+	const char *file = 0;
+	for (int x = 1; x < argc; x++)
+	{
+		if ((strcmp(argv[x], "-toggles") == 0) && (x+1 < argc))
+			toggles = atoi(argv[++x]);
+		else if ((strcmp(argv[x], "-batch") == 0) && (x+1 < argc))
+			batch = atoi(argv[++x]);
+		else if ((strcmp(argv[x], "-sector") == 0) && (x+1 < argc))
+			sectors = atoi(argv[++x]);
+		else if ((strcmp(argv[x], "-seed") == 0) && (x+1 < argc))
+			seed = (unsigned int)atoi(argv[++x]);
+		else if (argv[x][0] != '-')
+			file = argv[x];
+		else
+			file = 0, x = argc;
+	}
+	if ((file == 0) || (toggles < 1) || (batch < 1) || (sectors < 2))
+	{
+		printf("usage: %s [-toggles n] [-batch n] [-sector n] [-seed s] file.map\n", argv[0]);
+		exit(0);
+	}
+	srandom(seed);
+
+	Map *map = new Map(file);
+	printf("Map %s: %ld x %ld, sector size %d\n", file, map->GetMapWidth(), map->GetMapHeight(), sectors);
+	// the sector abstraction owns its map; the minimal abstraction only reads it
+	MapSectorAbstraction *msa = new MapSectorAbstraction(map, sectors);
+	MinimalSectorAbstraction *minimal = new MinimalSectorAbstraction(map, sectors);
+	printf("MapSectorAbstraction: %u levels, %d nodes at level 1\n", msa->getNumAbstractGraphs(),
+		   (msa->getNumAbstractGraphs() > 1)?msa->GetAbstractGraph(1)->GetNumNodes():0);
+
+	Timer t;
+	double sectorRepair = 0, minimalRepair = 0, worstSector = 0, worstMinimal = 0;
+	int repairs = 0;
+	for (int done = 0; done < toggles; )
+	{
+		for (int x = 0; x < batch && done < toggles; )
+		{
+			int tx = random()%map->GetMapWidth();
+			int ty = random()%map->GetMapHeight();
+			long terrain = map->GetTerrainType(tx, ty);
+			if ((terrain != kGround) && (terrain != kOutOfBounds))
+				continue;
+			map->SetTerrainType(tx, ty, (terrain == kGround)?kOutOfBounds:kGround);
+			msa->MarkTileChanged(tx, ty);
+			minimal->MarkTileChanged(tx, ty);
+			x++;
+			done++;
+		}
+		t.StartTimer();
+		msa->RepairAbstraction();
+		double elapsed = t.EndTimer();
+		sectorRepair += elapsed;
+		worstSector = std::max(worstSector, elapsed);
+		t.StartTimer();
+		minimal->RepairAbstraction();
+		elapsed = t.EndTimer();
+		minimalRepair += elapsed;
+		worstMinimal = std::max(worstMinimal, elapsed);
+		repairs++;
+	}
+
+	// build both again from the final map, to time and to compare against
+	t.StartTimer();
+	MapSectorAbstraction *built = new MapSectorAbstraction(new Map(map), sectors);
+	double sectorBuild = t.EndTimer();
+	t.StartTimer();
+	MinimalSectorAbstraction *minimalBuilt = new MinimalSectorAbstraction(map, sectors);
+	double minimalBuild = t.EndTimer();
+
+	printf("%d toggles in %d repairs of %d tiles\n", toggles, repairs, batch);
+	printf("MapSectorAbstraction:     repair %9.3f ms avg %9.3f ms worst, build %9.3f ms, %7.1fx\n",
+		   1000*sectorRepair/repairs, 1000*worstSector, 1000*sectorBuild, sectorBuild*repairs/sectorRepair);
+	printf("MinimalSectorAbstraction: repair %9.3f ms avg %9.3f ms worst, build %9.3f ms, %7.1fx\n",
+		   1000*minimalRepair/repairs, 1000*worstMinimal, 1000*minimalBuild, minimalBuild*repairs/minimalRepair);
+
+	bool sectorSame = SameAbstraction(msa, built);
+	bool minimalSame = SameAbstraction(minimal, minimalBuilt);
+	printf("MapSectorAbstraction %s, MinimalSectorAbstraction %s the abstraction built from the final map\n",
+		   sectorSame?"matches":"DOES NOT match", minimalSame?"matches":"DOES NOT match");
+
+	delete minimalBuilt;
+	delete built;
+	delete minimal;
+	delete msa;
+	return (sectorSame && minimalSame)?0:1;
+}
@@ -60,6 +60,9 @@ void GetInstanceFromStdin(RubiksState &start);
 
 bool readFromStdin = false;
 bool recording = false;
+// layout of the bloom filters that are built or loaded
+bloomLayout bloomType = kStandardBloom;
+bool bloomMMap = false;
 
 std::deque<RubiksAction> animateActions;
 
@@ -92,6 +95,8 @@ void InstallHandlers()
 
 	InstallCommandLineHandler(MyCLHandler, "-buildBloom", "-buildBloom <size> <#GB> <#hash> <dataloc>", "Build a bloom filter using a size/hash combo.");
 	InstallCommandLineHandler(MyCLHandler, "-buildMinBloom", "-buildMinBloom <#GB> <#hash> <maxDepth> <dataloc>", "Build a bloom filter using a size/hash combo.");
+	InstallCommandLineHandler(MyCLHandler, "-blockedBloom", "-blockedBloom", "Build/load cache-line blocked bloom filters (must come first).");
+	InstallCommandLineHandler(MyCLHandler, "-mmapBloom", "-mmapBloom", "Memory map blocked bloom filters instead of reading them (must come first).");
 	InstallCommandLineHandler(MyCLHandler, "-showStats", "-showStats <size> <#hash> <prefix>", "Print out bloom filter stats.");
 	
 	InstallCommandLineHandler(MyCLHandler, "-bloomSample", "-bloomSample <corner-prefix> <other-prefix> <8size> <8hash> <9size> <9hash>", "Use bloom filter + corner pdb. Pass data locations");
@@ -102,6 +107,7 @@ void InstallHandlers()
 	InstallCommandLineHandler(MyCLHandler, "-measure", "-measure interleave", "Measure loss from interleaving versus min");
 	InstallCommandLineHandler(MyCLHandler, "-extract", "-extract <file>", "Extract levels from <file>");
 	InstallCommandLineHandler(MyCLHandler, "-testBloom", "-testBloom <entires> <accuracy>", "Test bloom filter with <entries> total and given <accuracy>");
+	InstallCommandLineHandler(MyCLHandler, "-testDiskBitFile", "-testDiskBitFile <prefix>", "Compare random writes and reads through a DiskBitFile at <prefix> with memory, then exit");
 	InstallCommandLineHandler(MyCLHandler, "-testCompression", "-testCompression <factor> <type> <edgepdb> <cornerpdb>", "");
 	InstallCommandLineHandler(MyCLHandler, "-compress", "-compress <type [corner,n-edge,edge]> <input> <factor> <output>", "Compress provided pdb by a factor of <factor>");
 	InstallCommandLineHandler(MyCLHandler, "-pdb", "-pdb <edge> <corner>", "Run tests using edge and corner pdbs");
@@ -205,6 +211,7 @@ void BuildDepthBloomFilter(int size, float space, int numHash, const char *dataL
 void GetBloomStats(uint64_t size, int hash, const char *prefix);
 void BuildMinBloomFilter(float space, int numHash, int finalDepth, const char *dataLoc);
 void GetActionsFromStdin(std::vector<RubiksAction> &acts);
+void TestDiskBitFile(const char *prefix);
 
 int MyCLHandler(char *argument[], int maxNumArgs)
 {
@@ -257,6 +264,26 @@ int MyCLHandler(char *argument[], int maxNumArgs)
 		TestBloom2(atoi(argument[1]), atof(argument[2]));
 		exit(0);
 	}
+	else if (strcmp(argument[0], "-testDiskBitFile") == 0)
+	{
+		if (maxNumArgs < 2)
+		{
+			printf("Insufficient number of arguments\n");
+			exit(0);
+		}
+		TestDiskBitFile(argument[1]);
+		exit(0);
+	}
+	else if (strcmp(argument[0], "-blockedBloom") == 0)
+	{
+		bloomType = kBlockedBloom;
+		return 1;
+	}
+	else if (strcmp(argument[0], "-mmapBloom") == 0)
+	{
+		bloomMMap = true;
+		return 1;
+	}
 	else if (strcmp(argument[0], "-buildBloom") == 0)
 	{
 		BuildDepthBloomFilter(atoi(argument[1]), atof(argument[2]), atoi(argument[3]), argument[4]);
@@ -1085,7 +1112,7 @@ void BuildDepthBloomFilter(int size, float space, int numHash, const char *dataL
 	space = space*8*1024*1024*1024;
 	uint64_t depth9states = 11588911021ull;
 	
-	BloomFilter *bf = new BloomFilter(space, numHash, true, true);
+	BloomFilter *bf = new BloomFilter(space, numHash, true, true, bloomType);
 	printf("Approximate storage (%d): %llu bits (%1.2f MB / %1.2f GB)\n", size, bf->GetStorage(),
 		   bf->GetStorage()/8.0/1024.0/1024.0,
 		   bf->GetStorage()/8.0/1024.0/1024.0/1024.0);
@@ -1137,7 +1164,7 @@ void BuildMinBloomFilter(float space, int numHash, int finalDepth, const char *d
 	printf("Creating bloom filter using %2.1f GB of mem.\n", space);fflush(stdout);
 	space = space*8*1024*1024*1024;
 				
-	MinBloomFilter *bf = new MinBloomFilter(space, numHash, true, true);
+	MinBloomFilter *bf = new MinBloomFilter(space, numHash, true, true, bloomType);
 	printf("Approximate storage: %llu bits (%1.2f MB / %1.2f GB)\n", bf->GetStorage(),
 		   bf->GetStorage()*4.0/8.0/1024.0/1024.0,
 		   bf->GetStorage()*4.0/8.0/1024.0/1024.0/1024.0);
@@ -1185,6 +1212,54 @@ void BuildMinBloomFilter(float space, int numHash, int finalDepth, const char *d
 	delete bf;
 }
 
+/**
+ * Loads the depths of all edge states up to depth 7 into c.depthTable. The
+ * table is built from the depth files the first time and saved next to them.
+ */
+void LoadDepthTable(const char *depthPrefix)
+{
+	const int maxDepth = 8;
+	char name[255];
+	sprintf(name, "%sdepth-table-%d.dat", depthPrefix, maxDepth-1);
+	if (c.depthTable.Load(name))
+	{
+		printf("Loaded %llu entries from '%s' (%1.2f MB)\n", (unsigned long long)c.depthTable.GetNumEntries(), name,
+			   c.depthTable.GetMemoryUsage()/1024.0/1024.0);
+		return;
+	}
+
+	printf("Building hash table/bloom filter\n"); fflush(stdout);
+	for (int x = 0; x < maxDepth; x++)
+	{
+		sprintf(name, "%s12edge-depth-%d.dat", depthPrefix, x);
+		FILE *f = fopen(name, "r");
+		if (f == 0)
+		{
+			printf("Error opening %s; aborting!\n", name);
+			exit(0);
+		}
+		printf("Reading from '%s'\n", name);
+		fflush(stdout);
+		
+		uint64_t nextItem;
+		uint64_t count = 0;
+		while (fread(&nextItem, sizeof(uint64_t), 1, f) == 1)
+		{
+			if (0 != countBits(nextItem&0xFFF)%2)
+				nextItem ^= 1;
+			count++;
+			c.depthTable.Add(nextItem, x);
+		}
+		printf("%llu items read at depth %d\n", (unsigned long long)count, x);fflush(stdout);
+		fclose(f);
+	}
+	c.depthTable.Finalize();
+	printf("Depth table: %llu entries in %1.2f MB\n", (unsigned long long)c.depthTable.GetNumEntries(),
+		   c.depthTable.GetMemoryUsage()/1024.0/1024.0);
+	sprintf(name, "%sdepth-table-%d.dat", depthPrefix, maxDepth-1);
+	c.depthTable.Save(name);
+}
+
 void SampleBloomHeuristics(const char *cornerPDB, const char *depthPrefix, float size8, int hash8, float size9, int hash9)
 {
 	// setup corner pdb
@@ -1207,7 +1282,7 @@ void SampleBloomHeuristics(const char *cornerPDB, const char *depthPrefix, float
 		uint64_t size9filter = size9*1024ull*1024ull*1024ull*8ull;
 		
 		printf("Loading filter with %d GB of entries (%llu) and %d hashes\n", size8, size8filter, hash8);
-		c.depth8 = new BloomFilter(size8filter, hash8, depthPrefix);
+		c.depth8 = new BloomFilter(size8filter, hash8, depthPrefix, bloomType, bloomMMap);
 		printf("Approximate storage (%d): %llu bits (%1.2f MB / %1.2f GB)\n",
 			   8, c.depth8->GetStorage(),
 			   c.depth8->GetStorage()/8.0/1024.0/1024.0,
@@ -1215,7 +1290,7 @@ void SampleBloomHeuristics(const char *cornerPDB, const char *depthPrefix, float
 		printf("%d hashes being used\n", c.depth8->GetNumHash());
 		
 		printf("Loading filter with %d GB of entries (%llu) and %d hashes\n", size9, size9filter, hash9);
-		c.depth9 = new BloomFilter(size9filter, hash9, depthPrefix);
+		c.depth9 = new BloomFilter(size9filter, hash9, depthPrefix, bloomType, bloomMMap);
 		printf("Approximate storage (%d): %llu bits (%1.2f MB / %1.2f GB)\n",
 			   9, c.depth9->GetStorage(),
 			   c.depth9->GetStorage()/8.0/1024.0/1024.0,
@@ -1229,40 +1304,7 @@ void SampleBloomHeuristics(const char *cornerPDB, const char *depthPrefix, float
 	// load hash table / bloom filter data
 	if (1)
 	{
-		printf("Building hash table/bloom filter\n"); fflush(stdout);
-		RubikEdge e;
-		RubikEdgeState es;
-		for (int x = 0; x < 8; x++)
-		{
-			char name[255];
-			sprintf(name, "%s12edge-depth-%d.dat", depthPrefix, x);
-			FILE *f = fopen(name, "r");
-			if (f == 0)
-			{
-				printf("Error opening %s; aborting!\n", name);
-				exit(0);
-			}
-			printf("Reading from '%s'\n", name);
-			fflush(stdout);
-			
-			uint64_t nextItem;
-			uint64_t count = 0;
-			while (fread(&nextItem, sizeof(uint64_t), 1, f) == 1)
-			{
-				if (0 != countBits(nextItem&0xFFF)%2)
-					nextItem ^= 1;
-				if (x < 8)
-				{
-					count++;
-					c.depthTable[nextItem] = x;
-				}
-				else {
-					printf("Error; hit depth %d\n", x);
-				}
-			}
-			printf("%llu items read at depth %d\n", count, x);fflush(stdout);
-			fclose(f);
-		}
+		LoadDepthTable(depthPrefix);
 		
 	}
 	
@@ -1316,7 +1358,7 @@ void RunBloomFilterTest(const char *cornerPDB, const char *depthPrefix, float si
 		uint64_t size9filter = size9*1024ull*1024ull*1024ull*8ull;
 
 		printf("Loading filter with %d GB of entries (%llu) and %d hashes\n", size8, size8filter, hash8);
-		c.depth8 = new BloomFilter(size8filter, hash8, depthPrefix);
+		c.depth8 = new BloomFilter(size8filter, hash8, depthPrefix, bloomType, bloomMMap);
 		printf("Approximate storage (%d): %llu bits (%1.2f MB / %1.2f GB)\n",
 			   8, c.depth8->GetStorage(),
 			   c.depth8->GetStorage()/8.0/1024.0/1024.0,
@@ -1324,7 +1366,7 @@ void RunBloomFilterTest(const char *cornerPDB, const char *depthPrefix, float si
 		printf("%d hashes being used\n", c.depth8->GetNumHash());
 
 		printf("Loading filter with %d GB of entries (%llu) and %d hashes\n", size9, size9filter, hash9);
-		c.depth9 = new BloomFilter(size9filter, hash9, depthPrefix);
+		c.depth9 = new BloomFilter(size9filter, hash9, depthPrefix, bloomType, bloomMMap);
 		printf("Approximate storage (%d): %llu bits (%1.2f MB / %1.2f GB)\n",
 			   9, c.depth9->GetStorage(),
 			   c.depth9->GetStorage()/8.0/1024.0/1024.0,
@@ -1338,40 +1380,7 @@ void RunBloomFilterTest(const char *cornerPDB, const char *depthPrefix, float si
 	// load hash table / bloom filter data
 	if (1)
 	{
-		printf("Building hash table/bloom filter\n"); fflush(stdout);
-		RubikEdge e;
-		RubikEdgeState es;
-		for (int x = 0; x < 8; x++)
-		{
-			char name[255];
-			sprintf(name, "%s12edge-depth-%d.dat", depthPrefix, x);
-			FILE *f = fopen(name, "r");
-			if (f == 0)
-			{
-				printf("Error opening %s; aborting!\n", name);
-				exit(0);
-			}
-			printf("Reading from '%s'\n", name);
-			fflush(stdout);
-
-			uint64_t nextItem;
-			uint64_t count = 0;
-			while (fread(&nextItem, sizeof(uint64_t), 1, f) == 1)
-			{
-				if (0 != countBits(nextItem&0xFFF)%2)
-					nextItem ^= 1;
-				if (x < 8)
-				{
-					count++;
-					c.depthTable[nextItem] = x;
-				}
-				else {
-					printf("Error; hit depth %d\n", x);
-				}
-			}
-			printf("%llu items read at depth %d\n", count, x);fflush(stdout);
-			fclose(f);
-		}
+		LoadDepthTable(depthPrefix);
 
 	}
 	
@@ -1410,7 +1419,7 @@ void RunMinBloomFilterTest(const char *cornerPDB, const char *depthPrefix, float
 		printf("Creating bloom filter using %2.1f GB of mem.\n", space);fflush(stdout);
 		space = space*8*1024*1024*1024;
 		
-		MinBloomFilter *bf = new MinBloomFilter(space, numHash, depthPrefix);
+		MinBloomFilter *bf = new MinBloomFilter(space, numHash, depthPrefix, bloomType, bloomMMap);
 		printf("Approximate storage: %llu bits (%1.2f MB / %1.2f GB)\n", bf->GetStorage(),
 			   bf->GetStorage()*4.0/8.0/1024.0/1024.0,
 			   bf->GetStorage()*4.0/8.0/1024.0/1024.0/1024.0);
@@ -2144,3 +2153,114 @@ void TestMinBloom()
 	
 }
 
+/** The BITS-bit entry at index of a BitVector holding packed entries **/
+static int GetEntry(const BitVector &v, uint64_t index)
+{
+	int value = 0;
+	for (int x = 0; x < BITS; x++)
+		value |= v.Get(index*BITS+x)<<x;
+	return value;
+}
+
+static void SetEntry(BitVector &v, uint64_t index, int value)
+{
+	for (int x = 0; x < BITS; x++)
+		v.Set(index*BITS+x, (value>>x)&1);
+}
+
+/**
+ * Writes random entries through a DiskBitFile with a 2-page (8 MB) cache into
+ * three buckets of 18 MB in total, so pages are evicted and written back by
+ * the IO thread while other pages are read. Each batch of writes goes to a
+ * random region, each write followed by a read from another region, and the
+ * same entries are kept in BitVectors in memory. The files are then scanned
+ * with ReadChunk, which reads ahead, and compared with memory. Part way
+ * through the scan of a bucket, entries that are being read ahead are
+ * changed and written back, which must drop the stale read-ahead buffers.
+ * All of this is done twice.
+ */
+void TestDiskBitFile(const char *prefix)
+{
+	const int64_t chunkEntries = 1<<20;
+	const int numBatches = 200, batchSize = 5000;
+	const int64_t regionEntries = 1<<20; // aligned, so inside one 4 MB page
+	std::vector<bucketData> buckets(3);
+	buckets[0].theSize = 24*chunkEntries;
+	buckets[1].theSize = 9*chunkEntries;
+	buckets[2].theSize = 3*chunkEntries+7;
+	std::vector<BitVector *> memory;
+	for (unsigned int x = 0; x < buckets.size(); x++)
+	{
+		memory.push_back(new BitVector(buckets[x].theSize*BITS));
+		// Init fills the files with 0xFF
+		for (int64_t y = 0; y < buckets[x].theSize; y++)
+			SetEntry(*memory[x], y, (1<<BITS)-1);
+	}
+
+	DiskBitFile f(prefix, 2);
+	f.Init(buckets);
+	srandom(1776);
+	uint64_t errors = 0;
+	std::vector<uint8_t> chunk((chunkEntries*BITS+7)/8);
+	Timer t;
+	t.StartTimer();
+	for (int pass = 0; pass < 2; pass++)
+	{
+		uint64_t previous = errors;
+		for (int x = 0; x < numBatches; x++)
+		{
+			// each batch writes into one region and reads from another
+			int writeBucket = random()%buckets.size(), readBucket = random()%buckets.size();
+			int64_t writeStart = (random()%buckets[writeBucket].theSize)&~(regionEntries-1);
+			int64_t readStart = (random()%buckets[readBucket].theSize)&~(regionEntries-1);
+			int64_t writeSize = std::min(regionEntries, buckets[writeBucket].theSize-writeStart);
+			int64_t readSize = std::min(regionEntries, buckets[readBucket].theSize-readStart);
+			for (int y = 0; y < batchSize; y++)
+			{
+				int64_t offset = writeStart+random()%writeSize;
+				int value = random()%(1<<BITS);
+				f.WriteFileDepth(writeBucket, offset, value);
+				SetEntry(*memory[writeBucket], offset, value);
+
+				offset = readStart+random()%readSize;
+				if (f.ReadFileDepth(readBucket, offset) != GetEntry(*memory[readBucket], offset))
+					errors++;
+			}
+		}
+		f.CloseReadWriteFile();
+		for (unsigned int x = 0; x < buckets.size(); x++)
+		{
+			for (int64_t y = 0; y < buckets[x].theSize; y += chunkEntries)
+			{
+				// change entries that are being read ahead; writing them back
+				// must drop the stale read-ahead
+				if (y == 2*chunkEntries && y+2*chunkEntries <= buckets[x].theSize)
+				{
+					for (int z = 0; z < batchSize; z++)
+					{
+						int64_t offset = y+chunkEntries+random()%chunkEntries;
+						int value = random()%(1<<BITS);
+						f.WriteFileDepth(x, offset, value);
+						SetEntry(*memory[x], offset, value);
+					}
+					f.CloseReadWriteFile();
+				}
+				int count = (int)std::min(chunkEntries, buckets[x].theSize-y);
+				f.ReadChunk(x, y, count, &chunk[0]);
+				for (int z = 0; z < count; z++)
+				{
+					int value = (chunk[z*BITS/8]>>(BITS*(z%(8/BITS))))&((1<<BITS)-1);
+					if (value != GetEntry(*memory[x], y+z))
+						errors++;
+				}
+			}
+		}
+		printf("Pass %d: %llu entries differ from memory\n", pass, (unsigned long long)(errors-previous));
+	}
+	f.CloseReadFile();
+	printf("%1.2fs\n", t.EndTimer());
+	f.PrintIOStats();
+	printf("%llu errors\n", (unsigned long long)errors);
+	for (unsigned int x = 0; x < memory.size(); x++)
+		delete memory[x];
+}
@@ -0,0 +1,303 @@
+//
+//  ScenarioBench.cpp
+//  hog2 glut
+//
+//  A headless benchmark runner for grid path-finding. It loads one or more
+//  scenario files, solves every experiment with the chosen algorithm and
+//  prints one line of comma-separated values per query. Experiments are
+//  spread over a number of threads; each thread loads its own copy of the
+//  map and owns its own environment and search algorithm, so no search
+//  state is shared between threads.
+//
+//  usage: scenariobench [-alg name] [-threads n] file.scen [file.scen ...]
+//
+//  Scenario files refer to maps relative to the current directory, so the
+//  tool is normally run from the root of the repository.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "Map2DEnvironment.h"
+#include "TemplateAStar.h"
+#include "PEAStar.h"
+#include "MapFlatAbstraction.h"
+#include "ClusterAbstraction.h"
+#include "FringeSearch.h"
+#include "HPAStar.h"
+#include "ScenarioLoader.h"
+#include "Timer.h"
+
+enum benchAlgorithm {
+	kAStar,
+	kPEAStar,
+	kFringe,
+	kHPAStar
+};
+
+const char *algNames[] = { "astar", "peastar", "fringe", "hpastar" };
+const int numAlgorithms = 4;
+const int hpaClusterSize = 10;
+const char *hpaCacheDir = 0; // where HPA* abstractions are cached, if set
+
+struct queryResult {
+	uint64_t nodesExpanded;
+	double time;
+	double length;
+};
+
+/**
+ * All of the search state used by one thread. The map is reloaded whenever
+ * an experiment refers to a different map (or scale) than the last one.
+ */
+class BenchWorker {
+public:
+	BenchWorker(benchAlgorithm a);
+	~BenchWorker();
+	void LoadMap(const Experiment &e);
+	void Run(const Experiment &e, queryResult &r);
+private:
+	void Clear();
+	double GetPathLength(path *p);
+
+	benchAlgorithm alg;
+	std::string mapName;
+	int xScale, yScale;
+	Map *map;
+	MapAbstraction *abs; // owns map when used
+	MapEnvironment *env;
+
+	TemplateAStar<xyLoc, tDirection, MapEnvironment> astar;
+	PEAStar<xyLoc, tDirection, MapEnvironment> peastar;
+	FringeSearch fringe;
+	hpaStar hpa;
+	std::vector<xyLoc> thePath;
+};
+
+BenchWorker::BenchWorker(benchAlgorithm a)
+:alg(a), xScale(0), yScale(0), map(0), abs(0), env(0)
+{
+}
+
+BenchWorker::~BenchWorker()
+{
+	Clear();
+}
+
+void BenchWorker::Clear()
+{
+	delete env;
+	if (abs)
+		delete abs;
+	else
+		delete map;
+	env = 0;
+	abs = 0;
+	map = 0;
+}
+
+void BenchWorker::LoadMap(const Experiment &e)
+{
+	if (map != 0 && mapName == e.GetMapName() && xScale == e.GetXScale() && yScale == e.GetYScale())
+		return;
+	Clear();
+	mapName = e.GetMapName();
+	xScale = e.GetXScale();
+	yScale = e.GetYScale();
+	map = new Map(e.GetMapName());
+	if (xScale != kNoScaling)
+		map->Scale(xScale, yScale);
+	switch (alg)
+	{
+		case kFringe: abs = new MapFlatAbstraction(map); break;
+		case kHPAStar:
+		{
+			ClusterAbstraction *ca = new ClusterAbstraction(map, hpaClusterSize, hpaCacheDir);
+			hpa.setAbstraction(ca);
+			abs = ca;
+		}
+			break;
+		default: break;
+	}
+	env = new MapEnvironment(map);
+}
+
+/**
+ * Returns the cost of a path of map-level nodes using the environment's
+ * costs, so that the lengths are comparable across algorithms.
+ */
+double BenchWorker::GetPathLength(path *p)
+{
+	thePath.resize(0);
+	for (; p; p = p->next)
+	{
+		int x, y;
+		abs->GetTileFromNode(p->n, x, y);
+		thePath.push_back(xyLoc(x, y));
+	}
+	return env->GetPathLength(thePath);
+}
+
+void BenchWorker::Run(const Experiment &e, queryResult &r)
+{
+	LoadMap(e);
+	xyLoc start(e.GetStartX(), e.GetStartY()), goal(e.GetGoalX(), e.GetGoalY());
+	Timer t;
+	switch (alg)
+	{
+		case kAStar:
+			t.StartTimer();
+			astar.GetPath(env, start, goal, thePath);
+			r.time = t.EndTimer();
+			r.nodesExpanded = astar.GetNodesExpanded();
+			r.length = env->GetPathLength(thePath);
+			break;
+		case kPEAStar:
+			t.StartTimer();
+			peastar.GetPath(env, start, goal, thePath);
+			r.time = t.EndTimer();
+			r.nodesExpanded = peastar.GetNodesExpanded();
+			r.length = env->GetPathLength(thePath);
+			break;
+		case kFringe:
+		case kHPAStar:
+		{
+			SearchAlgorithm *sa = (alg == kFringe)?(SearchAlgorithm*)&fringe:(SearchAlgorithm*)&hpa;
+			node *from = abs->GetNodeFromMap(start.x, start.y);
+			node *to = abs->GetNodeFromMap(goal.x, goal.y);
+			t.StartTimer();
+			path *p = sa->GetPath(abs, from, to);
+			r.time = t.EndTimer();
+			r.nodesExpanded = sa->GetNodesExpanded();
+			r.length = GetPathLength(p);
+			delete p;
+		}
+			break;
+	}
+}
+
+void Usage()
+{
+	printf("usage: scenariobench [-alg name] [-threads n] [-hpacache dir] file.scen [file.scen ...]\n");
+	printf("algorithms:");
+	for (int x = 0; x < numAlgorithms; x++)
+		printf(" %s", algNames[x]);
+	printf("\n");
+	exit(1);
+}
+
+/**
+ * Calls func(t) on threads t = 0..numThreads-1 and waits for all of them.
+ */
+template <typename threadFunc>
+void RunOnThreads(int numThreads, threadFunc func)
+{
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads; t++)
+		threads.push_back(std::thread(func, t));
+	for (unsigned int t = 0; t < threads.size(); t++)
+		threads[t].join();
+}
+
+/**
+ * Solves all experiments in the scenario with the given number of threads.
+ * Threads claim experiments one at a time, so long and short queries are
+ * balanced automatically. Results are printed in scenario order once all
+ * threads are done, so the output doesn't depend on the number of threads.
+ */
+void RunScenario(const char *scenario, benchAlgorithm alg, int numThreads, std::vector<BenchWorker *> &workers)
+{
+	ScenarioLoader sl(scenario);
+	int count = sl.GetNumExperiments();
+	if (count == 0)
+	{
+		fprintf(stderr, "Error: no experiments in '%s'\n", scenario);
+		return;
+	}
+	std::vector<queryResult> results(count);
+	std::atomic<int> next(0);
+
+	// load the map (and build any abstraction) before timing the queries
+	RunOnThreads(numThreads, [&](int t) {
+		workers[t]->LoadMap(sl.GetNthExperiment(0));
+	});
+	Timer total;
+	total.StartTimer();
+	RunOnThreads(numThreads, [&](int t) {
+		for (int x = next++; x < count; x = next++)
+			workers[t]->Run(sl.GetNthExperiment(x), results[x]);
+	});
+	double elapsed = total.EndTimer();
+
+	for (int x = 0; x < count; x++)
+	{
+		Experiment e = sl.GetNthExperiment(x);
+		printf("%s,%d,%d,%s,%llu,%1.6f,%1.4f,%1.4f\n", scenario, x, e.GetBucket(), algNames[alg],
+			   (unsigned long long)results[x].nodesExpanded, results[x].time,
+			   results[x].length, e.GetDistance());
+	}
+	fprintf(stderr, "%s: %d queries in %1.3fs on %d threads (%1.1f queries/s)\n",
+			scenario, count, elapsed, numThreads, count/elapsed);
+}
+
+int main(int argc, char *argv[])
+{
+	benchAlgorithm alg = kAStar;
+	int numThreads = std::thread::hardware_concurrency();
+	std::vector<const char *> scenarios;
+	for (int x = 1; x < argc; x++)
+	{
+		if (strcmp(argv[x], "-alg") == 0 && x+1 < argc)
+		{
+			int which;
+			for (which = 0; which < numAlgorithms; which++)
+				if (strcmp(argv[x+1], algNames[which]) == 0)
+					break;
+			if (which == numAlgorithms)
+			{
+				fprintf(stderr, "Error: unknown algorithm '%s'\n", argv[x+1]);
+				Usage();
+			}
+			alg = (benchAlgorithm)which;
+			x++;
+		}
+		else if (strcmp(argv[x], "-threads") == 0 && x+1 < argc)
+		{
+			numThreads = atoi(argv[x+1]);
+			x++;
+		}
+		else if (strcmp(argv[x], "-hpacache") == 0 && x+1 < argc)
+		{
+			hpaCacheDir = argv[x+1];
+			x++;
+		}
+		else if (argv[x][0] == '-')
+			Usage();
+		else
+			scenarios.push_back(argv[x]);
+	}
+	if (scenarios.size() == 0)
+		Usage();
+	if (numThreads < 1)
+		numThreads = 1;
+
+	// workers (and the maps they have loaded) are kept across scenarios
+	std::vector<BenchWorker *> workers;
+	for (int t = 0; t < numThreads; t++)
+		workers.push_back(new BenchWorker(alg));
+	printf("scenario,index,bucket,algorithm,expanded,time,length,optimal\n");
+	for (unsigned int x = 0; x < scenarios.size(); x++)
+		RunScenario(scenarios[x], alg, numThreads, workers);
+	for (int t = 0; t < numThreads; t++)
+		delete workers[t];
+	return 0;
+}
+
+// the GLUT stub calls this; there is no window in this tool
+void renderScene()
+{
+}
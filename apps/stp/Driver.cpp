@@ -33,12 +33,21 @@
 #include "RandomUnit.h"
 #include "MNPuzzle.h"
 #include "IDAStar.h"
+#include "ParallelIDAStar.h"
+#include "ExternalBFS.h"
 #include "Timer.h"
+#include <signal.h>
+#include <sys/resource.h>
+#include "TemplateAStar.h"
+#include "BucketOpenClosed.h"
 
 void CompareToMinCompression();
 void CompareToSmallerPDB();
 
 void BuildSTP_PDB(unsigned long windowID, tKeyboardModifier , char);
+void OpenListBenchmark();
+void ParallelIDATest();
+void ExternalBFSTest();
 void STPTest(unsigned long , tKeyboardModifier , char);
 MNPuzzleState GetInstance(int which, bool weighted);
 void Test(MNPuzzle &mnp, const char *prefix);
@@ -90,6 +99,9 @@ void InstallHandlers()
 	InstallKeyboardHandler(BuildSTP_PDB, "Build STP PDBs", "Build PDBs for the STP", kNoModifier, 'a');
 
 	InstallCommandLineHandler(MyCLHandler, "-run", "-run", "Runs pre-set experiments.");
+	InstallCommandLineHandler(MyCLHandler, "-openListBench", "-openListBench", "Solves STP instances with A* using a binary heap and the bucket open list.");
+	InstallCommandLineHandler(MyCLHandler, "-parallelIDA", "-parallelIDA", "Checks parallel IDA* against IDA* on STP instances.");
+	InstallCommandLineHandler(MyCLHandler, "-externalBFS", "-externalBFS", "Checks the external BFS of the 8-puzzle against an in-memory BFS.");
 	
 	InstallWindowHandler(MyWindowHandler);
 
@@ -169,11 +181,91 @@ void MyFrameHandler(unsigned long windowID, unsigned int viewport, void *)
 
 int MyCLHandler(char *argument[], int maxNumArgs)
 {
+	if (strcmp(argument[0], "-openListBench") == 0)
+	{
+		OpenListBenchmark();
+		exit(0);
+	}
+	if (strcmp(argument[0], "-parallelIDA") == 0)
+	{
+		ParallelIDATest();
+		exit(0);
+	}
+	if (strcmp(argument[0], "-externalBFS") == 0)
+	{
+		ExternalBFSTest();
+		exit(0);
+	}
 	BuildSTP_PDB(0, kNoModifier, 'a');
 	exit(0);
 	return 2;
 }
 
+/**
+ * Solves random 4x4 instances with A* and Manhattan distance, first using
+ * a binary heap and then using the bucket open list. Weighted A* (w=1.3)
+ * f-costs don't fit the buckets, so there the bucket open list must fall
+ * back to a heap and expand exactly the same nodes.
+ */
+void OpenListBenchmark()
+{
+	MNPuzzle mnp(4, 4);
+	MNPuzzleState start(4, 4), goal(4, 4);
+	TemplateAStar<MNPuzzleState, slideDir, MNPuzzle> heapSearch;
+	TemplateAStar<MNPuzzleState, slideDir, MNPuzzle, BucketOpenClosed<MNPuzzleState, AStarCompare<MNPuzzleState> > > bucketSearch;
+	std::vector<MNPuzzleState> thePath;
+	std::vector<slideDir> acts;
+	double heapTime = 0, bucketTime = 0;
+	uint64_t heapNodes = 0, bucketNodes = 0;
+	Timer t;
+	const int numProblems = 50;
+	int weightedErrors = 0;
+	for (int x = 0; x < numProblems; x++)
+	{
+		srandom(x);
+		start.Reset();
+		for (int y = 0; y < 80; y++)
+		{
+			mnp.GetActions(start, acts);
+			mnp.ApplyAction(start, acts[random()%acts.size()]);
+		}
+
+		t.StartTimer();
+		heapSearch.GetPath(&mnp, start, goal, thePath);
+		heapTime += t.EndTimer();
+		heapNodes += heapSearch.GetNodesExpanded();
+		size_t heapLength = thePath.size();
+
+		t.StartTimer();
+		bucketSearch.GetPath(&mnp, start, goal, thePath);
+		bucketTime += t.EndTimer();
+		bucketNodes += bucketSearch.GetNodesExpanded();
+
+		if (heapLength != thePath.size())
+			printf("Error: problem %d has length %lu with the heap but %lu with buckets\n", x,
+				   (unsigned long)heapLength, (unsigned long)thePath.size());
+
+		heapSearch.SetWeight(1.3);
+		bucketSearch.SetWeight(1.3);
+		heapSearch.GetPath(&mnp, start, goal, thePath);
+		heapLength = thePath.size();
+		bucketSearch.GetPath(&mnp, start, goal, thePath);
+		if (heapLength != thePath.size() || heapSearch.GetNodesExpanded() != bucketSearch.GetNodesExpanded())
+		{
+			printf("Error: weighted problem %d has length %lu and %llu expansions with the heap but %lu and %llu with buckets\n", x,
+				   (unsigned long)heapLength, (unsigned long long)heapSearch.GetNodesExpanded(),
+				   (unsigned long)thePath.size(), (unsigned long long)bucketSearch.GetNodesExpanded());
+			weightedErrors++;
+		}
+		heapSearch.SetWeight(1);
+		bucketSearch.SetWeight(1);
+	}
+	printf("%d problems\n", numProblems);
+	printf("heap:   %1.3fs %llu nodes expanded\n", heapTime, (unsigned long long)heapNodes);
+	printf("bucket: %1.3fs %llu nodes expanded\n", bucketTime, (unsigned long long)bucketNodes);
+	printf("weighted A*: %d problems differ between the heap and the bucket fallback\n", weightedErrors);
+}
+
 void MyDisplayHandler(unsigned long windowID, tKeyboardModifier mod, char key)
 {
 	switch (key)
@@ -249,6 +341,252 @@ void GetSTPInstance(const MNPuzzle &ts, MNPuzzleState &theState, int which)
 	}
 }
 
+/**
+ * Solves STP instances with IDAStar and then with ParallelIDAStar on 1 to 4
+ * threads, and checks that every parallel solution is a valid path of the
+ * same (optimal) length. The threads share a small PDB, first stored with one
+ * byte per entry and then mod 3, so that concurrent lookups are exercised;
+ * both storages must expand the same nodes, so the times compare the lookups.
+ * The first four problems are also solved with TemplateAStar and the
+ * state-based IDAStar, which must expand the same nodes with both storages,
+ * and with TemplateAStar started from every state two moves from the start.
+ */
+void ParallelIDATest()
+{
+	MNPuzzle mnp(4, 4);
+	MNPuzzleState start(4, 4), goal(4, 4);
+	std::vector<int> tiles = {0, 1, 2, 3, 4, 5};
+	const char *pdbFile = "STP_0-5_pida.pdb";
+	mnp.Build_PDB(goal, tiles, pdbFile, std::thread::hardware_concurrency(), false);
+	remove(pdbFile);
+	goal.Reset(); // the build abstracts the goal
+	// the heuristic is the PDB alone, so IDA* can pass each node's h to its
+	// children and the mod 3 entries are decoded from it
+	mnp.StoreGoal(goal);
+	mnp.lookups.push_back({kLeafNode, 0, 0, 0});
+
+	IDAStar<MNPuzzleState, slideDir> ida;
+	ParallelIDAStar<MNPuzzleState, slideDir> pida;
+	TemplateAStar<MNPuzzleState, slideDir, MNPuzzle> astar;
+	pida.SetVerbose(false);
+	std::vector<slideDir> serialPath, parallelPath, acts;
+	std::vector<MNPuzzleState> statePath;
+	// decoded mod 3 entries are the 8-bit ones, so every search expands the same nodes
+	uint64_t expanded[10], astarExpanded[4], stateExpanded[4], multiExpanded[4];
+	int errors = 0;
+	for (int storage = 0; storage < 2; storage++)
+	{
+		if (storage == 1)
+			mnp.Convert_PDB_Storage(0, kPDB2BitMod3, false);
+		for (int x = 0; x < 10; x++)
+		{
+			srandom(x);
+			start.Reset();
+			for (int y = 0; y < 100; y++)
+			{
+				mnp.GetActions(start, acts);
+				mnp.ApplyAction(start, acts[random()%acts.size()]);
+			}
+			Timer t;
+			t.StartTimer();
+			ida.GetPath(&mnp, start, goal, serialPath);
+			printf("%s problem %d: length %d, IDA* %1.3fs", (storage == 0)?"8-bit":"mod 3",
+				   x, (int)serialPath.size(), t.EndTimer());
+			if (storage == 0)
+				expanded[x] = ida.GetNodesExpanded();
+			else if (ida.GetNodesExpanded() != expanded[x])
+			{
+				printf(" ERROR (%llu expanded, %llu with 8 bits)", (unsigned long long)ida.GetNodesExpanded(),
+					   (unsigned long long)expanded[x]);
+				errors++;
+			}
+			for (int threads = 1; threads <= 4; threads++)
+			{
+				pida.SetNumThreads(threads);
+				t.StartTimer();
+				pida.GetPath(&mnp, start, goal, parallelPath);
+				printf(", %d threads %1.3fs", threads, t.EndTimer());
+				MNPuzzleState s = start;
+				for (unsigned int y = 0; y < parallelPath.size(); y++)
+					mnp.ApplyAction(s, parallelPath[y]);
+				if (parallelPath.size() != serialPath.size() || !(s == goal))
+				{
+					printf(" ERROR (length %d)", (int)parallelPath.size());
+					errors++;
+				}
+			}
+			printf("\n");
+			// A* and state-based IDA* pass the parent's h to BatchHCost (easy problems only)
+			if (x < 4)
+			{
+				astar.GetPath(&mnp, start, goal, statePath);
+				uint64_t astarNodes = astar.GetNodesExpanded();
+				ida.GetPath(&mnp, start, goal, statePath);
+				if (storage == 0)
+				{
+					astarExpanded[x] = astarNodes;
+					stateExpanded[x] = ida.GetNodesExpanded();
+				}
+				else if (astarNodes != astarExpanded[x] || ida.GetNodesExpanded() != stateExpanded[x])
+				{
+					printf("ERROR: A*/IDA* on states %llu/%llu expanded, %llu/%llu with 8 bits\n",
+						   (unsigned long long)astarNodes, (unsigned long long)ida.GetNodesExpanded(),
+						   (unsigned long long)astarExpanded[x], (unsigned long long)stateExpanded[x]);
+					errors++;
+				}
+				// additional start states decode their children from their own h
+				astar.InitializeSearch(&mnp, start, goal, statePath);
+				std::vector<slideDir> moreActs;
+				mnp.GetActions(start, acts);
+				for (unsigned int a = 0; a < acts.size(); a++)
+				{
+					MNPuzzleState s = start;
+					mnp.ApplyAction(s, acts[a]);
+					mnp.GetActions(s, moreActs);
+					for (unsigned int b = 0; b < moreActs.size(); b++)
+					{
+						MNPuzzleState t = s;
+						mnp.ApplyAction(t, moreActs[b]);
+						if (!(t == start))
+							astar.AddAdditionalStartState(t);
+					}
+				}
+				while (!astar.DoSingleSearchStep(statePath))
+				{ }
+				if (storage == 0)
+					multiExpanded[x] = astar.GetNodesExpanded();
+				else if (astar.GetNodesExpanded() != multiExpanded[x])
+				{
+					printf("ERROR: A* from several starts %llu expanded, %llu with 8 bits\n",
+						   (unsigned long long)astar.GetNodesExpanded(), (unsigned long long)multiExpanded[x]);
+					errors++;
+				}
+			}
+		}
+	}
+	printf("%d errors\n", errors);
+}
+
+/**
+ * Runs the external BFS of the 8-puzzle on 1 to 4 threads and checks the
+ * size of every layer against an in-memory BFS. Half of the 9! permutations
+ * (181440 states) can be reached. The sort runs are small, so most buckets
+ * are sorted externally. Searches whose files can't be written must fail.
+ */
+void ExternalBFSTest()
+{
+	MNPuzzle mnp(3, 3);
+	MNPuzzleState start(3, 3), s(3, 3);
+	std::vector<MNPuzzleState> succ;
+	const uint64_t kReachable = 181440;
+
+	// in-memory BFS; the hash is a perfect ranking of the 9! permutations
+	std::vector<uint8_t> depth(362880, 255);
+	std::vector<uint64_t> memoryLayers;
+	std::vector<uint64_t> curr, next;
+	curr.push_back(mnp.GetStateHash(start));
+	depth[curr[0]] = 0;
+	while (curr.size() > 0)
+	{
+		memoryLayers.push_back(curr.size());
+		next.resize(0);
+		for (unsigned int x = 0; x < curr.size(); x++)
+		{
+			mnp.GetStateFromHash(curr[x], s);
+			mnp.GetSuccessors(s, succ);
+			for (unsigned int y = 0; y < succ.size(); y++)
+			{
+				uint64_t hash = mnp.GetStateHash(succ[y]);
+				if (depth[hash] == 255)
+				{
+					depth[hash] = memoryLayers.size();
+					next.push_back(hash);
+				}
+			}
+		}
+		curr.swap(next);
+	}
+
+	int errors = 0;
+	for (int threads = 1; threads <= 4; threads++)
+	{
+		ExternalBFS<MNPuzzleState, slideDir, MNPuzzle> ebfs("stp_ebfs", 16);
+		ebfs.SetNumThreads(threads);
+		ebfs.SetSortMemory(1000);
+		ebfs.SetVerbose(false);
+		Timer t;
+		t.StartTimer();
+		uint64_t total = ebfs.DoBFS(&mnp, start);
+		const std::vector<uint64_t> &layers = ebfs.GetLayerSizes();
+		printf("%d threads: %llu states in %d layers, %1.2fs", threads, (unsigned long long)total,
+			   (int)layers.size(), t.EndTimer());
+		if (total != kReachable || layers != memoryLayers)
+		{
+			printf(" ERROR (%llu states in %d layers expected)", (unsigned long long)kReachable, (int)memoryLayers.size());
+			errors++;
+		}
+		printf("\n");
+	}
+
+	// a search that can't write its files must fail instead of reporting
+	// a partial count: first the files can't be created at all, then writes
+	// start failing part way through (files are limited to 4KB)
+	for (int test = 0; test < 2; test++)
+	{
+		ExternalBFS<MNPuzzleState, slideDir, MNPuzzle> ebfs(test == 0?"stp_ebfs_missing/ebfs":"stp_ebfs", 16);
+		ebfs.SetSortMemory(1000);
+		ebfs.SetVerbose(false);
+		struct rlimit old, limit;
+		getrlimit(RLIMIT_FSIZE, &old);
+		void (*oldHandler)(int) = signal(SIGXFSZ, SIG_IGN);
+		if (test == 1)
+		{
+			limit = old;
+			limit.rlim_cur = 4096;
+			setrlimit(RLIMIT_FSIZE, &limit);
+		}
+		uint64_t total = ebfs.DoBFS(&mnp, start);
+		setrlimit(RLIMIT_FSIZE, &old);
+		signal(SIGXFSZ, oldHandler);
+		printf("%s: %llu states, %s", (test == 0)?"Missing directory":"4KB file limit",
+			   (unsigned long long)total, ebfs.Failed()?"failed":"succeeded");
+		if (total != 0 || !ebfs.Failed())
+		{
+			printf(" ERROR (failure expected)");
+			errors++;
+		}
+		printf("\n");
+	}
+	// the sort must report a failed write of its output
+	{
+		UInt64Writer w;
+		w.Open("stp_ebfs-sort.dat");
+		for (uint64_t x = 0; x < 2000; x++)
+			w.Add((x*7919)%2000);
+		w.Close();
+		struct rlimit old, limit;
+		getrlimit(RLIMIT_FSIZE, &old);
+		void (*oldHandler)(int) = signal(SIGXFSZ, SIG_IGN);
+		limit = old;
+		limit.rlim_cur = 4096;
+		setrlimit(RLIMIT_FSIZE, &limit);
+		int64_t result = SortUniqueFile("stp_ebfs-sort.dat", "stp_ebfs-sorted.dat",
+										std::vector<std::string>(), 1<<16, "stp_ebfs-sort");
+		setrlimit(RLIMIT_FSIZE, &old);
+		signal(SIGXFSZ, oldHandler);
+		remove("stp_ebfs-sort.dat");
+		remove("stp_ebfs-sorted.dat");
+		printf("Sort with 4KB file limit: %lld", (long long)result);
+		if (result != -1)
+		{
+			printf(" ERROR (failure expected)");
+			errors++;
+		}
+		printf("\n");
+	}
+	printf("%d errors\n", errors);
+}
+
 void BuildSTP_PDB(unsigned long windowID, tKeyboardModifier , char)
 {
 //	MNPuzzle mnp(4, 4);
@@ -630,6 +630,22 @@ uint64_t Directional2DEnvironment::GetStateHash(const xySpeedHeading &node) cons
 	return hval;
 }
 
+void Directional2DEnvironment::GetStateFromHash(uint64_t hash, xySpeedHeading &node) const
+{
+	if (motionModel == kBetterTank)
+	{
+		node.x = hash>>32;
+		node.y = (hash>>16)&0xFFFF;
+		node.rotation = hash&0xFFFF;
+		node.speed = 0;
+		return;
+	}
+	node.x = (hash>>48)/4;
+	node.y = ((hash>>32)&0xFFFF)/4;
+	node.rotation = (hash>>8)&0xFF;
+	node.speed = (int)(hash&0xFF)-4;
+}
+
 uint64_t Directional2DEnvironment::GetActionHash(deltaSpeedHeading act) const
 {
 	return ((act.turn+4)<<8)+(act.speed+4);
@@ -135,6 +135,8 @@ public:
 	bool GoalTest(const xySpeedHeading &node, const xySpeedHeading &goal);
 	bool GoalTest(const xySpeedHeading &) { assert(false); return false; }
 	uint64_t GetStateHash(const xySpeedHeading &node) const;
+	/** The hash only keeps the cell a state is in, so x and y come back as whole numbers **/
+	void GetStateFromHash(uint64_t hash, xySpeedHeading &node) const;
 	uint64_t GetActionHash(deltaSpeedHeading act) const;
 	virtual void OpenGLDraw() const;
 	virtual void OpenGLDraw(const xySpeedHeading &l) const;
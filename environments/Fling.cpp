@@ -8,6 +8,7 @@
  */
 
 #include "Fling.h"
+#include "PermutationRanking.h"
 #include <stdint.h>
 #include <string.h>
 #include <algorithm>
@@ -366,8 +367,6 @@ Fling::Fling()
 {
 	specificGoalLoc = false;
 	specificGoalPanda = false;
-	initBinomial();
-	//		initBinomialSums();
 }
 
 void Fling::SetGoalPanda(int which)
@@ -1023,55 +1022,20 @@ bool Fling::unrankPlayer(int64_t theRank, int pieces, FlingBoard &s)
 //	}
 //}
 //
+/**
+ * Returns the sum of (x choose k) for n2 < x <= n1, which by the hockey-stick
+ * identity is (n1+1 choose k+1) - (n2+1 choose k+1).
+ */
 int64_t Fling::binomialSum(unsigned int n1, unsigned int n2, unsigned int k)
 {
-	//	static std::vector<std::vector<int64_t> > sums;
-	//assert(theSums[k*(NUM_SPOTS+1)+n1]-theSums[k*(NUM_SPOTS+1)+n2] == sums[k][n1]-sums[k][n2]);
-	int64_t result = 0;
-	for (int x = n1; x > n2; x--)
-		result += binomial(x, k);
-	return result;
-	//return theSums[k*(NUM_SPOTS+1)+n1]-theSums[k*(NUM_SPOTS+1)+n2];
-	//return sums[k][n1]-sums[k][n2];
-}
-
-const int maxPieces = 14;
-
-void Fling::initBinomial()
-{
-	if (binomials.size() == 0)
-	{
-		for (int x = 0; x <= 56; x++)
-		{
-			for (int y = 0; y <= maxPieces; y++)
-			{
-				binomials.push_back(bi(x, y));
-			}
-		}
-	}
+	if (n1 <= n2)
+		return 0;
+	return BinomialCoefficient(n1+1, k+1)-BinomialCoefficient(n2+1, k+1);
 }
 
 int64_t Fling::binomial(unsigned int n, unsigned int k)
 {
-	//assert(bi(n, k) == binomials[n*(1+NUM_PLAYERS*NUM_PIECES)+k]);
-	return binomials[n*(1+maxPieces)+k];
-}
-
-int64_t Fling::bi(unsigned int n, unsigned int k)
-{
-	int64_t num = 1;
-	const unsigned int bound = (n - k);
-	while(n > bound)
-	{
-		num *= n--;
-	}
-	
-	int64_t den = 1;
-	while(k > 1)
-	{
-		den *= k--;
-	}
-	return num / den;
+	return BinomialCoefficient(n, k);
 }
 
 
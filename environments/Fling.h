@@ -178,9 +178,7 @@ public:
 
 //	void initBinomialSums();
 	int64_t binomialSum(unsigned int n1, unsigned int n2, unsigned int k);
-	void initBinomial();
 	int64_t binomial(unsigned int n, unsigned int k);
-	int64_t bi(unsigned int n, unsigned int k);
 
 	
 	virtual void OpenGLDraw() const {}
@@ -196,6 +194,5 @@ private:
 	bool specificGoalPanda;
 	int goalLoc;
 	std::vector<int64_t> theSums;
-	std::vector<int64_t> binomials;
 
 };
@@ -11,6 +11,9 @@
 #include "GLUtil.h"
 #include "Heap.h"
 #include "FloydWarshall.h"
+#include <thread>
+#include <queue>
+#include <float.h>
 
 using namespace GraphSearchConstants;
 
@@ -23,6 +26,7 @@ GraphEnvironment::GraphEnvironment(Graph *_g, GraphHeuristic *gh)
 {
 	m = 0;
  	directed = false;
+	frozen = false;
 }
 
 GraphEnvironment::GraphEnvironment(Map *_m, Graph *_g, GraphHeuristic *gh)
@@ -30,6 +34,7 @@ GraphEnvironment::GraphEnvironment(Map *_m, Graph *_g, GraphHeuristic *gh)
 {
 	m = _m;
  	directed = false;
+	frozen = false;
 }
 
 //GraphEnvironment::GraphEnvironment(Map *m)
@@ -47,8 +52,32 @@ GraphEnvironment::~GraphEnvironment()
 //	delete h;
 }
 
+void GraphEnvironment::FreezeGraph()
+{
+	csr.Build(g, kXCoordinate, kYCoordinate, kZCoordinate);
+	uniqueIDs.resize(g->GetNumNodes());
+	for (unsigned int x = 0; x < uniqueIDs.size(); x++)
+		uniqueIDs[x] = g->GetNode(x)->getUniqueID();
+	frozen = true;
+}
+
+void GraphEnvironment::UnfreezeGraph()
+{
+	csr.Clear();
+	uniqueIDs.clear();
+	frozen = false;
+}
+
 int GraphEnvironment::GetNumSuccessors(const graphState &stateID) const
 {
+	if (frozen)
+	{
+		if (stateID >= csr.GetNumNodes())
+			return 0;
+		if (directed)
+			return csr.OutEnd(stateID)-csr.OutBegin(stateID);
+		return csr.AllEnd(stateID)-csr.AllBegin(stateID);
+	}
 	node *n = g->GetNode(stateID);
 	
 	if (n == 0)
@@ -66,6 +95,21 @@ int GraphEnvironment::GetNumSuccessors(const graphState &stateID) const
 void GraphEnvironment::GetSuccessors(const graphState &stateID, std::vector<graphState> &neighbors) const
 {
 	neighbors.resize(0);
+	if (frozen)
+	{
+		if (stateID >= csr.GetNumNodes())
+			return;
+		if (directed)
+		{
+			for (uint32_t e = csr.OutBegin(stateID); e < csr.OutEnd(stateID); e++)
+				neighbors.push_back(csr.OutTarget(e));
+		}
+		else {
+			for (uint32_t e = csr.AllBegin(stateID); e < csr.AllEnd(stateID); e++)
+				neighbors.push_back(csr.AllNeighbor(e));
+		}
+		return;
+	}
 	node *n = g->GetNode(stateID);
 
 	if (n == 0)
@@ -96,6 +140,21 @@ void GraphEnvironment::GetSuccessors(const graphState &stateID, std::vector<grap
 void GraphEnvironment::GetActions(const graphState &stateID, std::vector<graphMove> &actions) const
 {
 	actions.resize(0);
+	if (frozen)
+	{
+		if (stateID >= csr.GetNumNodes())
+			return;
+		if (directed)
+		{
+			for (uint32_t e = csr.OutBegin(stateID); e < csr.OutEnd(stateID); e++)
+				actions.push_back(graphMove(stateID, csr.OutTarget(e)));
+		}
+		else {
+			for (uint32_t e = csr.AllBegin(stateID); e < csr.AllEnd(stateID); e++)
+				actions.push_back(graphMove(stateID, csr.AllNeighbor(e)));
+		}
+		return;
+	}
 	node *n = g->GetNode(stateID);
 
 	if (n == 0)
@@ -140,6 +199,11 @@ bool GraphEnvironment::InvertAction(graphMove &a) const
 	uint32_t tmp = a.from;
 	a.from = a.to;
 	a.to = tmp;
+	if (frozen)
+	{
+		double weight;
+		return csr.FindDirectedEdge(a.from, a.to, weight);
+	}
 	if (g->findDirectedEdge(a.from, a.to))
 		return true;
 	return false;
@@ -156,6 +220,13 @@ double GraphEnvironment::HCost(const graphState &state1, const graphState &state
 
 double GraphEnvironment::GCost(const graphState &, const graphMove &move)
 {
+	if (frozen)
+	{
+		double weight = 0;
+		bool found = csr.FindEdge(move.from, move.to, weight);
+		assert(found);
+		return weight;
+	}
 	edge *e = g->FindEdge(move.from, move.to);
 	assert(e);
 	return e->GetWeight();
@@ -163,6 +234,13 @@ double GraphEnvironment::GCost(const graphState &, const graphMove &move)
 
 double GraphEnvironment::GCost(const graphState &state1, const graphState &state2)
 {
+	if (frozen)
+	{
+		double weight = 0;
+		bool found = csr.FindEdge(state1, state2, weight);
+		assert(found);
+		return weight;
+	}
 	edge *e = g->FindEdge(state1, state2);
 //	if (!e)
 //		return -1000.0;
@@ -177,11 +255,15 @@ bool GraphEnvironment::GoalTest(const graphState &state, const graphState &goal)
 
 uint64_t GraphEnvironment::GetStateHash(const graphState &state) const
 {
+	if (frozen)
+		return uniqueIDs[state];
 	return g->GetNode(state)->getUniqueID();
 }
 
 uint64_t GraphEnvironment::GetActionHash(graphMove act) const
 {
+	if (frozen)
+		return (uniqueIDs[act.from]<<16)|(uniqueIDs[act.to]);
 	return (g->GetNode(act.from)->getUniqueID()<<16)|
 	(g->GetNode(act.to)->getUniqueID());
 }
@@ -610,23 +692,22 @@ double GraphMapInconsistentHeuristic::HCost(const graphState &state1, const grap
 	//for (unsigned int x = 0; x < heuristics.size(); x++)
 	if (hmode == kRandom)
 	{
-		int x = (x1+x2+y1+y2)%heuristics.size();
+		int x = (x1+x2+y1+y2)%table.GetNumLandmarks();
 		for (int y = 0; y < numHeuristics; y++)
 		{
-			int offset = heuristics.size()/numHeuristics;
-			double hval = heuristics[(x+y*offset)%heuristics.size()][state1]-heuristics[(x+y*offset)%heuristics.size()][state2];
-			if (hval < 0) hval = -hval;
+			int offset = table.GetNumLandmarks()/numHeuristics;
+			double hval = table.HCost((x+y*offset)%table.GetNumLandmarks(), state1, state2);
 			if (fgreater(hval, val))
 				val = hval;
 		}
 	}
 	else if (hmode == kMax) // hmode == 2, taking the max
 	{
-		for (unsigned int i = 0; i < heuristics.size() && i < (unsigned int)numHeuristics; i++)
+		if ((unsigned int)numHeuristics >= table.GetNumLandmarks())
+			return max(val, table.HCost(state1, state2));
+		for (unsigned int i = 0; i < (unsigned int)numHeuristics; i++)
 		{
-			double hval = heuristics[i][state1]-heuristics[i][state2];
-			if (hval < 0)
-				hval = -hval;
+			double hval = table.HCost(i, state1, state2);
 			if (fgreater(hval,val))
 				val = hval;
 		}
@@ -635,11 +716,9 @@ double GraphMapInconsistentHeuristic::HCost(const graphState &state1, const grap
 	{
 		if ( (x1+x2) % 4 == 0 && (y1+y2) % 4 == 0)
 		{
-			for (unsigned int i=0;i<heuristics.size();i++)
+			for (unsigned int i=0;i<table.GetNumLandmarks();i++)
 			{
-				double hval = heuristics[i][state1]-heuristics[i][state2];
-				if (hval < 0)
-					hval = -hval;
+				double hval = table.HCost(i, state1, state2);
 				if (fgreater(hval,val))
 					val = hval;
 			}
@@ -662,23 +741,23 @@ double GraphMapInconsistentHeuristic::HCost(const graphState &state1, const grap
 		
 		if (compressed)
 		{
-			for (unsigned int x = 0; x < heuristics.size(); x++)
+			for (unsigned int x = 0; x < table.GetNumLandmarks(); x++)
 			{
-				double hval = vals[x*numHeuristics+state1%numHeuristics]-heuristics[x][state1];
+				double hval = vals[x*numHeuristics+state1%numHeuristics]-table.Get(x, state1);
 				if (hval < 0)
 					hval = -hval;
-				hval -= errors[x*numHeuristics+state1%numHeuristics];
+				hval -= errors[x*numHeuristics+state1%numHeuristics]+table.GetErrorBound();
 				if (fgreater(hval,val))
 					val = hval;
 			}
 		}
 		else {
-			for (unsigned int x = (state1%numHeuristics); x < heuristics.size(); x+=numHeuristics)
+			for (unsigned int x = (state1%numHeuristics); x < table.GetNumLandmarks(); x+=numHeuristics)
 			{
-				double hval = vals[x]-heuristics[x][state1];
+				double hval = vals[x]-table.Get(x, state1);
 				if (hval < 0)
 					hval = -hval;
-				hval -= errors[x];
+				hval -= errors[x]+table.GetErrorBound();
 				if (fgreater(hval,val))
 					val = hval;
 			}
@@ -694,15 +773,15 @@ void GraphMapInconsistentHeuristic::Compress()
 	hmode = kCompressed;
 	compressed = true;
 
-	for (unsigned int state1 = 0; state1 < heuristics[0].size(); state1++)
+	for (unsigned int state1 = 0; state1 < table.GetNumNodes(); state1++)
 	{
-		for (unsigned int x = (state1%numHeuristics), y = 0; x < heuristics.size(); x+=numHeuristics, y++)
+		for (unsigned int x = (state1%numHeuristics), y = 0; x < table.GetNumLandmarks(); x+=numHeuristics, y++)
 		{
-			heuristics[y][state1] = heuristics[x][state1];
+			table.Set(y, state1, table.Get(x, state1));
 		}
 	}
-	assert((heuristics.size()%numHeuristics) == 0);
-	heuristics.resize(heuristics.size()/numHeuristics);
+	assert((table.GetNumLandmarks()%numHeuristics) == 0);
+	table.SetNumLandmarks(table.GetNumLandmarks()/numHeuristics);
 }
 
 void GraphMapInconsistentHeuristic::FillInCache(std::vector<double> &vals,
@@ -711,15 +790,15 @@ void GraphMapInconsistentHeuristic::FillInCache(std::vector<double> &vals,
 {
 	int unused;
 	if (numHeuristics == 0)
-		numHeuristics = heuristics.size();
+		numHeuristics = table.GetNumLandmarks();
 	if (!compressed)
 	{
-		unused = heuristics.size(); // set these values to the uncompressed size
-		vals.resize(heuristics.size());
-		errors.resize(heuristics.size());
+		unused = table.GetNumLandmarks(); // set these values to the uncompressed size
+		vals.resize(table.GetNumLandmarks());
+		errors.resize(table.GetNumLandmarks());
 	}
 	else {
-		unused = numHeuristics*heuristics.size();
+		unused = numHeuristics*table.GetNumLandmarks();
 		vals.resize(unused);
 		errors.resize(unused);
 	}
@@ -734,17 +813,17 @@ void GraphMapInconsistentHeuristic::FillInCache(std::vector<double> &vals,
 
 	if (!compressed)
 	{
-		for (unsigned int x = (state2%numHeuristics); x < heuristics.size(); x+=numHeuristics)
+		for (unsigned int x = (state2%numHeuristics); x < table.GetNumLandmarks(); x+=numHeuristics)
 		{
-			vals[x] = heuristics[x][state2];
+			vals[x] = table.Get(x, state2);
 			errors[x] = 0;
 			unused--;
 		}
 	}
 	else {
-		for (unsigned int x = 0; x < heuristics.size(); x++)
+		for (unsigned int x = 0; x < table.GetNumLandmarks(); x++)
 		{
-			vals[x*numHeuristics+state2%numHeuristics] = heuristics[x][state2];
+			vals[x*numHeuristics+state2%numHeuristics] = table.Get(x, state2);
 			errors[x*numHeuristics+state2%numHeuristics] = 0;
 			unused--;
 		}
@@ -762,23 +841,23 @@ void GraphMapInconsistentHeuristic::FillInCache(std::vector<double> &vals,
 
 			if (compressed)
 			{
-				for (unsigned int x = 0; x < heuristics.size(); x++)
+				for (unsigned int x = 0; x < table.GetNumLandmarks(); x++)
 				{
 					if (vals[x*numHeuristics+tmp%numHeuristics] == -1)
 					{
 						unused--;
-						vals[x*numHeuristics+tmp%numHeuristics] = heuristics[x][tmp];
+						vals[x*numHeuristics+tmp%numHeuristics] = table.Get(x, tmp);
 						errors[x*numHeuristics+tmp%numHeuristics] = cost+edgeCost;
 					}
 				}
 			}
 			else {
-				for (unsigned int x = (tmp%numHeuristics); x < heuristics.size(); x+=numHeuristics)
+				for (unsigned int x = (tmp%numHeuristics); x < table.GetNumLandmarks(); x+=numHeuristics)
 				{
 					if (vals[x] == -1)
 					{
 						unused--;
-						vals[x] = heuristics[x][tmp];
+						vals[x] = table.Get(x, tmp);
 						errors[x] = cost+edgeCost;
 					}
 				}
@@ -806,7 +885,7 @@ void GraphMapInconsistentHeuristic::OpenGLDraw() const
 {
 	//static int counter = 50;
 	//counter = (counter+1);
-	if (heuristics.size() == 0)
+	if (table.GetNumLandmarks() == 0)
 	{
 		printf("No heuristics\n");
 		return;
@@ -820,31 +899,31 @@ void GraphMapInconsistentHeuristic::OpenGLDraw() const
 	GraphEnvironment ge(m, g, 0);
 
 	double max = 0;
-	for (unsigned int a = 0; a < heuristics.back().size(); a++)
+	for (unsigned int a = 0; a < table.GetNumNodes(); a++)
 	{
-		if (heuristics.back()[a] > max)
-			max = heuristics.back()[a];
+		if (table.Get(table.GetNumLandmarks()-1, a) > max)
+			max = table.Get(table.GetNumLandmarks()-1, a);
 	}
 	
-	for (unsigned int a = 0; a < heuristics.back().size(); a++)
+	for (unsigned int a = 0; a < table.GetNumNodes(); a++)
 	{
 //		GLdouble x, y, z;
 		if ((hmode == kCompressed) &&
-			((a%heuristics.size() != displayHeuristic) || (heuristics.size() == displayHeuristic)))
+			((a%table.GetNumLandmarks() != (uint32_t)displayHeuristic) || (table.GetNumLandmarks() == (uint32_t)displayHeuristic)))
 			continue;
 		node *n = g->GetNode(a);
 		
 		if (n)
 		{
-			if (heuristics.size() == displayHeuristic)
+			if (table.GetNumLandmarks() == (uint32_t)displayHeuristic)
 			{
-				ge.SetColor(heuristics[a%heuristics.size()][a]/max, 0, 1-heuristics[a%heuristics.size()][a]/max, 1);
+				ge.SetColor(table.Get(a%table.GetNumLandmarks(), a)/max, 0, 1-table.Get(a%table.GetNumLandmarks(), a)/max, 1);
 				ge.OpenGLDraw(a);
 			}
 			else {
-				if (heuristics[displayHeuristic][a] != 0)
+				if (table.Get(displayHeuristic, a) != 0)
 				{
-					ge.SetColor(heuristics[displayHeuristic][a]/max, 0, 1-heuristics[displayHeuristic][a]/max, 1);
+					ge.SetColor(table.Get(displayHeuristic, a)/max, 0, 1-table.Get(displayHeuristic, a)/max, 1);
 					ge.OpenGLDraw(a);
 				}
 				else {
@@ -869,7 +948,7 @@ void GraphDistanceHeuristic::OpenGLDraw() const
 {
 	//static int counter = 50;
 	//counter = (counter+1);
-	if (heuristics.size() == 0)
+	if (table.GetNumLandmarks() == 0)
 		return;
 
 	double approxSize = 2.0/sqrt(g->GetNumNodes());
@@ -916,32 +995,23 @@ void GraphDistanceHeuristic::OpenGLDraw() const
 
 double GraphDistanceHeuristic::HCost(const graphState &state1, const graphState &state2)
 {
-	double val = 0;
-	for (unsigned int i = 0; i < heuristics.size(); i++)
-	{
-		double hval = heuristics[i][state1]-heuristics[i][state2];
-		if (hval < 0)
-			hval = -hval;
-		if (fgreater(hval,val))
-			val = hval;
-	}
-	return val;
+	return table.HCost(state1, state2);
 }
 
 void GraphDistanceHeuristic::ChooseStartGoal(graphState &start, graphState &goal)
 {
-	if (heuristics.size() == 0)
+	if (table.GetNumLandmarks() == 0)
 		return;
 	double minStart=-1, minGoal=-1;
 
-	minStart = heuristics[0][start];
-	minGoal = heuristics[0][goal];
-	for (unsigned int x = 1; x < heuristics.size(); x++)
+	minStart = table.Get(0, start);
+	minGoal = table.Get(0, goal);
+	for (unsigned int x = 1; x < table.GetNumLandmarks(); x++)
 	{
-		if (heuristics[x][start] < minStart)
-			minStart = heuristics[x][start];
-		if (heuristics[x][goal] < minGoal)
-			minGoal = heuristics[x][goal];
+		if (table.Get(x, start) < minStart)
+			minStart = table.Get(x, start);
+		if (table.Get(x, goal) < minGoal)
+			minGoal = table.Get(x, goal);
 	}
 	if (minStart < minGoal)
 	{
@@ -969,10 +1039,106 @@ void GraphDistanceHeuristic::AddHeuristic(node *n)
 
 void GraphDistanceHeuristic::AddHeuristic(std::vector<double> &values, graphState location)
 {
-	heuristics.push_back(values);
+	table.AddLandmark(location, values);
 	locations.push_back(location);
 }
 
+void GraphDistanceHeuristic::AddHeuristics(int count, int numThreads)
+{
+	if (placement == kAvoidPlacement) // each placement needs the heuristics before it
+	{
+		for (int x = 0; x < count; x++)
+			AddHeuristic();
+		return;
+	}
+	if (numThreads <= 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	// far placement only needs the locations of the previous landmarks, so
+	// they are all chosen first and the distances are computed afterwards
+	size_t oldCount = locations.size();
+	for (int x = 0; x < count; x++)
+	{
+		node *n = (placement == kFarPlacement)?FindFarNode(0):g->GetRandomNode();
+		locations.push_back(n->GetNum());
+	}
+	std::vector<graphState> newLocations(locations.begin()+oldCount, locations.end());
+	locations.resize(oldCount);
+
+	GraphCSR csr;
+	csr.Build(g);
+	std::vector<std::vector<double> > values(numThreads);
+	std::vector<std::thread*> threads(numThreads);
+	for (int x = 0; x < count; x += numThreads)
+	{
+		int batch = std::min(numThreads, count-x);
+		for (int y = 0; y < batch; y++)
+			threads[y] = new std::thread(GetCSRDistances, &csr, newLocations[x+y], &values[y]);
+		for (int y = 0; y < batch; y++)
+		{
+			threads[y]->join();
+			delete threads[y];
+			threads[y] = 0;
+			AddHeuristic(values[y], newLocations[x+y]);
+		}
+	}
+}
+
+/**
+ * Dijkstra search from a landmark over all edges of a snapshot, using only
+ * local state so that several can run at once. Unreachable nodes get -1.
+ */
+void GraphDistanceHeuristic::GetCSRDistances(const GraphCSR *csr, graphState from, std::vector<double> *values)
+{
+	typedef std::pair<double, uint32_t> entry;
+	std::priority_queue<entry, std::vector<entry>, std::greater<entry> > open;
+	std::vector<double> &dist = *values;
+	std::vector<double> best(csr->GetNumNodes(), DBL_MAX);
+	dist.assign(csr->GetNumNodes(), -1.0);
+	best[from] = 0;
+	open.push(entry(0, (uint32_t)from));
+	while (!open.empty())
+	{
+		entry next = open.top();
+		open.pop();
+		if (dist[next.second] != -1) // stale entry
+			continue;
+		dist[next.second] = next.first;
+		for (uint32_t e = csr->AllBegin(next.second); e < csr->AllEnd(next.second); e++)
+		{
+			uint32_t nb = csr->AllNeighbor(e);
+			double cost = next.first+csr->AllWeight(e);
+			if (dist[nb] == -1 && fless(cost, best[nb]))
+			{
+				best[nb] = cost;
+				open.push(entry(cost, nb));
+			}
+		}
+	}
+}
+
+bool GraphDistanceHeuristic::Save(const char *file) const
+{
+	return table.Save(file);
+}
+
+bool GraphDistanceHeuristic::Load(const char *file, bool useMMap)
+{
+	if (!table.Load(file, useMMap))
+		return false;
+	if (table.GetNumNodes() != (uint32_t)g->GetNumNodes())
+	{
+		printf("Heuristic in %s has %u nodes; graph has %d\n", file, table.GetNumNodes(), g->GetNumNodes());
+		table.Reset(0);
+		locations.clear();
+		return false;
+	}
+	locations.resize(table.GetNumLandmarks());
+	for (unsigned int x = 0; x < locations.size(); x++)
+		locations[x] = table.GetLocation(x);
+	return true;
+}
+
 
 
 void GraphDistanceHeuristic::GetOptimalDistances(node *n, std::vector<double> &values)
@@ -1028,18 +1194,18 @@ node *GraphDistanceHeuristic::FindAvoidNode(node *n)
 	{
 		int bestSum = MAXINT;
 		int bestId = 0;
-		for (unsigned int x = 0; x < heuristics[0].size(); x+=1)
+		for (unsigned int x = 0; x < table.GetNumNodes(); x+=1)
 		//for (unsigned int x = 0; x < 5; x++)
 		{
-			if (heuristics[0][x] == -1)
+			if (table.Get(0, x) == -1)
 				continue;
 			int sum = 0;
-			for (unsigned int y = 0; y < heuristics.size(); y++)
-				sum += heuristics[y][x];
+			for (unsigned int y = 0; y < table.GetNumLandmarks(); y++)
+				sum += table.Get(y, x);
 			int diff = 0;
-			sum /= heuristics.size();
-			for (unsigned int y = 0; y < heuristics.size(); y++)
-				diff = max(diff, fabs(sum-heuristics[y][x]));
+			sum /= table.GetNumLandmarks();
+			for (unsigned int y = 0; y < table.GetNumLandmarks(); y++)
+				diff = max(diff, fabs(sum-table.Get(y, x)));
 			if (diff < bestSum)
 			{
 				bestId = x;
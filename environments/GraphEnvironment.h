@@ -16,6 +16,8 @@
 #include "SearchEnvironment.h"
 #include "UnitSimulation.h"
 #include "Graph.h"
+#include "GraphCSR.h"
+#include "DifferentialHeuristicTable.h"
 #include "GraphAbstraction.h"
 #include "GLUtil.h"
 
@@ -137,6 +139,30 @@ private:
 	Graph *g;
 };
 
+/**
+ * Straight-line distance between the node coordinates of a CSR snapshot; the
+ * snapshot must have been built with coordinates. This is admissible when
+ * edge weights are at least the distance between their endpoints, as in road
+ * networks.
+ **/
+class GraphCSRStraightLineHeuristic : public GraphHeuristic {
+public:
+	GraphCSRStraightLineHeuristic(Graph *graph, const GraphCSR *snapshot, double scale = 1.0)
+	:g(graph), csr(snapshot), weight(scale) { assert(csr->HasCoordinates()); }
+	double HCost(const graphState &state1, const graphState &state2)
+	{
+		double dx = csr->GetX(state1)-csr->GetX(state2);
+		double dy = csr->GetY(state1)-csr->GetY(state2);
+		double dz = csr->GetZ(state1)-csr->GetZ(state2);
+		return weight*sqrt(dx*dx+dy*dy+dz*dz);
+	}
+	Graph *GetGraph() { return g; }
+private:
+	Graph *g;
+	const GraphCSR *csr;
+	double weight;
+};
+
 class GraphAbstractionHeuristic : public GraphHeuristic {
 public:
 	GraphAbstractionHeuristic(MapAbstraction *mabs, int lev)
@@ -218,7 +244,16 @@ public:
 	~GraphDistanceHeuristic() {}
 	virtual double HCost(const graphState &state1, const graphState &state2);
 	void AddHeuristic(node *n = 0);
-	int GetNumHeuristics() { return heuristics.size(); }
+	/**
+	 * Adds count heuristics. The landmarks are placed as AddHeuristic would
+	 * place them, but the Dijkstra searches from them run on numThreads
+	 * threads over a GraphCSR snapshot (0 uses every hardware thread).
+	 **/
+	void AddHeuristics(int count, int numThreads = 0);
+	int GetNumHeuristics() { return table.GetNumLandmarks(); }
+	/** Saves the heuristics; Load can map the file instead of reading it **/
+	bool Save(const char *file) const;
+	bool Load(const char *file, bool useMMap = false);
 	void SetPlacement(placementScheme s) { placement = s; }
 	Graph *GetGraph() { return g; }
 	void ChooseStartGoal(graphState &start, graphState &goal);
@@ -226,6 +261,7 @@ public:
 protected:
 	void GetOptimalDistances(node *n, std::vector<double> &values);
 	void AddHeuristic(std::vector<double> &values, graphState location);
+	static void GetCSRDistances(const GraphCSR *csr, graphState from, std::vector<double> *values);
 	node *FindFarNode(node *n);
 	node *FindAvoidNode(node *n);
 	node *FindBestChild(int best, std::vector<double> &dist,
@@ -235,7 +271,7 @@ protected:
 		
 	placementScheme placement;
 	Graph *g;
-	std::vector<std::vector<double> > heuristics;
+	DifferentialHeuristicTable table;
 	std::vector<graphState> locations;
 
 	// for avoid node computation
@@ -269,7 +305,7 @@ public:
 	virtual void OpenGLDraw() const;
 	
 	void IncreaseDisplayHeuristic()
-	{ displayHeuristic = (displayHeuristic+1)%(heuristics.size()+1); }
+	{ displayHeuristic = (displayHeuristic+1)%(table.GetNumLandmarks()+1); }
 private:
 	void FillInCache(std::vector<double> &vals,
 					 std::vector<double> &errors,
@@ -309,6 +345,17 @@ public:
 
 	Graph *GetGraph() { return g; };
 
+	/**
+	 * Takes a CSR snapshot of the graph (with node coordinates) and searches
+	 * over it instead of the Graph objects. The graph must not change while
+	 * it is frozen; call FreezeGraph again after changing it. The node unique
+	 * ids are copied too, so state and action hashes don't change.
+	 **/
+	void FreezeGraph();
+	void UnfreezeGraph();
+	bool IsGraphFrozen() const { return frozen; }
+	const GraphCSR *GetCSR() const { return frozen?&csr:0; }
+
 	virtual void StoreGoal(graphState &) {}
 	virtual void ClearGoal() {}
 	virtual bool IsGoalStored() {return false;}
@@ -324,9 +371,12 @@ public:
 
 protected:
 	bool directed;
+	bool frozen;
 	Map *m;
 	Graph *g;
 	GraphHeuristic *h;
+	GraphCSR csr;
+	std::vector<int> uniqueIDs;
 };
 
 class AbstractionGraphEnvironment: public GraphEnvironment {
@@ -15,6 +15,7 @@
 MNPuzzle::MNPuzzle(unsigned int _width, unsigned int _height)
 : width(_width), height(_height)
 {
+	assert(width*height <= MNPUZZLE_MAX_TILES);
 	weighted = false;
 	// stores applicable operators at each of the width*height positions
 	Change_Op_Order(Get_Op_Order_From_Hash(15)); // Right, Left, Down, Up is default operator ordering
@@ -26,6 +27,7 @@ MNPuzzle::MNPuzzle(unsigned int _width, unsigned int _height,
                    const std::vector<slideDir> op_order) :
 width(_width), height(_height)
 {
+	assert(width*height <= MNPUZZLE_MAX_TILES);
 	Change_Op_Order(op_order);
 	goal_stored = false;
 	use_manhattan = true;
@@ -448,6 +450,23 @@ bool MNPuzzle::InvertAction(slideDir &a) const
 //	return hval;
 //}
 //
+void MNPuzzle::BatchHCost(const MNPuzzleState *states, size_t count, const MNPuzzleState &goal, double *hcosts, double parentHCost)
+{
+	// only the stored-goal lookup is batched; everything else goes through HCost
+	if (goal_stored)
+		PermutationPuzzleEnvironment<MNPuzzleState, slideDir>::BatchHCost(states, count, hcosts, parentHCost);
+	else
+		SearchEnvironment<MNPuzzleState, slideDir>::BatchHCost(states, count, goal, hcosts, parentHCost);
+}
+
+double MNPuzzle::HCost(const MNPuzzleState &state1, const MNPuzzleState &state2, double parentHCost)
+{
+	// the parent's value only helps the stored-goal lookup
+	if (goal_stored)
+		return PermutationPuzzleEnvironment<MNPuzzleState, slideDir>::HCost(state1, parentHCost);
+	return HCost(state1, state2);
+}
+
 // TODO Remove PDB heuristic from this heuristic evaluator.
 double MNPuzzle::HCost(const MNPuzzleState &state1, const MNPuzzleState &state2)
 {
@@ -488,8 +507,8 @@ double MNPuzzle::HCost(const MNPuzzleState &state1, const MNPuzzleState &state2)
 			{
 				if (state1.puzzle[x + y*state1.width] != 0)
 				{
-					man_dist += (abs(xloc[state1.puzzle[x + y*state1.width]] - x)
-								 + abs(yloc[state1.puzzle[x + y*state1.width]] - y));
+					man_dist += (abs(xloc[state1.puzzle[x + y*state1.width]] - (int)x)
+								 + abs(yloc[state1.puzzle[x + y*state1.width]] - (int)y));
 				}
 			}
 		}
@@ -591,21 +610,8 @@ void MNPuzzle::GetStateFromPDBHash(uint64_t hash, MNPuzzleState &s,
 								   int count, const std::vector<int> &pattern,
 								   std::vector<int> &dual)
 {
-	uint64_t hashVal = hash;
 	dual.resize(pattern.size());
-	
-	int numEntriesLeft = count-pattern.size()+1;
-	for (int x = pattern.size()-1; x >= 0; x--)
-	{
-		dual[x] = hashVal%numEntriesLeft;
-		hashVal /= numEntriesLeft;
-		numEntriesLeft++;
-		for (int y = x+1; y < pattern.size(); y++)
-		{
-			if (dual[y] >= dual[x])
-				dual[y]++;
-		}
-	}
+	UnrankPartialPermutation(hash, dual.data(), (int)pattern.size(), count);
 	s.puzzle.resize(count);
 	std::fill(s.puzzle.begin(), s.puzzle.end(), -1);
 	for (int x = 0; x < dual.size(); x++)
@@ -803,15 +809,9 @@ double GraphPuzzleDistanceHeuristic::HCost(const graphState &state1, const graph
 	puzzle.GetStateFromHash(a, state1);
 	puzzle.GetStateFromHash(b, state2);
 	double val = puzzle.HCost(a, b);
-	
-	for (unsigned int i=0; i < heuristics.size(); i++)
-	{
-		double hval = heuristics[i][state1]-heuristics[i][state2];
-		if (hval < 0)
-			hval = -hval;
-		if (fgreater(hval,val))
-			val = hval;
-	}
+	double hval = GraphDistanceHeuristic::HCost(state1, state2);
+	if (fgreater(hval,val))
+		val = hval;
 	
 	return val;
 }
@@ -836,7 +836,7 @@ MNPuzzleState MNPuzzle::Generate_Random_Puzzle(unsigned num_cols, unsigned num_r
 	return new_puzz;
 }
 
-void MNPuzzle::GetStateFromHash(MNPuzzleState &s, uint64_t hash)
+void MNPuzzle::GetStateFromHash(MNPuzzleState &s, uint64_t hash) const
 {
 	PermutationPuzzleEnvironment<MNPuzzleState,slideDir>::GetStateFromHash(s, hash);
 	for (unsigned int x = 0; x < s.puzzle.size(); x++)
@@ -18,6 +18,15 @@
 #include "GraphEnvironment.h"
 #include "Graph.h"
 #include <sstream>
+#include "FixedVector.h"
+
+/**
+ Largest number of tiles an MNPuzzleState can hold. Tiles are stored inline
+ so that copying a state never allocates memory.
+ **/
+#ifndef MNPUZZLE_MAX_TILES
+#define MNPUZZLE_MAX_TILES 36
+#endif
 
 class MNPuzzleState {
 public:
@@ -38,7 +47,7 @@ public:
 	}
 	unsigned int width, height;
 	unsigned int blank;
-	std::vector<int> puzzle;
+	FixedVector<int8_t, MNPUZZLE_MAX_TILES> puzzle;
 };
 
 /**
@@ -54,7 +63,7 @@ static std::ostream& operator <<(std::ostream & out, const MNPuzzleState &loc)
 {
 	out << "(" << loc.width << "x" << loc.height << ")";
 	for (unsigned int x = 0; x < loc.puzzle.size(); x++)
-		out << loc.puzzle[x] << " ";
+		out << (int)loc.puzzle[x] << " ";
 	return out;
 }
 
@@ -102,8 +111,10 @@ public:
 
 	OccupancyInterface<MNPuzzleState, slideDir> *GetOccupancyInfo() { return 0; }
 	double HCost(const MNPuzzleState &state1, const MNPuzzleState &state2);
+	double HCost(const MNPuzzleState &state1, const MNPuzzleState &state2, double parentHCost);
 	double HCost(const MNPuzzleState &state1)
 	{ return PermutationPuzzleEnvironment<MNPuzzleState, slideDir>::HCost(state1); }
+	void BatchHCost(const MNPuzzleState *states, size_t count, const MNPuzzleState &goal, double *hcosts, double parentHCost);
 	double DefaultH(const MNPuzzleState &s) const;
 
 	double GCost(const MNPuzzleState &state1, const MNPuzzleState &state2);
@@ -175,7 +186,8 @@ public:
 	std::vector<slideDir> Get_Op_Order(){return ops_in_order;}
 
 	static MNPuzzleState Generate_Random_Puzzle(unsigned num_cols, unsigned num_rows);
-	virtual void GetStateFromHash(MNPuzzleState &s, uint64_t hash);
+	virtual void GetStateFromHash(MNPuzzleState &s, uint64_t hash) const;
+	void GetStateFromHash(uint64_t hash, MNPuzzleState &s) const { GetStateFromHash(s, hash); }
 
 	
 	bool State_Check(const MNPuzzleState &to_check);
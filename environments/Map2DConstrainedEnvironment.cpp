@@ -7,16 +7,83 @@
 //
 
 #include "Map2DConstrainedEnvironment.h"
-
-//std::vector<constraint> constraints;
-//MapEnvironment *mapEnv;
+#include <algorithm>
 
 bool operator==(const xytLoc &l1, const xytLoc &l2)
 {
 	return (l1.t == l2.t) && (l1.l == l2.l);
 }
 
+ConstraintTable::ConstraintTable()
+:lastTime(0)
+{
+}
+
+void ConstraintTable::Block(const xyLoc &loc, uint32_t t, uint16_t dirs)
+{
+	blocked[GetKey(loc, t)] |= dirs;
+	if (t > lastTime)
+		lastTime = t;
+	// waiting there is forbidden, so an agent can't stop there before t
+	if (dirs&(1<<kStay))
+	{
+		uint32_t &last = lastWait[GetKey(loc)];
+		if (t > last)
+			last = t;
+	}
+}
+
+void ConstraintTable::AddConstraint(const constraint &c)
+{
+	Block(c.loc.l, c.loc.t, (c.dir == kTeleport)?0xFFFF:(1<<c.dir));
+}
+
+void ConstraintTable::ReservePath(const std::vector<xytLoc> &path)
+{
+	for (unsigned int x = 0; x < path.size(); x++)
+	{
+		Block(path[x].l, path[x].t, 0xFFFF);
+		if (x == 0 || path[x].l == path[x-1].l)
+			continue;
+		// the swap: arriving where the agent was, from where it is going
+		const xyLoc &from = path[x].l, &to = path[x-1].l;
+		int dir = kStay;
+		if (to.y < from.y) dir |= kN;
+		if (to.y > from.y) dir |= kS;
+		if (to.x > from.x) dir |= kE;
+		if (to.x < from.x) dir |= kW;
+		Block(to, path[x].t, 1<<dir);
+	}
+	if (path.size() > 0)
+	{
+		std::unordered_map<uint32_t, uint32_t>::iterator i = parked.find(GetKey(path.back().l));
+		if (i == parked.end())
+			parked[GetKey(path.back().l)] = path.back().t+1;
+		else if (path.back().t+1 < i->second)
+			i->second = path.back().t+1;
+	}
+}
+
+void ConstraintTable::Clear()
+{
+	blocked.clear();
+	parked.clear();
+	lastWait.clear();
+	lastTime = 0;
+}
+
+int64_t ConstraintTable::GetLastBlockedTime(const xyLoc &loc) const
+{
+	if (parked.find(GetKey(loc)) != parked.end())
+		return kNeverFree;
+	std::unordered_map<uint32_t, uint32_t>::const_iterator i = lastWait.find(GetKey(loc));
+	if (i == lastWait.end())
+		return -1;
+	return i->second;
+}
+
 Map2DConstrainedEnvironment::Map2DConstrainedEnvironment(Map *m)
+:reservations(0), timeLimit(0)
 {
 	mapEnv = new MapEnvironment(m);
 	mapEnv->SetFourConnected();
@@ -25,6 +92,7 @@ Map2DConstrainedEnvironment::Map2DConstrainedEnvironment(Map *m)
 void Map2DConstrainedEnvironment::AddConstraint(constraint c)
 {
 	constraints.push_back(c);
+	table.AddConstraint(c);
 }
 
 void Map2DConstrainedEnvironment::AddConstraint(xytLoc loc)
@@ -37,68 +105,69 @@ void Map2DConstrainedEnvironment::AddConstraint(xytLoc loc, tDirection dir)
 	constraint c;
 	c.loc = loc;
 	c.dir = dir;
-	constraints.push_back(c);
+	AddConstraint(c);
 }
 
 void Map2DConstrainedEnvironment::ClearConstraints()
 {
 	constraints.resize(0);
+	table.Clear();
 }
 
-void Map2DConstrainedEnvironment::GetSuccessors(const xytLoc &nodeID, std::vector<xytLoc> &neighbors) const
+/**
+ * Writes the (four-connected) moves out of loc in the same order as
+ * MapEnvironment::GetSuccessors, without building a vector of locations.
+ **/
+int Map2DConstrainedEnvironment::GetMoves(const xyLoc &loc, tDirection *dirs) const
 {
-	std::vector<xyLoc> n;
-	mapEnv->GetSuccessors(nodeID.l, n);
-
-	// TODO: remove illegal successors
-	for (unsigned int x = 0; x < n.size(); x++)
-	{
-		if (!ViolatesConstraint(nodeID.l, n[x], nodeID.t))
-		{
-			xytLoc newLoc;
-			newLoc.l = n[x];
-			newLoc.t = nodeID.t+1;
-			neighbors.push_back(newLoc);
-		}
-	}
-	// TODO: Add kStay
-	if (!ViolatesConstraint(nodeID.l, nodeID.l, nodeID.t))
+	Map *map = mapEnv->GetMap();
+	int count = 0;
+	unsigned int n;
+	if (map->GetGroundNeighbors(loc.x, loc.y, n))
 	{
-		xytLoc newLoc;
-		newLoc.l = nodeID.l;
-		newLoc.t = nodeID.t+1;
-		neighbors.push_back(newLoc);
+		if (n&kNeighborS) dirs[count++] = kS;
+		if (n&kNeighborN) dirs[count++] = kN;
+		if (n&kNeighborW) dirs[count++] = kW;
+		if (n&kNeighborE) dirs[count++] = kE;
+		return count;
 	}
-//	std::cout << "Successors of " << nodeID << " are:" << std::endl;
-//	for (unsigned int x = 0; x < neighbors.size(); x++)
-//		std::cout << neighbors[x] << " ";
-//	std::cout << std::endl;
-	
+	if (map->CanStep(loc.x, loc.y, loc.x, loc.y+1)) dirs[count++] = kS;
+	if (map->CanStep(loc.x, loc.y, loc.x, loc.y-1)) dirs[count++] = kN;
+	if (map->CanStep(loc.x, loc.y, loc.x-1, loc.y)) dirs[count++] = kW;
+	if (map->CanStep(loc.x, loc.y, loc.x+1, loc.y)) dirs[count++] = kE;
+	return count;
 }
 
-bool Map2DConstrainedEnvironment::ViolatesConstraint(const xyLoc &from, const xyLoc &to, int time) const
+void Map2DConstrainedEnvironment::GetSuccessors(const xytLoc &nodeID, std::vector<xytLoc> &neighbors) const
 {
-	xyLoc tmp;
-	for (unsigned int x = 0; x < constraints.size(); x++)
+	if (timeLimit != 0 && nodeID.t >= timeLimit)
+		return;
+	tDirection dirs[5];
+	int count = GetMoves(nodeID.l, dirs);
+	dirs[count++] = kStay;
+	for (int x = 0; x < count; x++)
 	{
-		if ((constraints[x].dir == kTeleport) && time+1 == constraints[x].loc.t && (to == constraints[x].loc.l))
-			return true;
-		if ((constraints[x].dir != kTeleport) && time+1 == constraints[x].loc.t && (constraints[x].loc.l == to))
-		{
-			tmp = to;
-			mapEnv->UndoAction(tmp, constraints[x].dir);
-			if (tmp == from)
-				return true;
-		}
+		xytLoc newLoc(nodeID.l, nodeID.t+1);
+		mapEnv->ApplyAction(newLoc.l, dirs[x]);
+		if (!ViolatesConstraint(newLoc.l, dirs[x], nodeID.t))
+			neighbors.push_back(newLoc);
 	}
-	return false;
 }
 
 void Map2DConstrainedEnvironment::GetActions(const xytLoc &nodeID, std::vector<tDirection> &actions) const
 {
-	mapEnv->GetActions(nodeID.l, actions);
-
-	// TODO: remove illegal actions
+	if (timeLimit != 0 && nodeID.t >= timeLimit)
+		return;
+	tDirection dirs[5];
+	int count = GetMoves(nodeID.l, dirs);
+	dirs[count++] = kStay;
+	for (int x = 0; x < count; x++)
+	{
+		xyLoc next = nodeID.l;
+		mapEnv->ApplyAction(next, dirs[x]);
+		if (!ViolatesConstraint(next, dirs[x], nodeID.t))
+			actions.push_back(dirs[x]);
+	}
 }
 
 tDirection Map2DConstrainedEnvironment::GetAction(const xytLoc &s1, const xytLoc &s2) const
@@ -139,6 +208,14 @@ bool Map2DConstrainedEnvironment::GoalTest(const xytLoc &node, const xytLoc &goa
 	return (node.l == goal.l && node.t >= goal.t);
 }
 
+int64_t Map2DConstrainedEnvironment::GetLastBlockedTime(const xyLoc &loc) const
+{
+	int64_t last = table.GetLastBlockedTime(loc);
+	if (reservations)
+		last = std::max(last, reservations->GetLastBlockedTime(loc));
+	return last;
+}
+
 
 uint64_t Map2DConstrainedEnvironment::GetStateHash(const xytLoc &node) const
 {
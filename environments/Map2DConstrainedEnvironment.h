@@ -10,6 +10,7 @@
 #define __hog2_glut__Map2DConstrainedEnvironment__
 
 #include <iostream>
+#include <unordered_map>
 
 #include "Map2DEnvironment.h"
 
@@ -33,6 +34,65 @@ static std::ostream& operator <<(std::ostream & out, const xytLoc &loc)
 	
 bool operator==(const xytLoc &l1, const xytLoc &l2);
 
+/** The last blocked time of a location that is taken for good; nothing can stop there **/
+const int64_t kNeverFree = INT64_MAX;
+
+/**
+ * Constraints indexed by the location and time they apply to, so that a move
+ * is checked with one hash lookup no matter how many constraints there are.
+ * For each (x, y, t) the table keeps a bit for every direction in which
+ * arriving there at time t is forbidden; a vertex constraint (kTeleport)
+ * forbids all of them, and kStay forbids waiting there.
+ *
+ * The same table serves as a reservation table for prioritized planning:
+ * ReservePath blocks every state of a planned path, the swaps that would
+ * collide with its moves, and its last location for all later times.
+ **/
+class ConstraintTable {
+public:
+	ConstraintTable();
+	void AddConstraint(const constraint &c);
+	/** Reserves a path (with consecutive times) so that later agents avoid it **/
+	void ReservePath(const std::vector<xytLoc> &path);
+	void Clear();
+	bool Empty() const { return blocked.empty() && parked.empty(); }
+	/** True if arriving at loc at time t by moving in direction dir is not allowed **/
+	inline bool Violates(const xyLoc &loc, tDirection dir, uint32_t t) const;
+	/**
+	 * The last time at which an agent can't be at loc: -1 if there is none,
+	 * and kNeverFree if a reserved path ends there.
+	 **/
+	int64_t GetLastBlockedTime(const xyLoc &loc) const;
+private:
+	static uint64_t GetKey(const xyLoc &loc, uint32_t t)
+	{ return ((uint64_t)loc.x<<48)|((uint64_t)loc.y<<32)|t; }
+	static uint32_t GetKey(const xyLoc &loc)
+	{ return ((uint32_t)loc.x<<16)|loc.y; }
+	void Block(const xyLoc &loc, uint32_t t, uint16_t dirs);
+
+	std::unordered_map<uint64_t, uint16_t> blocked; // (x, y, t) -> bit 1<<dir per forbidden direction
+	std::unordered_map<uint32_t, uint32_t> parked; // (x, y) -> time from which it is taken for good
+	std::unordered_map<uint32_t, uint32_t> lastWait; // (x, y) -> last time waiting there is blocked
+	uint32_t lastTime; // no entries in blocked after this time
+};
+
+inline bool ConstraintTable::Violates(const xyLoc &loc, tDirection dir, uint32_t t) const
+{
+	if (!blocked.empty() && t <= lastTime)
+	{
+		std::unordered_map<uint64_t, uint16_t>::const_iterator i = blocked.find(GetKey(loc, t));
+		if (i != blocked.end() && (i->second&(1<<dir)))
+			return true;
+	}
+	if (!parked.empty())
+	{
+		std::unordered_map<uint32_t, uint32_t>::const_iterator i = parked.find(GetKey(loc));
+		if (i != parked.end() && t >= i->second)
+			return true;
+	}
+	return false;
+}
+
 
 class Map2DConstrainedEnvironment : public SearchEnvironment<xytLoc, tDirection>
 {
@@ -42,6 +102,26 @@ public:
 	void AddConstraint(xytLoc loc);
 	void AddConstraint(xytLoc loc, tDirection dir);
 	void ClearConstraints();
+	/**
+	 * Plans also avoid everything in this table (0 for none). Several
+	 * environments can share one table; each agent planned in priority
+	 * order reserves its path there for the agents that follow.
+	 **/
+	void SetReservationTable(const ConstraintTable *table) { reservations = table; }
+	const ConstraintTable *GetReservationTable() const { return reservations; }
+	/**
+	 * No successors are generated after this time (0 for no limit). Reserved
+	 * paths can make a goal unreachable, and without a limit the search then
+	 * never ends.
+	 **/
+	void SetTimeLimit(uint32_t limit) { timeLimit = limit; }
+	/**
+	 * The last time at which loc is blocked by a constraint or reservation
+	 * (see ConstraintTable). An agent stays at its goal, so a goal time after
+	 * this keeps the plan from stopping there too early. kNeverFree if
+	 * another agent stays there for good.
+	 **/
+	int64_t GetLastBlockedTime(const xyLoc &loc) const;
 
 	virtual void GetSuccessors(const xytLoc &nodeID, std::vector<xytLoc> &neighbors) const;
 	virtual void GetActions(const xytLoc &nodeID, std::vector<tDirection> &actions) const;
@@ -65,9 +145,14 @@ public:
 	virtual void OpenGLDraw(const xytLoc&, const tDirection&) const;
 	virtual void GLDrawLine(const xytLoc &x, const xytLoc &y) const;
 private:
-	bool ViolatesConstraint(const xyLoc &from, const xyLoc &to, int time) const;
+	int GetMoves(const xyLoc &loc, tDirection *dirs) const;
+	bool ViolatesConstraint(const xyLoc &to, tDirection dir, uint32_t time) const
+	{ return table.Violates(to, dir, time+1) || (reservations && reservations->Violates(to, dir, time+1)); }
 
-	std::vector<constraint> constraints;
+	std::vector<constraint> constraints; // for drawing; checks use table
+	ConstraintTable table;
+	const ConstraintTable *reservations;
+	uint32_t timeLimit;
 	MapEnvironment *mapEnv;
 };
 
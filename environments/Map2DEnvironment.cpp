@@ -52,6 +52,33 @@ void MapEnvironment::SetGraphHeuristic(GraphHeuristic *gh)
 void MapEnvironment::GetSuccessors(const xyLoc &loc, std::vector<xyLoc> &neighbors) const
 {
 	neighbors.resize(0);
+	unsigned int n;
+	if (map->GetGroundNeighbors(loc.x, loc.y, n))
+	{
+		// same successors, in the same order, as the CanStep() code below
+		bool up = (n&kNeighborN), down = (n&kNeighborS);
+		if (down)
+			neighbors.push_back(xyLoc(loc.x, loc.y+1));
+		if (up)
+			neighbors.push_back(xyLoc(loc.x, loc.y-1));
+		if (n&kNeighborW)
+		{
+			if (!fourConnected && up && (n&kNeighborNW))
+				neighbors.push_back(xyLoc(loc.x-1, loc.y-1));
+			if (!fourConnected && down && (n&kNeighborSW))
+				neighbors.push_back(xyLoc(loc.x-1, loc.y+1));
+			neighbors.push_back(xyLoc(loc.x-1, loc.y));
+		}
+		if (n&kNeighborE)
+		{
+			if (!fourConnected && up && (n&kNeighborNE))
+				neighbors.push_back(xyLoc(loc.x+1, loc.y-1));
+			if (!fourConnected && down && (n&kNeighborSE))
+				neighbors.push_back(xyLoc(loc.x+1, loc.y+1));
+			neighbors.push_back(xyLoc(loc.x+1, loc.y));
+		}
+		return;
+	}
 	bool up=false, down=false;
 	// 
 	if ((map->CanStep(loc.x, loc.y, loc.x, loc.y+1)))
@@ -347,6 +374,32 @@ bool MapEnvironment::GetNext8Successor(const xyLoc &currOpenNode, const xyLoc &g
 
 void MapEnvironment::GetActions(const xyLoc &loc, std::vector<tDirection> &actions) const
 {
+	unsigned int n;
+	if (map->GetGroundNeighbors(loc.x, loc.y, n))
+	{
+		bool up = (n&kNeighborN), down = (n&kNeighborS);
+		if (down)
+			actions.push_back(kS);
+		if (up)
+			actions.push_back(kN);
+		if (n&kNeighborW)
+		{
+			if (!fourConnected && up && (n&kNeighborNW))
+				actions.push_back(kNW);
+			if (!fourConnected && down && (n&kNeighborSW))
+				actions.push_back(kSW);
+			actions.push_back(kW);
+		}
+		if (n&kNeighborE)
+		{
+			if (!fourConnected && up && (n&kNeighborNE))
+				actions.push_back(kNE);
+			if (!fourConnected && down && (n&kNeighborSE))
+				actions.push_back(kSE);
+			actions.push_back(kE);
+		}
+		return;
+	}
 	bool up=false, down=false;
 	if ((map->CanStep(loc.x, loc.y, loc.x, loc.y+1)))
 	{
@@ -525,6 +578,28 @@ uint64_t MapEnvironment::GetStateHash(const xyLoc &node) const
 //	return (node.x<<16)|node.y;
 }
 
+void MapEnvironment::GetStateFromHash(uint64_t hash, xyLoc &node) const
+{
+	node.x = (uint16_t)(hash>>16);
+	node.y = (uint16_t)(hash&0xFFFF);
+}
+
+uint64_t MapEnvironment::GetNumStateIndices() const
+{
+	return (uint64_t)map->GetMapWidth()*map->GetMapHeight();
+}
+
+uint64_t MapEnvironment::GetStateIndex(const xyLoc &node) const
+{
+	return (uint64_t)node.y*map->GetMapWidth()+node.x;
+}
+
+void MapEnvironment::GetStateFromIndex(uint64_t index, xyLoc &node) const
+{
+	node.x = (uint16_t)(index%map->GetMapWidth());
+	node.y = (uint16_t)(index/map->GetMapWidth());
+}
+
 uint64_t MapEnvironment::GetActionHash(tDirection act) const
 {
 	return (uint32_t) act;
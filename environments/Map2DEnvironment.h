@@ -118,6 +118,11 @@ public:
 		exit(1); return false;}
 
 	uint64_t GetStateHash(const xyLoc &node) const;
+	void GetStateFromHash(uint64_t hash, xyLoc &node) const;
+	/** States are numbered y*width+x **/
+	uint64_t GetNumStateIndices() const;
+	uint64_t GetStateIndex(const xyLoc &node) const;
+	void GetStateFromIndex(uint64_t index, xyLoc &node) const;
 	uint64_t GetActionHash(tDirection act) const;
 	virtual void OpenGLDraw() const;
 	virtual void OpenGLDraw(const xyLoc &l) const;
@@ -29,6 +29,7 @@
 
 #include "MinimalSectorAbstraction.h"
 #include <queue>
+#include <algorithm>
 #include "GenericAStar.h"
 #include "Map2DEnvironment.h"
 
@@ -50,7 +51,7 @@ int sectorSize = 11;
  */
 
 MinimalSectorAbstraction::MinimalSectorAbstraction(Map *m, int theSectorSize)
-:map(m)
+:map(m), wastedBytes(0)
 {
 	sectorSize = theSectorSize;
     numYSectors = ((map->GetMapHeight()+sectorSize-1)/sectorSize);
@@ -116,6 +117,131 @@ void MinimalSectorAbstraction::BuildAbstraction()
     ComputePotentialMemorySavings();
 }
 
+/**
+ * MinimalSectorAbstraction::MarkTileChanged()
+ *
+ * \brief Record that the terrain of a tile has changed
+ *
+ * The abstraction isn't updated until RepairAbstraction() is called, so
+ * any number of tiles can be changed first.
+ *
+ * \param x The x-coordinate of the tile
+ * \param y The y-coordinate of the tile
+ * \return none
+ */
+void MinimalSectorAbstraction::MarkTileChanged(int x, int y)
+{
+    int sector = GetSector(x, y);
+    if (sector != -1)
+        dirtySectors.push_back(sector);
+}
+
+/**
+ * MinimalSectorAbstraction::RepairAbstraction()
+ *
+ * \brief Update the abstraction for the tiles marked as changed
+ *
+ * The regions of each changed sector are found again. The edges of a sector
+ * refer to the regions of its neighbors, so the changed sectors and their
+ * neighbors are then stored again. A sector that still fits in its old
+ * memory is stored in place; otherwise it is moved to the end of memory,
+ * and memory is compacted once more than half of it is unused. The work
+ * done is proportional to the number of changed sectors, apart from the
+ * occasional compaction.
+ *
+ * \param none
+ * \return none
+ */
+void MinimalSectorAbstraction::RepairAbstraction()
+{
+    if (dirtySectors.size() == 0)
+        return;
+    std::sort(dirtySectors.begin(), dirtySectors.end());
+    dirtySectors.erase(std::unique(dirtySectors.begin(), dirtySectors.end()), dirtySectors.end());
+    
+    // the number of regions is only updated when the sector is stored again,
+    // so that until then it still describes the sector's memory
+    std::vector<int> numRegions(dirtySectors.size());
+    std::vector<int> neighbors;
+    for (unsigned int x = 0; x < dirtySectors.size(); x++)
+    {
+        int xSector = dirtySectors[x]%numXSectors;
+        int ySector = dirtySectors[x]/numXSectors;
+        numRegions[x] = GetSectorRegions(areas[dirtySectors[x]], xSector, ySector);
+        assert(numRegions[x] < 256);
+        for (int dy = -1; dy <= 1; dy++)
+        {
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                if ((xSector+dx >= 0) && (xSector+dx < numXSectors) &&
+                    (ySector+dy >= 0) && (ySector+dy < numYSectors))
+                    neighbors.push_back((ySector+dy)*numXSectors+xSector+dx);
+            }
+        }
+    }
+    std::sort(neighbors.begin(), neighbors.end());
+    neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+    
+    for (unsigned int x = 0; x < neighbors.size(); x++)
+    {
+        int which = neighbors[x];
+        std::vector<tempEdgeData> edges;
+        GetEdges(areas, which%numXSectors, which/numXSectors, edges);
+        assert(edges.size() < 256);
+        
+        std::vector<int>::iterator d = std::lower_bound(dirtySectors.begin(), dirtySectors.end(), which);
+        int regions = sectors[which].numRegions;
+        if ((d != dirtySectors.end()) && (*d == which))
+            regions = numRegions[d-dirtySectors.begin()];
+        if ((int)memory.size()+2*regions+(int)edges.size() >= (1<<16))
+            CompactMemory();
+        
+        int oldAddress = sectors[which].memoryAddress;
+        int oldSize = 2*sectors[which].numRegions+sectors[which].numEdges;
+        sectors[which].numRegions = regions;
+        sectors[which].numEdges = (uint8_t)edges.size();
+        StoreSectorInMemory(sectors[which], areas[which], edges);
+        int newSize = (int)memory.size()-sectors[which].memoryAddress;
+        if (newSize <= oldSize)
+        {
+            std::copy(memory.begin()+sectors[which].memoryAddress, memory.end(), memory.begin()+oldAddress);
+            memory.resize(sectors[which].memoryAddress);
+            sectors[which].memoryAddress = oldAddress;
+            wastedBytes += oldSize-newSize;
+        }
+        else {
+            wastedBytes += oldSize;
+        }
+    }
+    dirtySectors.resize(0);
+    if (wastedBytes > (int)memory.size()/2)
+        CompactMemory();
+}
+
+/**
+ * MinimalSectorAbstraction::CompactMemory()
+ *
+ * \brief Remove the unused memory left by RepairAbstraction()
+ *
+ * \param none
+ * \return none
+ */
+void MinimalSectorAbstraction::CompactMemory()
+{
+    std::vector<uint8_t> compact;
+    compact.reserve(memory.size()-wastedBytes);
+    for (unsigned int x = 0; x < sectors.size(); x++)
+    {
+        int size = 2*sectors[x].numRegions+sectors[x].numEdges;
+        int address = (int)compact.size();
+        compact.insert(compact.end(), memory.begin()+sectors[x].memoryAddress,
+                       memory.begin()+sectors[x].memoryAddress+size);
+        sectors[x].memoryAddress = (uint16_t)address;
+    }
+    memory.swap(compact);
+    wastedBytes = 0;
+}
+
 /**
  * MinimalSectorAbstraction::GetEdges()
  *
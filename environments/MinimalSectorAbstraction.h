@@ -99,13 +99,19 @@ class MinimalSectorAbstraction {
   void GetNeighbors(unsigned int sector, unsigned int region,
             std::vector<tempEdgeData> &edges);
   int GetAdjacentSector(unsigned int sector, int direction);
+  int GetNumSectors() { return (int)sectors.size(); }
+  int GetNumRegions(unsigned int sector) { return sectors[sector].numRegions; }
 
   void OptimizeRegionLocations();
   void InitializeOptimization();
   bool PerformOneOptimizationStep();
 	int GetAbstractionBytesUsed() { return sectors.size()*4+memory.size(); }
+
+  void MarkTileChanged(int x, int y);
+  void RepairAbstraction();
  private:
   void BuildAbstraction();
+  void CompactMemory();
   void GetEdges(std::vector<std::vector<int> > &areas,
         int xSector, int ySector,
         std::vector<tempEdgeData> &edges);
@@ -142,6 +148,8 @@ class MinimalSectorAbstraction {
   std::vector<std::vector<double> > regionError;
   Map *map;
   std::vector<std::vector<int> > areas;
+  std::vector<int> dirtySectors;
+  int wastedBytes;
 
   int optimizationIndex;
 };
@@ -2,7 +2,7 @@
 #include <cstdlib>
 
 PancakePuzzle::PancakePuzzle(unsigned s) {
-	assert(s >= 2);
+	assert(s >= 2 && s <= PANCAKE_MAX_SIZE);
 	size = s;
 
 	// assign the default operator ordering
@@ -15,6 +15,7 @@ PancakePuzzle::PancakePuzzle(unsigned s) {
 }
 
 PancakePuzzle::PancakePuzzle(unsigned s, const std::vector<PancakePuzzleAction> op_order) {
+	assert(s <= PANCAKE_MAX_SIZE);
 	size = s;
 
 	Change_Op_Order(op_order);
@@ -6,9 +6,18 @@
 #include "SearchEnvironment.h"
 #include "PermutationPuzzleEnvironment.h"
 #include <sstream>
+#include "FixedVector.h"
 
 typedef unsigned PancakePuzzleAction;
 
+/**
+ Largest number of pancakes a PancakePuzzleState can hold. Pancakes are
+ stored inline so that copying a state never allocates memory.
+ **/
+#ifndef PANCAKE_MAX_SIZE
+#define PANCAKE_MAX_SIZE 64
+#endif
+
 class PancakePuzzleState {
 public:
 	PancakePuzzleState() { puzzle.clear(); }
@@ -22,13 +31,13 @@ public:
 		for (unsigned int x = 0; x < puzzle.size(); x++)
 			puzzle[x] = x;
 	}
-	std::vector<int> puzzle;
+	FixedVector<int8_t, PANCAKE_MAX_SIZE> puzzle;
 };
 
 static std::ostream& operator <<(std::ostream & out, const PancakePuzzleState &loc)
 {
 	for (unsigned int x = 0; x < loc.puzzle.size(); x++)
-		out << loc.puzzle[x] << " ";
+		out << (int)loc.puzzle[x] << " ";
 	return out;
 }
 
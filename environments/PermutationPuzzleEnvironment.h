@@ -6,11 +6,16 @@
 #include <stdint.h>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include "Timer.h"
 #include <thread>
 #include <deque>
-#include "SharedQueue.h"
+#include <mutex>
+#include "Barrier.h"
+#include "WorkStealingQueue.h"
 #include "RangeCompression.h"
+#include "PDBTable.h"
+#include "PermutationRanking.h"
 
 #ifndef PERMPUZZ_H
 #define PERMPUZZ_H
@@ -49,16 +54,11 @@ template <class state, class action>
 class PermutationPuzzleEnvironment : public SearchEnvironment<state, action>
 {
 public:
-	PermutationPuzzleEnvironment():maxItem(0), minPattern(100) {}
+	PermutationPuzzleEnvironment() :additive(false) {}
 	/**
 	 Returns the value of n! / k!
 	 **/
-	uint64_t nUpperk(int n, int k) const;
-	
-	/**
-	 Builds caches for nUpperk
-	 **/
-	void buildCaches() const;
+	uint64_t nUpperk(int n, int k) const { return FallingFactorial(n, k); }
 
 	/**
 	 Returns the Hash Value of the given state using the given set of distinct items
@@ -102,6 +102,17 @@ public:
 	void Value_Compress_PDB(int whichPDB, std::vector<int> cutoffs, bool print_histogram);
 	void Value_Range_Compress_PDB(int whichPDB, int numBits, bool print_histogram);
 
+	/**
+	 Changes how the entries of a PDB are stored: one byte per entry, packed
+	 into 4 bits, or as h mod 3 in 2 bits. The 2-bit encoding is only valid
+	 for unit-cost PDBs built over a reversible abstract space; its values are
+	 decoded during lookup by walking down to the abstract goal, so lookups
+	 cost O(h) extra rankings in exchange for a quarter of the memory.
+	 Additive PDBs, compressed PDBs, and any other PDB where this walk would
+	 give the wrong value are refused (this checks every entry).
+	 **/
+	void Convert_PDB_Storage(int whichPDB, PDBStorageType storage, bool print_histogram);
+
 	/**
 	 Re-compute PDB as delta over current heuristic value.
 	 **/
@@ -138,6 +149,25 @@ public:
 	 **/
 	void Load_Regular_PDB_Min_Compressed(const char *fname, state &goal, int factor, bool print_histogram);
 
+	/**
+	 Writes the given PDB with a versioned header so that it can be memory
+	 mapped by Load_Mapped_PDB. compression records how the entries are to be
+	 interpreted (the leaf type in lookups) along with its factor. The header
+	 also records the abstract goal and whether the PDBs of this environment
+	 are additive.
+	 **/
+	bool Save_PDB(int whichPDB, const state &goal, const char *fname,
+				  PDBTreeNodeType compression = kLeafNode, int factor = 0);
+	
+	/**
+	 Maps a PDB written by Save_PDB or Build_PDB read-only into memory. Lookups
+	 read directly from the page cache, so the table is shared between all
+	 processes that map the same file. Returns false (and loads nothing) if the
+	 file was built for another goal, is additive when this environment's PDBs
+	 are not (or the reverse), or doesn't have the expected compression.
+	 **/
+	bool Load_Mapped_PDB(const char *fname, const state &goal, PDBTreeNodeType compression = kLeafNode);
+
 	/**
 	 Performs a PDB lookup for the given state (additive or max is automatic)
 	 **/
@@ -149,9 +179,11 @@ public:
 	uint64_t Get_PDB_Size(state &start, int pdbEntries);
 	
 	/**
-	 Builds a regular PDB given the file name of the file to write the PDB to, and a list of distinct tiles
+	 Builds a regular PDB given the file name of the file to write the PDB to, and a list of distinct tiles.
+	 The file is written in the mapped format (see Save_PDB).
 	 **/
-	void Build_PDB(state &start, const std::vector<int> &distinct, const char *pdb_filename, int numThreads, bool additive);
+	void Build_PDB(state &start, const std::vector<int> &distinct, const char *pdb_filename, int numThreads, bool additive,
+				   PDBStorageType storage = kPDB8Bit);
 
 	void ClearPDBs()
 	{	PDB.resize(0); PDB_distincts.resize(0); lookups.resize(0); }
@@ -178,9 +210,12 @@ public:
 	virtual uint64_t GetStateHash(const state &s) const;
 	
 	/**
-	 Constructs a state from a hash value
+	 Constructs a state from a hash value. s must already hold a puzzle of
+	 the right size.
 	 **/
-	virtual void GetStateFromHash(state &s, uint64_t hash);
+	virtual void GetStateFromHash(state &s, uint64_t hash) const;
+	/** Same as above, with the argument order used by SearchEnvironment **/
+	void GetStateFromHash(uint64_t hash, state &s) const { GetStateFromHash(s, hash); }
 	
 	/**
 	 Returns the val! if it can fit in an uint64_t, otherwise returns the max
@@ -203,12 +238,40 @@ public:
 	void GetPDBHistogram(int which, std::vector<uint64_t> &values) const;
 	
 	double HCost(const state &s);
+	/**
+	 As HCost(s), where parentHCost is the heuristic of s or of a neighbor of
+	 s (as passed by IDA*). If the lookup tree is a single mod 3 PDB the
+	 entry is decoded from parentHCost; otherwise it is ignored.
+	 **/
+	double HCost(const state &s, double parentHCost);
+	/**
+	 Computes HCost(s) for count states at once. All PDB ranks are computed
+	 and the table entries prefetched before any values are read, so the
+	 cache misses of the different lookups overlap. parentHCost is as in
+	 HCost(s, parentHCost), for a state that all of them neighbor.
+	 **/
+	void BatchHCost(const state *states, size_t count, double *hcosts, double parentHCost);
 	virtual double DefaultH(const state &s) const { return 0; }
 
 	virtual double AdditiveGCost(const state &s, const action &d)
 	{ assert(!"Additive Gost used but not defined for this class\n"); }
 private:
-	double HCost(const state &s, int treeNode, std::vector<int> &c1, std::vector<int> &c2);
+	/**
+	 The lookups use c1, c2 and acts as scratch space, so each thread must
+	 pass its own.
+	 **/
+	double HCost(const state &s, int treeNode, std::vector<int> &c1, std::vector<int> &c2,
+				 std::vector<action> &acts, const uint64_t *ranks = 0, double parentHCost = -1);
+	void PrefetchLeaf(int treeNode, uint64_t rank) const;
+	int GetPDBValue(int whichPDB, uint64_t index, int puzzleSize, std::vector<int> &c1, std::vector<int> &c2,
+					std::vector<action> &acts, int parentValue = -1);
+	int DecodeMod3PDB(int whichPDB, uint64_t index, int puzzleSize, std::vector<int> &c1, std::vector<int> &c2,
+					  std::vector<action> &acts, int parentValue);
+	bool CanDecodeMod3(int whichPDB);
+	bool SavePDBFile(int whichPDB, const state &goal, const char *fname, bool additivePDB,
+					 PDBTreeNodeType compression, int factor);
+	/** The goal with every item outside the pattern replaced by -1 **/
+	void GetAbstractGoal(const state &goal, const std::vector<int> &pattern, std::vector<int> &abstractGoal) const;
 public:
 	/**
 	 Checks that the given state is a valid state for this domain. Note, is
@@ -249,26 +312,27 @@ public:
 	
 	static bool Read_In_Permutations(const char *filename, unsigned size, unsigned max_puzzles, std::vector<std::vector<int> > &permutations, bool puzz_num_start);
 	
-	void CreateThreads(int count, int depth);
-	void ThreadWorker(int depth, int totalTiles,
+	void ThreadWorker(int threadID, int totalTiles,
 					  std::vector<uint8_t> *DB,
-					  //std::vector<uint8_t> *coarseOpen,
+					  std::vector<uint8_t> *coarseOpen,
+					  std::vector<uint64_t> *claimed,
 					  const std::vector<int> *distinct,
-					  SharedQueue<std::pair<uint64_t, uint64_t> > *work,
-					  SharedQueue<uint64_t> *results,
-					  std::mutex *lock,
+					  WorkStealingQueue<uint64_t> *work,
+					  Barrier *barrier,
+					  const int *depth,
+					  std::vector<uint64_t> *expanded,
+					  std::vector<uint64_t> *discovered,
 					  bool additive);
 
-	void DeltaWorker(std::vector<uint8_t> *array,
+	void DeltaWorker(PDBTable *array,
 					 std::vector<int> *distinct,
 					 int puzzleSize,
 					 uint64_t start, uint64_t end);
 	
 	
 	bool additive;
-	int maxItem, minPattern;
 	// holds a set of Pattern Databases which can be maxed over later
-	std::vector<std::vector<uint8_t> > PDB;
+	std::vector<PDBTable> PDB;
 	// holds the set of distinct items used to build the associated PDB (and therefore needed for hashing)
 	std::vector<std::vector<int> > PDB_distincts;
 	std::vector<PDBTreeNode> lookups;
@@ -277,7 +341,6 @@ public:
 //	pthread_mutex_t queueLock;
 //	pthread_mutex_t writeLock;
 //	std::vector<uint64_t> workQueue;
-	mutable std::vector<std::vector<uint64_t> > factorialCache;
 };
 
 template <class state, class action>
@@ -305,44 +368,15 @@ std::vector<int> PermutationPuzzleEnvironment<state, action>::Get_Random_Permuta
 }
 
 template <class state, class action>
-void PermutationPuzzleEnvironment<state, action>::GetStateFromHash(state &s, uint64_t hash)
+void PermutationPuzzleEnvironment<state, action>::GetStateFromHash(state &s, uint64_t hash) const
 {
-	std::vector<int> puzzle = s.puzzle;
-	uint64_t hashVal = hash;
-	
-	int numEntriesLeft = 1;
-	for (int x = s.puzzle.size()-1; x >= 0; x--)
-	{
-		puzzle[x] = hashVal%numEntriesLeft;
-		hashVal /= numEntriesLeft;
-		numEntriesLeft++;
-		for (int y = x+1; y < (int) s.puzzle.size(); y++)
-		{
-			if (puzzle[y] >= puzzle[x])
-				puzzle[y]++;
-		}
-	}
-	
-	s.puzzle = puzzle;
+	UnrankPermutation(hash, s.puzzle.data(), (int)s.puzzle.size());
 }
 
 template <class state, class action>
 uint64_t PermutationPuzzleEnvironment<state, action>::GetStateHash(const state &s) const
 {
-	std::vector<int> puzzle = s.puzzle;
-	uint64_t hashVal = 0;
-	int numEntriesLeft = s.puzzle.size();
-	for (unsigned int x = 0; x < s.puzzle.size(); x++)
-	{
-		hashVal += puzzle[x]*Factorial(numEntriesLeft-1);
-		numEntriesLeft--;
-		for (unsigned y = x; y < puzzle.size(); y++)
-		{
-			if (puzzle[y] > puzzle[x])
-				puzzle[y]--;
-		}
-	}
-	return hashVal;
+	return RankPermutation(s.puzzle.data(), (int)s.puzzle.size());
 }
 
 template <class state, class action>
@@ -357,65 +391,15 @@ uint64_t PermutationPuzzleEnvironment<state, action>::Factorial(int val) const
 	return table[val];
 }
 
-template <class state, class action>
-void PermutationPuzzleEnvironment<state, action>::buildCaches() const
-{
-	factorialCache.resize(maxItem+1);
-	for (int n = 0; n < factorialCache.size(); n++)
-	{
-		factorialCache[n].resize(maxItem-minPattern+1);
-		for (int k = 0; k < factorialCache[n].size(); k++)
-		{
-			uint64_t value = 1;
-			for (int i = n; i > k; i--)
-			{
-				value *= i;
-			}
-			factorialCache[n][k] = value;
-
-		}
-	}
-}
-
-
-template <class state, class action>
-uint64_t PermutationPuzzleEnvironment<state, action>::nUpperk(int n, int k) const
-{
-	assert(factorialCache.size() > n);
-	assert(factorialCache[n].size() > k);
-	return factorialCache[n][k];
-
-//	static std::vector<std::vector<uint64_t> > cache;
-//	if (n >= cache.size())
-//		cache.resize(n+1);
-//	if (k >= cache[n].size())
-//		cache[n].resize(k+1);
-//	if (cache[n][k] == 0)
-//	{
-//		uint64_t value = 1;
-//		assert(n >= 0 && k >= 0);
-//		
-//		for (int i = n; i > k; i--)
-//		{
-//			value *= i;
-//		}
-//	
-//		cache[n][k] = value;
-//		return value;
-//	}
-//	return cache[n][k];
-}
-
 template <class state, class action>
 uint64_t PermutationPuzzleEnvironment<state, action>::GetPDBHash(const state &s,
 																 const std::vector<int> &distinct) const
 {
-	static std::vector<int> locs;
-	static std::vector<int> dual;
+	static thread_local std::vector<int> locs;
+	static thread_local std::vector<int> dual;
 	return GetPDBHash(s, distinct, locs, dual);
 }
 
-// TODO Change to Myrvold and Ruskey ranking function
 template <class state, class action>
 uint64_t PermutationPuzzleEnvironment<state, action>::GetPDBHash(const state &s,
 																 const std::vector<int> &distinct,
@@ -435,23 +419,7 @@ uint64_t PermutationPuzzleEnvironment<state, action>::GetPDBHash(const state &s,
 	{
 		locs[x] = dual[distinct[x]];
 	}
-	
-	uint64_t hashVal = 0;
-	int numEntriesLeft = s.puzzle.size();
-	
-	for (unsigned int x = 0; x < locs.size(); x++)
-	{
-		hashVal += locs[x]*nUpperk(numEntriesLeft-1, s.puzzle.size()-distinct.size());
-		numEntriesLeft--;
-		
-		// decrement locations of remaining items
-		for (unsigned y = x; y < locs.size(); y++)
-		{
-			if (locs[y] > locs[x])
-				locs[y]--;
-		}
-	}
-	return hashVal;
+	return RankPartialPermutation(locs.data(), (int)locs.size(), (int)s.puzzle.size());
 }
 
 // non-thread safe version of unranking
@@ -459,7 +427,7 @@ template <class state, class action>
 void PermutationPuzzleEnvironment<state, action>::GetStateFromPDBHash(uint64_t hash, state &s, int count,
 																	  const std::vector<int> &pattern)
 {
-	static std::vector<int> dual;
+	static thread_local std::vector<int> dual;
 	GetStateFromPDBHash(hash, s, count, pattern, dual);
 }
 
@@ -468,22 +436,8 @@ void PermutationPuzzleEnvironment<state, action>::GetStateFromPDBHash(uint64_t h
 																	  const std::vector<int> &pattern,
 																	  std::vector<int> &dual)
 {
-	uint64_t hashVal = hash;
-	///*static*/ std::vector<int> dual;
 	dual.resize(pattern.size());
-	
-	int numEntriesLeft = count-pattern.size()+1;
-	for (int x = pattern.size()-1; x >= 0; x--)
-	{
-		dual[x] = hashVal%numEntriesLeft;
-		hashVal /= numEntriesLeft;
-		numEntriesLeft++;
-		for (int y = x+1; y < pattern.size(); y++)
-		{
-			if (dual[y] >= dual[x])
-				dual[y]++;
-		}
-	}
+	UnrankPartialPermutation(hash, dual.data(), (int)pattern.size(), count);
 	s.puzzle.resize(count);
 	std::fill(s.puzzle.begin(), s.puzzle.end(), -1);
 	for (int x = 0; x < dual.size(); x++)
@@ -493,16 +447,18 @@ void PermutationPuzzleEnvironment<state, action>::GetStateFromPDBHash(uint64_t h
 template <class state, class action>
 void PermutationPuzzleEnvironment<state, action>::Min_Compress_PDB(int whichPDB, int factor, bool print_histogram)
 {
+	if (!PDB[whichPDB].Convert(kPDB8Bit))
+		return;
 	printf("Performing min compression, reducing from %llu entries to %llu entries\n",
 		   PDB[whichPDB].size(), (PDB[whichPDB].size()+factor-1)/factor);
 	std::vector<uint8_t> newPDB((PDB[whichPDB].size()+factor-1)/factor);
 	for (uint64_t x = 0; x < PDB[whichPDB].size(); x+=factor)
 	{
-		int minVal = PDB[whichPDB][x];
+		int minVal = PDB[whichPDB].Get(x);
 		for (uint64_t y = 1; y < factor; y++)
 		{
 			if (x+y < PDB[whichPDB].size())
-				minVal = min(minVal, PDB[whichPDB][x+y]);
+				minVal = min(minVal, PDB[whichPDB].Get(x+y));
 		}
 		newPDB[x/factor] = minVal;
 	}
@@ -511,6 +467,29 @@ void PermutationPuzzleEnvironment<state, action>::Min_Compress_PDB(int whichPDB,
 		PrintPDBHistogram(whichPDB);
 }
 
+template <class state, class action>
+void PermutationPuzzleEnvironment<state, action>::Convert_PDB_Storage(int whichPDB, PDBStorageType storage, bool print_histogram)
+{
+	uint64_t oldSize = PDB[whichPDB].GetMemoryUsage();
+	if (storage == kPDB2BitMod3 && PDB[whichPDB].GetStorageType() != kPDB2BitMod3 &&
+		!PDB[whichPDB].IsDecodableMod3())
+	{
+		// tables built or mapped by this class record the check; others are checked once here
+		if (additive || !CanDecodeMod3(whichPDB))
+		{
+			printf("Error: PDB %d can't be stored mod 3; it must be an uncompressed, unit-cost, non-additive PDB\n", whichPDB);
+			return;
+		}
+		PDB[whichPDB].SetDecodableMod3(true);
+	}
+	if (!PDB[whichPDB].Convert(storage))
+		return;
+	printf("PDB %d now uses %d bits per entry (%llu bytes; was %llu)\n", whichPDB,
+		   PDB[whichPDB].GetBitsPerEntry(), (unsigned long long)PDB[whichPDB].GetMemoryUsage(), (unsigned long long)oldSize);
+	if (print_histogram)
+		PrintPDBHistogram(whichPDB);
+}
+
 template <class state, class action>
 void PermutationPuzzleEnvironment<state, action>::Fractional_Compress_PDB(int whichPDB, uint64_t count, bool print_histogram)
 {
@@ -521,10 +500,12 @@ template <class state, class action>
 void PermutationPuzzleEnvironment<state, action>::Fractional_Mod_Compress_PDB(int whichPDB, uint64_t factor,
 																			  bool print_histogram)
 {
+	if (!PDB[whichPDB].Convert(kPDB8Bit))
+		return;
 	std::vector<uint8_t> newPDB(PDB[whichPDB].size()/factor);
 	for (int x = 0; x < PDB[whichPDB].size(); x+= factor)
 	{
-		newPDB[x/factor] = PDB[whichPDB][x];
+		newPDB[x/factor] = PDB[whichPDB].Get(x);
 	}
 	PDB[whichPDB].swap(newPDB);
 	if (print_histogram)
@@ -535,6 +516,8 @@ void PermutationPuzzleEnvironment<state, action>::Fractional_Mod_Compress_PDB(in
 template <class state, class action>
 void PermutationPuzzleEnvironment<state, action>::Mod_Compress_PDB(int whichPDB, uint64_t newEntries, bool print_histogram)
 {
+	if (!PDB[whichPDB].Convert(kPDB8Bit))
+		return;
 	if (newEntries == 0)
 	{
 		printf("Error -- cannot reduce to 0 entries\n");
@@ -543,9 +526,9 @@ void PermutationPuzzleEnvironment<state, action>::Mod_Compress_PDB(int whichPDB,
 	printf("Performing mod compression, reducing from %llu entries to %llu entries\n", PDB[whichPDB].size(), newEntries);
 	std::vector<uint8_t> newPDB(newEntries);
 	for (uint64_t x = 0; x < newEntries; x++)
-		newPDB[x] = PDB[whichPDB][x];
+		newPDB[x] = PDB[whichPDB].Get(x);
 	for (uint64_t x = newEntries; x < PDB[whichPDB].size(); x++)
-		newPDB[x%newEntries] = min(newPDB[x%newEntries], PDB[whichPDB][x]);
+		newPDB[x%newEntries] = min(newPDB[x%newEntries], PDB[whichPDB].Get(x));
 	PDB[whichPDB].swap(newPDB);
 	if (print_histogram)
 		PrintPDBHistogram(whichPDB);
@@ -555,9 +538,12 @@ void PermutationPuzzleEnvironment<state, action>::Mod_Compress_PDB(int whichPDB,
 template <class state, class action>
 void PermutationPuzzleEnvironment<state, action>::Value_Compress_PDB(int whichPDB, int maxValue, bool print_histogram)
 {
+	if (!PDB[whichPDB].Convert(kPDB8Bit))
+		return;
+	PDB[whichPDB].MakeWritable();
 	for (uint64_t x = 0; x < PDB[whichPDB].size(); x++)
-		if (PDB[whichPDB][x] > maxValue)
-			PDB[whichPDB][x] = maxValue;
+		if (PDB[whichPDB].Get(x) > maxValue)
+			PDB[whichPDB].Set(x, maxValue);
 	
 	if (print_histogram)
 		PrintPDBHistogram(whichPDB);
@@ -566,6 +552,9 @@ void PermutationPuzzleEnvironment<state, action>::Value_Compress_PDB(int whichPD
 template <class state, class action>
 void PermutationPuzzleEnvironment<state, action>::Value_Range_Compress_PDB(int whichPDB, int numBits, bool print_histogram)
 {
+	if (!PDB[whichPDB].Convert(kPDB8Bit))
+		return;
+	PDB[whichPDB].MakeWritable();
 	std::vector<uint64_t> dist;
 	std::vector<int> cutoffs;
 	GetPDBHistogram(whichPDB, dist);
@@ -580,10 +569,10 @@ void PermutationPuzzleEnvironment<state, action>::Value_Range_Compress_PDB(int w
 	{
 		for (int y = 0; y < cutoffs.size(); y++)
 		{
-			if (PDB[whichPDB][x] >= cutoffs[y] && PDB[whichPDB][x] < cutoffs[y+1])
+			if (PDB[whichPDB].Get(x) >= cutoffs[y] && PDB[whichPDB].Get(x) < cutoffs[y+1])
 			{
-				//printf("%d -> %d\n", PDB[whichPDB][x], cutoffs[y]);
-				PDB[whichPDB][x] = cutoffs[y];
+				//printf("%d -> %d\n", PDB[whichPDB].Get(x), cutoffs[y]);
+				PDB[whichPDB].Set(x, cutoffs[y]);
 				break;
 			}
 		}
@@ -596,15 +585,18 @@ void PermutationPuzzleEnvironment<state, action>::Value_Range_Compress_PDB(int w
 template <class state, class action>
 void PermutationPuzzleEnvironment<state, action>::Value_Compress_PDB(int whichPDB, std::vector<int> cutoffs, bool print_histogram)
 {
+	if (!PDB[whichPDB].Convert(kPDB8Bit))
+		return;
+	PDB[whichPDB].MakeWritable();
 
 	for (uint64_t x = 0; x < PDB[whichPDB].size(); x++)
 	{
 		for (int y = 0; y < cutoffs.size(); y++)
 		{
-			if (PDB[whichPDB][x] >= cutoffs[y] && PDB[whichPDB][x] < cutoffs[y+1])
+			if (PDB[whichPDB].Get(x) >= cutoffs[y] && PDB[whichPDB].Get(x) < cutoffs[y+1])
 			{
-				//printf("%d -> %d\n", PDB[whichPDB][x], cutoffs[y]);
-				PDB[whichPDB][x] = cutoffs[y];
+				//printf("%d -> %d\n", PDB[whichPDB].Get(x), cutoffs[y]);
+				PDB[whichPDB].Set(x, cutoffs[y]);
 				break;
 			}
 		}
@@ -619,6 +611,14 @@ template <class state, class action>
 void PermutationPuzzleEnvironment<state, action>::Load_Regular_PDB(const char *fname, state &goal, bool print_histogram)
 {
 	additive = false;
+	if (PDBTable::IsPDBFile(fname))
+	{
+		if (!Load_Mapped_PDB(fname, goal))
+			exit(0);
+		if (print_histogram)
+			PrintPDBHistogram(PDB.size()-1);
+		return;
+	}
 	PDB.resize(PDB.size()+1); // increase the number of regular PDBs being stored
 	printf("Loading PDB '%s'\n", fname);
 	std::vector<int> distinct;
@@ -636,15 +636,12 @@ void PermutationPuzzleEnvironment<state, action>::Load_Regular_PDB(const char *f
 	distinct.resize(num_distinct);
 	assert(fread(&distinct[0], sizeof(distinct[0]), distinct.size(), f) == distinct.size());
 	
-	maxItem = max(maxItem,goal.puzzle.size());
-	minPattern = min(minPattern, distinct.size());
-	buildCaches();
 	
 	uint64_t COUNT = nUpperk(goal.puzzle.size(), goal.puzzle.size() - distinct.size());
 	PDB.back().resize(COUNT);
 	
 	size_t index;
-	if ((index = fread(&PDB.back()[0], sizeof(uint8_t), COUNT, f)) != COUNT)
+	if ((index = fread(PDB.back().GetData(), sizeof(uint8_t), COUNT, f)) != COUNT)
 	{
 		printf("Error; did not correctly read %lu entries from PDB (%lu instead)\n", COUNT, index);
 		exit(0);
@@ -657,6 +654,111 @@ void PermutationPuzzleEnvironment<state, action>::Load_Regular_PDB(const char *f
 		PrintPDBHistogram(PDB.size()-1);
 }
 
+template <class state, class action>
+void PermutationPuzzleEnvironment<state, action>::GetAbstractGoal(const state &goal, const std::vector<int> &pattern,
+																  std::vector<int> &abstractGoal) const
+{
+	abstractGoal.resize(goal.puzzle.size());
+	for (unsigned int x = 0; x < goal.puzzle.size(); x++)
+	{
+		abstractGoal[x] = -1;
+		for (unsigned int y = 0; y < pattern.size(); y++)
+		{
+			if (goal.puzzle[x] == pattern[y])
+				abstractGoal[x] = pattern[y];
+		}
+	}
+}
+
+template <class state, class action>
+bool PermutationPuzzleEnvironment<state, action>::Save_PDB(int whichPDB, const state &goal, const char *fname,
+														   PDBTreeNodeType compression, int factor)
+{
+	return SavePDBFile(whichPDB, goal, fname, additive, compression, factor);
+}
+
+template <class state, class action>
+bool PermutationPuzzleEnvironment<state, action>::SavePDBFile(int whichPDB, const state &goal, const char *fname,
+															  bool additivePDB, PDBTreeNodeType compression, int factor)
+{
+	PDBFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.puzzleSize = goal.puzzle.size();
+	header.compression = compression;
+	header.compressionFactor = factor;
+	header.flags = additivePDB?kPDBAdditive:0;
+	std::vector<int> abstractGoal;
+	GetAbstractGoal(goal, PDB_distincts[whichPDB], abstractGoal);
+	if (!PDB[whichPDB].Write(fname, header, PDB_distincts[whichPDB], abstractGoal))
+	{
+		printf("Error writing PDB to '%s'\n", fname);
+		return false;
+	}
+	printf("Wrote %llu entries to '%s'\n", (unsigned long long)PDB[whichPDB].size(), fname);
+	return true;
+}
+
+template <class state, class action>
+bool PermutationPuzzleEnvironment<state, action>::Load_Mapped_PDB(const char *fname, const state &goal,
+																  PDBTreeNodeType compression)
+{
+	printf("Mapping PDB '%s'\n", fname);
+	PDBTable table;
+	PDBFileHeader header;
+	std::vector<int> distinct, fileGoal, abstractGoal;
+	if (!table.Map(fname, header, distinct, fileGoal))
+		return false;
+	if (header.puzzleSize != goal.puzzle.size())
+	{
+		printf("PDB '%s' was built for puzzle size %u, not %lu\n", fname, header.puzzleSize, goal.puzzle.size());
+		return false;
+	}
+	if (((header.flags&kPDBAdditive) != 0) != additive)
+	{
+		printf("PDB '%s' is %s PDB; expected %s PDB\n", fname,
+			   (header.flags&kPDBAdditive)?"an additive":"a regular", additive?"an additive":"a regular");
+		return false;
+	}
+	if (header.compression != compression)
+	{
+		printf("PDB '%s' has compression type %u; expected %d\n", fname, header.compression, compression);
+		return false;
+	}
+	for (unsigned int x = 0; x < distinct.size(); x++)
+	{
+		if (distinct[x] < 0 || distinct[x] >= (int)goal.puzzle.size())
+		{
+			printf("PDB '%s' has an invalid pattern\n", fname);
+			return false;
+		}
+	}
+	GetAbstractGoal(goal, distinct, abstractGoal);
+	if (abstractGoal != fileGoal)
+	{
+		printf("PDB '%s' was built for a different goal\n", fname);
+		return false;
+	}
+	if (table.GetStorageType() == kPDB2BitMod3 && !table.IsDecodableMod3())
+	{
+		printf("PDB '%s' is stored mod 3 but its values can't be decoded\n", fname);
+		return false;
+	}
+	
+	
+	// uncompressed tables must hold exactly one entry per abstract state
+	uint64_t COUNT = nUpperk(goal.puzzle.size(), goal.puzzle.size() - distinct.size());
+	if (compression == kLeafNode && header.numEntries != COUNT)
+	{
+		printf("PDB '%s' has %llu entries; expected %llu\n", fname, (unsigned long long)header.numEntries, (unsigned long long)COUNT);
+		return false;
+	}
+	
+	PDB.resize(PDB.size()+1);
+	PDB.back().swap(table);
+	PDB_distincts.push_back(distinct);
+	return true;
+}
+
 template <class state, class action>
 void PermutationPuzzleEnvironment<state, action>::Load_Regular_PDB_as_Delta_and_Min(const char *fname,
 																					state &goal, int factor,
@@ -667,10 +769,10 @@ void PermutationPuzzleEnvironment<state, action>::Load_Regular_PDB_as_Delta_and_
 	std::vector<uint8_t> newPDB((PDB.back().size()+factor-1)/factor);
 	for (uint64_t x = 0; x < PDB.back().size(); x+= factor)
 	{
-		uint64_t value = PDB.back()[x];
+		uint64_t value = PDB.back().Get(x);
 		for (int y = 1; y < factor && (x+y < PDB.back().size()); y++)
 		{
-			value = min(value, PDB.back()[x+y]);
+			value = min(value, PDB.back().Get(x+y));
 		}
 		newPDB[entry] = value;
 		entry++;
@@ -689,8 +791,8 @@ void PermutationPuzzleEnvironment<state, action>::PrintPDBHistogram(int which) c
 	// performs histogram count
 	for (uint64_t x = 0; x < PDB[which].size(); x++)
 	{
-		values[(PDB[which][x])]++;
-		maxval = max(maxval, PDB[which][x]);
+		values[(PDB[which].Get(x))]++;
+		maxval = max(maxval, PDB[which].Get(x));
 	}
 	// outputs histogram of heuristic value counts
 	for (uint64_t x = 0; x <= maxval; x++)
@@ -710,8 +812,8 @@ void PermutationPuzzleEnvironment<state, action>::GetPDBHistogram(int which, std
 	// performs histogram count
 	for (uint64_t x = 0; x < PDB[which].size(); x++)
 	{
-		values[(PDB[which][x])]++;
-		maxval = max(maxval, PDB[which][x]);
+		values[(PDB[which].Get(x))]++;
+		maxval = max(maxval, PDB[which].Get(x));
 	}
 	values.resize(maxval+1);
 }
@@ -720,6 +822,9 @@ void PermutationPuzzleEnvironment<state, action>::GetPDBHistogram(int which, std
 template <class state, class action>
 void PermutationPuzzleEnvironment<state, action>::Delta_Compress_PDB(state goal, int whichPDB, bool print_histogram)
 {
+	if (!PDB[whichPDB].Convert(kPDB8Bit))
+		return;
+	PDB[whichPDB].MakeWritable();
 	Timer t;
 	t.StartTimer();
 	uint64_t COUNT = PDB[whichPDB].size();
@@ -750,10 +855,10 @@ void PermutationPuzzleEnvironment<state, action>::Delta_Compress_PDB(state goal,
 		{
 			GetStateFromPDBHash(x, tmp, goal.puzzle.size(), PDB_distincts[whichPDB]);
 			int h1 = HCost(tmp);
-			int h2 = PDB.back()[x];
+			int h2 = PDB.back().Get(x);
 			//		if ((h1%2)||(h2%2))
 			//			printf("%d - %d = %d\n", h2, h1, h2-h1);
-			PDB.back()[x] = h2 - h1;
+			PDB.back().Set(x, h2 - h1);
 		}
 	}
 	printf("%1.2fs doing delta conversion\n", t.EndTimer());
@@ -766,37 +871,47 @@ template <class state, class action>
 void PermutationPuzzleEnvironment<state, action>::Load_Regular_PDB_as_Delta(const char *fname, state &goal, bool print_histogram)
 {
 	additive = false;
-	PDB.resize(PDB.size()+1); // increase the number of regular PDBs being stored
-	printf("Loading PDB '%s'\n", fname);
 	std::vector<int> distinct;
-	
-	FILE *f;
-	f = fopen(fname, "r");
-	if (f == 0)
+	uint64_t COUNT;
+	if (PDBTable::IsPDBFile(fname))
 	{
-		printf("Failed to open pdb '%s'\n", fname);
-		exit(0);
+		// the delta is written into the table, so it can't stay mapped
+		if (!Load_Mapped_PDB(fname, goal) || !PDB.back().Convert(kPDB8Bit))
+			exit(0);
+		PDB.back().MakeWritable();
+		distinct = PDB_distincts.back();
+		PDB_distincts.pop_back(); // stored again once the delta is computed
+		COUNT = PDB.back().size();
 	}
-	
-	int num_distinct;
-	assert(fread(&num_distinct, sizeof(num_distinct), 1, f) == 1);
-	distinct.resize(num_distinct);
-	assert(fread(&distinct[0], sizeof(distinct[0]), distinct.size(), f) == distinct.size());
-	
-	maxItem = max(maxItem,goal.puzzle.size());
-	minPattern = min(minPattern, distinct.size());
-	buildCaches();
-	
-	uint64_t COUNT = nUpperk(goal.puzzle.size(), goal.puzzle.size() - distinct.size());
-	PDB.back().resize(COUNT);
-	
-	size_t index;
-	if ((index = fread(&PDB.back()[0], sizeof(uint8_t), COUNT, f)) != COUNT)
-	{
-		printf("Error; did not correctly read %lu entries from PDB (%lu instead)\n", COUNT, index);
-		exit(0);
+	else {
+		PDB.resize(PDB.size()+1); // increase the number of regular PDBs being stored
+		printf("Loading PDB '%s'\n", fname);
+		
+		FILE *f;
+		f = fopen(fname, "r");
+		if (f == 0)
+		{
+			printf("Failed to open pdb '%s'\n", fname);
+			exit(0);
+		}
+		
+		int num_distinct;
+		assert(fread(&num_distinct, sizeof(num_distinct), 1, f) == 1);
+		distinct.resize(num_distinct);
+		assert(fread(&distinct[0], sizeof(distinct[0]), distinct.size(), f) == distinct.size());
+		
+		
+		COUNT = nUpperk(goal.puzzle.size(), goal.puzzle.size() - distinct.size());
+		PDB.back().resize(COUNT);
+		
+		size_t index;
+		if ((index = fread(PDB.back().GetData(), sizeof(uint8_t), COUNT, f)) != COUNT)
+		{
+			printf("Error; did not correctly read %lu entries from PDB (%lu instead)\n", COUNT, index);
+			exit(0);
+		}
+		fclose(f);
 	}
-	fclose(f);
 	
 	Timer t;
 	t.StartTimer();
@@ -827,10 +942,10 @@ void PermutationPuzzleEnvironment<state, action>::Load_Regular_PDB_as_Delta(cons
 		{
 			GetStateFromPDBHash(x, tmp, goal.puzzle.size(), distinct);
 			int h1 = HCost(tmp);
-			int h2 = PDB.back()[x];
+			int h2 = PDB.back().Get(x);
 			//		if ((h1%2)||(h2%2))
 			//			printf("%d - %d = %d\n", h2, h1, h2-h1);
-			PDB.back()[x] = h2 - h1;
+			PDB.back().Set(x, h2 - h1);
 		}
 	}
 	printf("%1.2fs doing delta conversion\n", t.EndTimer());
@@ -840,7 +955,7 @@ void PermutationPuzzleEnvironment<state, action>::Load_Regular_PDB_as_Delta(cons
 }
 
 template <class state, class action>
-void PermutationPuzzleEnvironment<state, action>::DeltaWorker(std::vector<uint8_t> *array,
+void PermutationPuzzleEnvironment<state, action>::DeltaWorker(PDBTable *array,
 															  std::vector<int> *distinct,
 															  int puzzleSize,
 															  uint64_t start, uint64_t end)
@@ -848,13 +963,14 @@ void PermutationPuzzleEnvironment<state, action>::DeltaWorker(std::vector<uint8_
 	std::vector<int> dual;
 	std::vector<int> c1;
 	std::vector<int> c2;
+	std::vector<action> acts;
 	state tmp;
 	for (uint64_t x = start; x < end; x++)
 	{
 		GetStateFromPDBHash(x, tmp, puzzleSize, *distinct, dual);
-		int h1 = HCost(tmp, 0, c1, c2);
-		int h2 = (*array)[x];
-		(*array)[x] = h2 - h1;
+		int h1 = HCost(tmp, 0, c1, c2, acts);
+		int h2 = array->Get(x);
+		array->Set(x, h2 - h1);
 		assert(h2 >= h1);
 	}
 }
@@ -865,6 +981,13 @@ void PermutationPuzzleEnvironment<state, action>::Load_Regular_PDB_Min_Compresse
 																				  int factor, bool print_histogram)
 {
 	additive = false;
+	if (PDBTable::IsPDBFile(fname))
+	{
+		if (!Load_Mapped_PDB(fname, goal) || !PDB.back().Convert(kPDB8Bit))
+			exit(0);
+		Min_Compress_PDB(PDB.size()-1, factor, true);
+		return;
+	}
 	PDB.resize(PDB.size()+1); // increase the number of regular PDBs being stored
 	printf("Loading PDB '%s'\n", fname);
 	std::vector<int> distinct;
@@ -882,13 +1005,9 @@ void PermutationPuzzleEnvironment<state, action>::Load_Regular_PDB_Min_Compresse
 	distinct.resize(num_distinct);
 	assert(fread(&distinct[0], sizeof(distinct[0]), distinct.size(), f) == distinct.size());
 	
-	maxItem = max(maxItem,goal.puzzle.size());
-	minPattern = min(minPattern, distinct.size());
-	buildCaches();
 	
 	uint64_t COUNT = nUpperk(goal.puzzle.size(), goal.puzzle.size() - distinct.size());
-	PDB.back().resize(0);
-	
+	std::vector<uint8_t> newPDB;
 	std::vector<uint8_t> items(factor);
 	size_t index = 0;
 	//if ((index = fread(&PDB.back()[0], sizeof(uint8_t), COUNT, f)) != COUNT)
@@ -897,7 +1016,7 @@ void PermutationPuzzleEnvironment<state, action>::Load_Regular_PDB_Min_Compresse
 		int minValue = items[0];
 		for (int x = 1; x < factor; x++)
 			minValue = min(minValue, items[x]);
-		PDB.back().push_back(minValue);
+		newPDB.push_back(minValue);
 	} while (index != COUNT && !feof(f));
 	if (index != COUNT)
 	{
@@ -905,6 +1024,7 @@ void PermutationPuzzleEnvironment<state, action>::Load_Regular_PDB_Min_Compresse
 		exit(0);
 	}
 	fclose(f);
+	PDB.back().swap(newPDB);
 	
 	PDB_distincts.push_back(distinct); // stores distinct
 	
@@ -919,9 +1039,11 @@ double PermutationPuzzleEnvironment<state, action>::PDB_Lookup(const state &s)
 		double val = 0;
 		for (unsigned int x = 0; x < PDB.size(); x++)
 		{
-			uint64_t index = GetPDBHash(s, PDB_distincts[x]);
+			static thread_local std::vector<int> c1, c2;
+			static thread_local std::vector<action> acts;
+			uint64_t index = GetPDBHash(s, PDB_distincts[x], c1, c2);
 			//histogram[PDB[x][index]]++;
-			val = std::max(val, (double)PDB[x][index]);
+			val = std::max(val, (double)GetPDBValue(x, index, s.puzzle.size(), c1, c2, acts));
 		}
 		return val;
 	}
@@ -932,7 +1054,7 @@ double PermutationPuzzleEnvironment<state, action>::PDB_Lookup(const state &s)
 		{
 			uint64_t index = GetPDBHash(s, PDB_distincts[x]);
 			//histogram[PDB[x][index]]++;
-			tmp = PDB[x][index];
+			tmp = PDB[x].Get(index);
 			if (tmp > 4) tmp = 4;
 			val += (double)tmp;
 		}
@@ -942,122 +1064,145 @@ double PermutationPuzzleEnvironment<state, action>::PDB_Lookup(const state &s)
 
 const int coarseSize = 1024;
 
+/**
+ Atomically lowers the entry at loc to val if val is smaller. Returns the
+ value that was stored before the call. This lets the PDB builder threads
+ write into the shared table without a global lock.
+ **/
+static inline uint8_t AtomicMinByte(uint8_t *loc, uint8_t val)
+{
+	uint8_t old = __atomic_load_n(loc, __ATOMIC_RELAXED);
+	while (val < old &&
+		   !__atomic_compare_exchange_n(loc, &old, val, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	{ }
+	return old;
+}
+
+/**
+ Lowers the pending cost of a coarse chunk to val. Unlike AtomicMinByte
+ this always writes, with release ordering, so that a worker resetting the
+ chunk either sees the new entry in the table or is overwritten by this.
+ **/
+static inline void LowerCoarseOpen(uint8_t *loc, uint8_t val)
+{
+	uint8_t old = __atomic_load_n(loc, __ATOMIC_ACQUIRE);
+	while (!__atomic_compare_exchange_n(loc, &old, std::min(old, val), true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{ }
+}
+
+/**
+ Sets the bit for entry x; returns true if this call set it. The thread that
+ claims an entry is the one that expands it.
+ **/
+static inline bool ClaimEntry(uint64_t *bits, uint64_t x)
+{
+	uint64_t mask = 1ull<<(x&63);
+	return (__atomic_fetch_or(&bits[x>>6], mask, __ATOMIC_RELAXED)&mask) == 0;
+}
+
 template <class state, class action>
-void PermutationPuzzleEnvironment<state, action>::ThreadWorker(int depth, int totalTiles,
+void PermutationPuzzleEnvironment<state, action>::ThreadWorker(int threadID, int totalTiles,
 															   std::vector<uint8_t> *DB,
-															   //std::vector<uint8_t> *coarseOpen,
+															   std::vector<uint8_t> *coarseOpen,
+															   std::vector<uint64_t> *claimed,
 															   const std::vector<int> *distinct,
-															   SharedQueue<std::pair<uint64_t, uint64_t> > *work,
-															   SharedQueue<uint64_t> *results,
-															   std::mutex *lock,
+															   WorkStealingQueue<uint64_t> *work,
+															   Barrier *barrier,
+															   const int *depthPtr,
+															   std::vector<uint64_t> *expanded,
+															   std::vector<uint64_t> *discovered,
 															   bool additive)
 {
-	std::pair<uint64_t, uint64_t> p;
 	std::vector<uint64_t> additiveQueue;
 	std::vector<int> cache1;
 	std::vector<int> cache2;
-	uint64_t start, end;
 	std::vector<action> acts;
 	state s, t;
-	uint64_t count = 0;
+	uint8_t *db = &(*DB)[0];
+	uint8_t *coarse = &(*coarseOpen)[0];
+	uint64_t *claims = (claimed->size() > 0)?&(*claimed)[0]:0;
+	const uint64_t COUNT = DB->size();
 
-	struct writeInfo {
-		uint64_t rank;
-		int newGCost;
-	};
-	std::vector<writeInfo> cache;
 	while (true)
 	{
-		if (work->Remove(p) == false)
-		{
-			std::this_thread::sleep_for(std::chrono::microseconds(10));
-			continue;
-		}
-		if (p.first == p.second)
-		{
+		// wait for the next depth to be set up (or for shutdown)
+		barrier->Wait();
+		const int depth = *depthPtr;
+		if (depth < 0)
 			break;
-		}
-		start = p.first;
-		end = p.second;
-		//int nextDepth = 255;
-		for (uint64_t x = start; x < end; x++)
+
+		uint64_t count = 0, seen = 0;
+		uint64_t chunk;
+		while (work->Remove(threadID, chunk))
 		{
-			int stateDepth = (*DB)[x];
-			if (stateDepth == depth)
+			uint64_t start = chunk*coarseSize;
+			uint64_t end = std::min(COUNT, start+coarseSize);
+			// Reset the chunk before scanning. Any write into this chunk from now on
+			// lowers the value again, and any write before it is seen by the scan,
+			// so no pending entry can be lost.
+			__atomic_exchange_n(&coarse[chunk], 255, __ATOMIC_ACQ_REL);
+			uint8_t nextDepth = 255;
+			for (uint64_t x = start; x < end; x++)
 			{
-				count++;
-				GetStateFromPDBHash(x, s, totalTiles, *distinct, cache1);
-				//std::cout << "Expanding[r][" << stateDepth << "]: " << s << std::endl;
-				this->GetActions(s, acts);
-				for (int y = 0; y < acts.size(); y++)
+				int stateDepth = __atomic_load_n(&db[x], __ATOMIC_RELAXED);
+				if (stateDepth != depth)
 				{
-					this->GetNextState(s, acts[y], t);
-					assert(this->InvertAction(acts[y]) == true);
-					//virtual bool InvertAction(action &a) const = 0;
-
-					uint64_t nextRank = GetPDBHash(t, *distinct, cache1, cache2);
-					int newCost = stateDepth+(additive?this->AdditiveGCost(t, acts[y]):this->GCost(t, acts[y]));
-					cache.push_back({nextRank, newCost});
+					if (stateDepth > depth && stateDepth < nextDepth)
+						nextDepth = stateDepth;
+					continue;
 				}
-			}
-		}
-		do {
-			// write out everything
-			lock->lock();
-			for (auto d : cache)
-			{
-				if (d.newGCost < (*DB)[d.rank]) // shorter path
+				if (claims && !ClaimEntry(claims, x)) // already expanded through a 0-cost action
+					continue;
+				additiveQueue.push_back(x);
+				// expand this state and every 0-cost successor that lands on this depth
+				while (additiveQueue.size() > 0)
 				{
-					(*DB)[d.rank] = d.newGCost;
-					if (d.newGCost == depth) // 0-cost action; will expand immediately
+					uint64_t next = additiveQueue.back();
+					additiveQueue.pop_back();
+					count++;
+					GetStateFromPDBHash(next, s, totalTiles, *distinct, cache1);
+					this->GetActions(s, acts);
+					for (unsigned int y = 0; y < acts.size(); y++)
 					{
-						additiveQueue.push_back(d.rank);
+						this->GetNextState(s, acts[y], t);
+						assert(this->InvertAction(acts[y]) == true);
+						
+						uint64_t nextRank = GetPDBHash(t, *distinct, cache1, cache2);
+						int newCost = depth+(additive?this->AdditiveGCost(t, acts[y]):this->GCost(t, acts[y]));
+						assert(newCost < 255);
+						uint8_t oldCost = AtomicMinByte(&db[nextRank], newCost);
+						if (newCost >= oldCost)
+							continue;
+						if (oldCost == 255)
+							seen++;
+						if (newCost == depth) // 0-cost action; will expand immediately
+						{
+							// unless the thread scanning its chunk got to it first
+							if (!claims || ClaimEntry(claims, nextRank))
+								additiveQueue.push_back(nextRank);
+						}
+						else
+							LowerCoarseOpen(&coarse[nextRank/coarseSize], newCost);
 					}
 				}
 			}
-			lock->unlock();
-			cache.resize(0);
-			
-			while (additiveQueue.size() > 0)
-			{
-				uint64_t x = additiveQueue.back();
-				additiveQueue.pop_back();
-				int stateDepth = (*DB)[x];
-				assert(stateDepth == depth);
-
-				count++;
-				GetStateFromPDBHash(x, s, totalTiles, *distinct, cache1);
-				//std::cout << "Expanding[a][" << stateDepth << "]: " << s << std::endl;
-				this->GetActions(s, acts);
-				for (int y = 0; y < acts.size(); y++)
-				{
-					this->GetNextState(s, acts[y], t);
-					assert(this->InvertAction(acts[y]) == true);
-					//virtual bool InvertAction(action &a) const = 0;
-					
-					uint64_t nextRank = GetPDBHash(t, *distinct, cache1, cache2);
-					int newCost = stateDepth+(additive?this->AdditiveGCost(t, acts[y]):this->GCost(t, acts[y]));
-					cache.push_back({nextRank, newCost});
-				}
-			}
-			
-		} while (cache.size() != 0);
+			LowerCoarseOpen(&coarse[chunk], nextDepth);
+		}
+		(*expanded)[threadID] = count;
+		(*discovered)[threadID] = seen;
+		// signal that this depth is complete
+		barrier->Wait();
 	}
-	results->Add(count);
 }
 
 
 template <class state, class action>
 void PermutationPuzzleEnvironment<state, action>::Build_PDB(state &start, const std::vector<int> &distinct,
-															const char *pdb_filename, int numThreads, bool additive)
+															const char *pdb_filename, int numThreads, bool additive,
+															PDBStorageType storage)
 {
-	SharedQueue<std::pair<uint64_t, uint64_t> > workQueue;
-	SharedQueue<uint64_t> resultQueue;
-	std::mutex lock;
-
-	maxItem = max(maxItem,start.puzzle.size());
-	minPattern = min(minPattern, distinct.size());
-	buildCaches();
+	if (numThreads < 1)
+		numThreads = 1;
 	
 	uint64_t COUNT = nUpperk(start.puzzle.size(), start.puzzle.size() - distinct.size());
 	std::vector<uint8_t> DB(COUNT);
@@ -1065,9 +1210,15 @@ void PermutationPuzzleEnvironment<state, action>::Build_PDB(state &start, const
 	std::fill(DB.begin(), DB.end(), 255);
 	
 	// with weights we have to store the lowest weight stored to make sure
-	// we don't skip regions
+	// we don't skip regions; a chunk only needs scanning at depth d if it
+	// might hold an entry with cost d.
 	std::vector<uint8_t> coarseOpen((COUNT+coarseSize-1)/coarseSize);
 	std::fill(coarseOpen.begin(), coarseOpen.end(), 255);
+	// With 0-cost actions an entry can reach the depth being expanded while
+	// that depth is scanned, so both the thread that lowered it and the one
+	// scanning its chunk may find it. Each entry is expanded once, by the
+	// thread that sets its bit here.
+	std::vector<uint64_t> claimed(additive?(COUNT+63)/64:0);
 	
 	uint64_t entries = 0;
 	std::cout << "Num Entries: " << COUNT << std::endl;
@@ -1075,9 +1226,6 @@ void PermutationPuzzleEnvironment<state, action>::Build_PDB(state &start, const
 	std::cout << "State Hash of Goal: " << GetStateHash(start) << std::endl;
 	std::cout << "PDB Hash of Goal: " << GetPDBHash(start, distinct) << std::endl;
 	
-	std::deque<state> q_curr, q_next;
-	std::vector<state> children;
-	
 	for (unsigned i = 0; i < start.puzzle.size(); i++)
 	{
 		bool is_distinct = false;
@@ -1100,84 +1248,67 @@ void PermutationPuzzleEnvironment<state, action>::Build_PDB(state &start, const
 	std::cout << "Abstract PDB Hash of Goal: " << GetPDBHash(start, distinct) << std::endl;
 	Timer t;
 	t.StartTimer();
-//	q_curr.push_back(start);
 	DB[GetPDBHash(start, distinct)] = 0;
 	coarseOpen[GetPDBHash(start, distinct)/coarseSize] = 0;
+	entries++;
+
+	// The worker threads persist for the whole build; each depth is bracketed by
+	// two barrier waits, one to start the workers and one to collect them.
 	int depth = 0;
-	uint64_t newEntries;
+	WorkStealingQueue<uint64_t> workQueue(numThreads);
+	Barrier barrier(numThreads+1);
+	std::vector<uint64_t> expanded(numThreads), discovered(numThreads);
 	std::vector<std::thread*> threads(numThreads);
 	printf("Creating %d threads\n", numThreads);
-	do {
-		newEntries = 0;
+	for (int x = 0; x < numThreads; x++)
+	{
+		threads[x] = new std::thread(&PermutationPuzzleEnvironment<state, action>::ThreadWorker, this,
+									 x, start.puzzle.size(), &DB, &coarseOpen, &claimed,
+									 &distinct, &workQueue, &barrier, &depth,
+									 &expanded, &discovered, additive);
+	}
+	std::vector<uint64_t> work;
+	while (true)
+	{
+		// jump straight to the next depth with open entries; with weighted
+		// actions some depths may be empty
+		depth = 255;
+		for (uint64_t x = 0; x < coarseOpen.size(); x++)
+			depth = std::min(depth, (int)coarseOpen[x]);
+		if (depth == 255)
+			break;
+
 		Timer s;
 		s.StartTimer();
-		for (int x = 0; x < numThreads; x++)
+		work.resize(0);
+		for (uint64_t x = 0; x < coarseOpen.size(); x++)
 		{
-			threads[x] = new std::thread(&PermutationPuzzleEnvironment<state, action>::ThreadWorker, this,
-										 depth, start.puzzle.size(), &DB,// &coarseOpen,
-										 &distinct,
-										 &workQueue, &resultQueue, &lock, additive);
-		}
-		
-		for (uint64_t x = 0; x < COUNT; x+=coarseSize)
-		{
-			bool submit = false;
-			for (uint64_t t = x; t < min(COUNT, x+coarseSize); t++)
-			{
-				if (DB[t] == depth)
-				{
-					submit = true;
-					//newEntries++;
-				}
-			}
-			if (submit)
-			{
-				while (workQueue.size() > 10*numThreads)
-				{ std::this_thread::sleep_for(std::chrono::microseconds(10)); }
-				workQueue.Add({x, min(COUNT, x+coarseSize)});
-			}
+			if (coarseOpen[x] <= depth)
+				work.push_back(x);
 		}
+		workQueue.Distribute(work);
+		barrier.Wait(); // start workers
+		barrier.Wait(); // workers done
+
+		uint64_t newEntries = 0, newExpansions = 0;
 		for (int x = 0; x < numThreads; x++)
 		{
-			workQueue.Add({0,0});
-		}
-		for (int x = 0; x < numThreads; x++)
-		{
-			threads[x]->join();
-			delete threads[x];
-			threads[x] = 0;
-		}
-		// read out node counts
-		while (true)
-		{
-			uint64_t val;
-			if (resultQueue.Remove(val))
-			{
-				//newEntries+=val;
-			}
-			else {
-				break;
-			}
-		}
-		
-		newEntries = 0;
-		for (uint64_t x = 0; x < COUNT; x++)
-		{
-			if (DB[x] == depth)
-			{
-				newEntries++;
-			}
+			newEntries += discovered[x];
+			newExpansions += expanded[x];
 		}
 		entries += newEntries;
-		printf("Depth %d complete; %1.2fs elapsed. %llu new states seen; %llu of %llu total\n",
-			   depth, s.EndTimer(), newEntries, entries, COUNT);
-		depth++;
-//		depth = coarseOpen[0];
-//		for (int x = 1; x < coarseOpen.size(); x++)
-//			depth = min(depth, coarseOpen[x]);
-//		if (depth == 255) // no new entries!
-//			break;
-	} while (entries != COUNT);
+		printf("Depth %d complete; %1.2fs elapsed. %llu states expanded; %llu new states seen; %llu of %llu total\n",
+			   depth, s.EndTimer(), (unsigned long long)newExpansions, (unsigned long long)newEntries,
+			   (unsigned long long)entries, (unsigned long long)COUNT);
+	}
+	depth = -1;
+	barrier.Wait(); // release workers to exit
+	for (int x = 0; x < numThreads; x++)
+	{
+		threads[x]->join();
+		delete threads[x];
+		threads[x] = 0;
+	}
 	
 	printf("%1.2fs elapsed\n", t.EndTimer());
 	if (entries != COUNT)
@@ -1186,25 +1317,21 @@ void PermutationPuzzleEnvironment<state, action>::Build_PDB(state &start, const
 		assert(entries == COUNT);
 	}
 	
-	//TODO fix the output of PDBs
-	FILE *f = fopen(pdb_filename, "w");
-	int num = distinct.size();
-	assert(fwrite(&num, sizeof(num), 1, f) == 1);
-	assert(fwrite(&distinct[0], sizeof(distinct[0]), distinct.size(), f) == distinct.size());
-	assert(fwrite(&DB[0], sizeof(uint8_t), COUNT, f) == COUNT);
-	fclose(f);
-
-	PDB.push_back(DB); // increase the number of regular PDBs being stored
+	PDB.resize(PDB.size()+1); // increase the number of regular PDBs being stored
+	PDB.back().swap(DB);
 	PDB_distincts.push_back(distinct); // stores distinct
 	PrintPDBHistogram(PDB.size()-1);
+	// recorded in the file so that the table can later be stored mod 3 without checking it again
+	if (!additive && CanDecodeMod3(PDB.size()-1))
+		PDB.back().SetDecodableMod3(true);
+	if (storage != kPDB8Bit)
+		Convert_PDB_Storage(PDB.size()-1, storage, false);
+	SavePDBFile(PDB.size()-1, start, pdb_filename, additive, kLeafNode, 0);
 }
 
 template <class state, class action>
 uint64_t PermutationPuzzleEnvironment<state, action>::Get_PDB_Size(state &start, int pdbEntries)
 {
-	maxItem = max(maxItem,start.puzzle.size());
-	minPattern = min(minPattern, pdbEntries);
-	buildCaches();
 	return nUpperk(start.puzzle.size(), start.puzzle.size()-pdbEntries);
 }
 
@@ -1212,9 +1339,6 @@ uint64_t PermutationPuzzleEnvironment<state, action>::Get_PDB_Size(state &start,
 template <class state, class action>
 void PermutationPuzzleEnvironment<state, action>::Build_Regular_PDB(state &start, const std::vector<int> &distinct, const char *pdb_filename)
 {
-	maxItem = max(maxItem,start.puzzle.size());
-	minPattern = min(minPattern, distinct.size());
-	buildCaches();
 
 	uint64_t COUNT = nUpperk(start.puzzle.size(), start.puzzle.size() - distinct.size());
 	std::vector<uint8_t> DB(COUNT);
@@ -1323,7 +1447,8 @@ void PermutationPuzzleEnvironment<state, action>::Build_Regular_PDB(state &start
 	for (int x = 0; x < depths.size(); x++)
 		printf("%d %lld\n", x, depths[x]);
 	
-	PDB.push_back(DB); // increase the number of regular PDBs being stored
+	PDB.resize(PDB.size()+1); // increase the number of regular PDBs being stored
+	PDB.back().swap(DB);
 	PDB_distincts.push_back(distinct); // stores distinct
 }
 
@@ -1331,9 +1456,6 @@ void PermutationPuzzleEnvironment<state, action>::Build_Regular_PDB(state &start
 template <class state, class action>
 void PermutationPuzzleEnvironment<state, action>::Build_Additive_PDB(state &start, const std::vector<int> &distinct, const char *pdb_filename, bool blank)
 {
-	maxItem = max(maxItem,start.puzzle.size());
-	minPattern = min(minPattern, distinct.size());
-	buildCaches();
 
 	uint64_t COUNT = nUpperk(start.puzzle.size(), start.puzzle.size() - distinct.size());
 	uint64_t closedSize = nUpperk(start.puzzle.size(), start.puzzle.size() - distinct.size() - 1);
@@ -1479,6 +1601,13 @@ template <class state, class action>
 void PermutationPuzzleEnvironment<state, action>::Load_Additive_PDB(const state &goal, const char *pdb_filename)
 {
 	additive = true;
+	if (PDBTable::IsPDBFile(pdb_filename))
+	{
+		if (!Load_Mapped_PDB(pdb_filename, goal))
+			exit(0);
+		PrintPDBHistogram(PDB.size()-1);
+		return;
+	}
 	
 	PDB.resize(PDB.size()+1); // increase the number of regular PDBs being stored
 	
@@ -1511,15 +1640,12 @@ void PermutationPuzzleEnvironment<state, action>::Load_Additive_PDB(const state
 		distinct.push_back(tmp);
 	}
 	
-	maxItem = max(maxItem,goal.puzzle.size());
-	minPattern = min(minPattern, distinct.size());
-	buildCaches();
 
 	uint64_t COUNT = nUpperk(goal.puzzle.size(), goal.puzzle.size() - distinct.size());
 	PDB.back().resize(COUNT);
 
 	size_t index;
-	if ((index = fread(&PDB.back()[0], sizeof(uint8_t), COUNT, f)) != COUNT)
+	if ((index = fread(PDB.back().GetData(), sizeof(uint8_t), COUNT, f)) != COUNT)
 	{
 		printf("Error; did not correctly read %lu entries from PDB (%lu instead)\n", COUNT, index);
 		exit(0);
@@ -1536,13 +1662,92 @@ double PermutationPuzzleEnvironment<state, action>::HCost(const state &s)
 {
 	if (lookups.size() == 0)
 		return 0;
-	static std::vector<int> c1, c2;
-	return HCost(s, 0, c1, c2);
+	static thread_local std::vector<int> c1, c2;
+	static thread_local std::vector<action> acts;
+	return HCost(s, 0, c1, c2, acts);
+}
+
+template <class state, class action>
+double PermutationPuzzleEnvironment<state, action>::HCost(const state &s, double parentHCost)
+{
+	if (lookups.size() == 0)
+		return 0;
+	static thread_local std::vector<int> c1, c2;
+	static thread_local std::vector<action> acts;
+	return HCost(s, 0, c1, c2, acts, 0, parentHCost);
+}
+
+template <class state, class action>
+void PermutationPuzzleEnvironment<state, action>::BatchHCost(const state *states, size_t count, double *hcosts, double parentHCost)
+{
+	if (lookups.size() == 0)
+	{
+		for (size_t x = 0; x < count; x++)
+			hcosts[x] = 0;
+		return;
+	}
+	static thread_local std::vector<int> c1, c2;
+	static thread_local std::vector<uint64_t> ranks;
+	static thread_local std::vector<action> acts;
+	// ranks for state x are stored in ranks[x*lookups.size()+treeNode]
+	int nodes = lookups.size();
+	ranks.resize(count*nodes);
+	for (size_t x = 0; x < count; x++)
+	{
+		for (int y = 0; y < nodes; y++)
+		{
+			if (lookups[y].t == kMaxNode || lookups[y].t == kAddNode || lookups[y].t == kLeafDefaultHeuristic)
+				continue;
+			ranks[x*nodes+y] = GetPDBHash(states[x], PDB_distincts[lookups[y].PDBID], c1, c2);
+			PrefetchLeaf(y, ranks[x*nodes+y]);
+		}
+	}
+	for (size_t x = 0; x < count; x++)
+		hcosts[x] = HCost(states[x], 0, c1, c2, acts, &ranks[x*nodes], parentHCost);
 }
 
+template <class state, class action>
+void PermutationPuzzleEnvironment<state, action>::PrefetchLeaf(int treeNode, uint64_t rank) const
+{
+	const PDBTreeNode &n = lookups[treeNode];
+	switch (n.t)
+	{
+		case kLeafNode:
+		case kLeafFractionalCompress:
+		case kLeafValueCompress:
+			PDB[n.PDBID].Prefetch(rank);
+			break;
+		case kLeafFractionalModCompress:
+			if (0 == rank%n.numChildren)
+				PDB[n.PDBID].Prefetch(rank/n.numChildren);
+			break;
+		case kLeafModCompress:
+			PDB[n.PDBID].Prefetch(rank%PDB[n.PDBID].size());
+			break;
+		case kLeafMinCompress:
+			PDB[n.PDBID].Prefetch(rank/n.numChildren);
+			break;
+		case kLeafDivPlusDeltaCompress:
+			PDB[n.PDBID].Prefetch(rank/n.numChildren);
+			PDB[n.firstChildID].Prefetch(rank);
+			break;
+		default:
+			break;
+	}
+}
+
+/**
+ Evaluates the lookup tree below treeNode. If ranks is non-null it holds the
+ PDB rank of s for each leaf (indexed by tree node); otherwise the ranks are
+ computed as the leaves are reached. parentHCost (if not negative) is the
+ value of the whole tree for a neighbor of s, so it only helps a leaf at the
+ root.
+ **/
 template <class state, class action>
 double PermutationPuzzleEnvironment<state, action>::HCost(const state &s, int treeNode,
-														  std::vector<int> &c1, std::vector<int> &c2)
+														  std::vector<int> &c1, std::vector<int> &c2,
+														  std::vector<action> &acts, const uint64_t *ranks,
+														  double parentHCost)
 {
 	double hval = 0;
 	switch (lookups[treeNode].t)
@@ -1551,59 +1756,60 @@ double PermutationPuzzleEnvironment<state, action>::HCost(const state &s, int tr
 		{
 			for (int x = 0; x < lookups[treeNode].numChildren; x++)
 			{
-				hval = max(hval, HCost(s, lookups[treeNode].firstChildID+x, c1, c2));
+				hval = max(hval, HCost(s, lookups[treeNode].firstChildID+x, c1, c2, acts, ranks));
 			}
 		} break;
 		case kAddNode:
 		{
 			for (int x = 0; x < lookups[treeNode].numChildren; x++)
 			{
-				hval += HCost(s, lookups[treeNode].firstChildID+x, c1, c2);
+				hval += HCost(s, lookups[treeNode].firstChildID+x, c1, c2, acts, ranks);
 			}
 		} break;
 		case kLeafNode:
 		{
-			uint64_t index = GetPDBHash(s, PDB_distincts[lookups[treeNode].PDBID], c1, c2);
-			hval = PDB[lookups[treeNode].PDBID][index];
+			uint64_t index = (ranks?ranks[treeNode]:GetPDBHash(s, PDB_distincts[lookups[treeNode].PDBID], c1, c2));
+			hval = GetPDBValue(lookups[treeNode].PDBID, index, s.puzzle.size(), c1, c2, acts,
+							   (treeNode == 0)?(int)parentHCost:-1);
 		} break;
 		case kLeafFractionalCompress:
 		{
-			uint64_t index = GetPDBHash(s, PDB_distincts[lookups[treeNode].PDBID], c1, c2);
+			uint64_t index = (ranks?ranks[treeNode]:GetPDBHash(s, PDB_distincts[lookups[treeNode].PDBID], c1, c2));
 			if (index < PDB[lookups[treeNode].PDBID].size())
-				hval = PDB[lookups[treeNode].PDBID][index];
+				hval = PDB[lookups[treeNode].PDBID].Get(index);
 			else
 				hval = 0;
 		} break;
 		case kLeafFractionalModCompress: // num children is the compression factor
 		{
-			uint64_t index = GetPDBHash(s, PDB_distincts[lookups[treeNode].PDBID], c1, c2);
+			uint64_t index = (ranks?ranks[treeNode]:GetPDBHash(s, PDB_distincts[lookups[treeNode].PDBID], c1, c2));
 			if (0 == index%lookups[treeNode].numChildren)
-				hval = PDB[lookups[treeNode].PDBID][index/lookups[treeNode].numChildren];
+				hval = PDB[lookups[treeNode].PDBID].Get(index/lookups[treeNode].numChildren);
 			else
 				hval = 0;
 		} break;
 		case kLeafModCompress:
 		{
-			uint64_t index = GetPDBHash(s, PDB_distincts[lookups[treeNode].PDBID], c1, c2);
-			hval = PDB[lookups[treeNode].PDBID][index%PDB[lookups[treeNode].PDBID].size()];
+			uint64_t index = (ranks?ranks[treeNode]:GetPDBHash(s, PDB_distincts[lookups[treeNode].PDBID], c1, c2));
+			hval = PDB[lookups[treeNode].PDBID].Get(index%PDB[lookups[treeNode].PDBID].size());
 		} break;
 		case kLeafMinCompress:
 		{
-			uint64_t index = GetPDBHash(s, PDB_distincts[lookups[treeNode].PDBID], c1, c2)/lookups[treeNode].numChildren;
-			hval = PDB[lookups[treeNode].PDBID][index];
+			uint64_t index = (ranks?ranks[treeNode]:GetPDBHash(s, PDB_distincts[lookups[treeNode].PDBID], c1, c2))/lookups[treeNode].numChildren;
+			hval = PDB[lookups[treeNode].PDBID].Get(index);
 		} break;
 		case kLeafValueCompress:
 		{
-			uint64_t index = GetPDBHash(s, PDB_distincts[lookups[treeNode].PDBID], c1, c2);
-			hval = PDB[lookups[treeNode].PDBID][index];
+			uint64_t index = (ranks?ranks[treeNode]:GetPDBHash(s, PDB_distincts[lookups[treeNode].PDBID], c1, c2));
+			hval = PDB[lookups[treeNode].PDBID].Get(index);
 			if (hval > lookups[treeNode].numChildren)
 				hval = lookups[treeNode].numChildren;
 		} break;
 		case kLeafDivPlusDeltaCompress:
 		{
-			uint64_t index = GetPDBHash(s, PDB_distincts[lookups[treeNode].PDBID], c1, c2);
-			hval = PDB[lookups[treeNode].PDBID][index/lookups[treeNode].numChildren];
-			hval += PDB[lookups[treeNode].firstChildID][index];
+			uint64_t index = (ranks?ranks[treeNode]:GetPDBHash(s, PDB_distincts[lookups[treeNode].PDBID], c1, c2));
+			hval = PDB[lookups[treeNode].PDBID].Get(index/lookups[treeNode].numChildren);
+			hval += PDB[lookups[treeNode].firstChildID].Get(index);
 		}
 		case kLeafDefaultHeuristic:
 		{
@@ -1613,6 +1819,107 @@ double PermutationPuzzleEnvironment<state, action>::HCost(const state &s, int tr
 	return hval;
 }
 
+template <class state, class action>
+int PermutationPuzzleEnvironment<state, action>::GetPDBValue(int whichPDB, uint64_t index, int puzzleSize,
+															 std::vector<int> &c1, std::vector<int> &c2,
+															 std::vector<action> &acts, int parentValue)
+{
+	if (PDB[whichPDB].GetStorageType() == kPDB2BitMod3)
+		return DecodeMod3PDB(whichPDB, index, puzzleSize, c1, c2, acts, parentValue);
+	return PDB[whichPDB].Get(index);
+}
+
+/**
+ In a unit-cost, reversible abstract space the values of neighbors differ by
+ at most one. If parentValue (the value of a neighbor) is known, the entry
+ is the one of parentValue-1, parentValue and parentValue+1 with the stored
+ residue. Otherwise every state other than the goal has a neighbor whose
+ value is exactly one less; that neighbor holds (h-1) mod 3, so the true
+ value is the number of such steps needed to reach the goal.
+ **/
+template <class state, class action>
+int PermutationPuzzleEnvironment<state, action>::DecodeMod3PDB(int whichPDB, uint64_t index, int puzzleSize,
+															   std::vector<int> &c1, std::vector<int> &c2,
+															   std::vector<action> &acts, int parentValue)
+{
+	const PDBTable &table = PDB[whichPDB];
+	int value = table.Get(index);
+	if (parentValue >= 0)
+	{
+		int hval = parentValue-1+(value-(parentValue+2)%3+3)%3;
+		if (hval >= 0)
+			return hval;
+	}
+	const std::vector<int> &pattern = PDB_distincts[whichPDB];
+	state abs, next;
+	int hval = 0;
+	while (true)
+	{
+		GetStateFromPDBHash(index, abs, puzzleSize, pattern, c1);
+		this->GetActions(abs, acts);
+		bool found = false;
+		for (unsigned int x = 0; x < acts.size(); x++)
+		{
+			this->GetNextState(abs, acts[x], next);
+			uint64_t nextIndex = GetPDBHash(next, pattern, c1, c2);
+			if (table.Get(nextIndex) == (value+2)%3)
+			{
+				index = nextIndex;
+				value = (value+2)%3;
+				hval++;
+				found = true;
+				break;
+			}
+		}
+		if (!found)
+			return hval;
+	}
+}
+
+/**
+ Checks that DecodeMod3PDB returns the stored value of every entry: the
+ entries of neighboring abstract states differ by at most one, and every
+ entry other than 0 has a neighbor that is one smaller. This scans the whole
+ table, so the result is kept with the table (see PDBTable::IsDecodableMod3).
+ **/
+template <class state, class action>
+bool PermutationPuzzleEnvironment<state, action>::CanDecodeMod3(int whichPDB)
+{
+	const PDBTable &table = PDB[whichPDB];
+	const std::vector<int> &pattern = PDB_distincts[whichPDB];
+	// the table must hold one entry per rank, or its indices aren't abstract states
+	int puzzleSize = 0;
+	for (int n = (int)pattern.size(); n < 64 && puzzleSize == 0; n++)
+	{
+		if (nUpperk(n, n-(int)pattern.size()) == table.size())
+			puzzleSize = n;
+	}
+	if (puzzleSize == 0)
+		return false;
+	std::vector<int> c1, c2;
+	std::vector<action> acts;
+	state abs, next;
+	for (uint64_t x = 0; x < table.size(); x++)
+	{
+		int value = table.Get(x);
+		bool smaller = (value == 0);
+		GetStateFromPDBHash(x, abs, puzzleSize, pattern, c1);
+		this->GetActions(abs, acts);
+		for (unsigned int y = 0; y < acts.size(); y++)
+		{
+			this->GetNextState(abs, acts[y], next);
+			int nextValue = table.Get(GetPDBHash(next, pattern, c1, c2));
+			if (nextValue > value+1 || nextValue < value-1)
+				return false;
+			if (nextValue == value-1)
+				smaller = true;
+		}
+		if (!smaller)
+			return false;
+	}
+	return true;
+}
+
 template <class state, class action>
 bool PermutationPuzzleEnvironment<state, action>::Check_Permutation(const std::vector<int> &to_check)
 {
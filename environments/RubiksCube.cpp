@@ -201,11 +201,11 @@ double RubiksCube::HCost(const RubiksState &node1, const RubiksState &node2, dou
 
 		}
 
-			auto depthLoc = depthTable.find(hash);
-			if (depthLoc != depthTable.end())
+			int depth = depthTable.Lookup(hash);
+			if (depth != -1)
 			{
-				val = max(val, depthLoc->second);
-				edgeDist[depthLoc->second]++;
+				val = max(val, double(depth));
+				edgeDist[depth]++;
 			}
 			else if (depth8->Contains(hash))
 			{
@@ -294,11 +294,11 @@ double RubiksCube::HCost(const RubiksState &node1, const RubiksState &node2)
 
 		hash = node1.edge.state;//e.GetStateHash(node1.edge);
 
-		auto depthLoc = depthTable.find(hash);
-		if (depthLoc != depthTable.end())
+		int depth = depthTable.Lookup(hash);
+		if (depth != -1)
 		{
-			val = max(val, depthLoc->second);
-			edgeDist[depthLoc->second]++;
+			val = max(val, double(depth));
+			edgeDist[depth]++;
 		}
 		else if (depth8->Contains(hash))
 		{
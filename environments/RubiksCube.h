@@ -22,6 +22,7 @@
 #include "EnvUtil.h"
 #include "Bloom.h"
 #include "MinBloom.h"
+#include "CompactDepthTable.h"
 
 class RubiksState
 {
@@ -140,7 +141,7 @@ public:
 	bool minBloomFilter;
 	std::vector<uint64_t> edgeDist;
 	std::vector<uint64_t> cornDist;
-	::std::unordered_map<uint64_t, uint8_t> depthTable;
+	CompactDepthTable depthTable;
 	BloomFilter *depth8, *depth9;
 	MinBloomFilter *minBloom;
 private:
@@ -8,6 +8,7 @@
 
 #include "RubiksCubeCorners.h"
 #include "GLUtil.h"
+#include "PermutationRanking.h"
 #include <assert.h>
 
 #define LINEAR_RANK 1
@@ -425,7 +426,7 @@ void RubiksCorner::rankPlayerRemaining(const RubiksCornerState &node, int who, i
 	{
 		hashVal = hashVal*3+node.GetCubeOrientation(x);
 	}
-	hashVal = hashVal*Factorial[8]+MRRank(8, perm, dual);
+	hashVal = hashVal*Factorial[8]+MRRankPacked(8, perm, dual);
 	rank = hashVal;
 #endif
 }
@@ -477,41 +478,11 @@ uint64_t RubiksCorner::GetStateHash(const RubiksCornerState &node) const
 	{
 		hashVal = hashVal*3+node.GetCubeOrientation(x);
 	}
-	//	return (MRRank(12, perm, dual)<<11)|hashVal;
-	hashVal = hashVal*Factorial[8]+MRRank(8, perm, dual);
+	hashVal = hashVal*Factorial[8]+MRRankPacked(8, perm, dual);
 	return hashVal;
 #endif
 }
 
-/////
-
-uint64_t RubiksCorner::MRRank(int n, uint64_t perm, uint64_t dual) const
-{
-	int ss[12];
-	int ssLoc = 0;
-	
-	int s;
-	for (int i = n; i > 1; i--)
-	{
-		s = get(perm, i-1);
-		ss[ssLoc] = s;
-		ssLoc++;
-		
-		swap(perm, i-1, get(dual, i-1));
-		swap(dual, s, i-1);
-	}
-	uint64_t result = 0;
-	int cnt = 2;
-	for (int i = (int)ssLoc-1; i >= 0; i--)
-	{
-		result *= cnt;
-		result += ss[i];
-		cnt++;
-	}
-	return result;
-}
-
-
 /////
 
 
@@ -568,7 +539,7 @@ void RubiksCorner::GetStateFromHash(uint64_t hash, RubiksCornerState &node) cons
 	uint64_t val = 0;
 	for (int x = 0; x < 8; x++)
 		set(val, x, x);
-	MRUnrank2(8, hVal, val);
+	MRUnrankPacked(8, hVal, val);
 	for (int x = 0; x < 8; x++)
 	{
 		node.SetCubeInLoc(x, get(val, x));
@@ -576,16 +547,6 @@ void RubiksCorner::GetStateFromHash(uint64_t hash, RubiksCornerState &node) cons
 #endif
 }
 
-void RubiksCorner::MRUnrank2(int n, uint64_t r, uint64_t &perm) const
-{
-	for (int i = n; i > 0; i--)
-	{
-		swap(perm, i-1, r%i);
-		r = r/i;
-	}
-}
-
-
 void RubiksCorner::OpenGLDraw() const
 {
 	
@@ -149,8 +149,6 @@ public:
 private:
 	void SetFaceColor(int face, const RubiksCornerState&) const;
 	//	void SetFaceColor(int face, const RubiksCornerState&) const;
-	uint64_t MRRank(int n, uint64_t perm, uint64_t dual) const;
-	void MRUnrank2(int n, uint64_t r, uint64_t &perm) const;
 	RubikCornerMove moves[18];
 };
 
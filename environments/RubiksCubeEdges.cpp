@@ -8,6 +8,7 @@
 
 #include "RubiksCubeEdges.h"
 #include "GLUtil.h"
+#include "PermutationRanking.h"
 #include <cassert>
 
 void RubikEdgeState::GetDual(RubikEdgeState &s) const
@@ -420,7 +421,7 @@ void RubikEdge::rankPlayerRemaining(const RubikEdgeState &node, int, int64_t &ra
 	{
 		hashVal = (hashVal<<1)+node.GetCubeOrientation(11-x);
 	}
-	hashVal = hashVal*Factorial(12)+MRRank(12, perm, dual);
+	hashVal = hashVal*Factorial(12)+MRRankPacked(12, perm, dual);
 	rank = hashVal;
 }
 
@@ -440,59 +441,10 @@ uint64_t RubikEdge::GetStateHash(const RubikEdgeState &node) const
 	{
 		hashVal = (hashVal<<1)+node.GetCubeOrientation(11-x);
 	}
-	//	return (MRRank(12, perm, dual)<<11)|hashVal;
-	hashVal = hashVal*Factorial(12)+MRRank(12, perm, dual);
+	hashVal = hashVal*Factorial(12)+MRRankPacked(12, perm, dual);
 	return hashVal;
 }
 
-// 38.522
-uint64_t RubikEdge::MRRank(int n, uint64_t perm, uint64_t dual) const
-{
-	int ss[12];
-	int ssLoc = 0;
-	//	static std::vector<int> ss;
-	//	ss.resize(0);
-	int s;
-	for (int i = n; i > 1; i--)
-	{
-		s = get(perm, i-1);
-		ss[ssLoc] = s;
-		ssLoc++;
-		//		ss.push_back(s);
-		swap(perm, i-1, get(dual, i-1));
-		swap(dual, s, i-1);
-	}
-	uint64_t result = 0;
-	int cnt = 2;
-	//	printf("0");
-	for (int i = (int)ssLoc-1; i >= 0; i--)
-	{
-		//		printf(")*%d + %d ", cnt, ss[i]);
-		result *= cnt;
-		result += ss[i];
-		cnt++;
-	}
-	//	printf("\n");
-	return result;
-	//	if (n == 1)
-	//		return 0;
-	//	int s = get(perm, n-1);
-	//	swap(perm, n-1, get(dual, n-1));
-	//	swap(dual, s, n-1);
-	//	return s+n*MRRank(n-1, perm, dual);
-}
-
-// 53.5% time
-uint64_t RubikEdge::MRRank2(int n, uint64_t perm, uint64_t dual) const
-{
-	if (n == 1)
-		return 0;
-	int s = get(perm, n-1);
-	swap(perm, n-1, get(dual, n-1));
-	swap(dual, s, n-1);
-	return s+n*MRRank2(n-1, perm, dual);
-}
-
 void RubikEdge::GetStateFromHash(uint64_t hash, RubikEdgeState &node) const
 {
 	int cnt = 0;
@@ -515,38 +467,13 @@ void RubikEdge::GetStateFromHash(uint64_t hash, RubikEdgeState &node) const
 	uint64_t val = 0;
 	for (int x = 0; x < 12; x++)
 		set(val, x, x);
-	MRUnrank2(12, hVal, val);
+	MRUnrankPacked(12, hVal, val);
 	for (int x = 0; x < 12; x++)
 	{
 		node.SetCubeInLoc(x, get(val, x));
 	}
 }
 
-// 38.982 sec elapsed
-// 3.5 % of time in function
-// Overall locality: 936842 / 1800000 = 0.520468
-void RubikEdge::MRUnrank(int n, uint64_t r, uint64_t &perm) const
-{
-	if (n > 0)
-	{
-		//		printf("Swap %d %llu\n", n-1, r%n);
-		swap(perm, n-1, r%n);
-		MRUnrank(n-1, r/n, perm);
-	}
-}
-
-//38.152 sec elapsed
-void RubikEdge::MRUnrank2(int n, uint64_t r, uint64_t &perm) const
-{
-	for (int i = n; i > 0; i--)
-	{
-		//		printf("Swap %d %llu\n", i-1, r%i);
-		swap(perm, i-1, r%i);
-		r = r/i;
-	}
-}
-
-
 // 50.970 sec elapsed
 // 73.9% of time inside this function
 // Overall locality: 1044342 / 1800000 = 0.580190
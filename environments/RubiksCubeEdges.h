@@ -147,10 +147,6 @@ public:
 	void OpenGLDrawCube(const RubikEdgeState &s, int cube) const;
 private:
 	int piecesToRank;
-	void MRUnrank(int n, uint64_t r, uint64_t &perm) const;
-	void MRUnrank2(int n, uint64_t r, uint64_t &perm) const;
-	uint64_t MRRank(int n, uint64_t perm, uint64_t dual) const;
-	uint64_t MRRank2(int n, uint64_t perm, uint64_t dual) const;
 	
 	void SetCubeColor(int which, bool face, const RubikEdgeState&) const;
 	RubikEdgeMove moves[18];
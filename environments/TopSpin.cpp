@@ -15,6 +15,7 @@
 TopSpin::TopSpin(unsigned int N, unsigned int k)
 :PermutationPuzzleEnvironment<TopSpinState, TopSpinAction>(), goal(N, k)
 {
+	assert(N <= TOPSPIN_MAX_SIZE);
 	weighted = false;
 	pruneSuccessors = false;
 	numTiles = N;
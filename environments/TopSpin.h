@@ -19,6 +19,15 @@
 #include "Graph.h"
 #include <sstream>
 #include <unordered_map>
+#include "FixedVector.h"
+
+/**
+ Largest number of tiles a TopSpinState can hold. Tiles are stored inline
+ so that copying a state never allocates memory.
+ **/
+#ifndef TOPSPIN_MAX_SIZE
+#define TOPSPIN_MAX_SIZE 32
+#endif
 
 class TopSpinState {
 public:
@@ -33,7 +42,7 @@ public:
 		for (unsigned int x = 0; x < puzzle.size(); x++)
 			puzzle[x] = x;
 	}
-	std::vector<int> puzzle;
+	FixedVector<int8_t, TOPSPIN_MAX_SIZE> puzzle;
 };
 
 /**
@@ -44,7 +53,7 @@ typedef int TopSpinAction;
 static std::ostream& operator <<(std::ostream & out, const TopSpinState &loc)
 {
 	for (unsigned int x = 0; x < loc.puzzle.size(); x++)
-		out << loc.puzzle[x] << " ";
+		out << (int)loc.puzzle[x] << " ";
 	return out;
 }
 
@@ -77,7 +86,11 @@ public:
 
 	OccupancyInterface<TopSpinState, TopSpinAction> *GetOccupancyInfo() { return 0; }
 	double HCost(const TopSpinState &state1, const TopSpinState &state2);
+	double HCost(const TopSpinState &state1, const TopSpinState &state2, double parentHCost)
+	{ return PermutationPuzzleEnvironment<TopSpinState, TopSpinAction>::HCost(state1, parentHCost); }
 //	double HCost(const TopSpinState &state1);
+	void BatchHCost(const TopSpinState *states, size_t count, const TopSpinState &goal, double *hcosts, double parentHCost)
+	{ PermutationPuzzleEnvironment<TopSpinState, TopSpinAction>::BatchHCost(states, count, hcosts, parentHCost); }
 
 	double GCost(const TopSpinState &state1, const TopSpinState &state2);
 	double GCost(const TopSpinState &, const TopSpinAction &);
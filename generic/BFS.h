@@ -12,7 +12,7 @@
 
 #include <iostream>
 #include "SearchEnvironment.h"
-#include <ext/hash_map>
+#include "FlatHashMap.h"
 #include "FPUtil.h"
 
 template <class state, class action>
@@ -37,7 +37,7 @@ private:
 template <class state, class action>
 void BFS<state, action>::DoBFS(SearchEnvironment<state, action> *env, state from)
 {
-	typedef __gnu_cxx::hash_map<uint64_t, bool, Hash64> BFSClosedList;
+	typedef FlatHashMap<uint64_t, bool> BFSClosedList;
 	std::deque<state> mOpen;
 	std::deque<int> depth;
 	BFSClosedList mClosed; // store parent id!
@@ -103,7 +103,7 @@ void BFS<state, action>::GetPath(SearchEnvironment<state, action> *env,
 								 state from, state to,
 								 std::vector<state> &thePath)
 {
-	typedef __gnu_cxx::hash_map<uint64_t, uint64_t, Hash64> BFSClosedList;
+	typedef FlatHashMap<uint64_t, uint64_t> BFSClosedList;
 	std::deque<state> mOpen;
 	std::deque<int> depth;
 	BFSClosedList mClosed; // store parent id!
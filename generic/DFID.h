@@ -12,10 +12,10 @@
 
 #include <iostream>
 #include "SearchEnvironment.h"
-#include <ext/hash_map>
+#include "FlatHashMap.h"
 #include "FPUtil.h"
 
-typedef __gnu_cxx::hash_map<uint64_t, double> NodeHashTable;
+typedef FlatHashMap<uint64_t, double> DFIDNodeTable;
 
 template <class state, class action>
 class DFID {
@@ -44,7 +44,7 @@ private:
 	void UpdateNextBound(double currBound, double gCost);
 	state goal;
 	double nextBound;
-	NodeHashTable nodeTable;
+	DFIDNodeTable nodeTable;
 	bool usePathMax;
 	bool useHashTable;
 };	
@@ -77,8 +77,10 @@ struct EPEAStarCompare {
 
 /**
  * A templated version of A*, based on HOG genericAStar
+ * The open/closed list is a template parameter; BucketOpenClosed is faster
+ * when all costs are multiples of a fixed unit (and uses a heap otherwise).
  */
-template <class state, class action, class environment>
+template <class state, class action, class environment, class openList = AStarOpenClosed<state, EPEAStarCompare<state>, EPEAOpenClosedData<state> > >
 class EPEAStar : public GenericSearchAlgorithm<state,action,environment> {
 public:
 	EPEAStar() { ResetNodeCount(); env = 0; stopAfterGoal = true; weight=1; reopenNodes = false; }
@@ -87,8 +89,7 @@ public:
 	
 	void GetPath(environment *, const state& , const state& , std::vector<action> & ) { assert(false); };
 	
-	AStarOpenClosed<state, EPEAStarCompare<state>, EPEAOpenClosedData<xyLoc> > openClosedList;
-	//BucketOpenClosed<state, EPEAStarCompare<state>, EPEAOpenClosedData<xyLoc> > openClosedList;
+	openList openClosedList;
 	state goal, start;
 	
 	bool InitializeSearch(environment *env, const state& from, const state& to, std::vector<state> &thePath);
@@ -157,8 +158,8 @@ private:
  * @return The name of the algorithm
  */
 
-template <class state, class action, class environment>
-const char *EPEAStar<state,action,environment>::GetName()
+template <class state, class action, class environment, class openList>
+const char *EPEAStar<state, action, environment, openList>::GetName()
 {
 	static char name[32];
 	sprintf(name, "EPEAStar[]");
@@ -176,8 +177,8 @@ const char *EPEAStar<state,action,environment>::GetName()
  * @param thePath A vector of states which will contain an optimal path 
  * between from and to when the function returns, if one exists. 
  */
-template <class state, class action, class environment>
-void EPEAStar<state,action,environment>::GetPath(environment *_env, const state& from, const state& to, std::vector<state> &thePath)
+template <class state, class action, class environment, class openList>
+void EPEAStar<state, action, environment, openList>::GetPath(environment *_env, const state& from, const state& to, std::vector<state> &thePath)
 {
 	//discardcount=0;
   	if (!InitializeSearch(_env, from, to, thePath))
@@ -197,8 +198,8 @@ void EPEAStar<state,action,environment>::GetPath(environment *_env, const state&
  * @param to The goal state
  * @return TRUE if initialization was successful, FALSE otherwise
  */
-template <class state, class action, class environment>
-bool EPEAStar<state,action,environment>::InitializeSearch(environment *_env, const state& from, const state& to, std::vector<state> &thePath)
+template <class state, class action, class environment, class openList>
+bool EPEAStar<state, action, environment, openList>::InitializeSearch(environment *_env, const state& from, const state& to, std::vector<state> &thePath)
 {
 	theHeuristic = _env;
 	thePath.resize(0);
@@ -231,10 +232,10 @@ bool EPEAStar<state,action,environment>::InitializeSearch(environment *_env, con
  * @author Nathan Sturtevant
  * @date 01/06/08
  */
-template <class state, class action, class environment>
-void EPEAStar<state,action,environment>::AddAdditionalStartState(state& newState)
+template <class state, class action, class environment, class openList>
+void EPEAStar<state, action, environment, openList>::AddAdditionalStartState(state& newState)
 {
-	openClosedList.AddOpenNode(newState, env->GetStateHash(newState), 0, weight*theHeuristic->HCost(start, goal));
+	openClosedList.AddOpenNode(newState, env->GetStateHash(newState), 0, weight*theHeuristic->HCost(newState, goal));
 }
 
 /**
@@ -242,10 +243,10 @@ void EPEAStar<state,action,environment>::AddAdditionalStartState(state& newState
  * @author Nathan Sturtevant
  * @date 09/25/10
  */
-template <class state, class action, class environment>
-void EPEAStar<state,action,environment>::AddAdditionalStartState(state& newState, double cost)
+template <class state, class action, class environment, class openList>
+void EPEAStar<state, action, environment, openList>::AddAdditionalStartState(state& newState, double cost)
 {
-	openClosedList.AddOpenNode(newState, env->GetStateHash(newState), cost, weight*theHeuristic->HCost(start, goal));
+	openClosedList.AddOpenNode(newState, env->GetStateHash(newState), cost, weight*theHeuristic->HCost(newState, goal));
 }
 
 /**
@@ -258,8 +259,8 @@ void EPEAStar<state,action,environment>::AddAdditionalStartState(state& newState
  * @return TRUE if there is no path or if we have found the goal, FALSE
  * otherwise
  */
-template <class state, class action, class environment>
-bool EPEAStar<state,action,environment>::DoSingleSearchStep(std::vector<state> &thePath)
+template <class state, class action, class environment, class openList>
+bool EPEAStar<state, action, environment, openList>::DoSingleSearchStep(std::vector<state> &thePath)
 {
 	if (openClosedList.OpenSize() == 0)
 	{
@@ -268,7 +269,8 @@ bool EPEAStar<state,action,environment>::DoSingleSearchStep(std::vector<state> &
 		return true;
 	}
 	uint64_t nodeid = openClosedList.Peek();
-	const state &currOpenNode = openClosedList.Lookup(nodeid).data;
+	// copy, since adding successors can reallocate the element storage
+	const state currOpenNode = openClosedList.Lookup(nodeid).data;
 	
 	if (!openClosedList.Lookup(nodeid).reopened)
 		uniqueNodesExpanded++;
@@ -345,8 +347,8 @@ bool EPEAStar<state,action,environment>::DoSingleSearchStep(std::vector<state> &
  * 
  * @return The first state in the open list. 
  */
-template <class state, class action, class environment>
-state EPEAStar<state, action,environment>::CheckNextNode()
+template <class state, class action, class environment, class openList>
+state EPEAStar<state, action, environment, openList>::CheckNextNode()
 {
 	uint64_t key = openClosedList.Peek();
 	return openClosedList.Lookup(key).data;
@@ -363,8 +365,8 @@ state EPEAStar<state, action,environment>::CheckNextNode()
  * @param goalNode the goal state
  * @param thePath will contain the path from goalNode to the start state
  */
-template <class state, class action,class environment>
-void EPEAStar<state, action,environment>::ExtractPathToStartFromID(uint64_t node,
+template <class state, class action, class environment, class openList>
+void EPEAStar<state, action, environment, openList>::ExtractPathToStartFromID(uint64_t node,
 																   std::vector<state> &thePath)
 {
 	do {
@@ -380,8 +382,8 @@ void EPEAStar<state, action,environment>::ExtractPathToStartFromID(uint64_t node
  * @author Nathan Sturtevant
  * @date 03/22/06
  */
-template <class state, class action, class environment>
-void EPEAStar<state, action,environment>::PrintStats()
+template <class state, class action, class environment, class openList>
+void EPEAStar<state, action, environment, openList>::PrintStats()
 {
 	printf("%u items in closed list\n", (unsigned int)openClosedList.ClosedSize());
 	printf("%u items in open queue\n", (unsigned int)openClosedList.OpenSize());
@@ -394,8 +396,8 @@ void EPEAStar<state, action,environment>::PrintStats()
  * 
  * @return The combined number of elements in the closed list and open queue
  */
-template <class state, class action, class environment>
-int EPEAStar<state, action,environment>::GetMemoryUsage()
+template <class state, class action, class environment, class openList>
+int EPEAStar<state, action, environment, openList>::GetMemoryUsage()
 {
 	return openClosedList.size();
 }
@@ -410,8 +412,8 @@ int EPEAStar<state, action,environment>::GetMemoryUsage()
  * @return success Whether we found the value or not
  * more states
  */
-template <class state, class action, class environment>
-bool EPEAStar<state, action,environment>::GetClosedListGCost(const state &val, double &gCost) const
+template <class state, class action, class environment, class openList>
+bool EPEAStar<state, action, environment, openList>::GetClosedListGCost(const state &val, double &gCost) const
 {
 	uint64_t theID;
 	dataLocation loc = openClosedList.Lookup(env->GetStateHash(val), theID);
@@ -429,8 +431,8 @@ bool EPEAStar<state, action,environment>::GetClosedListGCost(const state &val, d
  * @date 03/12/09
  * 
  */
-template <class state, class action, class environment>
-void EPEAStar<state, action,environment>::OpenGLDraw() const
+template <class state, class action, class environment, class openList>
+void EPEAStar<state, action, environment, openList>::OpenGLDraw() const
 {
 	double transparency = 1.0;
 	if (openClosedList.size() == 0)
@@ -0,0 +1,342 @@
+//
+//  ExternalBFS.h
+//  hog2 glut
+//
+//  A breadth-first search that keeps its layers on disk, for state spaces
+//  that are too large for memory. States are identified by their 64-bit
+//  hash (GetStateHash/GetStateFromHash must be a perfect ranking), and each
+//  layer is split into buckets by hash%numBuckets. Each bucket is a sorted
+//  file of hashes with no duplicates.
+//
+//  A layer is built in two passes:
+//    1. Expansion: threads claim buckets of the current layer, expand every
+//       state and append the successor hashes to per-thread buffers, one per
+//       target bucket. Full buffers are written to the bucket's file with a
+//       single large write.
+//    2. Duplicate detection: each bucket of the new layer is sorted (in
+//       memory if it fits in a run, otherwise by an external merge sort) and
+//       merged against the same bucket of the current and previous layers,
+//       which are already sorted. Nothing is looked up in a hash table and
+//       all files are read and written sequentially.
+//
+//  Since only the previous two layers are checked for duplicates, the
+//  actions must be reversible (every edge is undirected). The environment
+//  is shared by the expansion threads, so GetSuccessors, GetStateHash and
+//  GetStateFromHash must be safe to call concurrently.
+//
+
+#ifndef EXTERNALBFS_H
+#define EXTERNALBFS_H
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include "SearchEnvironment.h"
+#include "ExternalSort.h"
+#include "Timer.h"
+
+template <class state, class action, class environment = SearchEnvironment<state, action> >
+class ExternalBFS {
+public:
+	ExternalBFS(const char *filePrefix = "ebfs", int buckets = 256);
+	/**
+	 Runs the search from start until a layer is empty. Returns the number of
+	 states in the state space reachable from start, or 0 if a layer couldn't
+	 be read or written (see Failed).
+	 **/
+	uint64_t DoBFS(environment *env, const state &start);
+	void SetNumThreads(int count) { numThreads = (count > 0)?count:1; }
+	/**
+	 Sets the number of states each thread may sort in memory during
+	 duplicate detection. Larger buckets are sorted externally.
+	 **/
+	void SetSortMemory(size_t entries) { runEntries = entries; }
+	/** Sets the number of states buffered per bucket in each thread **/
+	void SetWriteBuffer(size_t entries) { bufferEntries = entries; }
+	/**
+	 By default only the last two layers are kept on disk; otherwise all of
+	 them are, and can be read from GetFileName(depth, bucket) afterwards.
+	 **/
+	void SetKeepLayers(bool keep) { keepLayers = keep; }
+	void SetVerbose(bool val) { verbose = val; }
+	/** True if the last search stopped because of a file error **/
+	bool Failed() const { return error; }
+	const std::vector<uint64_t> &GetLayerSizes() const { return layerSizes; }
+	uint64_t GetNodesExpanded() const { return nodesExpanded; }
+	uint64_t GetNodesTouched() const { return nodesTouched; }
+	std::string GetFileName(int depth, int bucket) const;
+private:
+	std::string GetTempFileName(int depth, int bucket) const;
+	void ExpandLayer(int depth);
+	void ExpandThread(int depth);
+	uint64_t DuplicateDetectLayer(int depth);
+	void DuplicateDetectThread(int depth);
+	void RemoveLayer(int depth);
+
+	environment *env;
+	state start;
+	std::string prefix;
+	int numBuckets;
+	int numThreads;
+	size_t runEntries, bufferEntries;
+	bool keepLayers, verbose;
+
+	std::vector<uint64_t> layerSizes;
+	std::atomic<uint64_t> nodesExpanded, nodesTouched;
+
+	// state for the threads of the current pass
+	std::atomic<int> nextBucket;
+	std::vector<FILE *> outFiles;
+	std::vector<std::mutex> outLocks;
+	std::atomic<uint64_t> layerCount;
+	std::atomic<bool> error;
+};
+
+template <class state, class action, class environment>
+ExternalBFS<state, action, environment>::ExternalBFS(const char *filePrefix, int buckets)
+:prefix(filePrefix), numBuckets(buckets), outLocks(buckets)
+{
+	numThreads = std::thread::hardware_concurrency();
+	if (numThreads < 1)
+		numThreads = 1;
+	runEntries = 1<<24;
+	bufferEntries = 1<<12;
+	keepLayers = false;
+	verbose = true;
+	nodesExpanded = nodesTouched = 0;
+}
+
+template <class state, class action, class environment>
+std::string ExternalBFS<state, action, environment>::GetFileName(int depth, int bucket) const
+{
+	char name[64];
+	sprintf(name, "-d%d-b%d.dat", depth, bucket);
+	return prefix+name;
+}
+
+template <class state, class action, class environment>
+std::string ExternalBFS<state, action, environment>::GetTempFileName(int depth, int bucket) const
+{
+	char name[64];
+	sprintf(name, "-d%d-b%d.tmp", depth, bucket);
+	return prefix+name;
+}
+
+template <class state, class action, class environment>
+uint64_t ExternalBFS<state, action, environment>::DoBFS(environment *e, const state &from)
+{
+	env = e;
+	start = from;
+	nodesExpanded = nodesTouched = 0;
+	layerSizes.resize(0);
+	error = false;
+
+	uint64_t hash = env->GetStateHash(start);
+	for (int x = 0; x < numBuckets && !error; x++)
+	{
+		UInt64Writer w(1);
+		if (w.Open(GetFileName(0, x).c_str()))
+		{
+			if ((int)(hash%numBuckets) == x)
+				w.Add(hash);
+		}
+		if (!w.Close())
+		{
+			printf("Error: unable to write '%s'\n", GetFileName(0, x).c_str());
+			error = true;
+		}
+	}
+	if (error)
+	{
+		RemoveLayer(0);
+		return 0;
+	}
+	layerSizes.push_back(1);
+	uint64_t total = 1;
+
+	Timer t;
+	for (int depth = 0; ; depth++)
+	{
+		t.StartTimer();
+		ExpandLayer(depth);
+		double expandTime = t.EndTimer();
+		uint64_t count = 0;
+		double ddTime = 0;
+		// a layer with a failed write is missing states, so it isn't sorted
+		if (!error)
+		{
+			t.StartTimer();
+			count = DuplicateDetectLayer(depth+1);
+			ddTime = t.EndTimer();
+		}
+		if (error)
+		{
+			printf("Error: search stopped at depth %d\n", depth+1);
+			for (int x = 0; x < numBuckets; x++)
+				remove(GetTempFileName(depth+1, x).c_str());
+			RemoveLayer(depth+1);
+			if (!keepLayers)
+			{
+				RemoveLayer(depth);
+				if (depth > 0)
+					RemoveLayer(depth-1);
+			}
+			return 0;
+		}
+		if (verbose)
+			printf("Depth %d: %llu states (%1.2fs expanding, %1.2fs duplicate detection)\n",
+				   depth+1, (unsigned long long)count, expandTime, ddTime);
+		if (!keepLayers && depth > 0)
+			RemoveLayer(depth-1);
+		if (count == 0)
+		{
+			RemoveLayer(depth+1);
+			if (!keepLayers)
+				RemoveLayer(depth);
+			break;
+		}
+		layerSizes.push_back(count);
+		total += count;
+	}
+	return total;
+}
+
+template <class state, class action, class environment>
+void ExternalBFS<state, action, environment>::ExpandLayer(int depth)
+{
+	outFiles.resize(numBuckets);
+	for (int x = 0; x < numBuckets; x++)
+	{
+		outFiles[x] = fopen(GetTempFileName(depth+1, x).c_str(), "wb");
+		if (outFiles[x] == 0)
+		{
+			printf("Error: unable to open '%s'\n", GetTempFileName(depth+1, x).c_str());
+			error = true;
+		}
+	}
+	if (!error)
+	{
+		nextBucket = 0;
+		std::vector<std::thread> threads;
+		for (int t = 0; t < numThreads; t++)
+			threads.push_back(std::thread(&ExternalBFS<state, action, environment>::ExpandThread, this, depth));
+		for (unsigned int t = 0; t < threads.size(); t++)
+			threads[t].join();
+	}
+	for (int x = 0; x < numBuckets; x++)
+	{
+		if (outFiles[x] && fclose(outFiles[x]) != 0)
+		{
+			printf("Error: write to '%s' failed\n", GetTempFileName(depth+1, x).c_str());
+			error = true;
+		}
+	}
+}
+
+/**
+ * Expands buckets of the layer until none are left. Successors are buffered
+ * per bucket; a full buffer is appended to the bucket's file while holding
+ * that bucket's lock.
+ */
+template <class state, class action, class environment>
+void ExternalBFS<state, action, environment>::ExpandThread(int depth)
+{
+	std::vector<std::vector<uint64_t> > buffers(numBuckets);
+	for (int x = 0; x < numBuckets; x++)
+		buffers[x].reserve(bufferEntries);
+	std::vector<state> succ;
+	// states are rebuilt from their hash into a copy of the start, so they
+	// already have the right size
+	state s = start;
+	uint64_t expanded = 0, touched = 0;
+	UInt64Reader r;
+
+	auto flush = [&](int which) {
+		std::lock_guard<std::mutex> l(outLocks[which]);
+		std::vector<uint64_t> &b = buffers[which];
+		if (fwrite(&b[0], sizeof(uint64_t), b.size(), outFiles[which]) != b.size())
+		{
+			printf("Error: write to '%s' failed\n", GetTempFileName(depth+1, which).c_str());
+			error = true;
+		}
+		b.resize(0);
+	};
+
+	for (int bucket = nextBucket++; bucket < numBuckets && !error; bucket = nextBucket++)
+	{
+		if (!r.Open(GetFileName(depth, bucket).c_str()))
+			continue;
+		uint64_t hash;
+		while (r.Next(hash))
+		{
+			env->GetStateFromHash(hash, s);
+			env->GetSuccessors(s, succ);
+			expanded++;
+			touched += succ.size();
+			for (unsigned int x = 0; x < succ.size(); x++)
+			{
+				uint64_t h = env->GetStateHash(succ[x]);
+				int which = h%numBuckets;
+				buffers[which].push_back(h);
+				if (buffers[which].size() == bufferEntries)
+					flush(which);
+			}
+		}
+		r.Close();
+	}
+	for (int x = 0; x < numBuckets; x++)
+		if (buffers[x].size() > 0)
+			flush(x);
+	nodesExpanded += expanded;
+	nodesTouched += touched;
+}
+
+template <class state, class action, class environment>
+uint64_t ExternalBFS<state, action, environment>::DuplicateDetectLayer(int depth)
+{
+	nextBucket = 0;
+	layerCount = 0;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads; t++)
+		threads.push_back(std::thread(&ExternalBFS<state, action, environment>::DuplicateDetectThread, this, depth));
+	for (unsigned int t = 0; t < threads.size(); t++)
+		threads[t].join();
+	return layerCount;
+}
+
+/**
+ * Sorts each bucket of the new layer, removing states found in the two
+ * previous layers.
+ */
+template <class state, class action, class environment>
+void ExternalBFS<state, action, environment>::DuplicateDetectThread(int depth)
+{
+	std::vector<std::string> previous;
+	for (int bucket = nextBucket++; bucket < numBuckets; bucket = nextBucket++)
+	{
+		previous.resize(0);
+		previous.push_back(GetFileName(depth-1, bucket));
+		if (depth >= 2)
+			previous.push_back(GetFileName(depth-2, bucket));
+		std::string temp = GetTempFileName(depth, bucket);
+		int64_t count = SortUniqueFile(temp.c_str(), GetFileName(depth, bucket).c_str(),
+									   previous, runEntries, temp.c_str());
+		remove(temp.c_str());
+		if (count < 0)
+			error = true;
+		else
+			layerCount += count;
+	}
+}
+
+template <class state, class action, class environment>
+void ExternalBFS<state, action, environment>::RemoveLayer(int depth)
+{
+	for (int x = 0; x < numBuckets; x++)
+		remove(GetFileName(depth, x).c_str());
+}
+
+#endif
@@ -58,6 +58,13 @@ public:
 	virtual Unit<state,action,environment>* GetTarget() { return target; }
 
 	virtual bool MakeMove(environment *env, OccupancyInterface<state,action> *oi, SimulationInfo<state,action,environment> *si, action& a);
+	/**
+	 * Lets this unit think at the same time as other units. Only set this
+	 * when the unit has its own algorithm instance and the algorithm and
+	 * heuristic don't write to anything shared.
+	 */
+	void SetThinkInParallel(bool val) { thinkInParallel = val; }
+	virtual bool CanThinkInParallel() { return thinkInParallel; }
 	
 	virtual void UpdateLocation(environment *env, state &l, bool success, SimulationInfo<state,action,environment> *si);
 	
@@ -82,6 +89,7 @@ protected:
 	//GLfloat r, g, b;
 	state loc, goal, lastloc;
 	double targetTime, lastTime;
+	bool thinkInParallel;
 	bool onTarget;
 };
 
@@ -95,6 +103,7 @@ GenericSearchUnit<state,action,environment>::GenericSearchUnit(state &start, sta
 	algorithm = alg;
 	nodesExpanded = 0;
 	nodesTouched = 0;
+	thinkInParallel = false;
 	
 	targetTime = 0;
 	
@@ -118,6 +127,7 @@ GenericSearchUnit<state,action,environment>::GenericSearchUnit(state &start, Uni
 	algorithm = alg;
 	nodesExpanded = 0;
 	nodesTouched = 0; 
+	thinkInParallel = false;
 	
 	targetTime = 0; 
 
@@ -39,11 +39,11 @@ private:
 	double DoIteration(SearchEnvironment<state, action> *env,
 					   state parent, state currState,
 					   std::vector<state> &thePath, double bound, double g,
-					   double maxH);
+					   double maxH, double h);
 	double DoIteration(SearchEnvironment<state, action> *env,
 					   action forbiddenAction, state &currState,
 					   std::vector<action> &thePath, double bound, double g,
-					   double maxH, double parentH);
+					   double maxH, double h);
 	
 	void UpdateNextBound(double currBound, double fCost);
 	state goal;
@@ -52,6 +52,8 @@ private:
 	bool usePathMax;
 	bool useHashTable;
 	vectorCache<action> actCache;
+	vectorCache<state> stateCache;
+	vectorCache<double> hCache;
 };
 
 template <class state, class action>
@@ -62,14 +64,15 @@ void IDAStar<state, action>::GetPath(SearchEnvironment<state, action> *env,
 	nextBound = 0;
 	nodesExpanded = nodesTouched = 0;
 	thePath.resize(0);
-	UpdateNextBound(0, env->HCost(from, to));
+	double rootH = env->HCost(from, to);
+	UpdateNextBound(0, rootH);
 	goal = to;
 	thePath.push_back(from);
 	while (true) //thePath.size() == 0)
 	{
 		nodeTable.clear();
 		printf("Starting iteration with bound %f\n", nextBound);
-		if (DoIteration(env, from, from, thePath, nextBound, 0, 0) == 0)
+		if (DoIteration(env, from, from, thePath, nextBound, 0, 0, rootH) == 0)
 			break;
 	}
 }
@@ -104,10 +107,10 @@ template <class state, class action>
 double IDAStar<state, action>::DoIteration(SearchEnvironment<state, action> *env,
 										   state parent, state currState,
 										   std::vector<state> &thePath, double bound, double g,
-										   double maxH)
+										   double maxH, double h)
 {
 	nodesExpanded++;
-	double h = env->HCost(currState, goal);
+	double rawH = h; // the children's lookups are decoded from this
 	
 	// path max
 	if (usePathMax && fless(h, maxH))
@@ -124,15 +127,25 @@ double IDAStar<state, action>::DoIteration(SearchEnvironment<state, action> *env
 	std::vector<state> neighbors;
 	env->GetSuccessors(currState, neighbors);
 	nodesTouched += neighbors.size();
+	// the parent isn't searched again, so it isn't looked up either
+	unsigned int count = 0;
+	for (unsigned int x = 0; x < neighbors.size(); x++)
+	{
+		if (!(neighbors[x] == parent))
+			neighbors[count++] = neighbors[x];
+	}
+	neighbors.resize(count);
+	// the children's heuristics are computed together so the lookups can overlap
+	std::vector<double> neighborH(neighbors.size());
+	if (neighbors.size() > 0)
+		env->BatchHCost(&neighbors[0], neighbors.size(), goal, &neighborH[0], rawH);
 	
 	for (unsigned int x = 0; x < neighbors.size(); x++)
 	{
-		if (neighbors[x] == parent)
-			continue;
 		thePath.push_back(neighbors[x]);
 		double edgeCost = env->GCost(currState, neighbors[x]);
 		double childH = DoIteration(env, currState, neighbors[x], thePath, bound,
-																g+edgeCost, maxH - edgeCost);
+																g+edgeCost, maxH - edgeCost, neighborH[x]);
 		if (env->GoalTest(thePath.back(), goal))
 			return 0;
 		thePath.pop_back();
@@ -155,11 +168,10 @@ template <class state, class action>
 double IDAStar<state, action>::DoIteration(SearchEnvironment<state, action> *env,
 										   action forbiddenAction, state &currState,
 										   std::vector<action> &thePath, double bound, double g,
-										   double maxH, double parentH)
+										   double maxH, double h)
 {
 	nodesExpanded++;
-	double h = env->HCost(currState, goal, parentH);
-	parentH = h;
+	double rawH = h; // the children's lookups are decoded from this
 	// path max
 	if (usePathMax && fless(h, maxH))
 		h = maxH;
@@ -177,43 +189,64 @@ double IDAStar<state, action>::DoIteration(SearchEnvironment<state, action> *env
 	env->GetActions(currState, actions);
 	nodesTouched += actions.size();
 	int depth = thePath.size();
-	
+
+	// apply every action that is searched, then look up all of the children
+	// together so the lookups can overlap
+	std::vector<state> &children = *stateCache.getItem();
+	std::vector<double> &childH = *hCache.getItem();
+	unsigned int count = 0;
 	for (unsigned int x = 0; x < actions.size(); x++)
 	{
 		if ((depth != 0) && (actions[x] == forbiddenAction))
 			continue;
-
+		actions[count++] = actions[x];
+		children.push_back(currState);
+		env->ApplyAction(children.back(), actions[x]);
+	}
+	actions.resize(count);
+	childH.resize(count);
+	if (count > 0)
+		env->BatchHCost(&children[0], count, goal, &childH[0], rawH);
+	
+	for (unsigned int x = 0; x < actions.size(); x++)
+	{
 		thePath.push_back(actions[x]);
 
 		double edgeCost = env->GCost(currState, actions[x]);
 		env->ApplyAction(currState, actions[x]);
 		action a = actions[x];
 		env->InvertAction(a);
-		double childH = DoIteration(env, a, currState, thePath, bound,
-									g+edgeCost, maxH - edgeCost, parentH);
+		double result = DoIteration(env, a, currState, thePath, bound,
+									g+edgeCost, maxH - edgeCost, childH[x]);
 		env->UndoAction(currState, actions[x]);
-		if (fequal(childH, -1)) // found goal
+		if (fequal(result, -1)) // found goal
 		{
 			actCache.returnItem(&actions);
+			stateCache.returnItem(&children);
+			hCache.returnItem(&childH);
 			return -1;
 		}
 
 		thePath.pop_back();
 
 		// pathmax
-		if (usePathMax && fgreater(childH-edgeCost, h))
+		if (usePathMax && fgreater(result-edgeCost, h))
 		{
 			//			nodeTable[currState] = g;//+h
-			h = childH-edgeCost;
+			h = result-edgeCost;
 			if (fgreater(g+h, bound))
 			{
 				UpdateNextBound(bound, g+h);
 				actCache.returnItem(&actions);
+				stateCache.returnItem(&children);
+				hCache.returnItem(&childH);
 				return h;
 			}
 		}
 	}
 	actCache.returnItem(&actions);
+	stateCache.returnItem(&children);
+	hCache.returnItem(&childH);
 	return h;
 }
 
@@ -0,0 +1,430 @@
+//
+//  ParallelIDAStar.h
+//  hog2 glut
+//
+//  A multi-threaded version of IDA* for action-based search environments.
+//  Each iteration first enumerates the tree to a fixed depth; every node at
+//  that depth becomes a work item holding the actions that lead to it. The
+//  items are split between the threads, each of which searches its subtrees
+//  depth-first with the same bound. A thread that runs out of work steals
+//  from the back of another thread's queue, so the remaining (and usually
+//  larger, left-to-right unexplored) subtrees are shared out at the end of
+//  an iteration. The threads share the minimum f-cost above the bound, which
+//  becomes the next bound. Every solution found within the bound is optimal,
+//  so the first thread to find one stops all the others. The nodes above the
+//  split depth are all expanded before any subtree is searched, so the last
+//  iteration can expand a few more nodes than IDAStar.
+//
+//  The environment is shared between the threads, so GetActions, ApplyAction,
+//  UndoAction, GCost, GoalTest and HCost must be safe to call concurrently.
+//  This is true of MNPuzzle and the other PermutationPuzzleEnvironment
+//  domains with their built-in heuristics (Manhattan distance and PDBs in
+//  any storage, whose lookups keep their scratch space per thread), as long
+//  as no PDB is built, loaded or compressed during the search. Heuristics
+//  that keep other state between calls are not safe. apps/stp -parallelIDA
+//  checks the results against IDAStar.
+//
+
+#ifndef PARALLELIDASTAR_H
+#define PARALLELIDASTAR_H
+
+#include <stdio.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cfloat>
+#include "SearchEnvironment.h"
+#include "FPUtil.h"
+
+template <class state, class action>
+class ParallelIDAStar {
+public:
+	ParallelIDAStar();
+	virtual ~ParallelIDAStar() {}
+	void GetPath(SearchEnvironment<state, action> *env, state from, state to,
+				 std::vector<action> &thePath);
+	void GetPath(SearchEnvironment<state, action> *env, state from, state to,
+				 std::vector<state> &thePath);
+
+	uint64_t GetNodesExpanded() { return nodesExpanded; }
+	uint64_t GetNodesTouched() { return nodesTouched; }
+	void ResetNodeCount() { nodesExpanded = nodesTouched = 0; }
+	void SetUseBDPathMax(bool val) { usePathMax = val; }
+	void SetNumThreads(int count) { numThreads = (count > 0)?count:1; }
+	int GetNumThreads() const { return numThreads; }
+	/**
+	 Sets the depth at which the tree is split into work items. With the
+	 default of 0 the depth is chosen each iteration so that there are
+	 at least kWorkPerThread items for each thread.
+	 **/
+	void SetWorkDepth(int depth) { workDepth = depth; }
+	void SetVerbose(bool val) { verbose = val; }
+private:
+	static const int kWorkPerThread = 64;
+	static const int kMaxWorkDepth = 64;
+	// returned by DoIteration (negative, so never a heuristic value)
+	static constexpr double kFoundGoal = -1;
+	static constexpr double kStopped = -2;
+
+	struct workItem {
+		double g, parentH, maxH;
+	};
+	struct workQueue {
+		std::mutex lock;
+		std::deque<size_t> items;
+	};
+	struct threadData {
+		threadData() :nodesExpanded(0), nodesTouched(0), nextBound(DBL_MAX) {}
+		uint64_t nodesExpanded, nodesTouched;
+		double nextBound;
+		std::vector<action> thePath;
+		// one list per depth; a deque so growing it doesn't move the lists
+		// still in use further up the recursion
+		std::deque<std::vector<action> > actions;
+	};
+
+	bool GenerateWork(action forbiddenAction, state &currState, std::vector<action> &thePath,
+					  double g, double maxH, double parentH, threadData &data);
+	void DoWork(int whichThread);
+	bool GetNextItem(int whichThread, size_t &item);
+	double DoIteration(action forbiddenAction, state &currState, std::vector<action> &thePath,
+					   double g, double maxH, double parentH, threadData &data);
+	void UpdateNextBound(double fCost, threadData &data);
+	void MergeNextBound(double fCost);
+
+	SearchEnvironment<state, action> *env;
+	state root, goal;
+	double bound;
+	std::atomic<double> nextBound;
+	std::atomic<bool> stop;
+	std::mutex solutionLock;
+	std::vector<action> solution;
+
+	int splitDepth;
+	std::vector<workItem> work;
+	std::vector<action> workActions; // splitDepth actions per item
+	std::vector<workQueue> queues;
+
+	uint64_t nodesExpanded, nodesTouched;
+	int numThreads;
+	int workDepth;
+	bool usePathMax;
+	bool verbose;
+};
+
+template <class state, class action>
+ParallelIDAStar<state, action>::ParallelIDAStar()
+{
+	nodesExpanded = nodesTouched = 0;
+	numThreads = std::thread::hardware_concurrency();
+	if (numThreads < 1)
+		numThreads = 1;
+	workDepth = 0;
+	splitDepth = 1;
+	usePathMax = false;
+	verbose = true;
+}
+
+template <class state, class action>
+void ParallelIDAStar<state, action>::GetPath(SearchEnvironment<state, action> *e,
+											 state from, state to,
+											 std::vector<state> &thePath)
+{
+	std::vector<action> acts;
+	GetPath(e, from, to, acts);
+	thePath.resize(0);
+	thePath.push_back(from);
+	for (unsigned int x = 0; x < acts.size(); x++)
+	{
+		e->ApplyAction(from, acts[x]);
+		thePath.push_back(from);
+	}
+}
+
+template <class state, class action>
+void ParallelIDAStar<state, action>::GetPath(SearchEnvironment<state, action> *e,
+											 state from, state to,
+											 std::vector<action> &thePath)
+{
+	env = e;
+	root = from;
+	goal = to;
+	nodesExpanded = nodesTouched = 0;
+	thePath.resize(0);
+	solution.resize(0);
+
+	if (env->GoalTest(from, to))
+		return;
+
+	double rootH = env->HCost(from, to);
+	bound = rootH;
+	std::vector<action> act;
+	env->GetActions(from, act);
+	if (act.size() == 0)
+		return;
+	while (true)
+	{
+		if (verbose)
+		{
+			printf("Starting iteration with bound %f; %llu expanded\n", bound, (unsigned long long)nodesExpanded);
+			fflush(stdout);
+		}
+		nextBound = DBL_MAX;
+		stop = false;
+
+		// split the tree into work items. Without a fixed depth, the split
+		// goes deeper until there is enough work for all the threads
+		threadData splitData;
+		bool found;
+		splitDepth = (workDepth > 0)?workDepth:1;
+		while (true)
+		{
+			splitData = threadData();
+			work.resize(0);
+			workActions.resize(0);
+			state s = root;
+			std::vector<action> prefix;
+			found = GenerateWork(act[0], s, prefix, 0, 0, rootH, splitData);
+			// no items means the whole tree fit above the split depth
+			if (found || workDepth > 0 || splitDepth >= kMaxWorkDepth || work.size() == 0 ||
+				work.size() >= (size_t)(kWorkPerThread*numThreads))
+				break;
+			splitDepth++;
+		}
+		nodesExpanded += splitData.nodesExpanded;
+		nodesTouched += splitData.nodesTouched;
+		MergeNextBound(splitData.nextBound);
+		if (found)
+		{
+			solution = splitData.thePath;
+			break;
+		}
+
+		// deal the items out in contiguous runs so each thread starts on
+		// its own part of the tree
+		std::vector<workQueue> newQueues(numThreads);
+		queues.swap(newQueues);
+		for (size_t x = 0; x < work.size(); x++)
+			queues[(x*numThreads)/work.size()].items.push_back(x);
+
+		std::vector<std::thread> threads;
+		for (int t = 1; t < numThreads; t++)
+			threads.push_back(std::thread(&ParallelIDAStar<state, action>::DoWork, this, t));
+		DoWork(0);
+		for (unsigned int t = 0; t < threads.size(); t++)
+			threads[t].join();
+
+		if (stop)
+			break;
+		if (nextBound == DBL_MAX)
+		{
+			// every branch was pruned by the domain; there is no solution
+			if (verbose)
+				printf("No solution exists\n");
+			break;
+		}
+		bound = nextBound;
+	}
+	thePath = solution;
+}
+
+/**
+ * Enumerates the tree down to splitDepth, adding a work item for each node
+ * at that depth which is within the bound. Returns true if the goal was found
+ * above the split depth, in which case data.thePath holds the solution.
+ */
+template <class state, class action>
+bool ParallelIDAStar<state, action>::GenerateWork(action forbiddenAction, state &currState,
+												  std::vector<action> &thePath,
+												  double g, double maxH, double parentH, threadData &data)
+{
+	int depth = thePath.size();
+	if (depth == splitDepth)
+	{
+		workItem w = {g, parentH, maxH};
+		work.push_back(w);
+		workActions.insert(workActions.end(), thePath.begin(), thePath.end());
+		return false;
+	}
+	data.nodesExpanded++;
+	double h = env->HCost(currState, goal, parentH);
+	parentH = h;
+	if (usePathMax && fless(h, maxH))
+		h = maxH;
+	if (fgreater(g+h, bound))
+	{
+		UpdateNextBound(g+h, data);
+		return false;
+	}
+	if (env->GoalTest(currState, goal))
+	{
+		data.thePath = thePath;
+		return true;
+	}
+
+	std::vector<action> actions;
+	env->GetActions(currState, actions);
+	data.nodesTouched += actions.size();
+	for (unsigned int x = 0; x < actions.size(); x++)
+	{
+		if ((depth != 0) && (actions[x] == forbiddenAction))
+			continue;
+		thePath.push_back(actions[x]);
+		double edgeCost = env->GCost(currState, actions[x]);
+		env->ApplyAction(currState, actions[x]);
+		action a = actions[x];
+		env->InvertAction(a);
+		bool found = GenerateWork(a, currState, thePath, g+edgeCost, maxH-edgeCost, parentH, data);
+		env->UndoAction(currState, actions[x]);
+		if (found)
+			return true;
+		thePath.pop_back();
+	}
+	return false;
+}
+
+/**
+ * Takes the next item from the front of the thread's own queue or, if that
+ * is empty, steals one from the back of another thread's queue.
+ */
+template <class state, class action>
+bool ParallelIDAStar<state, action>::GetNextItem(int whichThread, size_t &item)
+{
+	for (int x = 0; x < numThreads; x++)
+	{
+		workQueue &q = queues[(whichThread+x)%numThreads];
+		std::lock_guard<std::mutex> l(q.lock);
+		if (q.items.size() == 0)
+			continue;
+		if (x == 0)
+		{
+			item = q.items.front();
+			q.items.pop_front();
+		}
+		else {
+			item = q.items.back();
+			q.items.pop_back();
+		}
+		return true;
+	}
+	return false;
+}
+
+template <class state, class action>
+void ParallelIDAStar<state, action>::DoWork(int whichThread)
+{
+	threadData data;
+	size_t item;
+	while (!stop && GetNextItem(whichThread, item))
+	{
+		const workItem &w = work[item];
+		state s = root;
+		data.thePath.resize(0);
+		for (int x = 0; x < splitDepth; x++)
+		{
+			action a = workActions[item*splitDepth+x];
+			env->ApplyAction(s, a);
+			data.thePath.push_back(a);
+		}
+		action forbidden = data.thePath.back();
+		env->InvertAction(forbidden);
+		double result = DoIteration(forbidden, s, data.thePath, w.g, w.maxH, w.parentH, data);
+		if (result == kFoundGoal)
+		{
+			std::lock_guard<std::mutex> l(solutionLock);
+			if (!stop)
+			{
+				solution = data.thePath;
+				stop = true;
+			}
+		}
+		MergeNextBound(data.nextBound);
+	}
+	std::lock_guard<std::mutex> l(solutionLock);
+	nodesExpanded += data.nodesExpanded;
+	nodesTouched += data.nodesTouched;
+}
+
+template <class state, class action>
+double ParallelIDAStar<state, action>::DoIteration(action forbiddenAction, state &currState,
+												   std::vector<action> &thePath,
+												   double g, double maxH, double parentH, threadData &data)
+{
+	if (stop.load(std::memory_order_relaxed))
+		return kStopped;
+	data.nodesExpanded++;
+	double h = env->HCost(currState, goal, parentH);
+	parentH = h;
+	// path max
+	if (usePathMax && fless(h, maxH))
+		h = maxH;
+	if (fgreater(g+h, bound))
+	{
+		UpdateNextBound(g+h, data);
+		return h;
+	}
+	// must do this after we check the f-cost bound
+	if (env->GoalTest(currState, goal))
+		return kFoundGoal;
+
+	int depth = thePath.size();
+	if (depth >= (int)data.actions.size())
+		data.actions.resize(depth+1);
+	std::vector<action> &actions = data.actions[depth];
+	env->GetActions(currState, actions);
+	data.nodesTouched += actions.size();
+
+	for (unsigned int x = 0; x < actions.size(); x++)
+	{
+		if (actions[x] == forbiddenAction)
+			continue;
+
+		thePath.push_back(actions[x]);
+
+		double edgeCost = env->GCost(currState, actions[x]);
+		env->ApplyAction(currState, actions[x]);
+		action a = actions[x];
+		env->InvertAction(a);
+		double childH = DoIteration(a, currState, thePath, g+edgeCost, maxH - edgeCost, parentH, data);
+		env->UndoAction(currState, actions[x]);
+		if (childH == kFoundGoal || childH == kStopped)
+			return childH;
+
+		thePath.pop_back();
+
+		// pathmax
+		if (usePathMax && fgreater(childH-edgeCost, h))
+		{
+			h = childH-edgeCost;
+			if (fgreater(g+h, bound))
+			{
+				UpdateNextBound(g+h, data);
+				return h;
+			}
+		}
+	}
+	return h;
+}
+
+/**
+ * Records an f-cost above the bound in the thread's own minimum; the minimum
+ * is merged into the shared next bound after each work item.
+ */
+template <class state, class action>
+void ParallelIDAStar<state, action>::UpdateNextBound(double fCost, threadData &data)
+{
+	if (fless(fCost, data.nextBound))
+		data.nextBound = fCost;
+}
+
+template <class state, class action>
+void ParallelIDAStar<state, action>::MergeNextBound(double fCost)
+{
+	double curr = nextBound.load();
+	while (fCost < curr && !nextBound.compare_exchange_weak(curr, fCost))
+	{ }
+}
+
+#endif
@@ -47,7 +47,6 @@
 #include <algorithm> // for vector reverse
 
 #include "GenericSearchAlgorithm.h"
-static double lastF = 0;
 
 template <class state>
 struct AStarCompare {
@@ -63,18 +62,19 @@ struct AStarCompare {
 
 /**
  * A templated version of A*, based on HOG genericAStar
+ * The open/closed list is a template parameter; BucketOpenClosed is faster
+ * when all costs are multiples of a fixed unit (and uses a heap otherwise).
  */
-template <class state, class action, class environment>
+template <class state, class action, class environment, class openList = AStarOpenClosed<state, AStarCompare<state> > >
 class TemplateAStar : public GenericSearchAlgorithm<state,action,environment> {
 public:
-	TemplateAStar() { ResetNodeCount(); env = 0; useBPMX = 0; radius = 4.0; stopAfterGoal = true; weight=1; useRadius=false; useOccupancyInfo=false; radEnv = 0; reopenNodes = false; theHeuristic = 0; }
+	TemplateAStar() { ResetNodeCount(); env = 0; lastF = 0; useBPMX = 0; radius = 4.0; stopAfterGoal = true; weight=1; useRadius=false; useOccupancyInfo=false; radEnv = 0; reopenNodes = false; theHeuristic = 0; }
 	virtual ~TemplateAStar() {}
 	void GetPath(environment *env, const state& from, const state& to, std::vector<state> &thePath);
 	
 	void GetPath(environment *, const state& , const state& , std::vector<action> & ) { assert(false); };
 	
-	AStarOpenClosed<state, AStarCompare<state> > openClosedList;
-	//BucketOpenClosed<state, AStarCompare<state> > openClosedList;
+	openList openClosedList;
 	state goal, start;
 	
 	bool InitializeSearch(environment *env, const state& from, const state& to, std::vector<state> &thePath);
@@ -140,6 +140,8 @@ private:
 	std::vector<uint64_t> neighborID;
 	std::vector<double> edgeCosts;
 	std::vector<dataLocation> neighborLoc;
+	std::vector<state> newNeighbors;
+	std::vector<double> newNeighborH;
 	environment *env;
 	bool stopAfterGoal;
 	
@@ -153,6 +155,7 @@ private:
 	uint64_t uniqueNodesExpanded;
 	environment *radEnv;
 	Heuristic<state> *theHeuristic;
+	double lastF; // largest f-cost expanded so far
 };
 
 //static const bool verbose = false;
@@ -165,8 +168,8 @@ private:
  * @return The name of the algorithm
  */
 
-template <class state, class action, class environment>
-const char *TemplateAStar<state,action,environment>::GetName()
+template <class state, class action, class environment, class openList>
+const char *TemplateAStar<state, action, environment, openList>::GetName()
 {
 	static char name[32];
 	sprintf(name, "TemplateAStar[]");
@@ -184,8 +187,8 @@ const char *TemplateAStar<state,action,environment>::GetName()
  * @param thePath A vector of states which will contain an optimal path 
  * between from and to when the function returns, if one exists. 
  */
-template <class state, class action, class environment>
-void TemplateAStar<state,action,environment>::GetPath(environment *_env, const state& from, const state& to, std::vector<state> &thePath)
+template <class state, class action, class environment, class openList>
+void TemplateAStar<state, action, environment, openList>::GetPath(environment *_env, const state& from, const state& to, std::vector<state> &thePath)
 {
 	//discardcount=0;
   	if (!InitializeSearch(_env, from, to, thePath))
@@ -209,8 +212,8 @@ void TemplateAStar<state,action,environment>::GetPath(environment *_env, const s
  * @param to The goal state
  * @return TRUE if initialization was successful, FALSE otherwise
  */
-template <class state, class action, class environment>
-bool TemplateAStar<state,action,environment>::InitializeSearch(environment *_env, const state& from, const state& to, std::vector<state> &thePath)
+template <class state, class action, class environment, class openList>
+bool TemplateAStar<state, action, environment, openList>::InitializeSearch(environment *_env, const state& from, const state& to, std::vector<state> &thePath)
 {
 	lastF = 0;
 	
@@ -246,10 +249,10 @@ bool TemplateAStar<state,action,environment>::InitializeSearch(environment *_env
  * @author Nathan Sturtevant
  * @date 01/06/08
  */
-template <class state, class action, class environment>
-void TemplateAStar<state,action,environment>::AddAdditionalStartState(state& newState)
+template <class state, class action, class environment, class openList>
+void TemplateAStar<state, action, environment, openList>::AddAdditionalStartState(state& newState)
 {
-	openClosedList.AddOpenNode(newState, env->GetStateHash(newState), 0, weight*theHeuristic->HCost(start, goal));
+	openClosedList.AddOpenNode(newState, env->GetStateHash(newState), 0, weight*theHeuristic->HCost(newState, goal));
 }
 
 /**
@@ -257,10 +260,10 @@ void TemplateAStar<state,action,environment>::AddAdditionalStartState(state& new
  * @author Nathan Sturtevant
  * @date 09/25/10
  */
-template <class state, class action, class environment>
-void TemplateAStar<state,action,environment>::AddAdditionalStartState(state& newState, double cost)
+template <class state, class action, class environment, class openList>
+void TemplateAStar<state, action, environment, openList>::AddAdditionalStartState(state& newState, double cost)
 {
-	openClosedList.AddOpenNode(newState, env->GetStateHash(newState), cost, weight*theHeuristic->HCost(start, goal));
+	openClosedList.AddOpenNode(newState, env->GetStateHash(newState), cost, weight*theHeuristic->HCost(newState, goal));
 }
 
 /**
@@ -273,8 +276,8 @@ void TemplateAStar<state,action,environment>::AddAdditionalStartState(state& new
  * @return TRUE if there is no path or if we have found the goal, FALSE
  * otherwise
  */
-template <class state, class action, class environment>
-bool TemplateAStar<state,action,environment>::DoSingleSearchStep(std::vector<state> &thePath)
+template <class state, class action, class environment, class openList>
+bool TemplateAStar<state, action, environment, openList>::DoSingleSearchStep(std::vector<state> &thePath)
 {
 	if (openClosedList.OpenSize() == 0)
 	{
@@ -328,6 +331,25 @@ bool TemplateAStar<state,action,environment>::DoSingleSearchStep(std::vector<sta
 		openClosedList.Lookup(nodeid).h = std::max(openClosedList.Lookup(nodeid).h, bestH); 
 	}
 	
+	// 2. get the heuristic for all new children in one call so the lookups can overlap
+	unsigned int numNew = 0;
+	for (unsigned int x = 0; x < neighbors.size(); x++)
+	{
+		if (neighborLoc[x] != kNotFound)
+			continue;
+		if (numNew < newNeighbors.size())
+			newNeighbors[numNew] = neighbors[x];
+		else
+			newNeighbors.push_back(neighbors[x]);
+		numNew++;
+	}
+	newNeighborH.resize(numNew);
+	// the parent's h is only the heuristic's own value if nothing raised or scaled it
+	double parentH = (useBPMX || useRadius || weight != 1)?-1:openClosedList.Lookup(nodeid).h;
+	if (numNew > 0)
+		theHeuristic->BatchHCost(&newNeighbors[0], numNew, goal, &newNeighborH[0], parentH);
+	unsigned int nextNew = 0;
+	
 	// iterate again updating costs and writing out to memory
 	for (int x = 0; x < neighbors.size(); x++)
 	{
@@ -376,6 +398,8 @@ bool TemplateAStar<state,action,environment>::DoSingleSearchStep(std::vector<sta
 				}
 				break;
 			case kNotFound:
+			{
+				double childH = newNeighborH[nextNew++];
 				// node is occupied; just mark it closed
 				if (useRadius && useOccupancyInfo && env->GetOccupancyInfo() && radEnv && (radEnv->HCost(start, neighbors[x]) < radius) &&(env->GetOccupancyInfo()->GetStateOccupied(neighbors[x])) && ((!(radEnv->GoalTest(neighbors[x], goal)))))
 				{
@@ -383,7 +407,7 @@ bool TemplateAStar<state,action,environment>::DoSingleSearchStep(std::vector<sta
 					openClosedList.AddClosedNode(neighbors[x],
 												 env->GetStateHash(neighbors[x]),
 												 openClosedList.Lookup(nodeid).g+edgeCosts[x],
-												 std::max(theHeuristic->HCost(neighbors[x], goal), openClosedList.Lookup(nodeid).h-edgeCosts[x]),
+												 std::max(childH, openClosedList.Lookup(nodeid).h-edgeCosts[x]),
 												 nodeid);
 				}
 				else { // add node to open list
@@ -393,14 +417,14 @@ bool TemplateAStar<state,action,environment>::DoSingleSearchStep(std::vector<sta
 						openClosedList.AddOpenNode(neighbors[x],
 												   env->GetStateHash(neighbors[x]),
 												   openClosedList.Lookup(nodeid).g+edgeCosts[x],
-												   std::max(weight*theHeuristic->HCost(neighbors[x], goal), openClosedList.Lookup(nodeid).h-edgeCosts[x]),
+												   std::max(weight*childH, openClosedList.Lookup(nodeid).h-edgeCosts[x]),
 												   nodeid);
 					}
 					else {
 						openClosedList.AddOpenNode(neighbors[x],
 												   env->GetStateHash(neighbors[x]),
 												   openClosedList.Lookup(nodeid).g+edgeCosts[x],
-												   weight*theHeuristic->HCost(neighbors[x], goal),
+												   weight*childH,
 												   nodeid);
 					}
 //					if (loc == -1)
@@ -409,6 +433,7 @@ bool TemplateAStar<state,action,environment>::DoSingleSearchStep(std::vector<sta
 //						x--;
 //					}
 				}
+			}
 		}
 	}
 		
@@ -422,8 +447,8 @@ bool TemplateAStar<state,action,environment>::DoSingleSearchStep(std::vector<sta
  * 
  * @return The first state in the open list. 
  */
-template <class state, class action, class environment>
-state TemplateAStar<state, action,environment>::CheckNextNode()
+template <class state, class action, class environment, class openList>
+state TemplateAStar<state, action, environment, openList>::CheckNextNode()
 {
 	uint64_t key = openClosedList.Peek();
 	return openClosedList.Lookup(key).data;
@@ -438,8 +463,8 @@ state TemplateAStar<state, action,environment>::CheckNextNode()
  * 
  * @return The first state in the open list. 
  */
-template <class state, class action, class environment>
-void TemplateAStar<state, action,environment>::FullBPMX(uint64_t nodeID, int distance)
+template <class state, class action, class environment, class openList>
+void TemplateAStar<state, action, environment, openList>::FullBPMX(uint64_t nodeID, int distance)
 {
 	if (distance <= 0)
 		return;
@@ -489,8 +514,8 @@ void TemplateAStar<state, action,environment>::FullBPMX(uint64_t nodeID, int dis
  * @param goalNode the goal state
  * @param thePath will contain the path from goalNode to the start state
  */
-template <class state, class action,class environment>
-void TemplateAStar<state, action,environment>::ExtractPathToStartFromID(uint64_t node,
+template <class state, class action, class environment, class openList>
+void TemplateAStar<state, action, environment, openList>::ExtractPathToStartFromID(uint64_t node,
 																	 std::vector<state> &thePath)
 {
 	do {
@@ -506,8 +531,8 @@ void TemplateAStar<state, action,environment>::ExtractPathToStartFromID(uint64_t
  * @author Nathan Sturtevant
  * @date 03/22/06
  */
-template <class state, class action, class environment>
-void TemplateAStar<state, action,environment>::PrintStats()
+template <class state, class action, class environment, class openList>
+void TemplateAStar<state, action, environment, openList>::PrintStats()
 {
 	printf("%u items in closed list\n", (unsigned int)openClosedList.ClosedSize());
 	printf("%u items in open queue\n", (unsigned int)openClosedList.OpenSize());
@@ -520,8 +545,8 @@ void TemplateAStar<state, action,environment>::PrintStats()
  * 
  * @return The combined number of elements in the closed list and open queue
  */
-template <class state, class action, class environment>
-int TemplateAStar<state, action,environment>::GetMemoryUsage()
+template <class state, class action, class environment, class openList>
+int TemplateAStar<state, action, environment, openList>::GetMemoryUsage()
 {
 	return openClosedList.size();
 }
@@ -536,8 +561,8 @@ int TemplateAStar<state, action,environment>::GetMemoryUsage()
  * @return success Whether we found the value or not
  * more states
  */
-template <class state, class action, class environment>
-bool TemplateAStar<state, action,environment>::GetClosedListGCost(const state &val, double &gCost) const
+template <class state, class action, class environment, class openList>
+bool TemplateAStar<state, action, environment, openList>::GetClosedListGCost(const state &val, double &gCost) const
 {
 	uint64_t theID;
 	dataLocation loc = openClosedList.Lookup(env->GetStateHash(val), theID);
@@ -555,8 +580,8 @@ bool TemplateAStar<state, action,environment>::GetClosedListGCost(const state &v
  * @date 03/12/09
  * 
  */
-template <class state, class action, class environment>
-void TemplateAStar<state, action,environment>::OpenGLDraw() const
+template <class state, class action, class environment, class openList>
+void TemplateAStar<state, action, environment, openList>::OpenGLDraw() const
 {
 	double transparency = 1.0;
 	if (openClosedList.size() == 0)
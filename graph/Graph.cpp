@@ -337,14 +337,11 @@ node *Graph::RemoveNode(node *n, unsigned int &oldID)
 	//printf("_nodes size is %u\n", _nodes.size());
 	node *tmp = _nodes.back();
 	_nodes.pop_back();
-	if (_nodes.size() > 0)
-	{
-		_nodes[n->GetNum()] = tmp;
-		oldID = tmp->nodeNum;
-		tmp->nodeNum = n->GetNum();
-	}
-	
+	// the last node is moved into the slot of n, unless it is n
 	if (n == tmp) return 0;
+	_nodes[n->GetNum()] = tmp;
+	oldID = tmp->nodeNum;
+	tmp->nodeNum = n->GetNum();
 	
 	// repair edges to and from this node...
 	edge_iterator ei = tmp->getIncomingEdgeIter();
@@ -578,7 +575,7 @@ void edge::SetLabelL(unsigned int index, long val)
 }
 
 
-unsigned node::uniqueIDCounter = 0;
+std::atomic<unsigned int> node::uniqueIDCounter(0);
 
 node::node(const char *n)
 :label(), _edgesOutgoing(), _edgesIncoming(), _allEdges()
@@ -25,6 +25,7 @@
 
 #include <limits.h>
 #include <vector>
+#include <atomic>
 #include <list>
 #include <iostream>
 #include <stdio.h>
@@ -238,7 +239,7 @@ private:
 	int keyLabel;
 	
 	int uniqueID;
-	static unsigned int uniqueIDCounter;
+	static std::atomic<unsigned int> uniqueIDCounter;
 };
 
 std::ostream& operator <<(std::ostream & out, const Graph &_Graph);
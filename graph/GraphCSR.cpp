@@ -0,0 +1,73 @@
+//
+//  GraphCSR.cpp
+//  hog2 glut
+//
+
+#include "GraphCSR.h"
+
+void GraphCSR::Build(Graph *g, int xLabel, int yLabel, int zLabel)
+{
+	Clear();
+	uint32_t numNodes = g->GetNumNodes();
+	uint32_t numEdges = g->GetNumEdges();
+	outOffset.reserve(numNodes+1);
+	allOffset.reserve(numNodes+1);
+	outTarget.reserve(numEdges);
+	outWeight.reserve(numEdges);
+	allNeighbor.reserve(2*numEdges);
+	allWeight.reserve(2*numEdges);
+	if (xLabel >= 0)
+	{
+		x.resize(numNodes);
+		y.resize(numNodes);
+		z.resize(numNodes);
+	}
+
+	for (uint32_t n = 0; n < numNodes; n++)
+	{
+		node *theNode = g->GetNode(n);
+		outOffset.push_back((uint32_t)outTarget.size());
+		allOffset.push_back((uint32_t)allNeighbor.size());
+
+		edge_iterator ei = theNode->getOutgoingEdgeIter();
+		for (edge *e = theNode->edgeIterNextOutgoing(ei); e; e = theNode->edgeIterNextOutgoing(ei))
+		{
+			outTarget.push_back(e->getTo());
+			outWeight.push_back(e->GetWeight());
+		}
+		ei = theNode->getEdgeIter();
+		for (edge *e = theNode->edgeIterNext(ei); e; e = theNode->edgeIterNext(ei))
+		{
+			allNeighbor.push_back((e->getTo() != n)?e->getTo():e->getFrom());
+			allWeight.push_back(e->GetWeight());
+		}
+
+		if (xLabel >= 0)
+		{
+			x[n] = theNode->GetLabelF(xLabel);
+			y[n] = (yLabel >= 0)?theNode->GetLabelF(yLabel):0;
+			z[n] = (zLabel >= 0)?theNode->GetLabelF(zLabel):0;
+		}
+	}
+	outOffset.push_back((uint32_t)outTarget.size());
+	allOffset.push_back((uint32_t)allNeighbor.size());
+}
+
+void GraphCSR::Clear()
+{
+	outOffset.clear();
+	outTarget.clear();
+	outWeight.clear();
+	allOffset.clear();
+	allNeighbor.clear();
+	allWeight.clear();
+	x.clear();
+	y.clear();
+	z.clear();
+}
+
+size_t GraphCSR::GetMemoryUsage() const
+{
+	return (outOffset.capacity()+outTarget.capacity()+allOffset.capacity()+allNeighbor.capacity())*sizeof(uint32_t)+
+	(outWeight.capacity()+allWeight.capacity()+x.capacity()+y.capacity()+z.capacity())*sizeof(double);
+}
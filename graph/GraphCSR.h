@@ -0,0 +1,106 @@
+//
+//  GraphCSR.h
+//  hog2 glut
+//
+//  An immutable compressed sparse row (CSR) snapshot of a Graph, for search.
+//
+//  A Graph keeps every node and edge as a separate heap object, with three
+//  edge vectors per node and the edge weight stored as a label, so visiting
+//  the neighbors of a node chases several pointers per neighbor. The snapshot
+//  copies the adjacency into flat arrays in one pass: for each node, the
+//  offset of its first edge, and for each edge, its other endpoint and its
+//  weight. There are two views, matching the two ways GraphEnvironment walks
+//  a graph: the outgoing edges of each node (directed) and all edges incident
+//  to each node (undirected). Both list the edges in the same order as the
+//  Graph, so searches expand successors in the same order.
+//
+//  Node coordinates can optionally be copied from three node labels.
+//
+//  The snapshot doesn't track later changes to the Graph; it has to be built
+//  again after nodes or edges are added or removed.
+//
+
+#ifndef GRAPHCSR_H
+#define GRAPHCSR_H
+
+#include <stdint.h>
+#include <vector>
+#include "Graph.h"
+
+class GraphCSR {
+public:
+	GraphCSR() {}
+	/**
+	 * Builds the snapshot of g. If xLabel is not negative, node coordinates
+	 * are copied from labels xLabel, yLabel and zLabel (a negative y or z
+	 * label stores 0).
+	 **/
+	void Build(Graph *g, int xLabel = -1, int yLabel = -1, int zLabel = -1);
+	void Clear();
+
+	uint32_t GetNumNodes() const { return (outOffset.size() == 0)?0:(uint32_t)outOffset.size()-1; }
+	uint32_t GetNumEdges() const { return (uint32_t)outTarget.size(); }
+
+	/** Edges [OutBegin(n), OutEnd(n)) leave n **/
+	uint32_t OutBegin(uint32_t n) const { return outOffset[n]; }
+	uint32_t OutEnd(uint32_t n) const { return outOffset[n+1]; }
+	uint32_t OutTarget(uint32_t e) const { return outTarget[e]; }
+	double OutWeight(uint32_t e) const { return outWeight[e]; }
+
+	/** Edges [AllBegin(n), AllEnd(n)) are all edges incident to n, in either direction **/
+	uint32_t AllBegin(uint32_t n) const { return allOffset[n]; }
+	uint32_t AllEnd(uint32_t n) const { return allOffset[n+1]; }
+	/** The endpoint of edge e that isn't the node it is listed under **/
+	uint32_t AllNeighbor(uint32_t e) const { return allNeighbor[e]; }
+	double AllWeight(uint32_t e) const { return allWeight[e]; }
+
+	/** Finds the weight of an edge from -> to; returns false if there is none **/
+	inline bool FindDirectedEdge(uint32_t from, uint32_t to, double &weight) const;
+	/** Finds the weight of an edge between from and to in either direction **/
+	inline bool FindEdge(uint32_t from, uint32_t to, double &weight) const;
+
+	bool HasCoordinates() const { return x.size() != 0; }
+	double GetX(uint32_t n) const { return x[n]; }
+	double GetY(uint32_t n) const { return y[n]; }
+	double GetZ(uint32_t n) const { return z[n]; }
+
+	size_t GetMemoryUsage() const;
+private:
+	std::vector<uint32_t> outOffset, outTarget;
+	std::vector<double> outWeight;
+	std::vector<uint32_t> allOffset, allNeighbor;
+	std::vector<double> allWeight;
+	std::vector<double> x, y, z;
+};
+
+inline bool GraphCSR::FindDirectedEdge(uint32_t from, uint32_t to, double &weight) const
+{
+	if (from >= GetNumNodes())
+		return false;
+	for (uint32_t e = outOffset[from]; e < outOffset[from+1]; e++)
+	{
+		if (outTarget[e] == to)
+		{
+			weight = outWeight[e];
+			return true;
+		}
+	}
+	return false;
+}
+
+inline bool GraphCSR::FindEdge(uint32_t from, uint32_t to, double &weight) const
+{
+	if (from >= GetNumNodes())
+		return false;
+	for (uint32_t e = allOffset[from]; e < allOffset[from+1]; e++)
+	{
+		if (allNeighbor[e] == to)
+		{
+			weight = allWeight[e];
+			return true;
+		}
+	}
+	return false;
+}
+
+#endif
@@ -8,45 +8,330 @@
  */
 
 #include "FloydWarshall.h"
+#include "GraphCSR.h"
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <queue>
+#include <thread>
+#include <string.h>
+#include <float.h>
 
-//1 /* Assume a function edgeCost(i,j) which returns the cost of the edge from i to j
-// 2    (infinity if there is none).
-// 3    Also assume that n is the number of vertices and edgeCost(i,i)=0
-// 4 */
-//5
-//6 int path[][];
-//7 /* A 2-dimensional matrix. At each step in the algorithm, path[i][j] is the shortest path
-// 8    from i to j using intermediate vertices (1..k-1).  Each path[i][j] is initialized to
-// 9    edgeCost(i,j).
-// 10 */
-//11
-void FloydWarshall(Graph *g, std::vector<std::vector<double> > &lengths)
+#if defined(__GNUC__) && defined(__x86_64__)
+#define FW_X86_SIMD
+#endif
+
+/*
+ * The blocked algorithm splits the (padded) matrix into tiles of
+ * tileSize x tileSize. For each block k of intermediate nodes it
+ *  1. runs Floyd-Warshall within the diagonal tile (k, k),
+ *  2. updates the other tiles of row k and column k through tile (k, k),
+ *  3. updates every other tile (i, j) from tiles (i, k) and (k, j).
+ * The tiles of phases 2 and 3 are independent of each other, so they are
+ * split among threads, and each tile update touches three tiles that fit in
+ * cache. The inner loops are min-plus over a fixed number of contiguous
+ * entries, which the compiler vectorizes.
+ */
+static const int tileSize = 64;
+
+static inline double MinPlus(double c, double a, double b)
+{ double v = a+b; return (v < c)?v:c; }
+
+static inline float MinPlus(float c, float a, float b)
+{ float v = a+b; return (v < c)?v:c; }
+
+// c is at most UINT16_MAX, so an unreachable (saturated) sum never wins
+static inline uint16_t MinPlus(uint16_t c, uint16_t a, uint16_t b)
+{ uint32_t v = (uint32_t)a+b; return (v < c)?(uint16_t)v:c; }
+
+/** Tile update where c may be a or b; k must be the outer loop **/
+template <typename T>
+static inline __attribute__((always_inline))
+void DependentTileT(T *c, const T *a, const T *b, uint64_t stride)
 {
-	lengths.resize(0);
-	lengths.resize(g->GetNumNodes());
-	for (int x = 0; x < g->GetNumNodes(); x++)
+	for (int k = 0; k < tileSize; k++)
 	{
-		lengths[x].resize(g->GetNumNodes());
-		for (int i = 0; i < g->GetNumNodes(); i++)
-			lengths[x][i] = 1e10;
+		const T *bRow = b+k*stride;
+		for (int i = 0; i < tileSize; i++)
+		{
+			T *cRow = c+i*stride;
+			T aik = a[i*stride+k];
+			for (int j = 0; j < tileSize; j++)
+				cRow[j] = MinPlus(cRow[j], aik, bRow[j]);
+		}
 	}
+}
+
+/** Tile update where c is neither a nor b, so each row of c is finished in turn **/
+template <typename T>
+static inline __attribute__((always_inline))
+void IndependentTileT(T *__restrict c, const T *__restrict a, const T *__restrict b, uint64_t stride)
+{
+	for (int i = 0; i < tileSize; i++)
+	{
+		T *__restrict cRow = c+i*stride;
+		for (int k = 0; k < tileSize; k++)
+		{
+			const T *__restrict bRow = b+k*stride;
+			T aik = a[i*stride+k];
+			for (int j = 0; j < tileSize; j++)
+				cRow[j] = MinPlus(cRow[j], aik, bRow[j]);
+		}
+	}
+}
+
+template <typename T>
+static void DependentTile(T *c, const T *a, const T *b, uint64_t stride)
+{ DependentTileT(c, a, b, stride); }
+
+template <typename T>
+static void IndependentTile(T *c, const T *a, const T *b, uint64_t stride)
+{ IndependentTileT(c, a, b, stride); }
+
+#ifdef FW_X86_SIMD
+// the same loops compiled for AVX2, chosen at run time
+template <typename T>
+__attribute__((target("avx2")))
+static void DependentTileAVX2(T *c, const T *a, const T *b, uint64_t stride)
+{ DependentTileT(c, a, b, stride); }
+
+template <typename T>
+__attribute__((target("avx2")))
+static void IndependentTileAVX2(T *c, const T *a, const T *b, uint64_t stride)
+{ IndependentTileT(c, a, b, stride); }
+#endif
 
+template <typename T>
+struct TileKernels {
+	TileKernels()
+	{
+		dependent = DependentTile<T>;
+		independent = IndependentTile<T>;
+#ifdef FW_X86_SIMD
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+		{
+			dependent = DependentTileAVX2<T>;
+			independent = IndependentTileAVX2<T>;
+		}
+#endif
+	}
+	void (*dependent)(T *, const T *, const T *, uint64_t);
+	void (*independent)(T *, const T *, const T *, uint64_t);
+};
+
+static int GetNumThreads(int numThreads)
+{
+	if (numThreads > 0)
+		return numThreads;
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+
+static inline double ConvertWeight(double w, double) { return w; }
+static inline float ConvertWeight(double w, float) { return (float)w; }
+static inline uint16_t ConvertWeight(double w, uint16_t infinity)
+{ return (w+0.5 >= infinity)?infinity:(uint16_t)(w+0.5); }
+
+/** Fills the padded matrix with infinity and then the edges (and diagonal) **/
+template <typename T>
+static void InitMatrix(Graph *g, T *m, uint64_t stride, T infinity, bool zeroDiagonal)
+{
+	std::fill(m, m+stride*stride, infinity);
 	for (int x = 0; x < g->GetNumEdges(); x++)
 	{
 		edge *e = g->GetEdge(x);
-		lengths[e->getFrom()][e->getTo()] = e->GetWeight();
-		lengths[e->getTo()][e->getFrom()] = e->GetWeight();
+		T w = ConvertWeight(e->GetWeight(), infinity);
+		uint64_t from = e->getFrom(), to = e->getTo();
+		m[from*stride+to] = std::min(m[from*stride+to], w);
+		m[to*stride+from] = std::min(m[to*stride+from], w);
+	}
+	if (zeroDiagonal)
+	{
+		for (uint64_t x = 0; x < (uint64_t)g->GetNumNodes(); x++)
+			m[x*stride+x] = 0;
 	}
-	
-	for (int x = 0; x < g->GetNumNodes(); x++)
+}
+
+/** Phase 2 (row and column kb) or phase 3 tiles first, first+step, ... **/
+template <typename T>
+static void TileWorker(T *m, uint64_t stride, int kb, int phase, int first, int step, const TileKernels<T> *kernels)
+{
+	int blocks = (int)(stride/tileSize);
+	T *diag = m+kb*tileSize*stride+kb*tileSize;
+	if (phase == 2)
 	{
-		for (int i = 0; i < g->GetNumNodes(); i++)
+		for (int w = first; w < 2*blocks; w += step)
 		{
-			for (int j = 0; j < g->GetNumNodes(); j++)
+			int b = w/2;
+			if (b == kb)
+				continue;
+			if (w&1) // tile (b, kb) in column kb
 			{
-				lengths[i][j] = std::min(lengths[i][j], lengths[i][x]+lengths[x][j]);
+				T *c = m+b*tileSize*stride+kb*tileSize;
+				kernels->dependent(c, c, diag, stride);
+			}
+			else { // tile (kb, b) in row kb
+				T *c = m+kb*tileSize*stride+b*tileSize;
+				kernels->dependent(c, diag, c, stride);
+			}
+		}
+	}
+	else {
+		for (int bi = first; bi < blocks; bi += step)
+		{
+			if (bi == kb)
+				continue;
+			const T *a = m+bi*tileSize*stride+kb*tileSize;
+			for (int bj = 0; bj < blocks; bj++)
+			{
+				if (bj == kb)
+					continue;
+				kernels->independent(m+bi*tileSize*stride+bj*tileSize, a, m+kb*tileSize*stride+bj*tileSize, stride);
 			}
 		}
 	}
 }
 
+template <typename T>
+static void RunPhase(T *m, uint64_t stride, int kb, int phase, int numThreads, const TileKernels<T> *kernels)
+{
+	if (numThreads == 1)
+	{
+		TileWorker(m, stride, kb, phase, 0, 1, kernels);
+		return;
+	}
+	std::vector<std::thread*> threads(numThreads);
+	for (int x = 0; x < numThreads; x++)
+		threads[x] = new std::thread(TileWorker<T>, m, stride, kb, phase, x, numThreads, kernels);
+	for (int x = 0; x < numThreads; x++)
+	{
+		threads[x]->join();
+		delete threads[x];
+		threads[x] = 0;
+	}
+}
+
+template <typename T>
+static void BlockedFloydWarshall(T *m, uint64_t stride, int numThreads)
+{
+	static const TileKernels<T> kernels;
+	int blocks = (int)(stride/tileSize);
+	numThreads = std::min(numThreads, blocks);
+	for (int kb = 0; kb < blocks; kb++)
+	{
+		T *diag = m+kb*tileSize*stride+kb*tileSize;
+		kernels.dependent(diag, diag, diag, stride);
+		if (blocks == 1)
+			break;
+		RunPhase(m, stride, kb, 2, numThreads, &kernels);
+		RunPhase(m, stride, kb, 3, numThreads, &kernels);
+	}
+}
+
+/** Runs the blocked algorithm on a padded matrix, then packs it to n*n **/
+template <typename T>
+static void BlockedAPSP(Graph *g, std::vector<T> &lengths, T infinity, bool zeroDiagonal, int numThreads)
+{
+	uint64_t n = g->GetNumNodes();
+	uint64_t stride = (n+tileSize-1)/tileSize*tileSize;
+	lengths.resize(stride*stride);
+	if (n == 0)
+		return;
+	InitMatrix(g, &lengths[0], stride, infinity, zeroDiagonal);
+	BlockedFloydWarshall(&lengths[0], stride, GetNumThreads(numThreads));
+	for (uint64_t x = 1; x < n; x++)
+		memmove(&lengths[x*n], &lengths[x*stride], n*sizeof(T));
+	lengths.resize(n*n);
+}
+
+void FloydWarshall(Graph *g, std::vector<std::vector<double> > &lengths)
+{
+	std::vector<double> matrix;
+	BlockedAPSP(g, matrix, 1e10, false, 0);
+	int n = g->GetNumNodes();
+	lengths.resize(0);
+	lengths.resize(n);
+	for (int x = 0; x < n; x++)
+		lengths[x].assign(matrix.begin()+(uint64_t)x*n, matrix.begin()+(uint64_t)(x+1)*n);
+}
+
+void FloydWarshall(Graph *g, std::vector<float> &lengths, int numThreads)
+{
+	BlockedAPSP(g, lengths, std::numeric_limits<float>::infinity(), true, numThreads);
+}
+
+void FloydWarshall(Graph *g, std::vector<uint16_t> &lengths, int numThreads)
+{
+	BlockedAPSP(g, lengths, (uint16_t)UINT16_MAX, true, numThreads);
+}
+
+/** Dijkstra from sources taken from next until all are done, writing rows of lengths **/
+template <typename T>
+static void DijkstraWorker(const GraphCSR *csr, T *lengths, T infinity, std::atomic<uint32_t> *next)
+{
+	typedef std::pair<double, uint32_t> entry;
+	uint32_t n = csr->GetNumNodes();
+	std::vector<double> best(n);
+	std::vector<bool> closed(n);
+	for (uint32_t from = (*next)++; from < n; from = (*next)++)
+	{
+		T *row = lengths+(uint64_t)from*n;
+		std::fill(row, row+n, infinity);
+		std::fill(best.begin(), best.end(), DBL_MAX);
+		std::fill(closed.begin(), closed.end(), false);
+		std::priority_queue<entry, std::vector<entry>, std::greater<entry> > open;
+		best[from] = 0;
+		open.push(entry(0, from));
+		while (!open.empty())
+		{
+			entry e = open.top();
+			open.pop();
+			if (closed[e.second]) // stale entry
+				continue;
+			closed[e.second] = true;
+			row[e.second] = ConvertWeight(e.first, infinity);
+			for (uint32_t x = csr->AllBegin(e.second); x < csr->AllEnd(e.second); x++)
+			{
+				uint32_t nb = csr->AllNeighbor(x);
+				double cost = e.first+csr->AllWeight(x);
+				if (!closed[nb] && cost < best[nb])
+				{
+					best[nb] = cost;
+					open.push(entry(cost, nb));
+				}
+			}
+		}
+	}
+}
+
+template <typename T>
+static void ParallelDijkstra(Graph *g, std::vector<T> &lengths, T infinity, int numThreads)
+{
+	GraphCSR csr;
+	csr.Build(g);
+	uint64_t n = csr.GetNumNodes();
+	lengths.resize(n*n);
+	if (n == 0)
+		return;
+	numThreads = GetNumThreads(numThreads);
+	std::atomic<uint32_t> next(0);
+	std::vector<std::thread*> threads(numThreads);
+	for (int x = 0; x < numThreads; x++)
+		threads[x] = new std::thread(DijkstraWorker<T>, &csr, &lengths[0], infinity, &next);
+	for (int x = 0; x < numThreads; x++)
+	{
+		threads[x]->join();
+		delete threads[x];
+		threads[x] = 0;
+	}
+}
+
+void AllPairsDijkstra(Graph *g, std::vector<float> &lengths, int numThreads)
+{
+	ParallelDijkstra(g, lengths, std::numeric_limits<float>::infinity(), numThreads);
+}
+
+void AllPairsDijkstra(Graph *g, std::vector<uint16_t> &lengths, int numThreads)
+{
+	ParallelDijkstra(g, lengths, (uint16_t)UINT16_MAX, numThreads);
+}
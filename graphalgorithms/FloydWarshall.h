@@ -11,8 +11,35 @@
 #define FLOYDWARSHALL_H
 
 #include "Graph.h"
+#include <stdint.h>
 #include <vector>
 
+/**
+ * All-pairs shortest paths, treating every edge as undirected. Unreachable
+ * pairs are 1e10, and lengths[x][x] is the shortest cycle through x (not 0),
+ * as it has always been. Uses the blocked version below on all hardware threads.
+ */
 void FloydWarshall(Graph *g, std::vector<std::vector<double> > &lengths);
 
+/**
+ * Blocked, multi-threaded Floyd-Warshall into a contiguous row-major matrix:
+ * the distance from a to b is lengths[a*n+b], where n = g->GetNumNodes().
+ * Edges are undirected and the diagonal is 0. Unreachable pairs are infinity
+ * for float, and UINT16_MAX for uint16_t, which is meant for graphs with
+ * integer edge weights (weights are rounded). numThreads 0 uses every
+ * hardware thread.
+ *
+ * Time is cubic in the number of nodes; on sparse graphs AllPairsDijkstra
+ * is much faster.
+ */
+void FloydWarshall(Graph *g, std::vector<float> &lengths, int numThreads = 0);
+void FloydWarshall(Graph *g, std::vector<uint16_t> &lengths, int numThreads = 0);
+
+/**
+ * Computes the same matrix as FloydWarshall with a Dijkstra search from
+ * every node, over a GraphCSR snapshot, with the sources split among threads.
+ */
+void AllPairsDijkstra(Graph *g, std::vector<float> &lengths, int numThreads = 0);
+void AllPairsDijkstra(Graph *g, std::vector<uint16_t> &lengths, int numThreads = 0);
+
 #endif
@@ -19,6 +19,7 @@
 #include "TemplateAStar.h"
 #include "Timer.h"
 #include "vectorCache.h"
+#include "LearnedHeuristic.h"
 #include <queue>
 #include <iostream>
 
@@ -47,11 +48,10 @@ namespace FLRTA {
 	template <class state>
 	class learnedStateData {
 	public:
-		learnedStateData() :theState(), gCost(DBL_MAX), hCost(0), dead(false), redundant(false), parents(0), children(0) {}
+		learnedStateData() :theState(), gCost(DBL_MAX), dead(false), redundant(false), parents(0), children(0) {}
 		~learnedStateData() { delete parents; delete children; }
 		state theState;
 		double gCost;
-		double hCost;
 		bool dead;
 		bool redundant;
 		std::vector<state> *parents;
@@ -273,8 +273,8 @@ namespace FLRTA {
 
 			if (verbose) std::cout << "-->GCost of " << where << " setting to " << val << std::endl;
 			//std::cout << "Hashing state:3 " << std::endl << where << std::endl;
-			fAmountLearned -= theState.hCost;
-			theState.hCost = 0;
+			fAmountLearned -= heur.Get(env, where);
+			heur.Set(env, where, 0);
 			theState.gCost = val;
 			theState.theState = where;
 			theState.dead = false; // updated g-cost, make it alive again
@@ -307,17 +307,12 @@ namespace FLRTA {
 			double tmp = val-env->HCost(where, to);
 			if (tmp < 0) tmp = 0;
 			//std::cout << "Hashing state:5 " << std::endl << where << std::endl;
-			stateData[env->GetStateHash(where)].hCost = tmp;
-			stateData[env->GetStateHash(where)].theState = where;
+			heur.Set(env, where, tmp);
 		}
 		double HCost(environment *env, const state &from, const state &to)
 		{
 			//std::cout << "Hashing state:6 " << std::endl << from << std::endl;
-			if (stateData.find(env->GetStateHash(from)) != stateData.end())
-			{
-				return stateData[env->GetStateHash(from)].hCost+env->HCost(from, to);
-			}
-			return env->HCost(from, to);
+			return heur.Get(env, from)+env->HCost(from, to);
 		}
 		double HCost(const state &from, const state &to)
 		{ return HCost(m_pEnv, from, to); }
@@ -466,6 +461,9 @@ namespace FLRTA {
 		
 		environment *m_pEnv;
 		LearnedStateData stateData;
+		// not shareable: h-costs are reset to 0 when a shorter g-cost is found.
+		// mutable because lookups initialize the store, including when drawing
+		mutable LearnedHeuristic<state, environment> heur;
 		double fAmountLearned, fWeight;
 		uint64_t nodesExpanded, nodesTouched;
 		int nodeExpansionLimit, nodeLearningLimit;
@@ -945,13 +943,7 @@ namespace FLRTA {
 //		astar.OpenGLDraw();
 		char str[32];
 		
-		double learned = 0;
-		for (typename LearnedStateData::const_iterator it = stateData.begin(); it != stateData.end(); it++)
-		{
-			double thisState = (*it).second.hCost;
-			if (learned < thisState)
-				learned = thisState;
-		}
+		double learned = heur.GetMaxLearned();
 		for (typename LearnedStateData::const_iterator it = stateData.begin(); it != stateData.end(); it++)
 		{
 			uint64_t node;
@@ -972,7 +964,7 @@ namespace FLRTA {
 				if ((*it).second.dead)
 					sprintf(str, " %1.1f", (*it).second.gCost);
 				else
-					sprintf(str, "%1.1f %1.1f", (*it).second.gCost, (*it).second.hCost+m_pEnv->HCost((*it).second.theState, theEnd));
+					sprintf(str, "%1.1f %1.1f", (*it).second.gCost, heur.Get(m_pEnv, (*it).second.theState)+m_pEnv->HCost((*it).second.theState, theEnd));
 				e->SetColor(0.9, 0.9, 0.9, 1);
 				e->GLLabelState((*it).second.theState, str);
 			}
@@ -984,7 +976,7 @@ namespace FLRTA {
 			}
 			else
 			{
-				double r = (*it).second.hCost;
+				double r = heur.Get(m_pEnv, (*it).second.theState);
 				if (r > 0)
 				{
 					e->SetColor(0.5+0.5*r/learned, ((loc==kOpenList)?0.5:0.0), 0, 0.1+0.8*r/learned);
@@ -14,20 +14,15 @@
 #include "FPUtil.h"
 #include <deque>
 #include <vector>
-#include <ext/hash_map>
-
-template <class state>
-struct learnedData {
-	state theState;
-	double theHeuristic;
-};
+#include <cmath>
+#include "LearnedHeuristic.h"
 
 // This class defines the LRTA* algorithm
 template <class state, class action, class environment>
 class LRTAStar : public LearningAlgorithm<state,action,environment> {
 public:
 	LRTAStar()
-	{ fAmountLearned = 0.0f; }
+	{ fAmountLearned = 0.0f; heur = &ownHeur; }
 	virtual ~LRTAStar(void) { }
 
 	void GetPath(environment *env, const state& from, const state& to, std::vector<state> &thePath);
@@ -35,15 +30,16 @@ public:
 	virtual const char *GetName() { return "LRTAStar"; }
 	void SetHCost(environment *env, const state &where, const state &to, double val)
 	{
-		heur[env->GetStateHash(where)].theHeuristic = val-env->HCost(where, to);
-		heur[env->GetStateHash(where)].theState = where;
+		heur->Set(env, where, val-env->HCost(where, to));
 	}
 	double HCost(environment *env, const state &from, const state &to)
 	{
-		if (heur.find(env->GetStateHash(from)) != heur.end())
-			return heur[env->GetStateHash(from)].theHeuristic+env->HCost(from, to);
-		return env->HCost(from, to);
+		return heur->Get(env, from)+env->HCost(from, to);
 	}
+	/** Shares learning with other agents or episodes; 0 goes back to this agent's own store **/
+	void SetLearnedHeuristic(LearnedHeuristic<state, environment> *h)
+	{ heur = (h == 0)?&ownHeur:h; }
+	LearnedHeuristic<state, environment> *GetLearnedHeuristic() { return heur; }
 	
 	virtual uint64_t GetNodesExpanded() const { return nodesExpanded; }
 	virtual uint64_t GetNodesTouched() const { return nodesTouched; }
@@ -56,9 +52,8 @@ public:
 	void OpenGLDraw() const {}
 	void OpenGLDraw(const environment *env) const;
 private:
-	typedef __gnu_cxx::hash_map<uint64_t, learnedData<state>, Hash64 > LearnedHeuristic;
-
-	LearnedHeuristic heur;
+	LearnedHeuristic<state, environment> ownHeur;
+	LearnedHeuristic<state, environment> *heur;
 	state goal;
 	double fAmountLearned;
 	uint64_t nodesExpanded, nodesTouched;
@@ -155,14 +150,27 @@ void LRTAStar<state, action, environment>::GetPath(environment *env, const state
 	
 	deltaH = fabs(deltaH);			// decreasing h is also learning
 	
-	// update h[from,to]
-	if (fgreater(deltaH,0.0))
-		SetHCost(env, from, to, newH);
-	
-	// Update the amount learned on this trial
-	// We do this with an if to avoid accumulating floating point errors
-	if (fgreater(deltaH,0.0))
-		fAmountLearned += deltaH;
+	if (heur == &ownHeur)
+	{
+		// update h[from,to]
+		if (fgreater(deltaH,0.0))
+			SetHCost(env, from, to, newH);
+		
+		// Update the amount learned on this trial
+		// We do this with an if to avoid accumulating floating point errors
+		if (fgreater(deltaH,0.0))
+			fAmountLearned += deltaH;
+	}
+	else if (fgreater(deltaH,0.0))
+	{
+		// Another agent sharing the learned values may have raised h[from,to]
+		// since oldH was read, so never lower it, and only count as learned
+		// what this update adds to the store.
+		double learned = newH-env->HCost(from, to);
+		double old = heur->Raise(env, from, learned);
+		if (fgreater(learned, old))
+			fAmountLearned += learned-old;
+	}
 	
 	// Move -------------------------------------------------------------------------
 	if (1) // daLRTA*
@@ -176,22 +184,14 @@ void LRTAStar<state, action, environment>::GetPath(environment *env, const state
 template <class state, class action, class environment>
 void LRTAStar<state, action, environment>::OpenGLDraw(const environment *e) const
 {
-	double learned = 0;
-	for (typename LearnedHeuristic::const_iterator it = heur.begin(); it != heur.end(); it++)
-	{
-		double thisState = (*it).second.theHeuristic;
-		if (learned < thisState)
-			learned = thisState;
-	}
-	for (typename LearnedHeuristic::const_iterator it = heur.begin(); it != heur.end(); it++)
-	{
-		double r = (*it).second.theHeuristic;
+	double learned = heur->GetMaxLearned();
+	heur->ForEach(e, [&](const state &s, double r) {
 		if (r > 0)
 		{
 			e->SetColor(0.5+0.5*r/learned, 0, 0, 0.1+0.8*r/learned);
-			e->OpenGLDraw((*it).second.theState);
+			e->OpenGLDraw(s);
 		}
-	}
+	});
 }
 
 #endif
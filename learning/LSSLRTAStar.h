@@ -14,7 +14,8 @@
 #include "FPUtil.h"
 #include <deque>
 #include <vector>
-#include <ext/hash_map>
+#include "FlatHashMap.h"
+#include "LearnedHeuristic.h"
 #include "TemplateAStar.h"
 #include "Timer.h"
 #include <queue>
@@ -40,14 +41,6 @@ public:
 	}
 };
 
-template <class state>
-struct lssLearnedData {
-	lssLearnedData() { dead = false; }
-	state theState;
-	bool dead;
-	double theHeuristic;
-};
-
 template <class state, class action, class environment>
 class LSSLRTAStar : public LearningAlgorithm<state,action,environment>, public Heuristic<state> {
 public:
@@ -61,6 +54,7 @@ public:
 		initialHeuristic = true;
 		randomizeMoves = true;
 		initialHeuristicWeight = 1.0;
+		heur = &ownHeur;
 	}
 	virtual ~LSSLRTAStar(void) { }
 	
@@ -73,20 +67,15 @@ public:
 		else sprintf(name, "LSSLRTAStar(%d)", nodeExpansionLimit); return name; }
 	void SetHCost(environment *env, const state &where, const state &to, double val)
 	{
-		heur[env->GetStateHash(where)].theHeuristic = val-BaseHCost(env, where, to);
-		heur[env->GetStateHash(where)].theState = where;
+		heur->Set(env, where, val-BaseHCost(env, where, to));
 	}
 	double HCostLearned(const state &from)
 	{
-		if (heur.find(m_pEnv->GetStateHash(from)) != heur.end())
-			return heur[m_pEnv->GetStateHash(from)].theHeuristic;
-		return 0;
+		return heur->Get(m_pEnv, from);
 	}
 	double HCost(environment *env, const state &from, const state &to)
 	{
-		if (heur.find(env->GetStateHash(from)) != heur.end())
-			return heur[env->GetStateHash(from)].theHeuristic+BaseHCost(env, from, to);
-		return BaseHCost(env, from, to);
+		return heur->Get(env, from)+BaseHCost(env, from, to);
 	}
 	double BaseHCost(environment *env, const state &from, const state &to) const
 	{ return initialHeuristicWeight*env->HCost(from, to);
@@ -96,15 +85,12 @@ public:
 	
 	double GetMaxStateLearning()
 	{
-		double learned = 0;
-		for (typename LearnedHeuristic::const_iterator it = heur.begin(); it != heur.end(); it++)
-		{
-			double thisState = (*it).second.theHeuristic;
-			if (learned < thisState)
-				learned = thisState;
-		}
-		return learned;
+		return heur->GetMaxLearned();
 	}
+	/** Shares learning with other agents or episodes; 0 goes back to this agent's own store **/
+	void SetLearnedHeuristic(LearnedHeuristic<state, environment> *h)
+	{ heur = (h == 0)?&ownHeur:h; }
+	LearnedHeuristic<state, environment> *GetLearnedHeuristic() { return heur; }
 	void SetInititialHeuristicWeight(double val)
 	{ initialHeuristicWeight = val; }
 	
@@ -122,11 +108,12 @@ public:
 	void OpenGLDraw() const {}
 	void OpenGLDraw(const environment *env) const;
 private:
-	typedef __gnu_cxx::hash_map<uint64_t, lssLearnedData<state>, Hash64 > LearnedHeuristic;
-	typedef __gnu_cxx::hash_map<uint64_t, bool, Hash64 > ClosedList;
+	// the h-costs computed for the closed states during learning
+	typedef FlatHashMap<uint64_t, double> ClosedList;
 	
 	environment *m_pEnv;
-	LearnedHeuristic heur;
+	LearnedHeuristic<state, environment> ownHeur;
+	LearnedHeuristic<state, environment> *heur;
 	double fAmountLearned;
 	double initialHeuristicWeight;
 	uint64_t nodesExpanded, nodesTouched;
@@ -237,18 +224,23 @@ void LSSLRTAStar<state, action, environment>::GetPath(environment *env, const st
 		if (verbose) std::cout << "Preparing border state: " << data.data << " h: " << data.h << std::endl;
 	}
 	
-	std::vector<state> succ;
+	// The new h-costs are computed in c and only stored once learning is done.
+	// A shared store is updated with Raise, so that agents sharing the learned
+	// heuristic never lower each other's values.
+	std::vector<state> succ, learned;
 	ClosedList c;
+	double learning = 0;
 	while (q.size() > 0)
 	{
 		nodesExpanded++;
 		nodesTouched++;
 		state s = q.top().theState;
-		if (verbose) std::cout << "Starting with " << s << " h: " << q.top().heuristic << "/" << HCost(s, to) << std::endl;
 		q.pop();
+		typename ClosedList::const_iterator it = c.find(env->GetStateHash(s));
+		double hCost = (it == c.end())?HCost(env, s, to):it->second;
+		if (verbose) std::cout << "Starting with " << s << " h: " << hCost << std::endl;
 		//			std::cout << s << " " << learnData[env->GetStateHash(s)].learnedHeuristic << std::endl;
 		env->GetSuccessors(s, succ);
-		double hCost = HCost(s, to);
 		for (unsigned int x = 0; x < succ.size(); x++)
 		{
 			nodesTouched++;
@@ -260,16 +252,17 @@ void LSSLRTAStar<state, action, environment>::GetPath(environment *env, const st
 			}
 			double edgeCost = env->GCost(s, succ[x]);
 			if (verbose) std::cout << s << " to " << succ[x] << " " << edgeCost << " ";
-			succHCost = HCost(env, succ[x], to);
-			if (c[env->GetStateHash(succ[x])]) // in closed list, but seen before, update if smaller
+			typename ClosedList::iterator succIt = c.find(env->GetStateHash(succ[x]));
+			if (succIt != c.end()) // in closed list, but seen before, update if smaller
 			{
+				succHCost = succIt->second;
 				if (verbose) std::cout << succ[x] << " updated before ";
 				if (fless(hCost + edgeCost, succHCost))
 				{
 					if (verbose) std::cout << "lowering cost to " << hCost + edgeCost << " from " << succHCost << std::endl;
-					fAmountLearned = fAmountLearned - (succHCost - (hCost+edgeCost));
-					if (verbose) std::cout << " learning now " << fAmountLearned;
-					SetHCost(env, succ[x], to, hCost + edgeCost);
+					learning = learning - (succHCost - (hCost+edgeCost));
+					if (verbose) std::cout << " learning now " << learning;
+					succIt->second = hCost + edgeCost;
 					q.push(borderData<state>(succ[x], hCost + edgeCost));
 				}
 				if (verbose) std::cout << std::endl;
@@ -280,17 +273,34 @@ void LSSLRTAStar<state, action, environment>::GetPath(environment *env, const st
 				if (verbose) std::cout << succ[x] << " NOT updated before ";
 				//if (fgreater(hCost + edgeCost, succHCost))
 				{
+					succHCost = HCost(env, succ[x], to);
 					if (verbose) std::cout << "setting cost to " << hCost + edgeCost << " over " << succHCost;
-					fAmountLearned += (edgeCost + hCost) - succHCost;
-					if (verbose) std::cout << " learning now " << fAmountLearned;
-					SetHCost(env, succ[x], to, hCost + edgeCost);
+					learning += (edgeCost + hCost) - succHCost;
+					if (verbose) std::cout << " learning now " << learning;
 					q.push(borderData<state>(succ[x], hCost + edgeCost));
-					c[env->GetStateHash(succ[x])] = true;
+					c[env->GetStateHash(succ[x])] = hCost + edgeCost;
+					learned.push_back(succ[x]);
 				}
 				if (verbose) std::cout << std::endl;
 			}
 		}
 	}
+	if (heur == &ownHeur)
+	{
+		for (unsigned int x = 0; x < learned.size(); x++)
+			SetHCost(env, learned[x], to, c[env->GetStateHash(learned[x])]);
+		fAmountLearned += learning;
+	}
+	else {
+		// only count as learned what is added to the shared store
+		for (unsigned int x = 0; x < learned.size(); x++)
+		{
+			double val = c[env->GetStateHash(learned[x])]-BaseHCost(env, learned[x], to);
+			double old = heur->Raise(env, learned[x], val);
+			if (fgreater(val, old))
+				fAmountLearned += val-old;
+		}
+	}
 	//std::cout << GetName() << " " << nodesExpanded-nodeExpansionLimit << " expanded during learning" << std::endl;
 	
 //	if (thePath.size() != 0)
@@ -308,22 +318,14 @@ void LSSLRTAStar<state, action, environment>::OpenGLDraw(const environment *e) c
 {
 	astar.OpenGLDraw();
 	
-	double learned = 0;
-	for (typename LearnedHeuristic::const_iterator it = heur.begin(); it != heur.end(); it++)
-	{
-		double thisState = (*it).second.theHeuristic;
-		if (learned < thisState)
-			learned = thisState;
-	}
-	for (typename LearnedHeuristic::const_iterator it = heur.begin(); it != heur.end(); it++)
-	{
-		double r = (*it).second.theHeuristic;
+	double learned = heur->GetMaxLearned();
+	heur->ForEach(e, [&](const state &s, double r) {
 		if (r > 0)
 		{
 			e->SetColor(0.5+0.5*r/learned, 0, 0, 0.1+0.8*r/learned);
-			e->OpenGLDraw((*it).second.theState);
+			e->OpenGLDraw(s);
 		}
-	}
+	});
 }
 
 #endif
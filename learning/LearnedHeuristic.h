@@ -0,0 +1,191 @@
+//
+//  LearnedHeuristic.h
+//  hog2 glut
+//
+//  Storage for the heuristic values learned by real-time search (LRTA*,
+//  LSS-LRTA*, f-LRTA*). Only the amount learned is stored for each state,
+//  that is the difference from the environment's own heuristic, and states
+//  that have learned nothing read as 0.
+//
+//  By default the values are kept in a FlatHashMap keyed by the state hash,
+//  which only grows with the states that have actually learned something.
+//  After SetAllowDense(true), environments that number their states densely
+//  (GetNumStateIndices() > 0, as grid maps do) get a flat array with one
+//  entry per state instead, so a lookup is a single array read. The array is
+//  allocated and zeroed on first use, so it is meant for stores shared by
+//  several agents, not for each agent's own. No copy of the state is stored
+//  in either case; drawing the learned values recovers states with
+//  GetStateFromIndex or GetStateFromHash.
+//
+//  A store can be shared by several agents, or kept from one episode to the
+//  next, with SetLearnedHeuristic on LRTA* and LSS-LRTA*. f-LRTA* keeps its
+//  own, because it resets the h-cost of a state when it finds a shorter
+//  g-cost, which would undo what other agents learned. In the dense array
+//  every entry is atomic, so agents thinking in parallel (see
+//  UnitSimulation::SetNumThreads) can share a dense store; both algorithms
+//  store into a shared store with Raise, which never lowers a value, so
+//  concurrent updates never undo each other. The storage is chosen once, by Initialize
+//  or by the first lookup, whichever thread makes it. The hashed store may
+//  only be used by one thread at a time.
+//
+
+#ifndef LEARNEDHEURISTIC_H
+#define LEARNEDHEURISTIC_H
+
+#include <stdint.h>
+#include <cassert>
+#include <atomic>
+#include <mutex>
+#include "FlatHashMap.h"
+
+template <class state, class environment>
+class LearnedHeuristic {
+public:
+	LearnedHeuristic() :values(0), numValues(0), initialized(false), useDense(false) {}
+	~LearnedHeuristic() { delete [] values; }
+
+	/** Chooses dense or hashed storage for env; only the first call (or lookup) does anything **/
+	void Initialize(const environment *env)
+	{ std::call_once(initOnce, &LearnedHeuristic::Allocate, this, env); }
+	bool IsInitialized() const { return initialized.load(std::memory_order_acquire); }
+	/** Set to true before first use to use a dense array where the environment allows it **/
+	void SetAllowDense(bool val) { useDense = val; }
+	bool IsDense() const { return values != 0; }
+
+	/** The amount learned at s, 0 if nothing has been learned **/
+	double Get(const environment *env, const state &s)
+	{
+		if (!IsInitialized())
+			Initialize(env);
+		if (values)
+			return values[GetIndex(env, s)].load(std::memory_order_relaxed);
+		typename HashedValues::const_iterator it = hashed.find(env->GetStateHash(s));
+		return (it == hashed.end())?0:it->second;
+	}
+	void Set(const environment *env, const state &s, double val)
+	{
+		if (!IsInitialized())
+			Initialize(env);
+		if (values)
+			values[GetIndex(env, s)].store(val, std::memory_order_relaxed);
+		else
+			hashed[env->GetStateHash(s)] = val;
+	}
+	/** Sets the value at s to val if that is larger; returns the previous value **/
+	double Raise(const environment *env, const state &s, double val);
+
+	/** Sets every value back to 0 **/
+	void Clear();
+	/** The largest value learned (at least 0) **/
+	double GetMaxLearned() const;
+	/** Calls f(s, value) for each state s with a non-zero value; the hashed store needs GetStateFromHash **/
+	template <class function>
+	void ForEach(const environment *env, function f) const;
+private:
+	LearnedHeuristic(const LearnedHeuristic &);
+	LearnedHeuristic &operator=(const LearnedHeuristic &);
+	void Allocate(const environment *env);
+	uint64_t GetIndex(const environment *env, const state &s) const
+	{
+		uint64_t index = env->GetStateIndex(s);
+		assert(index < numValues);
+		return index;
+	}
+
+	typedef FlatHashMap<uint64_t, double> HashedValues;
+	// 128MB of doubles, enough for a 4096x4096 map
+	static const uint64_t maxDenseStates = 1ull<<24;
+
+	std::atomic<double> *values;
+	uint64_t numValues;
+	HashedValues hashed;
+	std::once_flag initOnce;
+	std::atomic<bool> initialized;
+	bool useDense;
+};
+
+template <class state, class environment>
+void LearnedHeuristic<state, environment>::Allocate(const environment *env)
+{
+	uint64_t count = env->GetNumStateIndices();
+	if (useDense && count > 0 && count <= maxDenseStates)
+	{
+		numValues = count;
+		values = new std::atomic<double>[numValues];
+		for (uint64_t x = 0; x < numValues; x++)
+			values[x].store(0, std::memory_order_relaxed);
+	}
+	initialized.store(true, std::memory_order_release);
+}
+
+template <class state, class environment>
+double LearnedHeuristic<state, environment>::Raise(const environment *env, const state &s, double val)
+{
+	if (!IsInitialized())
+		Initialize(env);
+	if (values)
+	{
+		std::atomic<double> &v = values[GetIndex(env, s)];
+		double old = v.load(std::memory_order_relaxed);
+		while (old < val && !v.compare_exchange_weak(old, val, std::memory_order_relaxed))
+		{ }
+		return old;
+	}
+	double &v = hashed[env->GetStateHash(s)];
+	double old = v;
+	if (old < val)
+		v = val;
+	return old;
+}
+
+template <class state, class environment>
+void LearnedHeuristic<state, environment>::Clear()
+{
+	for (uint64_t x = 0; x < numValues; x++)
+		values[x].store(0, std::memory_order_relaxed);
+	hashed.clear();
+}
+
+template <class state, class environment>
+double LearnedHeuristic<state, environment>::GetMaxLearned() const
+{
+	double learned = 0;
+	for (uint64_t x = 0; x < numValues; x++)
+	{
+		double v = values[x].load(std::memory_order_relaxed);
+		if (learned < v)
+			learned = v;
+	}
+	for (typename HashedValues::const_iterator it = hashed.begin(); it != hashed.end(); it++)
+	{
+		if (learned < it->second)
+			learned = it->second;
+	}
+	return learned;
+}
+
+template <class state, class environment>
+template <class function>
+void LearnedHeuristic<state, environment>::ForEach(const environment *env, function f) const
+{
+	state s;
+	for (uint64_t x = 0; x < numValues; x++)
+	{
+		double v = values[x].load(std::memory_order_relaxed);
+		if (v != 0)
+		{
+			env->GetStateFromIndex(x, s);
+			f(s, v);
+		}
+	}
+	for (typename HashedValues::const_iterator it = hashed.begin(); it != hashed.end(); it++)
+	{
+		if (it->second != 0)
+		{
+			env->GetStateFromHash(it->first, s);
+			f(s, it->second);
+		}
+	}
+}
+
+#endif
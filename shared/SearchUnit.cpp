@@ -43,6 +43,7 @@ SearchUnit::SearchUnit(int _x, int _y, AbsMapUnit *_target, SearchAlgorithm *alg
 	nodesExpanded = 0;
 	nodesTouched = 0;
 	targetTime = 0;
+	thinkInParallel = false;
 }
 
 //SearchUnit::SearchUnit(int _x, int _y, unit *_target, spreadExecSearchAlgorithm *alg)
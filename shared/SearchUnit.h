@@ -63,6 +63,15 @@ public:
 	//void printRoundStats(FILE *f);
 	void LogStats(StatCollection *stats);
 	void LogFinalStats(StatCollection *stats);
+	/**
+	* Lets this unit think at the same time as other units. The unit owns its
+	* algorithm, so this is safe when the algorithm keeps its search data to
+	* itself and the abstraction isn't changed while the units think. aStar
+	* does so once SetMarkPath(false) is called. Algorithms that label the
+	* nodes of the abstraction, such as praStar, must not think in parallel.
+	*/
+	void SetThinkInParallel(bool val) { thinkInParallel = val; }
+	virtual bool CanThinkInParallel() { return thinkInParallel; }
 protected:
 	virtual void addPathToCache(path *p);
 	bool getCachedMove(tDirection &dir);
@@ -78,6 +87,7 @@ protected:
 
 	double targetTime;
 	bool onTarget;
+	bool thinkInParallel;
 };
 
 #endif
@@ -28,6 +28,18 @@ class Heuristic {
 public:
 	virtual ~Heuristic() {}
 	virtual double HCost(const state &a, const state &b) = 0;
+	/**
+	 Heuristic value between each of count states and the goal. Heuristics
+	 that are large table lookups can override this to compute all the
+	 table addresses and prefetch them before reading any values.
+	 parentHCost is the value of a state that all of them neighbor, or
+	 negative if there is none (see SearchEnvironment::HCost).
+	 **/
+	virtual void BatchHCost(const state *states, size_t count, const state &goal, double *hcosts, double parentHCost)
+	{
+		for (size_t x = 0; x < count; x++)
+			hcosts[x] = HCost(states[x], goal);
+	}
 };
 
 template <class state, class action>
@@ -68,6 +80,11 @@ public:
 	virtual double HCost(const state &node1, const state &node2) = 0;
 	virtual double HCost(const state &node1, const state &node2, double parentHCost)
 	{ return HCost(node1, node2); }
+	virtual void BatchHCost(const state *states, size_t count, const state &goal, double *hcosts, double parentHCost)
+	{
+		for (size_t x = 0; x < count; x++)
+			hcosts[x] = HCost(states[x], goal, parentHCost);
+	}
 	/** Heuristic value between node and the stored goal. Asserts that the
 	 goal is stored **/
 	virtual double HCost(const state &node)
@@ -83,6 +100,13 @@ public:
 
 	virtual uint64_t GetStateHash(const state &node) const = 0;
 	virtual void GetStateFromHash(uint64_t parent, state &s) const { assert(false); }
+	/**
+	 Environments that can number their states 0...n-1 return n here (and 0
+	 otherwise), so that per-state data can be kept in an array of size n.
+	 **/
+	virtual uint64_t GetNumStateIndices() const { return 0; }
+	virtual uint64_t GetStateIndex(const state &node) const { return GetStateHash(node); }
+	virtual void GetStateFromIndex(uint64_t index, state &s) const { GetStateFromHash(index, s); }
 
 	virtual uint64_t GetActionHash(action act) const = 0;
 
@@ -47,6 +47,13 @@ public:
 	virtual void OpenGLDraw(const environment *, const SimulationInfo<state,action,environment> *) const = 0;
 	virtual void GetGoal(state &s) = 0;
 	virtual bool Done() { return true;} 
+	/**
+	 * True if MakeMove only changes this unit's own data, so it can run at the
+	 * same time as other units' MakeMove (see UnitSimulation::SetNumThreads).
+	 * Units that share a search algorithm or write to a shared abstraction or
+	 * heuristic must leave this false.
+	 */
+	virtual bool CanThinkInParallel() { return false; }
 
 	virtual double GetSpeed() { return speed; }
 	void SetSpeed(double s) { speed = s; }
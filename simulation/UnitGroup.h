@@ -55,6 +55,16 @@ public:
 		return (u->MakeMove(e, e->GetOccupancyInfo(), si,a));
 	}
 
+	/**
+	 * True if MakeMove can run for u at the same time as for other units.
+	 * Groups whose MakeMove uses data shared between their members must
+	 * return false.
+	 */
+	virtual bool CanThinkInParallel(Unit<state, action, environment> *u)
+	{
+		return u->CanThinkInParallel();
+	}
+
 	virtual void UpdateLocation(Unit<state, action, environment> *u, environment *e, state &loc, bool success, SimulationInfo<state,action,environment> *si)
 	{
 		u->UpdateLocation(e, loc, success, si);
@@ -29,8 +29,12 @@
 
 #include <vector>
 #include <queue>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 #include "Unit.h"
 #include "Timer.h"
+#include "Barrier.h"
 #include "FPUtil.h"
 #include "StatCollection.h"
 #include "SearchEnvironment.h"
@@ -132,6 +136,19 @@ public:
 	/** getPenalty for thinking. Gets the multiplier used to penalize thinking time. */
 	double GetThinkingPenalty() { return penalty; }
 
+	/**
+	 * Sets the number of threads that run MakeMove for the units that are
+	 * ready to move (1, the default, moves the units one at a time; 0 uses
+	 * every hardware thread). With more than one thread, all ready units think
+	 * at once against the world as it was at the start of the step, and then
+	 * their moves are made in unit order, so occupancy conflicts are resolved
+	 * the same way on every run. Only units whose group says they can think in
+	 * parallel (see Unit::CanThinkInParallel) do so; the others think one at a
+	 * time as their moves are made. The threads are kept between steps.
+	 */
+	void SetNumThreads(int count) { StopThinkPool(); numThreads = count; }
+	int GetNumThreads() const { return numThreads; }
+
 	virtual void OpenGLDraw() const;
 	virtual void OpenGLDraw(unsigned int whichUnit) const;
 	
@@ -141,14 +158,35 @@ public:
 	
 
 	virtual SimulationInfo<state,action,environment>* GetSimulationInfo() { return this; }
-	virtual unsigned int GetCurrentUnit() const { return currentActor; }
+	virtual unsigned int GetCurrentUnit() const
+	{ return (ThinkingActor() == -1)?currentActor:ThinkingActor(); }
 
 protected:
+	/** The result of one unit's MakeMove, made later by CommitUnitMove **/
+	struct UnitThought {
+		UnitInfo<state, action, environment> *theUnit;
+		unsigned int which;
+		action where;
+		bool moved;
+		bool parallel;
+		double thinking;
+	};
+
 	void StepUnitTime(UnitInfo<state, action, environment> *ui, double timeStep);
+	void ThinkUnit(UnitThought &thought);
+	void ThinkWorker(std::vector<UnitThought> *thoughts, std::atomic<unsigned int> *next);
+	void StartThinkPool(int count);
+	void StopThinkPool();
+	void ThinkPoolWorker();
+	void CommitUnitMove(UnitInfo<state, action, environment> *theUnit, double timeStep,
+						bool moved, action where, double moveThinking);
 	bool MakeUnitMove(UnitInfo<state, action, environment> *theUnit, action where, double &moveCost);
+	/** The unit the calling thread is running MakeMove for in DoParallelTimestepCalc (or -1) **/
+	static int &ThinkingActor() { static thread_local int actor = -1; return actor; }
 
 	virtual void DoPreTimestepCalc();
 	virtual void DoTimestepCalc(double amount);
+	virtual void DoParallelTimestepCalc(double amount);
 	virtual void DoPostTimestepCalc();
 	
 	double penalty;
@@ -160,6 +198,13 @@ protected:
 	tTimestep stepType;
 	StatCollection stats;
 	mutable unsigned int currentActor;
+	int numThreads;
+	// threads that help the calling thread think in DoParallelTimestepCalc
+	std::vector<std::thread> thinkPool;
+	Barrier *thinkBarrier;
+	std::vector<UnitThought> *poolThoughts;
+	std::atomic<unsigned int> poolNext;
+	bool poolDone;
 //	SimulationInfo<state,action,environment> sinfo;
 };
 
@@ -174,11 +219,16 @@ UnitSimulation<state, action, environment>::UnitSimulation(environment *se)
 	logStats = true;
 	unitGroups.push_back(new UnitGroup<state, action, environment>);
 	currentActor = 0;
+	numThreads = 1;
+	thinkBarrier = 0;
+	poolThoughts = 0;
+	poolDone = false;
 	// allocate default unit group!(?)
 }
 
 template<class state, class action, class environment>
 UnitSimulation<state, action, environment>::~UnitSimulation() {
+	StopThinkPool();
 	ClearAllUnits();
 	unitGroups.clear();
 }
@@ -357,6 +407,11 @@ void UnitSimulation<state, action, environment>::DoPreTimestepCalc()
 template<class state, class action, class environment>
 void UnitSimulation<state, action, environment>::DoTimestepCalc(double timeStep)
 {
+	if (numThreads != 1)
+	{
+		DoParallelTimestepCalc(timeStep);
+		return;
+	}
 	for (unsigned int x = 0; x < units.size(); x++)
 	{
 		currentActor = x;
@@ -370,6 +425,128 @@ void UnitSimulation<state, action, environment>::DoTimestepCalc(double timeStep)
 	}
 }
 
+/**
+ * Moves the units like DoTimestepCalc, but in rounds: every unit that is
+ * ready and can think in parallel runs MakeMove (on numThreads threads), and
+ * then the moves are made in unit order. Units that can't think in parallel
+ * run MakeMove just before their move is made. In real time, further rounds
+ * take the units that still have time left, which DoTimestepCalc steps one
+ * unit at a time.
+ */
+template<class state, class action, class environment>
+void UnitSimulation<state, action, environment>::DoParallelTimestepCalc(double timeStep)
+{
+	int threadCount = (numThreads > 0)?numThreads:std::max(1u, std::thread::hardware_concurrency());
+	std::vector<UnitThought> thoughts;
+	for (bool firstRound = true; ; firstRound = false)
+	{
+		thoughts.resize(0);
+		int parallelCount = 0;
+		for (unsigned int x = 0; x < units.size(); x++)
+		{
+			if ((currTime < units[x]->nextTime) || (!firstRound && !(currTime > units[x]->nextTime)))
+				continue;
+			UnitThought thought;
+			thought.theUnit = units[x];
+			thought.which = x;
+			thought.parallel = units[x]->agent->GetUnitGroup()->CanThinkInParallel(units[x]->agent);
+			if (thought.parallel)
+				parallelCount++;
+			thoughts.push_back(thought);
+		}
+		if (thoughts.size() == 0)
+			break;
+
+		poolThoughts = &thoughts;
+		poolNext = 0;
+		if (threadCount == 1 || parallelCount <= 1)
+		{
+			ThinkWorker(&thoughts, &poolNext);
+		}
+		else {
+			if ((int)thinkPool.size() != threadCount-1)
+			{
+				StopThinkPool();
+				StartThinkPool(threadCount);
+			}
+			thinkBarrier->Wait(); // start the pool on this round
+			ThinkWorker(&thoughts, &poolNext);
+			thinkBarrier->Wait(); // and wait for it to finish
+		}
+		poolThoughts = 0;
+
+		for (unsigned int x = 0; x < thoughts.size(); x++)
+		{
+			currentActor = thoughts[x].which;
+			if (!thoughts[x].parallel)
+				ThinkUnit(thoughts[x]);
+			CommitUnitMove(thoughts[x].theUnit, firstRound?timeStep:0, thoughts[x].moved,
+						   thoughts[x].where, thoughts[x].thinking);
+		}
+		if (stepType != kRealTime)
+			break;
+	}
+}
+
+/** Runs MakeMove for the parallel thoughts taken from next until all are done **/
+template<class state, class action, class environment>
+void UnitSimulation<state, action, environment>::ThinkWorker(std::vector<UnitThought> *thoughts, std::atomic<unsigned int> *next)
+{
+	for (unsigned int x = (*next)++; x < thoughts->size(); x = (*next)++)
+		if ((*thoughts)[x].parallel)
+			ThinkUnit((*thoughts)[x]);
+}
+
+/** Starts count-1 threads, which think along with the calling thread **/
+template<class state, class action, class environment>
+void UnitSimulation<state, action, environment>::StartThinkPool(int count)
+{
+	thinkBarrier = new Barrier(count);
+	poolDone = false;
+	for (int x = 1; x < count; x++)
+		thinkPool.push_back(std::thread(&UnitSimulation::ThinkPoolWorker, this));
+}
+
+template<class state, class action, class environment>
+void UnitSimulation<state, action, environment>::StopThinkPool()
+{
+	if (thinkPool.size() == 0)
+		return;
+	poolDone = true;
+	thinkBarrier->Wait();
+	for (unsigned int x = 0; x < thinkPool.size(); x++)
+		thinkPool[x].join();
+	thinkPool.resize(0);
+	delete thinkBarrier;
+	thinkBarrier = 0;
+}
+
+/** Each round of DoParallelTimestepCalc is started and ended by the barrier **/
+template<class state, class action, class environment>
+void UnitSimulation<state, action, environment>::ThinkPoolWorker()
+{
+	while (true)
+	{
+		thinkBarrier->Wait();
+		if (poolDone)
+			return;
+		ThinkWorker(poolThoughts, &poolNext);
+		thinkBarrier->Wait();
+	}
+}
+
+template<class state, class action, class environment>
+void UnitSimulation<state, action, environment>::ThinkUnit(UnitThought &thought)
+{
+	Unit<state, action, environment>* u = thought.theUnit->agent;
+	Timer t;
+	ThinkingActor() = thought.which;
+	t.StartTimer();
+	thought.moved = u->GetUnitGroup()->MakeMove(u, env, this, thought.where);
+	thought.thinking = t.EndTimer();
+	ThinkingActor() = -1;
+}
+
 template<class state, class action, class environment>
 void UnitSimulation<state, action, environment>::DoPostTimestepCalc()
 {
@@ -387,16 +564,31 @@ void UnitSimulation<state, action, environment>::StepUnitTime(UnitInfo<state, ac
 {
 	if (currTime < theUnit->nextTime) return;
 
-	double moveThinking=0, locThinking=0, moveTime=0;
 	action where;
 	Timer t;
 	Unit<state, action, environment>* u = theUnit->agent;
 	
 	t.StartTimer();
+	bool moved = u->GetUnitGroup()->MakeMove(u, env, this, where);
+	double moveThinking = t.EndTimer();
+	CommitUnitMove(theUnit, timeStep, moved, where, moveThinking);
+}
+
+/**
+ * Makes the move chosen by MakeMove (if it chose one), updates the unit's
+ * location and sets the time of its next move.
+ */
+template<class state, class action, class environment>
+void UnitSimulation<state, action, environment>::CommitUnitMove(UnitInfo<state, action, environment> *theUnit, double timeStep,
+																 bool moved, action where, double moveThinking)
+{
+	double locThinking=0, moveTime=0;
+	Timer t;
+	Unit<state, action, environment>* u = theUnit->agent;
+	
 	// need to do if/then check - makemove ok or not? need to stay where you are? 
-	if (u->GetUnitGroup()->MakeMove(u, env, this, where))
+	if (moved)
 	{
-		moveThinking = t.EndTimer();
 		theUnit->totalThinking += moveThinking;
 		theUnit->lastMove = where;
 		theUnit->lastTime = theUnit->nextTime;
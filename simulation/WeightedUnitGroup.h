@@ -34,6 +34,8 @@ class WeightedUnitGroup : public UnitGroup<state,action,environment>
 		}
 			
 		virtual const char *GetName() { return "WeightedUnitGroup"; }
+		// MakeMove updates the weights shared by the group
+		virtual bool CanThinkInParallel(Unit<state, action, environment> *) { return false; }
 	
 		virtual bool MakeMove(Unit<state, action, environment> *u, environment *e, SimulationInfo<state,action,environment> *si, action& a)
 		{
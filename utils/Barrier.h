@@ -0,0 +1,44 @@
+//
+//  Barrier.h
+//  hog2 glut
+//
+//  Reusable thread barrier for phase-synchronised worker pools.
+//
+
+#ifndef BARRIER_H
+#define BARRIER_H
+
+#include <stdint.h>
+#include <mutex>
+#include <condition_variable>
+
+class Barrier {
+public:
+	Barrier(int count) :total(count), waiting(0), round(0) {}
+	/**
+	 Blocks until all count threads have called Wait(). The barrier
+	 resets itself so it can be used again for the next phase.
+	 **/
+	void Wait()
+	{
+		std::unique_lock<std::mutex> l(lock);
+		uint64_t myRound = round;
+		waiting++;
+		if (waiting == total)
+		{
+			waiting = 0;
+			round++;
+			cv.notify_all();
+			return;
+		}
+		cv.wait(l, [this, myRound]{ return round != myRound; });
+	}
+private:
+	int total;
+	int waiting;
+	uint64_t round;
+	std::mutex lock;
+	std::condition_variable cv;
+};
+
+#endif
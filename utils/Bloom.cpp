@@ -8,7 +8,11 @@
 
 #include <cmath>
 #include <limits>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
 #include "Bloom.h"
+#include "MMapUtil.h"
 
 //int numHash;
 //uint64_t filterSize;
@@ -135,29 +139,49 @@ static uint64_t zobrist[8][256] = {
 //};
 
 
-BloomFilter::BloomFilter(uint64_t filterSize, int numHash, bool save, bool zero)
+BloomFilter::BloomFilter(uint64_t filterSize, int numHash, bool save, bool zero, bloomLayout layout)
 {
 	this->filterSize = filterSize;
 	this->numHash = numHash;
     saveAtExit = save;
-	bits = new BitVector(filterSize);
+	this->layout = layout;
+	if (layout == kBlockedBloom)
+		LimitBlockedHashes(numHash);
+	bits = 0;
+	blocks = 0;
+	mapped = 0;
+	if (layout == kBlockedBloom)
+		AllocateBlocks();
+	else
+		bits = new BitVector(filterSize);
 }
 
-BloomFilter::BloomFilter(uint64_t filterSize, int numHash, const char *loadPrefix)
+BloomFilter::BloomFilter(uint64_t filterSize, int numHash, const char *loadPrefix, bloomLayout layout, bool useMMap)
 {
 	this->filterSize = filterSize;
 	this->numHash = numHash;
     saveAtExit = false;
-	bits = new BitVector(filterSize);
-	saveAtExit = false;
+	this->layout = layout;
+	if (layout == kBlockedBloom)
+		LimitBlockedHashes(numHash);
+	bits = 0;
+	blocks = 0;
+	mapped = 0;
 
-	char name[127];
-	sprintf(name, "%sbloom-%llu-%d.dat", loadPrefix, filterSize, numHash);
+	char name[255];
+	GetFileName(name, loadPrefix);
 	printf("Loading '%s'\n", name);
-	bits->Load(name);
+	if (layout == kBlockedBloom)
+	{
+		LoadBlocks(name, useMMap);
+	}
+	else {
+		bits = new BitVector(filterSize);
+		bits->Load(name);
+	}
 }
 
-BloomFilter::BloomFilter(uint64_t numItems, double targetFalseRate, bool save, bool zero)
+BloomFilter::BloomFilter(uint64_t numItems, double targetFalseRate, bool save, bool zero, bloomLayout layout)
 {
 	double min_m = std::numeric_limits<double>::infinity();
 	double min_k = 0.0;
@@ -179,7 +203,15 @@ BloomFilter::BloomFilter(uint64_t numItems, double targetFalseRate, bool save, b
 	numHash = static_cast<unsigned int>(min_k);
 	filterSize = static_cast<unsigned long long int>(min_m);
 	saveAtExit = save;
-	if (0)
+	this->layout = layout;
+	bits = 0;
+	blocks = 0;
+	mapped = 0;
+	if (layout == kBlockedBloom)
+	{
+		AllocateBlocks();
+	}
+	else if (0)
 	{
 //		char name[127];
 //		sprintf(name, "/tmp/bloom-%llu-%d.dat", filterSize, numHash);
@@ -194,32 +226,145 @@ BloomFilter::~BloomFilter()
 {
 	if (saveAtExit)
 	{
-		char name[127];
-		sprintf(name, "bloom-%llu-%d.dat", filterSize, numHash);
+		char name[255];
+		GetFileName(name, "");
 		printf("Writing to '%s'\n", name);
-		bits->Save(name);
+		if (layout == kBlockedBloom)
+		{
+			FILE *f = fopen(name, "w+");
+			if (f == 0 || fwrite(blocks, bloomBlockBytes, numBlocks, f) != numBlocks)
+				printf("File write error (%s)\n", name);
+			if (f)
+				fclose(f);
+		}
+		else {
+			bits->Save(name);
+		}
 	}
 	delete bits;
 	bits = 0;
+	if (mapped)
+		CloseMMap(mapped, numBlocks*bloomBlockBytes, mapFD);
+	else
+		free(blocks);
+	blocks = 0;
+}
+
+void BloomFilter::GetFileName(char *name, const char *prefix)
+{
+	if (layout == kBlockedBloom)
+		sprintf(name, "%sbloom-blocked-%llu-%d.dat", prefix, (unsigned long long)filterSize, numHash);
+	else
+		sprintf(name, "%sbloom-%llu-%d.dat", prefix, (unsigned long long)filterSize, numHash);
+}
+
+/**
+ * Blocks are aligned to cache lines, so that testing an item touches a
+ * single line.
+ */
+void BloomFilter::AllocateBlocks()
+{
+	numBlocks = (filterSize+bloomBlockBytes*8-1)/(bloomBlockBytes*8);
+	void *mem = 0;
+	if (posix_memalign(&mem, bloomBlockBytes, numBlocks*bloomBlockBytes) != 0)
+	{
+		printf("Unable to allocate %llu bytes for bloom filter\n", (unsigned long long)(numBlocks*bloomBlockBytes));
+		exit(0);
+	}
+	blocks = (uint64_t*)mem;
+	memset(blocks, 0, numBlocks*bloomBlockBytes);
+}
+
+/**
+ * Blocked filters are saved as the raw blocks, so the file can be mapped
+ * directly (mmap returns page-aligned memory).
+ */
+void BloomFilter::LoadBlocks(const char *name, bool useMMap)
+{
+	numBlocks = (filterSize+bloomBlockBytes*8-1)/(bloomBlockBytes*8);
+	if (useMMap)
+	{
+		uint64_t fileSize = 0;
+		mapped = GetReadOnlyMMAP(name, fileSize, mapFD);
+		if (mapped != 0 && fileSize != numBlocks*bloomBlockBytes)
+		{
+			CloseMMap(mapped, fileSize, mapFD);
+			mapped = 0;
+		}
+		if (mapped == 0)
+		{
+			printf("File read error (%s)\n", name);
+			exit(0);
+		}
+		blocks = (uint64_t*)mapped;
+		return;
+	}
+	if (blocks == 0)
+		AllocateBlocks();
+	FILE *f = fopen(name, "r");
+	if (f == 0 || fread(blocks, bloomBlockBytes, numBlocks, f) != numBlocks)
+	{
+		printf("File read error (%s)\n", name);
+		exit(0);
+	}
+	fclose(f);
 }
 
 void BloomFilter::Analyze()
 {
-	uint64_t entries = bits->GetSize();
-	uint64_t setEntries = bits->GetNumSetBits();
+	uint64_t entries, setEntries = 0;
+	if (layout == kBlockedBloom)
+	{
+		entries = numBlocks*bloomBlockBytes*8;
+		for (uint64_t x = 0; x < numBlocks*bloomBlockBytes/8; x++)
+			setEntries += __builtin_popcountll(blocks[x]);
+	}
+	else {
+		entries = bits->GetSize();
+		setEntries = bits->GetNumSetBits();
+	}
 	printf("%llu of %llu entries set. (%1.2f%%)\n", setEntries, entries, 100.0*double(setEntries)/double(entries));
 }
 
 void BloomFilter::Load()
 {
 	saveAtExit = false;
-	char name[127];
-	sprintf(name, "bloom-%llu-%d.dat", filterSize, numHash);
-	bits->Load(name);
+	char name[255];
+	GetFileName(name, "");
+	if (layout == kBlockedBloom)
+	{
+		if (mapped == 0)
+			LoadBlocks(name, false);
+	}
+	else {
+		bits->Load(name);
+	}
+}
+
+/** Sets the bits of the item in its block (bloomBlockBytes/8 words) **/
+void BloomFilter::GetBlockMask(uint64_t item, uint64_t *mask)
+{
+	for (int x = 0; x < bloomBlockBytes/8; x++)
+		mask[x] = 0;
+	for (int x = 0; x < numHash; x++)
+	{
+		uint64_t offset = GetBloomOffset(item, x, bloomBlockBitsPower);
+		mask[offset>>6] |= 1ull<<(offset&0x3F);
+	}
 }
 
 void BloomFilter::Insert(uint64_t item)
 {
+	if (layout == kBlockedBloom)
+	{
+		assert(mapped == 0);
+		uint64_t mask[bloomBlockBytes/8];
+		uint64_t *block = &blocks[GetBloomBlock(item, numBlocks)*(bloomBlockBytes/8)];
+		GetBlockMask(item, mask);
+		for (int x = 0; x < bloomBlockBytes/8; x++)
+			block[x] |= mask[x];
+		return;
+	}
 	for (int x = 0; x < numHash; x++)
 	{
 		bits->SetTrue(Hash(item, x)%filterSize);
@@ -228,6 +373,17 @@ void BloomFilter::Insert(uint64_t item)
 
 bool BloomFilter::Contains(uint64_t item)
 {
+	if (layout == kBlockedBloom)
+	{
+		uint64_t mask[bloomBlockBytes/8];
+		const uint64_t *block = &blocks[GetBloomBlock(item, numBlocks)*(bloomBlockBytes/8)];
+		GetBlockMask(item, mask);
+		// no early exit, so the whole block is tested with vector instructions
+		uint64_t missing = 0;
+		for (int x = 0; x < bloomBlockBytes/8; x++)
+			missing |= mask[x]&~block[x];
+		return missing == 0;
+	}
 	for (int x = 0; x < numHash; x++)
 	{
 		if (!bits->Get(Hash(item, x)%filterSize))
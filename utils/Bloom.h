@@ -11,26 +11,89 @@
 
 #include <iostream>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include "BitVector.h"
 
+/**
+ * kStandardBloom sets numHash independent bits anywhere in the filter, so a
+ * query touches up to numHash cache lines. kBlockedBloom uses one hash to pick
+ * a 64-byte (cache-line) block and sets all of the bits inside it, so a query
+ * costs about one cache miss at the price of a slightly higher false positive
+ * rate for the same size.
+ */
+enum bloomLayout {
+	kStandardBloom,
+	kBlockedBloom
+};
+
+const int bloomBlockBytes = 64;
+const int bloomBlockBitsPower = 9; // 512 bits per block
+const int maxBloomHash = 8;
+
+/** Stops with an error if a blocked filter asks for more hashes than there are multipliers for **/
+inline void LimitBlockedHashes(int numHash)
+{
+	if (numHash > maxBloomHash)
+	{
+		printf("Blocked bloom filters use at most %d hashes (%d requested)\n", maxBloomHash, numHash);
+		exit(0);
+	}
+}
+
+// random odd multipliers for the multiply-shift hashes of the blocked layout
+static const uint64_t bloomMultiplier[maxBloomHash+1] = {
+	0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull,
+	0xD6E8FEB86659FD93ull, 0xFF51AFD7ED558CCDull, 0xC4CEB9FE1A85EC53ull,
+	0x94D049BB133111EBull, 0xBF58476D1CE4E5B9ull, 0x8CB92BA72F3D8DD7ull
+};
+
+/** Selects the block of an item in a blocked filter with numBlocks blocks **/
+inline uint64_t GetBloomBlock(uint64_t item, uint64_t numBlocks)
+{
+	return (uint64_t)(((unsigned __int128)(item*bloomMultiplier[0])*numBlocks)>>64);
+}
+
+/** The which-th position (of 2^bits possible) inside the block of an item **/
+inline uint64_t GetBloomOffset(uint64_t item, int which, int bits)
+{
+	return (item*bloomMultiplier[which+1])>>(64-bits);
+}
+
 class BloomFilter {
 public:
-	BloomFilter(uint64_t numItems, double targetHitRate, bool save, bool zero=true);
-	BloomFilter(uint64_t filterSize, int numHash, bool save, bool zero=true);
-	BloomFilter(uint64_t filterSize, int numHash, const char *loadPrefix);
+	BloomFilter(uint64_t numItems, double targetHitRate, bool save, bool zero=true, bloomLayout layout=kStandardBloom);
+	BloomFilter(uint64_t filterSize, int numHash, bool save, bool zero=true, bloomLayout layout=kStandardBloom);
+	/**
+	 * Loads a saved filter. Blocked filters can also be memory mapped
+	 * read-only, so that processes using the same file share its pages.
+	 */
+	BloomFilter(uint64_t filterSize, int numHash, const char *loadPrefix, bloomLayout layout=kStandardBloom, bool useMMap=false);
 	~BloomFilter();
 	void Analyze();
 	void Insert(uint64_t item);
 	bool Contains(uint64_t item);
 	uint64_t GetStorage() { return filterSize; }
 	int GetNumHash() { return numHash; }
+	bloomLayout GetLayout() { return layout; }
 	void Load();
 private:
 	uint64_t Hash(uint64_t value, int which);
+	void GetFileName(char *name, const char *prefix);
+	void AllocateBlocks();
+	void LoadBlocks(const char *name, bool useMMap);
+	void GetBlockMask(uint64_t item, uint64_t *mask);
 	int numHash;
 	bool saveAtExit;
 	uint64_t filterSize;
 	BitVector *bits;
+
+	// blocked layout
+	bloomLayout layout;
+	uint64_t numBlocks;
+	uint64_t *blocks;
+	uint8_t *mapped; // 0 unless the blocks are memory mapped
+	int mapFD;
 };
 
 #endif /* defined(__hog2_glut__Bloom__) */
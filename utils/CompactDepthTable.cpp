@@ -0,0 +1,206 @@
+//
+//  CompactDepthTable.cpp
+//  hog2 glut
+//
+
+#include "CompactDepthTable.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+static const char kDepthTableMagic[8] = {'H', 'O', 'G', 'C', 'D', 'T', 0, 0};
+// changes whenever the hash, bucket choice or entry layout changes
+static const uint32_t kDepthTableVersion = 1;
+
+/** Header at the start of a saved table, followed by the buckets **/
+struct DepthTableFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t bucketSize; // entries per bucket
+	uint32_t fingerprintMask;
+	uint32_t reserved; // 0
+	uint64_t numBuckets;
+	uint64_t numEntries;
+};
+
+CompactDepthTable::CompactDepthTable()
+:numBuckets(0), numEntries(0), entries(0)
+{
+}
+
+CompactDepthTable::~CompactDepthTable()
+{
+	Clear();
+}
+
+void CompactDepthTable::Add(uint64_t key, uint8_t value)
+{
+	assert(value < 16);
+	items.push_back((Hash(key)&~0xFull)|value);
+}
+
+/**
+ * Duplicate keys (equal hashes) are removed first, keeping the smaller value,
+ * which sorts first. If the cuckoo insertion gets stuck the table is rebuilt
+ * with 5% more buckets.
+ */
+void CompactDepthTable::Finalize()
+{
+	std::sort(items.begin(), items.end());
+	uint64_t count = 0;
+	for (uint64_t x = 0; x < items.size(); x++)
+	{
+		if (count > 0 && (items[count-1]>>4) == (items[x]>>4))
+			continue;
+		items[count++] = items[x];
+	}
+	items.resize(count);
+	assert(count < 0xFFFFFFFFull);
+
+	uint64_t buckets = std::max((uint64_t)(count/(bucketSize*0.9)), (uint64_t)1);
+	while (true)
+	{
+		Allocate(buckets);
+		if (Build(items))
+			break;
+		buckets += buckets/20+1;
+	}
+	numEntries = count;
+	std::vector<uint64_t>().swap(items);
+}
+
+/**
+ * Inserts every hash into the less full of its buckets. When both are full an
+ * entry of one of them is moved to its other bucket, and so on (a random walk)
+ * until an empty entry is found. The index of the item in each entry is kept
+ * during the build, since fingerprints alone don't give the other bucket.
+ */
+bool CompactDepthTable::Build(const std::vector<uint64_t> &hashes)
+{
+	const int maxMoves = 1000;
+	std::vector<uint32_t> owner(numBuckets*bucketSize, 0xFFFFFFFF);
+	std::vector<uint8_t> used(numBuckets, 0);
+	uint64_t random = 0x2545F4914F6CDD1Dull;
+	for (uint64_t x = 0; x < hashes.size(); x++)
+	{
+		uint32_t item = (uint32_t)x;
+		uint64_t b1, b2;
+		GetBuckets(hashes[item]&~0xFull, b1, b2);
+		uint64_t bucket = (used[b2] < used[b1])?b2:b1;
+		int moves = 0;
+		while (used[bucket] == bucketSize)
+		{
+			if (++moves > maxMoves)
+				return false;
+			random ^= random<<13; random ^= random>>7; random ^= random<<17;
+			int slot = random%bucketSize;
+			std::swap(item, owner[bucket*bucketSize+slot]);
+			entries[bucket*bucketSize+slot] = GetEntry(hashes[owner[bucket*bucketSize+slot]],
+													   hashes[owner[bucket*bucketSize+slot]]&0xF);
+			// the evicted item goes to its other bucket
+			GetBuckets(hashes[item]&~0xFull, b1, b2);
+			bucket = (bucket == b1)?b2:b1;
+		}
+		owner[bucket*bucketSize+used[bucket]] = item;
+		entries[bucket*bucketSize+used[bucket]] = GetEntry(hashes[item], hashes[item]&0xF);
+		used[bucket]++;
+	}
+	return true;
+}
+
+/** Buckets are aligned to cache lines, so each lookup touches two lines **/
+void CompactDepthTable::Allocate(uint64_t buckets)
+{
+	free(entries);
+	entries = 0;
+	numBuckets = buckets;
+	void *mem = 0;
+	if (posix_memalign(&mem, bucketSize*sizeof(uint32_t), numBuckets*bucketSize*sizeof(uint32_t)) != 0)
+	{
+		printf("Unable to allocate %llu bytes for depth table\n", (unsigned long long)(numBuckets*bucketSize*sizeof(uint32_t)));
+		exit(0);
+	}
+	entries = (uint32_t*)mem;
+	memset(entries, 0, numBuckets*bucketSize*sizeof(uint32_t));
+}
+
+void CompactDepthTable::Clear()
+{
+	numBuckets = 0;
+	numEntries = 0;
+	free(entries);
+	entries = 0;
+	std::vector<uint64_t>().swap(items);
+}
+
+bool CompactDepthTable::Save(const char *file) const
+{
+	FILE *f = fopen(file, "w+");
+	if (f == 0)
+	{
+		printf("File write error (%s)\n", file);
+		return false;
+	}
+	DepthTableFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kDepthTableMagic, sizeof(kDepthTableMagic));
+	header.version = kDepthTableVersion;
+	header.bucketSize = bucketSize;
+	header.fingerprintMask = fingerprintMask;
+	header.numBuckets = numBuckets;
+	header.numEntries = numEntries;
+	bool success = (fwrite(&header, sizeof(header), 1, f) == 1 &&
+					fwrite(entries, sizeof(uint32_t)*bucketSize, numBuckets, f) == numBuckets);
+	fclose(f);
+	if (!success)
+		printf("File write error (%s)\n", file);
+	return success;
+}
+
+/**
+ * Returns false, leaving the table empty, if the file is missing, wasn't
+ * saved by this version with the same parameters, or is truncated.
+ */
+bool CompactDepthTable::Load(const char *file)
+{
+	Clear();
+	FILE *f = fopen(file, "r");
+	if (f == 0)
+		return false;
+	DepthTableFileHeader header;
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+		memcmp(header.magic, kDepthTableMagic, sizeof(kDepthTableMagic)) != 0)
+	{
+		printf("'%s' is not a depth table\n", file);
+		fclose(f);
+		return false;
+	}
+	if (header.version != kDepthTableVersion || header.bucketSize != bucketSize ||
+		header.fingerprintMask != fingerprintMask)
+	{
+		printf("Depth table '%s' has version %u (%u entries per bucket, fingerprint mask 0x%X); expected version %u (%d, 0x%X)\n",
+			   file, header.version, header.bucketSize, header.fingerprintMask,
+			   kDepthTableVersion, bucketSize, fingerprintMask);
+		fclose(f);
+		return false;
+	}
+	bool success = false;
+	if (header.numEntries <= header.numBuckets*bucketSize &&
+		fseek(f, 0, SEEK_END) == 0 &&
+		(uint64_t)ftell(f) == sizeof(header)+header.numBuckets*bucketSize*sizeof(uint32_t) &&
+		fseek(f, sizeof(header), SEEK_SET) == 0)
+	{
+		Allocate(header.numBuckets);
+		success = (fread(entries, sizeof(uint32_t)*bucketSize, numBuckets, f) == numBuckets);
+	}
+	fclose(f);
+	if (!success)
+	{
+		printf("File read error (%s)\n", file);
+		Clear();
+		return false;
+	}
+	numEntries = header.numEntries;
+	return true;
+}
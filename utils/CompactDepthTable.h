@@ -0,0 +1,113 @@
+//
+//  CompactDepthTable.h
+//  hog2 glut
+//
+//  An immutable map from 64-bit keys (states) to 4-bit values (depths), for
+//  large tables that are built once and then only queried, such as the
+//  depths of all shallow states of a puzzle.
+//
+//  The table is a bucketized cuckoo hash table: every key can be stored in
+//  one of two buckets, and each bucket is one 64-byte cache line of sixteen
+//  32-bit entries holding a 28-bit fingerprint of the key and its value.
+//  A lookup loads both lines at once (their addresses don't depend on each
+//  other) and compares all entries without branching, so it costs about one
+//  cache miss. The table is filled to 90%, about 4.4 bytes per entry.
+//
+//  Since only fingerprints are stored, a key that was never added is reported
+//  as present with probability of about 32/2^28, and if two keys sharing a
+//  bucket have the same fingerprint a lookup of either returns the smaller
+//  value. When the table holds all states up to some depth, a key that wasn't
+//  added is deeper than anything in the table, so every value returned is
+//  still a lower bound on the depth of the key.
+//
+
+#ifndef COMPACTDEPTHTABLE_H
+#define COMPACTDEPTHTABLE_H
+
+#include <stdint.h>
+#include <cassert>
+#include <vector>
+
+class CompactDepthTable {
+public:
+	CompactDepthTable();
+	~CompactDepthTable();
+	/** Adds a key; if a key is added more than once the smallest value is kept **/
+	void Add(uint64_t key, uint8_t value);
+	/** Builds the table from the added keys; no keys can be added afterwards **/
+	void Finalize();
+	/** Returns the value of key, or -1 if it isn't in the table **/
+	inline int Lookup(uint64_t key) const;
+	uint64_t GetNumEntries() const { return numEntries; }
+	uint64_t GetMemoryUsage() const { return numBuckets*bucketSize*sizeof(uint32_t); }
+	void Clear();
+	/** Saves the buckets after a header with a magic number, version and the table's parameters **/
+	bool Save(const char *file) const;
+	/** Loads a table written by Save, refusing files with another header **/
+	bool Load(const char *file);
+private:
+	CompactDepthTable(const CompactDepthTable &);
+	CompactDepthTable &operator=(const CompactDepthTable &);
+	static inline uint64_t Hash(uint64_t key);
+	inline void GetBuckets(uint64_t hash, uint64_t &b1, uint64_t &b2) const;
+	static inline uint32_t GetEntry(uint64_t hash, uint8_t value);
+	bool Build(const std::vector<uint64_t> &hashes);
+	void Allocate(uint64_t buckets);
+
+	const static int bucketSize = 16;
+	const static uint32_t fingerprintMask = 0x0FFFFFFF;
+
+	std::vector<uint64_t> items; // hashes with the value in the low 4 bits, until Finalize
+	uint64_t numBuckets, numEntries;
+	uint32_t *entries; // fingerprint<<4 | value; 0 is empty
+};
+
+/** The finalizer of splitmix64; every bit of the key affects every bit of the hash **/
+inline uint64_t CompactDepthTable::Hash(uint64_t key)
+{
+	key = (key^(key>>30))*0xBF58476D1CE4E5B9ull;
+	key = (key^(key>>27))*0x94D049BB133111EBull;
+	return key^(key>>31);
+}
+
+/** The two buckets come from the high and low halves of the hash **/
+inline void CompactDepthTable::GetBuckets(uint64_t hash, uint64_t &b1, uint64_t &b2) const
+{
+	b1 = (uint64_t)(((unsigned __int128)hash*numBuckets)>>64);
+	b2 = (uint64_t)(((unsigned __int128)(hash*0x9E3779B97F4A7C15ull)*numBuckets)>>64);
+}
+
+/** Fingerprints come from bits that don't select the first bucket; 0 marks an empty entry **/
+inline uint32_t CompactDepthTable::GetEntry(uint64_t hash, uint8_t value)
+{
+	uint32_t fingerprint = (hash>>4)&fingerprintMask;
+	if (fingerprint == 0)
+		fingerprint = 1;
+	return (fingerprint<<4)|value;
+}
+
+inline int CompactDepthTable::Lookup(uint64_t key) const
+{
+	if (numBuckets == 0)
+		return -1;
+	// the table is built from hashes with the value in the low 4 bits
+	uint64_t hash = Hash(key)&~0xFull;
+	uint64_t b1, b2;
+	GetBuckets(hash, b1, b2);
+	const uint32_t *first = &entries[b1*bucketSize];
+	const uint32_t *second = &entries[b2*bucketSize];
+	uint32_t fingerprint = GetEntry(hash, 0)>>4;
+	// the smallest matching value, or 16 if none match; no early exit, so
+	// the comparisons can be done with vector instructions
+	uint32_t result = 16;
+	for (int x = 0; x < bucketSize; x++)
+	{
+		uint32_t v1 = ((first[x]>>4) == fingerprint)?(first[x]&0xF):16;
+		uint32_t v2 = ((second[x]>>4) == fingerprint)?(second[x]&0xF):16;
+		result = (v1 < result)?v1:result;
+		result = (v2 < result)?v2:result;
+	}
+	return (result == 16)?-1:(int)result;
+}
+
+#endif
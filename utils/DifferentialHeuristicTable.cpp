@@ -0,0 +1,303 @@
+//
+//  DifferentialHeuristicTable.cpp
+//  hog2 glut
+//
+
+#include "DifferentialHeuristicTable.h"
+#include "MMapUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <cassert>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define DH_X86_SIMD
+#include <immintrin.h>
+#endif
+
+static const char tableMagic[8] = "HOGDHT1";
+
+struct tableHeader {
+	char magic[8];
+	uint64_t numNodes;
+	uint32_t numLandmarks;
+	uint32_t stride;
+	float maxValue;
+};
+
+#ifdef DH_X86_SIMD
+// count is a multiple of 8 and both rows are 32-byte aligned
+__attribute__((target("avx2")))
+static float MaxAbsDiffAVX2(const float *a, const float *b, uint32_t count)
+{
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	__m256 best = _mm256_setzero_ps();
+	for (uint32_t x = 0; x < count; x += 8)
+	{
+		__m256 d = _mm256_sub_ps(_mm256_load_ps(a+x), _mm256_load_ps(b+x));
+		best = _mm256_max_ps(best, _mm256_andnot_ps(signBit, d));
+	}
+	__m128 m = _mm_max_ps(_mm256_castps256_ps128(best), _mm256_extractf128_ps(best, 1));
+	m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+	return _mm_cvtss_f32(m);
+}
+
+static float MaxAbsDiffSSE(const float *a, const float *b, uint32_t count)
+{
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	__m128 best = _mm_setzero_ps();
+	for (uint32_t x = 0; x < count; x += 4)
+	{
+		__m128 d = _mm_sub_ps(_mm_load_ps(a+x), _mm_load_ps(b+x));
+		best = _mm_max_ps(best, _mm_andnot_ps(signBit, d));
+	}
+	best = _mm_max_ps(best, _mm_movehl_ps(best, best));
+	best = _mm_max_ss(best, _mm_shuffle_ps(best, best, 1));
+	return _mm_cvtss_f32(best);
+}
+#else
+static float MaxAbsDiffScalar(const float *a, const float *b, uint32_t count)
+{
+	float best = 0;
+	for (uint32_t x = 0; x < count; x++)
+	{
+		float d = fabsf(a[x]-b[x]);
+		if (d > best)
+			best = d;
+	}
+	return best;
+}
+#endif
+
+DifferentialHeuristicTable::DifferentialHeuristicTable()
+:data(0), numNodes(0), numLandmarks(0), stride(0), maxValue(0), errorBound(0), mapped(0), mapSize(0), mapFD(-1)
+{
+#ifdef DH_X86_SIMD
+	__builtin_cpu_init();
+	maxAbsDiff = __builtin_cpu_supports("avx2")?MaxAbsDiffAVX2:MaxAbsDiffSSE;
+#else
+	maxAbsDiff = MaxAbsDiffScalar;
+#endif
+}
+
+DifferentialHeuristicTable::~DifferentialHeuristicTable()
+{
+	Free();
+}
+
+void DifferentialHeuristicTable::Free()
+{
+	if (mapped)
+		CloseMMap(mapped, mapSize, mapFD);
+	else
+		free(data);
+	mapped = 0;
+	data = 0;
+}
+
+void DifferentialHeuristicTable::Reset(uint32_t nodes)
+{
+	Free();
+	numNodes = nodes;
+	numLandmarks = 0;
+	stride = 0;
+	locations.clear();
+	maxValue = 0;
+	UpdateErrorBound();
+}
+
+/**
+ * Each stored distance is off by at most half an ulp of the largest distance,
+ * and so is the float subtraction, so 2^-21 of the largest distance bounds
+ * the error of a difference with room to spare.
+ */
+void DifferentialHeuristicTable::UpdateErrorBound()
+{
+	errorBound = ldexp((double)maxValue, -21);
+}
+
+/**
+ * Moves the table into newly allocated (and writable) memory with the given
+ * number of floats per node; the padding is zero so it never affects HCost.
+ */
+void DifferentialHeuristicTable::Resize(uint32_t newStride)
+{
+	void *mem = 0;
+	uint64_t bytes = (uint64_t)numNodes*newStride*sizeof(float);
+	if (posix_memalign(&mem, 64, bytes > 0 ? bytes : 64) != 0)
+	{
+		printf("Unable to allocate %llu bytes for differential heuristic\n", (unsigned long long)bytes);
+		exit(0);
+	}
+	float *newData = (float*)mem;
+	memset(newData, 0, bytes);
+	uint32_t keep = (numLandmarks < newStride)?numLandmarks:newStride;
+	if (data)
+	{
+		for (uint64_t n = 0; n < numNodes; n++)
+			memcpy(newData+n*newStride, data+n*stride, keep*sizeof(float));
+	}
+	Free();
+	data = newData;
+	stride = newStride;
+}
+
+void DifferentialHeuristicTable::AddLandmark(uint64_t location, const std::vector<double> &distances)
+{
+	if (numLandmarks == 0 && numNodes == 0)
+		numNodes = (uint32_t)distances.size();
+	assert(distances.size() == numNodes);
+	if (numLandmarks == stride)
+		Resize(stride+landmarkBlock);
+	else if (mapped)
+		Resize(stride);
+	for (uint64_t n = 0; n < numNodes; n++)
+	{
+		float value = (float)distances[n];
+		data[n*stride+numLandmarks] = value;
+		if (fabsf(value) > maxValue)
+			maxValue = fabsf(value);
+	}
+	locations.push_back(location);
+	numLandmarks++;
+	UpdateErrorBound();
+}
+
+void DifferentialHeuristicTable::SetNumLandmarks(uint32_t count)
+{
+	if (count >= numLandmarks)
+		return;
+	numLandmarks = count;
+	locations.resize(count);
+	// Resize only copies the landmarks that are kept, so the rest becomes zero padding
+	Resize((count+landmarkBlock-1)/landmarkBlock*landmarkBlock);
+}
+
+void DifferentialHeuristicTable::Set(uint32_t landmark, uint32_t node, double value)
+{
+	assert(landmark < numLandmarks && node < numNodes);
+	if (mapped)
+		Resize(stride);
+	float v = (float)value;
+	data[(uint64_t)node*stride+landmark] = v;
+	if (fabsf(v) > maxValue)
+	{
+		maxValue = fabsf(v);
+		UpdateErrorBound();
+	}
+}
+
+double DifferentialHeuristicTable::HCost(uint32_t a, uint32_t b) const
+{
+	if (numLandmarks == 0)
+		return 0;
+	double h = maxAbsDiff(data+(uint64_t)a*stride, data+(uint64_t)b*stride, stride);
+	return (h > errorBound)?(h-errorBound):0;
+}
+
+double DifferentialHeuristicTable::HCost(uint32_t landmark, uint32_t a, uint32_t b) const
+{
+	double h = fabs((double)Get(landmark, a)-Get(landmark, b));
+	return (h > errorBound)?(h-errorBound):0;
+}
+
+/**
+ * The file is a 64-byte header, the landmark locations padded to a multiple
+ * of 64 bytes, and then the table exactly as it is held in memory, so that
+ * a mapped file (which is page aligned) keeps every row aligned.
+ */
+bool DifferentialHeuristicTable::Save(const char *file) const
+{
+	FILE *f = fopen(file, "w+");
+	if (f == 0)
+	{
+		printf("File write error (%s)\n", file);
+		return false;
+	}
+	uint8_t header[headerBytes];
+	memset(header, 0, headerBytes);
+	tableHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, tableMagic, sizeof(h.magic));
+	h.numNodes = numNodes;
+	h.numLandmarks = numLandmarks;
+	h.stride = stride;
+	h.maxValue = maxValue;
+	memcpy(header, &h, sizeof(h));
+	std::vector<uint64_t> locs(locations);
+	locs.resize((numLandmarks*sizeof(uint64_t)+headerBytes-1)/headerBytes*headerBytes/sizeof(uint64_t));
+	bool ok = (fwrite(header, 1, headerBytes, f) == headerBytes);
+	if (ok && locs.size() > 0)
+		ok = (fwrite(&locs[0], sizeof(uint64_t), locs.size(), f) == locs.size());
+	if (ok && numNodes > 0 && stride > 0)
+		ok = (fwrite(data, sizeof(float)*stride, numNodes, f) == numNodes);
+	fclose(f);
+	if (!ok)
+		printf("File write error (%s)\n", file);
+	return ok;
+}
+
+bool DifferentialHeuristicTable::Load(const char *file, bool useMMap)
+{
+	FILE *f = fopen(file, "r");
+	if (f == 0)
+	{
+		printf("File read error (%s)\n", file);
+		return false;
+	}
+	uint8_t header[headerBytes];
+	tableHeader h;
+	bool ok = (fread(header, 1, headerBytes, f) == headerBytes);
+	memcpy(&h, header, sizeof(h));
+	if (!ok || memcmp(h.magic, tableMagic, sizeof(h.magic)) != 0 || h.stride%landmarkBlock != 0 ||
+		h.numLandmarks > h.stride)
+	{
+		printf("Invalid differential heuristic file (%s)\n", file);
+		fclose(f);
+		return false;
+	}
+	Reset((uint32_t)h.numNodes);
+	uint64_t locationBytes = (h.numLandmarks*sizeof(uint64_t)+headerBytes-1)/headerBytes*headerBytes;
+	std::vector<uint64_t> locs(locationBytes/sizeof(uint64_t));
+	if (locs.size() > 0)
+		ok = (fread(&locs[0], sizeof(uint64_t), locs.size(), f) == locs.size());
+	locs.resize(h.numLandmarks);
+	uint64_t dataBytes = h.numNodes*h.stride*sizeof(float);
+	if (ok && useMMap)
+	{
+		fclose(f);
+		f = 0;
+		mapped = GetReadOnlyMMAP(file, mapSize, mapFD);
+		if (mapped != 0 && mapSize != headerBytes+locationBytes+dataBytes)
+		{
+			CloseMMap(mapped, mapSize, mapFD);
+			mapped = 0;
+		}
+		ok = (mapped != 0);
+		if (ok)
+			data = (float*)(mapped+headerBytes+locationBytes);
+	}
+	else if (ok)
+	{
+		numLandmarks = 0;
+		Resize(h.stride);
+		if (dataBytes > 0)
+			ok = (fread(data, 1, dataBytes, f) == dataBytes);
+	}
+	if (f)
+		fclose(f);
+	if (!ok)
+	{
+		printf("File read error (%s)\n", file);
+		Reset(0);
+		return false;
+	}
+	stride = h.stride;
+	numLandmarks = h.numLandmarks;
+	locations = locs;
+	maxValue = h.maxValue;
+	UpdateErrorBound();
+	return true;
+}
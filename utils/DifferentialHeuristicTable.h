@@ -0,0 +1,72 @@
+//
+//  DifferentialHeuristicTable.h
+//  hog2 glut
+//
+//  Storage for differential heuristics: the distance from each of a set of
+//  landmarks to every node, where the heuristic between two nodes is the
+//  largest |d(landmark, a) - d(landmark, b)| over the landmarks.
+//
+//  Distances are stored as floats, node-major: all landmarks of one node are
+//  contiguous, padded to a multiple of eight, and 32-byte aligned. A lookup
+//  reads one short run of memory per node and takes the maximum with AVX2
+//  (when the CPU has it), eight landmarks per instruction. Rounding to float
+//  can make a difference slightly larger than the true one, so HCost subtracts
+//  a bound on the rounding error to remain admissible. Code that takes
+//  differences of Get values itself must subtract GetErrorBound too.
+//
+//  Tables can be saved and then loaded by mapping the file, so that several
+//  processes share one copy.
+//
+
+#ifndef DIFFERENTIALHEURISTICTABLE_H
+#define DIFFERENTIALHEURISTICTABLE_H
+
+#include <stdint.h>
+#include <vector>
+
+class DifferentialHeuristicTable {
+public:
+	DifferentialHeuristicTable();
+	~DifferentialHeuristicTable();
+	/** Removes all landmarks and sets the number of nodes **/
+	void Reset(uint32_t numNodes);
+	uint32_t GetNumNodes() const { return numNodes; }
+	uint32_t GetNumLandmarks() const { return numLandmarks; }
+	/** Adds a landmark at location; distances[n] is its distance to n (-1 if unreachable) **/
+	void AddLandmark(uint64_t location, const std::vector<double> &distances);
+	/** Keeps only the first count landmarks **/
+	void SetNumLandmarks(uint32_t count);
+	uint64_t GetLocation(uint32_t landmark) const { return locations[landmark]; }
+	double Get(uint32_t landmark, uint32_t node) const { return data[(uint64_t)node*stride+landmark]; }
+	void Set(uint32_t landmark, uint32_t node, double value);
+	/** Returns the max over all landmarks of |d(a)-d(b)|, less the rounding error **/
+	double HCost(uint32_t a, uint32_t b) const;
+	/** Returns |d(a)-d(b)| for one landmark, less the rounding error **/
+	double HCost(uint32_t landmark, uint32_t a, uint32_t b) const;
+	/** Bound on the rounding error of a difference of two stored distances **/
+	double GetErrorBound() const { return errorBound; }
+	uint64_t GetMemoryUsage() const { return (uint64_t)numNodes*stride*sizeof(float); }
+	bool Save(const char *file) const;
+	bool Load(const char *file, bool useMMap = false);
+private:
+	DifferentialHeuristicTable(const DifferentialHeuristicTable &);
+	DifferentialHeuristicTable &operator=(const DifferentialHeuristicTable &);
+	void Resize(uint32_t newStride);
+	void Free();
+	void UpdateErrorBound();
+
+	const static int landmarkBlock = 8; // floats per AVX2 register
+	const static int headerBytes = 64;
+
+	float *data;
+	uint32_t numNodes, numLandmarks, stride;
+	std::vector<uint64_t> locations;
+	float maxValue;
+	double errorBound;
+	float (*maxAbsDiff)(const float *, const float *, uint32_t);
+	uint8_t *mapped;
+	uint64_t mapSize;
+	int mapFD;
+};
+
+#endif
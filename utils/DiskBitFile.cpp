@@ -7,278 +7,415 @@
 //
 
 #include "DiskBitFile.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <algorithm>
 
-DiskBitFile::DiskBitFile(const char *pre)
+DiskBitFile::DiskBitFile(const char *pre, int numCachePages)
 {
 //	subBucketBits = subSize;
 	strncpy(prefix, pre, 62);
-	outputFile = 0;
-	outputBucket = -1;
-	outputSubBucket = -1;
-	cacheOffset = -1; // beginning of cache [in bytes]
-	
-	theCacheSize = 0;      // valid bytes in the cache
-	cacheFilePosition = 0; // current offset in file (bytes)
-	cacheChanged = false;
-	
+	prefix[62] = 0;
+
+	pages.resize(std::max(numCachePages, 1));
+	for (unsigned int x = 0; x < pages.size(); x++)
+	{
+		pages[x].bucket = -1;
+		pages[x].changed = false;
+		pages[x].lastUsed = 0;
+		pages[x].data.resize(cacheSize);
+	}
+	lastPage = 0;
+	useCounter = 0;
+
+	for (int x = 0; x < 2; x++)
+	{
+		readAhead[x].bucket = -1;
+		readAhead[x].pending = false;
+	}
+	chunkBucket = -1;
+	chunkSubBucket = -1;
+	chunkEnd = 0;
+
 	bytesRead = 0;
 	bytesWritten = 0;
+	for (int x = 0; x < latencyBuckets; x++)
+	{
+		readLatency[x] = 0;
+		writeLatency[x] = 0;
+	}
 
-
-	fileOpen = false;
-	chunkFile = 0;
-	fileOffset = 0;
-	currBucket = -1;
-	currSubBucket = -1;
+	activeRequests = 0;
+	quit = false;
+	ioThread = std::thread(&DiskBitFile::IOThread, this);
 }
 
 DiskBitFile::~DiskBitFile()
 {
 	CloseReadFile();
 	CloseReadWriteFile();
+	{
+		std::lock_guard<std::mutex> l(ioLock);
+		quit = true;
+	}
+	ioWork.notify_all();
+	ioThread.join();
+	CloseFiles();
 }
 
+/**
+ * Writes back all changed pages and waits until they are on disk. Files are
+ * kept open.
+ */
 void DiskBitFile::CloseReadWriteFile()
 {
-	if (outputFile != 0)
+	for (unsigned int x = 0; x < pages.size(); x++)
 	{
-		fclose(outputFile);
-		//printf("Closing file\n");fflush(stdout);
-		outputFile = 0;
+		if (pages[x].changed)
+			WriteBack(pages[x]);
 	}
-	outputBucket = -1;
-	outputSubBucket = -1;
-	cacheOffset = -1;
-	cacheFilePosition = 0;
+	WaitForIO();
 }
 
 // incoming offset is in entries, not bytes
 void DiskBitFile::WriteFileDepth(int bucket, int64_t offset, uint8_t value)
 {
-	int64_t subBucket = (offset*BITS/8)>>subBucketBits;
 	if (bucket == -1)
 	{
-		FlushCache();
 		CloseReadWriteFile();
 		return;
 	}
-	if ((bucket != outputBucket) || (subBucket != outputSubBucket))
-	{
-		FlushCache();
-		CloseReadWriteFile();
-	}
-	if (outputFile == 0)
-	{
-	  //printf("Opening '%s'\n", getBucketFileName(bucket, subBucket)); fflush(stdout);
-		outputFile = fopen(getBucketFileName(bucket, subBucket), "r+");
-		if (outputFile == 0) { printf("Unable to open '%s'; aborting\n", getBucketFileName(bucket, subBucket)); exit(0); }
-		outputBucket = bucket;
-		outputSubBucket = subBucket;
-		cacheFilePosition = 0;
-		cacheOffset = -1;
-	}
-	
+	int64_t subBucket = (offset*BITS/8)>>subBucketBits;
 	offset -= subBucket*(1<<subBucketBits)*8/BITS;
-#if BITS==8
-	assert(cacheOffset != -1);
-	assert(offset-cacheOffset < theCacheSize);
-	assert(offset-cacheOffset >= 0);
-	cache[offset-cacheOffset] = value;
-	//printf("Writing %d to local cache offset %lld\n", value, offset-cacheOffset);
-	cacheChanged = true;
-#elif BITS==4
-	assert(cacheOffset != -1);
-	assert((offset>>1)-cacheOffset < theCacheSize);
-	assert((offset>>1)-cacheOffset >= 0);
-	uint8_t curr;
-	curr = cache[(offset>>1)-cacheOffset];
-	curr &= (~(0xF<<(4*(offset%2)))); // wipe out old value
-	curr |= (value<<(4*(offset%2))); // or in new value
-	cache[(offset>>1)-cacheOffset] = curr;
-	cacheChanged = true;
-#elif BITS==2
-	assert(cacheOffset != -1);
-	assert((offset>>2)-cacheOffset < theCacheSize);
-	assert((offset>>2)-cacheOffset >= 0);
-	uint8_t curr;
-	curr = cache[(offset>>2)-cacheOffset];
-	curr &= (~(0x3<<(2*(offset%4)))); // wipe out old value
-	curr |= (value<<(2*(offset%4))); // or in new value
-	cache[(offset>>2)-cacheOffset] = curr;
-	cacheChanged = true;
-#else // BITS==1
-	assert(false);
-#endif
-	
+	int64_t byteOffset = offset*BITS/8;
+	int shift = BITS*(offset%(8/BITS));
+
+	cachePage *p = GetPage(bucket, subBucket, byteOffset);
+	assert(byteOffset-p->start < p->valid);
+	uint8_t &curr = p->data[byteOffset-p->start];
+	curr &= ~(((1<<BITS)-1)<<shift); // wipe out old value
+	curr |= (value<<shift); // or in new value
+	p->changed = true;
 }
 
 int DiskBitFile::ReadFileDepth(int bucket, int64_t offset)
 {
-	int64_t subBucket = (offset*BITS/8)>>subBucketBits;
 	if (bucket == -1)
 	{
-		FlushCache();
 		CloseReadWriteFile();
 		return 0;
 	}
-	if ((bucket != outputBucket) || (subBucket != outputSubBucket))
+	int64_t subBucket = (offset*BITS/8)>>subBucketBits;
+	offset -= subBucket*(1<<subBucketBits)*8/BITS;
+	int64_t byteOffset = offset*BITS/8;
+	int shift = BITS*(offset%(8/BITS));
+
+	cachePage *p = GetPage(bucket, subBucket, byteOffset);
+	assert(byteOffset-p->start < p->valid);
+	return (p->data[byteOffset-p->start]>>shift)&((1<<BITS)-1);
+}
+
+/**
+ * Returns the page holding byteOffset of the given file, reading it if it
+ * isn't cached. The least recently used page is replaced; if it was changed
+ * it is handed to the background thread to be written.
+ */
+DiskBitFile::cachePage *DiskBitFile::GetPage(int bucket, int64_t subBucket, int64_t byteOffset)
+{
+	int64_t start = byteOffset&(~(cacheSize-1));
+	if (lastPage && lastPage->start == start && lastPage->bucket == bucket && lastPage->subBucket == subBucket)
+		return lastPage;
+
+	cachePage *victim = &pages[0];
+	for (unsigned int x = 0; x < pages.size(); x++)
 	{
-		FlushCache();
-		CloseReadWriteFile();
+		cachePage &p = pages[x];
+		if (p.bucket == bucket && p.subBucket == subBucket && p.start == start)
+		{
+			p.lastUsed = ++useCounter;
+			lastPage = &p;
+			return &p;
+		}
+		if (p.lastUsed < victim->lastUsed)
+			victim = &p;
 	}
-	if (outputFile == 0)
+	if (victim->changed)
+		WriteBack(*victim);
+
+	int fd = GetFile(bucket, subBucket);
+	WaitForWrites(fd, start, cacheSize);
+	victim->bucket = bucket;
+	victim->subBucket = subBucket;
+	victim->start = start;
+	victim->valid = TimedRead(fd, &victim->data[0], cacheSize, start);
+	if (victim->valid < 0)
 	{
-	  //printf("Opening '%s'\n", getBucketFileName(bucket, subBucket)); fflush(stdout);
-		outputFile = fopen(getBucketFileName(bucket, subBucket), "r+");
-		if (outputFile == 0) { printf("Unable to open '%s'; aborting\n", getBucketFileName(bucket, subBucket)); exit(0); }
-		outputBucket = bucket;
-		outputSubBucket = subBucket;
-		cacheFilePosition = 0;
-		cacheOffset = -1;
+		printf("Error reading '%s'\n", getBucketFileName(bucket, (int)subBucket));
+		victim->valid = 0;
 	}
-	
-	offset -= subBucket*(1<<subBucketBits)*8/BITS;
-#if BITS==8
-	if ((cacheOffset == -1) || // just read into memory
-		(offset-cacheOffset < 0)  || (offset-cacheOffset >= theCacheSize))
+	victim->changed = false;
+	victim->lastUsed = ++useCounter;
+	lastPage = victim;
+	return victim;
+}
+
+/**
+ * Queues a changed page to be written by the background thread. The page
+ * gets a fresh buffer and is no longer valid afterwards. Read-ahead buffers
+ * with stale copies of the page are dropped.
+ */
+void DiskBitFile::WriteBack(cachePage &p)
+{
+	ioRequest *r = new ioRequest;
+	r->write = true;
+	r->fd = GetFile(p.bucket, p.subBucket);
+	r->start = p.start;
+	r->length = p.valid;
+	r->target = 0;
 	{
-		FlushCache();
-		
-		cacheOffset = offset&(~(cacheSize-1));
-		fseek(outputFile, cacheOffset-cacheFilePosition, SEEK_CUR);
-		//fseek(outputFile, cacheOffset, SEEK_SET);
-		cacheFilePosition += cacheOffset-cacheFilePosition;
-		theCacheSize = fread(cache, sizeof(uint8_t), cacheSize, outputFile);
-		chunksRead++;
-		cacheFilePosition += theCacheSize;
-		//printf("cacheOffset: %lld; cacheFilePosition: %lld\n", cacheOffset, cacheFilePosition);
+		std::unique_lock<std::mutex> l(ioLock);
+		for (int x = 0; x < 2; x++)
+		{
+			readAheadBuffer &b = readAhead[x];
+			if (b.bucket == p.bucket && b.subBucket == p.subBucket &&
+				b.start < p.start+p.valid && p.start < b.start+b.length)
+			{
+				while (b.pending)
+					ioDone.wait(l);
+				b.bucket = -1;
+			}
+		}
+		// limit the memory used by pages waiting to be written
+		while (activeRequests >= maxPendingWrites)
+			ioDone.wait(l);
+		r->data.swap(p.data);
+		if (freeBuffers.size() > 0)
+		{
+			p.data.swap(freeBuffers.back());
+			freeBuffers.pop_back();
+		}
+		pendingWrites[std::make_pair(r->fd, r->start)]++;
+		activeRequests++;
+		requests.push_back(r);
 	}
-	return cache[offset-cacheOffset];
-	
-#elif BITS==4
-	
-	if ((cacheOffset == -1) || // just read into memory
-		(offset>>1)-cacheOffset < 0  || (offset>>1)-cacheOffset >= theCacheSize)
+	ioWork.notify_one();
+	p.data.resize(cacheSize);
+	p.bucket = -1;
+	p.changed = false;
+	p.lastUsed = 0;
+	if (lastPage == &p)
+		lastPage = 0;
+}
+
+/** Waits until no queued write overlaps the given range of the file **/
+void DiskBitFile::WaitForWrites(int fd, int64_t start, int64_t length)
+{
+	std::unique_lock<std::mutex> l(ioLock);
+	while (true)
 	{
-		FlushCache();
-		
-		cacheOffset = (offset>>1)&(~(cacheSize-1));
-		fseek(outputFile, cacheOffset-cacheFilePosition, SEEK_CUR);
-		//fseek(outputFile, cacheOffset, SEEK_SET);
-		cacheFilePosition += cacheOffset-cacheFilePosition;
-		theCacheSize = fread(cache, sizeof(uint8_t), cacheSize, outputFile);
-		//chunksRead++;
-		bytesRead += cacheSize;
-		cacheFilePosition += theCacheSize;
+		// pages are aligned, so only a page starting less than a page before
+		// start can overlap
+		auto i = pendingWrites.lower_bound(std::make_pair(fd, start-cacheSize+1));
+		if (i == pendingWrites.end() || i->first.first != fd || i->first.second >= start+length)
+			return;
+		ioDone.wait(l);
 	}
-	return (cache[(offset>>1)-cacheOffset]>>(4*(offset%2)))&0xF;
-	
-#elif BITS==2
-	if ((cacheOffset == -1) || // just read into memory
-		(offset>>2)-cacheOffset < 0  || (offset>>2)-cacheOffset >= theCacheSize)
+}
+
+/** Waits until the background thread has nothing left to do **/
+void DiskBitFile::WaitForIO()
+{
+	std::unique_lock<std::mutex> l(ioLock);
+	while (activeRequests > 0)
+		ioDone.wait(l);
+}
+
+/**
+ * Runs the queued reads and writes in order. Since there is only one thread,
+ * a read-ahead always sees the writes that were queued before it.
+ */
+void DiskBitFile::IOThread()
+{
+	std::unique_lock<std::mutex> l(ioLock);
+	while (true)
 	{
-		FlushCache();
-		
-		cacheOffset = (offset>>2)&(~(cacheSize-1));
-		fseek(outputFile, cacheOffset-cacheFilePosition, SEEK_CUR);
-		//fseek(outputFile, cacheOffset, SEEK_SET);
-		cacheFilePosition += cacheOffset-cacheFilePosition;
-		theCacheSize = fread(cache, sizeof(uint8_t), cacheSize, outputFile);
-		chunksRead++;
-		cacheFilePosition += theCacheSize;
+		while (requests.size() == 0 && !quit)
+			ioWork.wait(l);
+		if (requests.size() == 0)
+			return;
+		ioRequest *r = requests.front();
+		requests.pop_front();
+		l.unlock();
+		int64_t result;
+		if (r->write)
+		{
+			result = TimedWrite(r->fd, &r->data[0], r->length, r->start);
+			if (result != r->length)
+				printf("Error: write of %lld bytes at %lld failed\n", (long long)r->length, (long long)r->start);
+		}
+		else {
+			result = TimedRead(r->fd, &r->target->data[0], r->length, r->start);
+		}
+		l.lock();
+		if (r->write)
+		{
+			auto i = pendingWrites.find(std::make_pair(r->fd, r->start));
+			if (--i->second == 0)
+				pendingWrites.erase(i);
+			freeBuffers.push_back(std::vector<uint8_t>());
+			freeBuffers.back().swap(r->data);
+		}
+		else {
+			r->target->valid = std::max(result, (int64_t)0);
+			r->target->pending = false;
+		}
+		activeRequests--;
+		delete r;
+		ioDone.notify_all();
 	}
-	return (cache[(offset>>2)-cacheOffset]>>(2*(offset%4)))&0x3;
-	
-#else // BITS==1
-	assert(false);
-#endif
 }
 
 void DiskBitFile::CloseReadFile()
 {
-	if (fileOpen)
+	std::unique_lock<std::mutex> l(ioLock);
+	for (int x = 0; x < 2; x++)
 	{
-		fclose(chunkFile);
-		chunkFile = 0;
-		//printf("Closing READ file\n");
-		fileOpen = false;
+		while (readAhead[x].pending)
+			ioDone.wait(l);
+		readAhead[x].bucket = -1;
 	}
+	chunkBucket = -1;
+	chunkSubBucket = -1;
+	chunkEnd = 0;
 }
 
-uint8_t *DiskBitFile::ReadChunk(int bucket, int64_t offset, int numEntries, uint8_t *data)
+/**
+ * Returns the read-ahead buffer holding byteOffset of the file, waiting for
+ * it to be read if necessary, or 0 if there isn't one.
+ */
+DiskBitFile::readAheadBuffer *DiskBitFile::FindReadAhead(int bucket, int64_t subBucket, int64_t byteOffset)
 {
-	
-	int64_t subBucket = (offset*BITS/8)>>subBucketBits;
-	offset -= subBucket*(1<<subBucketBits)*8/BITS;
-	
-	if (bucket == -1)
+	for (int x = 0; x < 2; x++)
 	{
-		if (fileOpen)
-		{
-			fclose(chunkFile);
-			//printf("Closing READ file\n");
-			fileOpen = false;
-		}
+		readAheadBuffer *b = &readAhead[x];
+		if (b->bucket != bucket || b->subBucket != subBucket ||
+			byteOffset < b->start || byteOffset >= b->start+b->length)
+			continue;
+		std::unique_lock<std::mutex> l(ioLock);
+		while (b->pending)
+			ioDone.wait(l);
+		if (byteOffset < b->start+b->valid)
+			return b;
 		return 0;
 	}
-	if (fileOpen && ((bucket != currBucket) || (subBucket != currSubBucket)))
+	return 0;
+}
+
+/**
+ * Makes sure that the part of the file starting at start is being read. If
+ * no read-ahead buffer covers it, the buffer that isn't the one in use is
+ * reused.
+ */
+DiskBitFile::readAheadBuffer *DiskBitFile::RequestReadAhead(int bucket, int64_t subBucket, int64_t start,
+															int64_t length, readAheadBuffer *inUse)
+{
+	for (int x = 0; x < 2; x++)
 	{
-		fclose(chunkFile);
-		chunkFile = 0;
-		//printf("Closing READ file\n");
-		fileOpen = false;
+		readAheadBuffer *b = &readAhead[x];
+		if (b->bucket == bucket && b->subBucket == subBucket && b->start <= start && start < b->start+b->length)
+			return b;
 	}
-	if (!fileOpen)
+	readAheadBuffer *b = (inUse == &readAhead[0])?&readAhead[1]:&readAhead[0];
+	ioRequest *r = new ioRequest;
+	r->write = false;
+	r->fd = GetFile(bucket, subBucket);
+	r->start = start;
+	r->length = length;
+	r->target = b;
 	{
-		//printf("Opening %s for READ only\n", getBucketFileName(bucket, subBucket));
-		chunkFile = fopen(getBucketFileName(bucket, subBucket), "r");
-		if (chunkFile == 0)
-		{
-			printf("Unable to open file %s\n", getBucketFileName(bucket, subBucket));
-			exit(0);
-		}
-		fileOffset = 0;
-		currBucket = bucket;
-		currSubBucket = subBucket;
-		fileOpen = true;
+		std::unique_lock<std::mutex> l(ioLock);
+		while (b->pending)
+			ioDone.wait(l);
+		b->bucket = bucket;
+		b->subBucket = subBucket;
+		b->start = start;
+		b->length = length;
+		b->valid = 0;
+		b->pending = true;
+		if ((int64_t)b->data.size() < length)
+			b->data.resize(length);
+		activeRequests++;
+		requests.push_back(r);
 	}
-	
-	fseek(chunkFile, offset*BITS/8-fileOffset, SEEK_CUR);
-	fileOffset+=offset*BITS/8-fileOffset;
-	//	fseek(f, offset*BITS/8, SEEK_SET);
-	
-	int alignedSize = (numEntries*BITS+7)/8;
-	//	uint8_t *data = GetMemoryChunk((openSize*BITS+7)/8); //new uint8_t[alignedSize];
-	assert(0 == offset%2);
-	fread(data, sizeof(uint8_t), alignedSize, chunkFile);
-	fileOffset += alignedSize;
-	bytesRead += alignedSize;
-	//chunksRead++;
-	return data;
+	ioWork.notify_one();
+	return b;
 }
 
-void DiskBitFile::FlushCache()
+uint8_t *DiskBitFile::ReadChunk(int bucket, int64_t offset, int numEntries, uint8_t *data)
 {
-	if (cacheChanged)
+	if (bucket == -1)
+	{
+		CloseReadFile();
+		return 0;
+	}
+	int64_t subBucket = (offset*BITS/8)>>subBucketBits;
+	offset -= subBucket*(1<<subBucketBits)*8/BITS;
+	assert(0 == (offset*BITS)%8);
+	int64_t start = offset*BITS/8;
+	int64_t alignedSize = ((int64_t)numEntries*BITS+7)/8;
+	bool sequential = (bucket == chunkBucket && subBucket == chunkSubBucket && start == chunkEnd);
+
+	// copy whatever has already been read ahead
+	int64_t done = 0;
+	while (done < alignedSize)
 	{
-		fseek(outputFile, cacheOffset-cacheFilePosition, SEEK_CUR);
-		//fseek(outputFile, cacheOffset, SEEK_SET);
-		cacheFilePosition += cacheOffset-cacheFilePosition;
-		fwrite(cache, sizeof(uint8_t), theCacheSize, outputFile);
-		bytesWritten += theCacheSize;
-		//chunksWritten++;
-		cacheFilePosition += theCacheSize;
-		cacheChanged = false;
+		readAheadBuffer *b = FindReadAhead(bucket, subBucket, start+done);
+		if (b == 0)
+			break;
+		int64_t amount = std::min(alignedSize-done, b->start+b->valid-(start+done));
+		memcpy(data+done, &b->data[start+done-b->start], amount);
+		done += amount;
 	}
+	if (done < alignedSize)
+	{
+		int fd = GetFile(bucket, subBucket);
+		WaitForWrites(fd, start+done, alignedSize-done);
+		if (TimedRead(fd, data+done, alignedSize-done, start+done) < 0)
+			printf("Error reading '%s'\n", getBucketFileName(bucket, (int)subBucket));
+	}
+
+	chunkBucket = bucket;
+	chunkSubBucket = subBucket;
+	chunkEnd = start+alignedSize;
+	// during a sequential scan keep the next two windows of the file in flight
+	if (sequential)
+	{
+		int64_t length = (alignedSize > readAheadSize)?alignedSize:readAheadSize;
+		readAheadBuffer *b = RequestReadAhead(bucket, subBucket, chunkEnd, length, 0);
+		RequestReadAhead(bucket, subBucket, b->start+b->length, length, b);
+	}
+	return data;
 }
 
 void DiskBitFile::Init(const std::vector<bucketData> &buckets)
 {
-	int subBucket = 0;
+	// the files are recreated, so nothing cached is valid anymore
+	CloseReadFile();
+	CloseReadWriteFile();
+	for (unsigned int x = 0; x < pages.size(); x++)
+	{
+		pages[x].bucket = -1;
+		pages[x].lastUsed = 0;
+	}
+	lastPage = 0;
+	CloseFiles();
+
 	for (unsigned int x = 0; x < buckets.size(); x++)
 	{
 		printf("Bucket %d has %llu entries\n", x, buckets[x].theSize);
 		
+		int subBucket = 0;
 		FILE *f = fopen(getBucketFileName(x, subBucket), "w");
 		if (f == 0)
 		{ printf("Error opening file '%s'\n", getBucketFileName(x, subBucket)); exit(0); }
@@ -295,7 +432,7 @@ void DiskBitFile::Init(const std::vector<bucketData> &buckets)
 			{
 				fclose(f);
 				subBucket = currSubBucket;
-				FILE *f = fopen(getBucketFileName(x, subBucket), "w");
+				f = fopen(getBucketFileName(x, subBucket), "w");
 				if (f == 0)
 				{ printf("Error opening file '%s'\n", getBucketFileName(x, subBucket)); exit(0); }
 			}
@@ -308,6 +445,102 @@ void DiskBitFile::Init(const std::vector<bucketData> &buckets)
 	}
 }
 
+/** Returns the descriptor of the file, opening it the first time it is used **/
+int DiskBitFile::GetFile(int bucket, int64_t subBucket)
+{
+	std::pair<int, int64_t> key(bucket, subBucket);
+	auto i = files.find(key);
+	if (i != files.end())
+		return i->second;
+	int fd = open(getBucketFileName(bucket, (int)subBucket), O_RDWR);
+	if (fd == -1) // read-only files can still be used for lookups
+		fd = open(getBucketFileName(bucket, (int)subBucket), O_RDONLY);
+	if (fd == -1)
+	{ printf("Unable to open '%s'; aborting\n", getBucketFileName(bucket, (int)subBucket)); exit(0); }
+	files[key] = fd;
+	return fd;
+}
+
+void DiskBitFile::CloseFiles()
+{
+	WaitForIO();
+	for (auto i = files.begin(); i != files.end(); i++)
+		close(i->second);
+	files.clear();
+}
+
+static int LatencyBucket(std::chrono::steady_clock::duration d, int numBuckets)
+{
+	int64_t micro = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+	int which = 0;
+	while (which < numBuckets-1 && (1ll<<which) < micro)
+		which++;
+	return which;
+}
+
+/** Reads length bytes (fewer at the end of the file); returns -1 on error **/
+int64_t DiskBitFile::TimedRead(int fd, uint8_t *data, int64_t length, int64_t start)
+{
+	auto t = std::chrono::steady_clock::now();
+	int64_t done = 0;
+	while (done < length)
+	{
+		ssize_t result = pread(fd, data+done, length-done, start+done);
+		if (result == -1)
+			return -1;
+		if (result == 0)
+			break;
+		done += result;
+	}
+	readLatency[LatencyBucket(std::chrono::steady_clock::now()-t, latencyBuckets)]++;
+	bytesRead += done;
+	return done;
+}
+
+int64_t DiskBitFile::TimedWrite(int fd, const uint8_t *data, int64_t length, int64_t start)
+{
+	auto t = std::chrono::steady_clock::now();
+	int64_t done = 0;
+	while (done < length)
+	{
+		ssize_t result = pwrite(fd, data+done, length-done, start+done);
+		if (result <= 0)
+			return -1;
+		done += result;
+	}
+	writeLatency[LatencyBucket(std::chrono::steady_clock::now()-t, latencyBuckets)]++;
+	bytesWritten += done;
+	return done;
+}
+
+void DiskBitFile::GetReadLatency(std::vector<uint64_t> &histogram) const
+{
+	histogram.resize(latencyBuckets);
+	for (int x = 0; x < latencyBuckets; x++)
+		histogram[x] = readLatency[x];
+}
+
+void DiskBitFile::GetWriteLatency(std::vector<uint64_t> &histogram) const
+{
+	histogram.resize(latencyBuckets);
+	for (int x = 0; x < latencyBuckets; x++)
+		histogram[x] = writeLatency[x];
+}
+
+void DiskBitFile::PrintIOStats() const
+{
+	printf("%llu bytes read, %llu bytes written\n",
+		   (unsigned long long)bytesRead, (unsigned long long)bytesWritten);
+	printf("latency (us)   reads   writes\n");
+	for (int x = 0; x < latencyBuckets; x++)
+	{
+		if (readLatency[x] == 0 && writeLatency[x] == 0)
+			continue;
+		printf("<= %-10llu %7llu %8llu\n", 1ull<<x,
+			   (unsigned long long)readLatency[x], (unsigned long long)writeLatency[x]);
+	}
+}
+
 const char *DiskBitFile::getBucketFileName(int bucket, int subBucket)
 {
 	//static char fname[255];
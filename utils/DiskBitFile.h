@@ -16,14 +16,36 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 //const int BITS = 4;
 #define BITS 4
 
+/**
+ * Stores BITS bits per entry in a set of bucket files on disk. Each bucket is
+ * split into sub-bucket files of 2^subBucketBits bytes.
+ *
+ * All files are opened once and kept open; they are accessed with
+ * pread/pwrite, so any number of them can be in use at the same time.
+ * ReadFileDepth and WriteFileDepth go through a small LRU cache of pages,
+ * which may come from different buckets. Changed pages are written back by a
+ * background thread when they are evicted (write-behind), and CloseReadWriteFile
+ * writes all of them back and waits for the writes to finish.
+ *
+ * ReadChunk detects sequential scans of a file and has the background thread
+ * read the next part of the file while the current part is being used.
+ * ReadChunk only sees changes made with WriteFileDepth once the changed pages
+ * have been written back (when evicted, or by CloseReadWriteFile).
+ */
 class DiskBitFile
 {
 public:
-	DiskBitFile(const char *pre);
+	DiskBitFile(const char *pre, int numCachePages = 8);
 	~DiskBitFile();
 	void Init(const std::vector<bucketData> &buckets);
 	
@@ -37,31 +59,85 @@ public:
 
 	uint64_t GetBytesRead() const { return bytesRead; }
 	uint64_t GetBytesWritten() const { return bytesWritten; }
+	/**
+	 * Latency histograms of the individual disk reads and writes. Entry i
+	 * counts the operations that took between 2^(i-1) and 2^i microseconds.
+	 */
+	void GetReadLatency(std::vector<uint64_t> &histogram) const;
+	void GetWriteLatency(std::vector<uint64_t> &histogram) const;
+	void PrintIOStats() const;
 private:
-	void FlushCache();
+	struct cachePage {
+		int bucket;
+		int64_t subBucket;
+		int64_t start; // beginning of page in file [in bytes]
+		int64_t valid; // valid bytes in the page
+		bool changed;
+		uint64_t lastUsed;
+		std::vector<uint8_t> data;
+	};
+	struct readAheadBuffer {
+		int bucket;
+		int64_t subBucket;
+		int64_t start, length; // requested range [in bytes]
+		int64_t valid;         // bytes actually read
+		bool pending;
+		std::vector<uint8_t> data;
+	};
+	struct ioRequest {
+		bool write;
+		int fd;
+		int64_t start, length;
+		std::vector<uint8_t> data; // for writes
+		readAheadBuffer *target;   // for reads
+	};
+
+	cachePage *GetPage(int bucket, int64_t subBucket, int64_t byteOffset);
+	void WriteBack(cachePage &p);
+	readAheadBuffer *RequestReadAhead(int bucket, int64_t subBucket, int64_t start,
+									  int64_t length, readAheadBuffer *inUse);
+	readAheadBuffer *FindReadAhead(int bucket, int64_t subBucket, int64_t byteOffset);
+	void WaitForWrites(int fd, int64_t start, int64_t length);
+	void WaitForIO();
+	void IOThread();
+	int GetFile(int bucket, int64_t subBucket);
+	void CloseFiles();
+	int64_t TimedRead(int fd, uint8_t *data, int64_t length, int64_t start);
+	int64_t TimedWrite(int fd, const uint8_t *data, int64_t length, int64_t start);
 	const char *getBucketFileName(int bucket, int subBucket);
 
-	// data for reading and writing depths
-	FILE *outputFile;
-	int outputBucket;
-	int outputSubBucket;
-	int64_t cacheOffset; // beginning of cache [in bytes]
-	
+	const static int subBucketBits = 30;
+	const static int64_t cacheSize = 1ull<<22; // 4 MB per page
+	const static int64_t readAheadSize = 1ull<<22;
+	const static int maxPendingWrites = 4;
+	const static int latencyBuckets = 32;
+
+	// pages for reading and writing depths
+	std::vector<cachePage> pages;
+	cachePage *lastPage;
+	uint64_t useCounter;
+
 	// data for reading chunks
-	bool fileOpen;
-	FILE *chunkFile;
-	int64_t fileOffset;
-	int64_t currBucket;
-	int64_t currSubBucket;
+	readAheadBuffer readAhead[2];
+	int chunkBucket;
+	int64_t chunkSubBucket;
+	int64_t chunkEnd; // end of the last chunk [in bytes]
 
-	const static int subBucketBits = 30;
-	const static int64_t cacheSize = 1ull<<22;//4096;//1024*512; // no problem(?) // 4 MB!
-	int64_t theCacheSize;      // valid bytes in the cache
-	int64_t cacheFilePosition; // current offset in file (bytes)
-	bool cacheChanged;
-	uint8_t cache[cacheSize];
+	// files are only opened and closed by the calling thread
+	std::map<std::pair<int, int64_t>, int> files;
+
+	// work for the background thread
+	std::thread ioThread;
+	std::mutex ioLock;
+	std::condition_variable ioWork, ioDone;
+	std::deque<ioRequest *> requests;
+	std::map<std::pair<int, int64_t>, int> pendingWrites; // (fd, page start)
+	std::vector<std::vector<uint8_t> > freeBuffers;
+	int activeRequests;
+	bool quit;
 
-	uint64_t bytesRead, bytesWritten;
+	std::atomic<uint64_t> bytesRead, bytesWritten;
+	std::atomic<uint64_t> readLatency[latencyBuckets], writeLatency[latencyBuckets];
 	char bucketFileName[255];
 	char prefix[64];
 };
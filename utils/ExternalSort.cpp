@@ -0,0 +1,271 @@
+//
+//  ExternalSort.cpp
+//  hog2 glut
+//
+
+#include "ExternalSort.h"
+#include <algorithm>
+#include <queue>
+#include <functional>
+
+UInt64Reader::UInt64Reader(size_t bufferEntries)
+:f(0), buffer(bufferEntries), next(0), count(0)
+{
+}
+
+bool UInt64Reader::Open(const char *fname)
+{
+	Close();
+	f = fopen(fname, "rb");
+	return f != 0;
+}
+
+void UInt64Reader::Close()
+{
+	if (f)
+		fclose(f);
+	f = 0;
+	next = count = 0;
+}
+
+bool UInt64Reader::Fill()
+{
+	if (f == 0)
+		return false;
+	count = fread(&buffer[0], sizeof(uint64_t), buffer.size(), f);
+	next = 0;
+	return count > 0;
+}
+
+UInt64Writer::UInt64Writer(size_t bufferEntries)
+:f(0), written(0), failed(false)
+{
+	buffer.reserve(bufferEntries);
+}
+
+bool UInt64Writer::Open(const char *fname, bool append)
+{
+	Close();
+	f = fopen(fname, append?"ab":"wb");
+	written = 0;
+	failed = (f == 0);
+	return f != 0;
+}
+
+bool UInt64Writer::Close()
+{
+	if (f == 0)
+	{
+		buffer.resize(0);
+		return !failed;
+	}
+	Flush();
+	if (fclose(f) != 0)
+		failed = true;
+	f = 0;
+	return !failed;
+}
+
+void UInt64Writer::Add(const uint64_t *vals, size_t count)
+{
+	// large blocks go straight to the file
+	if (count >= buffer.capacity())
+	{
+		if (!Flush())
+			return;
+		if (fwrite(vals, sizeof(uint64_t), count, f) != count)
+		{
+			printf("Error: write failed\n");
+			failed = true;
+			return;
+		}
+		written += count;
+		return;
+	}
+	for (size_t x = 0; x < count; x++)
+		Add(vals[x]);
+}
+
+/** Writes out the buffer. Once a write has failed nothing more is written. **/
+bool UInt64Writer::Flush()
+{
+	if (f == 0 || failed)
+	{
+		failed = true;
+		buffer.resize(0);
+		return false;
+	}
+	if (buffer.size() == 0)
+		return true;
+	if (fwrite(&buffer[0], sizeof(uint64_t), buffer.size(), f) != buffer.size())
+	{
+		printf("Error: write failed\n");
+		failed = true;
+	}
+	else
+		written += buffer.size();
+	buffer.resize(0);
+	return !failed;
+}
+
+static inline bool NextValue(std::vector<UInt64Reader *> &runs, const std::vector<uint64_t> &memRun,
+							 size_t &memNext, size_t which, uint64_t &val)
+{
+	if (which < runs.size())
+		return runs[which]->Next(val);
+	if (memNext == memRun.size())
+		return false;
+	val = memRun[memNext++];
+	return true;
+}
+
+/**
+ * Merges the sorted runs (on disk, plus an optional one in memory), dropping
+ * duplicates and anything found in the sorted exclude streams, which are only
+ * ever read forwards.
+ */
+static uint64_t MergeRuns(std::vector<UInt64Reader *> &runs,
+						  const std::vector<uint64_t> &memRun,
+						  std::vector<UInt64Reader *> &exclude,
+						  UInt64Writer &out)
+{
+	typedef std::pair<uint64_t, size_t> runHead;
+	std::priority_queue<runHead, std::vector<runHead>, std::greater<runHead> > heads;
+	size_t memNext = 0;
+	// the in-memory run is numbered runs.size()
+	for (size_t x = 0; x <= runs.size(); x++)
+	{
+		uint64_t val;
+		if (NextValue(runs, memRun, memNext, x, val))
+			heads.push(runHead(val, x));
+	}
+	std::vector<uint64_t> excludeHead(exclude.size());
+	std::vector<bool> excludeValid(exclude.size());
+	for (size_t x = 0; x < exclude.size(); x++)
+		excludeValid[x] = exclude[x]->Next(excludeHead[x]);
+
+	bool first = true;
+	uint64_t last = 0, count = 0;
+	while (!heads.empty())
+	{
+		runHead h = heads.top();
+		heads.pop();
+		uint64_t val;
+		if (NextValue(runs, memRun, memNext, h.second, val))
+			heads.push(runHead(val, h.second));
+		if (!first && h.first == last)
+			continue;
+		first = false;
+		last = h.first;
+
+		bool found = false;
+		for (size_t x = 0; x < exclude.size(); x++)
+		{
+			while (excludeValid[x] && excludeHead[x] < last)
+				excludeValid[x] = exclude[x]->Next(excludeHead[x]);
+			if (excludeValid[x] && excludeHead[x] == last)
+				found = true;
+		}
+		if (!found)
+		{
+			out.Add(last);
+			count++;
+		}
+	}
+	return count;
+}
+
+/** Name of the temporary file holding a sorted run **/
+static std::string RunName(const char *tempPrefix, int which)
+{
+	char name[32];
+	sprintf(name, "-r%d.run", which);
+	return std::string(tempPrefix)+name;
+}
+
+int64_t SortUniqueFile(const char *input, const char *output,
+					   const std::vector<std::string> &exclude,
+					   size_t runEntries, const char *tempPrefix)
+{
+	UInt64Reader in;
+	if (!in.Open(input))
+	{
+		printf("Error: unable to open '%s'\n", input);
+		return -1;
+	}
+
+	// sort the input in runs, writing each run to a file
+	std::vector<uint64_t> run;
+	run.reserve(runEntries);
+	int numRuns = 0;
+	bool done = false;
+	while (!done)
+	{
+		run.resize(0);
+		uint64_t val;
+		while (run.size() < runEntries && (done = !in.Next(val)) == false)
+			run.push_back(val);
+		if (run.size() == 0)
+			break;
+		std::sort(run.begin(), run.end());
+		run.erase(std::unique(run.begin(), run.end()), run.end());
+		// if everything fit in one run it is merged straight from memory
+		if (done && numRuns == 0)
+			break;
+		UInt64Writer w;
+		if (!w.Open(RunName(tempPrefix, numRuns).c_str()))
+		{
+			printf("Error: unable to write '%s'\n", RunName(tempPrefix, numRuns).c_str());
+			return -1;
+		}
+		w.Add(&run[0], run.size());
+		if (!w.Close())
+		{
+			printf("Error: unable to write '%s'\n", RunName(tempPrefix, numRuns).c_str());
+			for (int x = 0; x <= numRuns; x++)
+				remove(RunName(tempPrefix, x).c_str());
+			return -1;
+		}
+		run.resize(0);
+		numRuns++;
+	}
+	in.Close();
+
+	std::vector<UInt64Reader *> runs, excludeReaders;
+	for (int x = 0; x < numRuns; x++)
+	{
+		runs.push_back(new UInt64Reader());
+		runs.back()->Open(RunName(tempPrefix, x).c_str());
+	}
+	for (size_t x = 0; x < exclude.size(); x++)
+	{
+		UInt64Reader *r = new UInt64Reader();
+		if (r->Open(exclude[x].c_str()))
+			excludeReaders.push_back(r);
+		else
+			delete r;
+	}
+
+	int64_t result = -1;
+	UInt64Writer out;
+	if (out.Open(output))
+	{
+		result = MergeRuns(runs, run, excludeReaders, out);
+		if (!out.Close())
+		{
+			printf("Error: unable to write '%s'\n", output);
+			result = -1;
+		}
+	}
+	else
+		printf("Error: unable to write '%s'\n", output);
+
+	for (size_t x = 0; x < runs.size(); x++)
+	{
+		delete runs[x];
+		remove(RunName(tempPrefix, (int)x).c_str());
+	}
+	for (size_t x = 0; x < excludeReaders.size(); x++)
+		delete excludeReaders[x];
+	return result;
+}
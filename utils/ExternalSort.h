@@ -0,0 +1,89 @@
+//
+//  ExternalSort.h
+//  hog2 glut
+//
+//  Sequential, buffered I/O on files of 64-bit values, and an external sort
+//  that removes duplicates. These are the building blocks of disk-based
+//  searches (see ExternalBFS), which only ever read and write whole files
+//  front to back so that they are limited by the disk's sequential bandwidth
+//  rather than by seeks or by hashing.
+//
+
+#ifndef EXTERNALSORT_H
+#define EXTERNALSORT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/**
+ Reads a file of uint64_t values in large blocks.
+ **/
+class UInt64Reader {
+public:
+	UInt64Reader(size_t bufferEntries = 1<<16);
+	~UInt64Reader() { Close(); }
+	/** Returns false if the file can't be opened **/
+	bool Open(const char *fname);
+	void Close();
+	inline bool Next(uint64_t &val)
+	{
+		if (next == count && !Fill())
+			return false;
+		val = buffer[next++];
+		return true;
+	}
+private:
+	bool Fill();
+	FILE *f;
+	std::vector<uint64_t> buffer;
+	size_t next, count;
+};
+
+/**
+ Writes a file of uint64_t values in large blocks.
+ **/
+class UInt64Writer {
+public:
+	UInt64Writer(size_t bufferEntries = 1<<16);
+	~UInt64Writer() { Close(); }
+	/** Returns false if the file can't be opened **/
+	bool Open(const char *fname, bool append = false);
+	/**
+	 Flushes the buffer and closes the file. Returns false if any write since
+	 Open failed.
+	 **/
+	bool Close();
+	inline void Add(uint64_t val)
+	{
+		buffer.push_back(val);
+		if (buffer.size() == buffer.capacity())
+			Flush();
+	}
+	void Add(const uint64_t *vals, size_t count);
+	uint64_t GetNumWritten() const { return written+buffer.size(); }
+	/** Set once a write fails; stays set until the next Open **/
+	bool Failed() const { return failed; }
+private:
+	bool Flush();
+	FILE *f;
+	std::vector<uint64_t> buffer;
+	uint64_t written;
+	bool failed;
+};
+
+/**
+ Sorts the values in the file input and removes duplicates, as well as any
+ value that appears in one of the (already sorted) exclude files, writing the
+ result to output. Values are sorted in memory in runs of at most runEntries
+ values; if the input doesn't fit in one run the sorted runs are written to
+ temporary files (tempPrefix followed by the run number) and merged. Missing
+ exclude files are treated as empty. Returns the number of values written, or
+ -1 if a file couldn't be opened or written.
+ **/
+int64_t SortUniqueFile(const char *input, const char *output,
+					   const std::vector<std::string> &exclude,
+					   size_t runEntries, const char *tempPrefix);
+
+#endif
@@ -0,0 +1,93 @@
+//
+//  FixedVector.h
+//  hog2 glut
+//
+//  A vector with a compile-time capacity whose elements are stored inline.
+//  Copying one never allocates, which makes it suitable for search states
+//  that are copied on every expansion. It supports the parts of the
+//  std::vector interface used by the puzzle domains and converts to and
+//  from std::vector<int>.
+//
+
+#ifndef FIXEDVECTOR_H
+#define FIXEDVECTOR_H
+
+#include <stdint.h>
+#include <assert.h>
+#include <vector>
+#include <type_traits>
+
+template <typename T, unsigned int maxSize>
+class FixedVector {
+public:
+	typedef T value_type;
+	typedef T *iterator;
+	typedef const T *const_iterator;
+	typedef T &reference;
+	typedef const T &const_reference;
+	typedef size_t size_type;
+
+	FixedVector() :count(0) {}
+	FixedVector(size_t n, const T &val = T()) :count(0) { resize(n, val); }
+	FixedVector(const std::vector<int> &v) :count(0) { *this = v; }
+	FixedVector &operator=(const std::vector<int> &v)
+	{
+		assert(v.size() <= maxSize);
+		count = v.size();
+		for (size_t x = 0; x < count; x++)
+			items[x] = v[x];
+		return *this;
+	}
+	operator std::vector<int>() const
+	{ return std::vector<int>(begin(), end()); }
+
+	size_t size() const { return count; }
+	static size_t capacity() { return maxSize; }
+	bool empty() const { return count == 0; }
+	void clear() { count = 0; }
+	void resize(size_t n, const T &val = T())
+	{
+		assert(n <= maxSize);
+		for (size_t x = count; x < n; x++)
+			items[x] = val;
+		count = n;
+	}
+	void push_back(const T &val)
+	{ assert(count < maxSize); items[count++] = val; }
+	void pop_back() { count--; }
+
+	T &operator[](size_t which) { return items[which]; }
+	const T &operator[](size_t which) const { return items[which]; }
+	T &front() { return items[0]; }
+	const T &front() const { return items[0]; }
+	T &back() { return items[count-1]; }
+	const T &back() const { return items[count-1]; }
+	T *data() { return items; }
+	const T *data() const { return items; }
+
+	iterator begin() { return items; }
+	iterator end() { return items+count; }
+	const_iterator begin() const { return items; }
+	const_iterator end() const { return items+count; }
+private:
+	typedef typename std::conditional<(maxSize < 256), uint8_t, uint32_t>::type countType;
+	countType count;
+	T items[maxSize];
+};
+
+template <typename T, unsigned int maxSize>
+bool operator==(const FixedVector<T, maxSize> &a, const FixedVector<T, maxSize> &b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t x = 0; x < a.size(); x++)
+		if (a[x] != b[x])
+			return false;
+	return true;
+}
+
+template <typename T, unsigned int maxSize>
+bool operator!=(const FixedVector<T, maxSize> &a, const FixedVector<T, maxSize> &b)
+{ return !(a == b); }
+
+#endif
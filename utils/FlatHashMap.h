@@ -0,0 +1,253 @@
+//
+//  FlatHashMap.h
+//  hog2 glut
+//
+//  An open-addressing hash table for 64-bit keys. Entries live in a single
+//  array (linear probing) with a parallel array of one-byte tags. The tag
+//  array is small enough to stay in cache, so probing for a key that isn't
+//  present rarely misses, and a key is only compared when its tag matches.
+//  Inserting never allocates (apart from growing the table) and erasing uses
+//  backward-shift deletion, so no tombstones are ever left in the table.
+//  The interface follows the parts of __gnu_cxx::hash_map used in hog2, so
+//  it can replace it directly.
+//
+//  As with other open-addressing tables, inserting an element invalidates
+//  references and iterators into the table.
+//
+
+#ifndef FLATHASHMAP_H
+#define FLATHASHMAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+/**
+ Mixes all 64 bits of the key (the MurmurHash3 finalizer). Ranks and
+ packed coordinates are highly structured, so the identity hash clusters
+ badly under linear probing.
+ **/
+struct FlatHash64 {
+	size_t operator()(uint64_t x) const
+	{
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdull;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ull;
+		x ^= x >> 33;
+		return (size_t)x;
+	}
+};
+
+template <typename key, typename value, typename hashFcn = FlatHash64>
+class FlatHashMap {
+public:
+	typedef std::pair<key, value> value_type;
+
+	template <typename mapType, typename entryType>
+	class iteratorBase {
+	public:
+		iteratorBase() :map(0), loc(0) {}
+		iteratorBase(mapType *m, size_t l) :map(m), loc(l) { SkipEmpty(); }
+		// allows conversion from iterator to const_iterator
+		template <typename m2, typename e2>
+		iteratorBase(const iteratorBase<m2, e2> &i) :map(i.map), loc(i.loc) {}
+		entryType &operator*() const { return map->entries[loc]; }
+		entryType *operator->() const { return &map->entries[loc]; }
+		iteratorBase &operator++() { loc++; SkipEmpty(); return *this; }
+		iteratorBase operator++(int) { iteratorBase tmp = *this; ++(*this); return tmp; }
+		bool operator==(const iteratorBase &i) const { return loc == i.loc; }
+		bool operator!=(const iteratorBase &i) const { return loc != i.loc; }
+		mapType *map;
+		size_t loc;
+	private:
+		void SkipEmpty()
+		{ while (loc < map->tags.size() && map->tags[loc] == 0) loc++; }
+	};
+	typedef iteratorBase<FlatHashMap, value_type> iterator;
+	typedef iteratorBase<const FlatHashMap, const value_type> const_iterator;
+
+	FlatHashMap() :numItems(0), mask(0) {}
+	FlatHashMap(size_t expected) :numItems(0), mask(0) { reserve(expected); }
+
+	size_t size() const { return numItems; }
+	bool empty() const { return numItems == 0; }
+	/** Number of elements that can be stored before the table grows **/
+	size_t capacity() const { return (tags.size()/4)*3; }
+	/** Grows the table so that expected elements fit without rehashing **/
+	void reserve(size_t expected);
+	/** Removes all elements but keeps the memory for reuse **/
+	void clear();
+
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(this, tags.size()); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, tags.size()); }
+
+	iterator find(const key &k)
+	{ return iterator(this, Find(k)); }
+	const_iterator find(const key &k) const
+	{ return const_iterator(this, Find(k)); }
+	size_t count(const key &k) const { return (Find(k) != tags.size())?1:0; }
+
+	value &operator[](const key &k);
+	std::pair<iterator, bool> insert(const value_type &v);
+	size_t erase(const key &k);
+	void erase(iterator it) { erase(it->first); }
+	void swap(FlatHashMap &m);
+private:
+	// the top bit marks a used slot; the other 7 bits are taken from the hash
+	static uint8_t Tag(size_t h) { return 0x80|(h>>57); }
+	size_t Find(const key &k) const;
+	size_t Insert(const key &k, bool &added);
+	void Grow(size_t newSize);
+
+	std::vector<uint8_t> tags;
+	std::vector<value_type> entries;
+	size_t numItems;
+	size_t mask;
+	hashFcn hash;
+};
+
+template <typename key, typename value, typename hashFcn>
+void FlatHashMap<key, value, hashFcn>::reserve(size_t expected)
+{
+	size_t newSize = 16;
+	while ((newSize/4)*3 < expected)
+		newSize *= 2;
+	if (newSize > tags.size())
+		Grow(newSize);
+}
+
+template <typename key, typename value, typename hashFcn>
+void FlatHashMap<key, value, hashFcn>::clear()
+{
+	if (numItems == 0)
+		return;
+	for (size_t x = 0; x < tags.size(); x++)
+	{
+		if (tags[x])
+		{
+			tags[x] = 0;
+			entries[x] = value_type();
+		}
+	}
+	numItems = 0;
+}
+
+template <typename key, typename value, typename hashFcn>
+size_t FlatHashMap<key, value, hashFcn>::Find(const key &k) const
+{
+	if (numItems == 0)
+		return tags.size();
+	size_t h = hash(k);
+	uint8_t tag = Tag(h);
+	for (size_t loc = h&mask; ; loc = (loc+1)&mask)
+	{
+		if (tags[loc] == 0)
+			return tags.size();
+		if (tags[loc] == tag && entries[loc].first == k)
+			return loc;
+	}
+}
+
+template <typename key, typename value, typename hashFcn>
+size_t FlatHashMap<key, value, hashFcn>::Insert(const key &k, bool &added)
+{
+	if (numItems+1 > capacity())
+		Grow(tags.size() == 0?16:tags.size()*2);
+	size_t h = hash(k);
+	uint8_t tag = Tag(h);
+	for (size_t loc = h&mask; ; loc = (loc+1)&mask)
+	{
+		if (tags[loc] == 0)
+		{
+			tags[loc] = tag;
+			entries[loc].first = k;
+			numItems++;
+			added = true;
+			return loc;
+		}
+		if (tags[loc] == tag && entries[loc].first == k)
+		{
+			added = false;
+			return loc;
+		}
+	}
+}
+
+template <typename key, typename value, typename hashFcn>
+value &FlatHashMap<key, value, hashFcn>::operator[](const key &k)
+{
+	bool added;
+	return entries[Insert(k, added)].second;
+}
+
+template <typename key, typename value, typename hashFcn>
+std::pair<typename FlatHashMap<key, value, hashFcn>::iterator, bool> FlatHashMap<key, value, hashFcn>::insert(const value_type &v)
+{
+	bool added;
+	size_t loc = Insert(v.first, added);
+	if (added)
+		entries[loc].second = v.second;
+	return std::make_pair(iterator(this, loc), added);
+}
+
+/**
+ Removes k from the table. Later elements of the probe sequence are shifted
+ back into the hole so that lookups never need to skip deleted slots.
+ **/
+template <typename key, typename value, typename hashFcn>
+size_t FlatHashMap<key, value, hashFcn>::erase(const key &k)
+{
+	size_t hole = Find(k);
+	if (hole == tags.size())
+		return 0;
+	for (size_t loc = (hole+1)&mask; tags[loc] != 0; loc = (loc+1)&mask)
+	{
+		size_t home = hash(entries[loc].first)&mask;
+		// move the entry if its home slot is not cyclically in (hole, loc]
+		if (((loc-home)&mask) >= ((loc-hole)&mask))
+		{
+			tags[hole] = tags[loc];
+			entries[hole] = entries[loc];
+			hole = loc;
+		}
+	}
+	tags[hole] = 0;
+	entries[hole] = value_type();
+	numItems--;
+	return 1;
+}
+
+template <typename key, typename value, typename hashFcn>
+void FlatHashMap<key, value, hashFcn>::swap(FlatHashMap &m)
+{
+	tags.swap(m.tags);
+	entries.swap(m.entries);
+	std::swap(numItems, m.numItems);
+	std::swap(mask, m.mask);
+}
+
+template <typename key, typename value, typename hashFcn>
+void FlatHashMap<key, value, hashFcn>::Grow(size_t newSize)
+{
+	std::vector<uint8_t> oldTags(newSize, 0);
+	std::vector<value_type> oldEntries(newSize);
+	oldTags.swap(tags);
+	oldEntries.swap(entries);
+	mask = newSize-1;
+	for (size_t x = 0; x < oldTags.size(); x++)
+	{
+		if (oldTags[x] == 0)
+			continue;
+		size_t loc = hash(oldEntries[x].first)&mask;
+		while (tags[loc] != 0)
+			loc = (loc+1)&mask;
+		tags[loc] = oldTags[x];
+		entries[loc] = oldEntries[x];
+	}
+}
+
+#endif
@@ -11,5 +11,11 @@
 
 uint8_t *GetMMAP(const char *filename, uint64_t mapSizeBytes, int &fd, bool zero = false);
 void CloseMMap(uint8_t *mem, uint64_t mapSizeBytes, int fd);
+/**
+ Maps an existing file read-only and shared, so that every process mapping the
+ same file uses the same pages in the OS page cache. Returns 0 on failure;
+ mapSizeBytes is set to the size of the file.
+ **/
+uint8_t *GetReadOnlyMMAP(const char *filename, uint64_t &mapSizeBytes, int &fd);
 
 #endif
@@ -104,6 +104,7 @@ Map::Map(long _width, long _height)
 	dList = 0;
 	updated = true;
 	revision = 0;
+	UpdateGroundBitmap();
 	//	numAbstractions = 1;
 	//	pathgraph = 0;
 }
@@ -133,6 +134,8 @@ Map::Map(Map *m)
 	for (int x = 0; x < width; x++)
 		for (int y = 0; y < height; y++)
 			land[x][y] = m->land[x][y];
+	groundBits = m->groundBits;
+	groundStride = m->groundStride;
 }
 
 /** 
@@ -215,6 +218,7 @@ void Map::Scale(long newWidth, long newHeight)
 	revision++;
 	updated = true;
 	map_name[0] = 0;
+	UpdateGroundBitmap();
 }
 
 void Map::Trim()
@@ -254,6 +258,7 @@ void Map::Trim()
 	revision++;
 	updated = true;
 	map_name[0] = 0;
+	UpdateGroundBitmap();
 }
 
 
@@ -291,6 +296,7 @@ void Map::Load(const char *filename)
 		dList = 0;
 		updated = true;
 		map_name[0] = 0;
+		UpdateGroundBitmap();
 	}
 }
 
@@ -306,6 +312,8 @@ void Map::Load(FILE *f)
 		delete [] land;
 		land = 0;
 	}
+	// rebuilt once the new tiles are loaded
+	groundBits.clear();
 	
 	char format[32];
 	// ADD ERROR HANDLING HERE
@@ -319,15 +327,18 @@ void Map::Load(FILE *f)
 			loadOctileCorner(f, height, width);
 		else if (strcmp(format, "raw") == 0)
 			loadRaw(f, height, width);
+		UpdateGroundBitmap();
 		return;
 	}
 	if (tryLoadRollingStone(f))
 	{
+		UpdateGroundBitmap();
 		return;
 	}
 	if (tryDragonAge(f))
 	{
 		//Trim();
+		UpdateGroundBitmap();
 		return;
 	}
 
@@ -342,6 +353,7 @@ void Map::Load(FILE *f)
 		dList = 0;
 		updated = true;
 		map_name[0] = 0;
+		UpdateGroundBitmap();
 	}
 }
 
@@ -1106,7 +1118,7 @@ long Map::GetTerrainType(long x, long y, tEdge side) const
 void Map::SetTerrainType(long x, long y, tTerrain type, tSplitSide split)
 {
 	if ((x >= width)||(x<0)) return;
-	if ((y >= height)||(x<0)) return;
+	if ((y >= height)||(y<0)) return;
 	revision++;
 	updated = true;
 	map_name[0] = 0;
@@ -1128,6 +1140,36 @@ void Map::SetTerrainType(long x, long y, tTerrain type, tSplitSide split)
 			land[x][y].tile2.type = type;
 			break;
 	}
+	SetGroundBit(x, y);
+}
+
+/**
+ * Rebuilds the bitmap of ground tiles used by GetGroundNeighbors. Must be
+ * called whenever the tiles are replaced wholesale.
+ */
+void Map::UpdateGroundBitmap()
+{
+	groundStride = ((width+2+63)/64)*64;
+	// an extra word so that reading across a word boundary in the last row
+	// stays in range
+	groundBits.assign((groundStride/64)*(height+2)+1, 0);
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			SetGroundBit(x, y);
+}
+
+/**
+ * Updates the ground bit for (x, y) from its terrain type.
+ */
+void Map::SetGroundBit(long x, long y)
+{
+	if (groundBits.size() == 0)
+		return;
+	uint64_t bit = (uint64_t)(y+1)*groundStride+(x+1);
+	if ((GetTerrainType(x, y)>>terrainBits) == (kGround>>terrainBits))
+		groundBits[bit>>6] |= (1ull<<(bit&63));
+	else
+		groundBits[bit>>6] &= ~(1ull<<(bit&63));
 }
 
 /** 
@@ -35,6 +35,7 @@ static const double ONE_OVER_ROOT_TWO = 1.0/ROOT_TWO;//0.707106781f;
 #include <unistd.h>
 #include <iostream>
 #include <stdint.h>
+#include <vector>
 
 #include "GLUtil.h"
 //#include "Graph.h"
@@ -130,6 +131,19 @@ public:
 	tSplit split;
 };
 
+// bits of the 3x3 neighborhood returned by Map::GetGroundNeighbors
+enum {
+	kNeighborNW = 0x001,
+	kNeighborN = 0x002,
+	kNeighborNE = 0x004,
+	kNeighborW = 0x008,
+	kNeighborCenter = 0x010,
+	kNeighborE = 0x020,
+	kNeighborSW = 0x040,
+	kNeighborS = 0x080,
+	kNeighborSE = 0x100
+};
+
 enum tMapType {
 	kOctile,
 	kOctileCorner,
@@ -218,6 +232,14 @@ public:
 	bool AdjacentCorners(long x, long y, tCorner corner) const;
 	// returns whether we can step between two locations or not
 	bool CanStep(long x1, long y1, long x2, long y2) const;
+	/**
+	 * For octile maps, returns the 3x3 block of cells around a ground tile
+	 * that are also ground, using the kNeighbor bits. On those maps a set
+	 * bit means exactly that CanStep() from (x, y) to that cell is true.
+	 * Returns false (and mask should be ignored) if (x, y) isn't a ground tile of an
+	 * octile map, in which case CanStep() has to be used.
+	 */
+	inline bool GetGroundNeighbors(long x, long y, unsigned int &mask) const;
 	
 	void OpenGLDraw(tDisplay how = kPolygons) const;
 	bool GetOpenGLCoord(int _x, int _y, GLdouble &x, GLdouble &y, GLdouble &z, GLdouble &radius) const;
@@ -248,8 +270,14 @@ private:
 	bool isLegalStone(char c);
 	void paintRoomInside(int x, int y);
 	void drawLandQuickly() const;
+	void UpdateGroundBitmap();
+	void SetGroundBit(long x, long y);
 	int width, height;
 	Tile **land;
+	// one bit per tile, set for ground tiles, with a border of empty bits
+	// around the map so that neighbors never need bounds checks
+	std::vector<uint64_t> groundBits;
+	long groundStride; // in bits
 	bool drawLand;
 	mutable GLuint dList;
 	mutable bool updated;
@@ -260,4 +288,24 @@ private:
 	tTileset tileSet;
 };
 
+inline bool Map::GetGroundNeighbors(long x, long y, unsigned int &mask) const
+{
+	if (mapType != kOctile || groundBits.size() == 0 ||
+		(x < 0) || (x >= width) || (y < 0) || (y >= height))
+		return false;
+	// the bit for tile (x, y) is at (y+1)*groundStride+(x+1), so the row
+	// above (x-1, y-1) starts at y*groundStride+x
+	uint64_t bit = (uint64_t)y*groundStride+x;
+	mask = 0;
+	for (int row = 0; row < 3; row++, bit += groundStride)
+	{
+		unsigned int offset = bit&63;
+		uint64_t bits = groundBits[bit>>6]>>offset;
+		if (offset > 61)
+			bits |= groundBits[(bit>>6)+1]<<(64-offset);
+		mask |= (bits&0x7)<<(3*row);
+	}
+	return (mask&kNeighborCenter) != 0;
+}
+
 #endif
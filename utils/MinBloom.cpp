@@ -10,7 +10,11 @@
 
 #include <cmath>
 #include <limits>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
 #include "Bloom.h"
+#include "MMapUtil.h"
 
 // [8 possible hashes][16x 4-bit segments][16 values for 4 bits]
 static uint64_t salt[8] = {0x6B8B4567327B23C6ull, 0x643C986966334873ull, 0x74B0DC5119495CFFull, 0x2AE8944A625558ECull, 0x238E1F2946E87CCDull, 0x3D1B58BA507ED7ABull, 0x2EB141F241B71EFBull, 0x79E2A9E37545E146ull};
@@ -26,30 +30,53 @@ static uint64_t zobrist[8][256] = {
 };
 
 
-MinBloomFilter::MinBloomFilter(uint64_t filterSize, int numHash, bool save, bool zero)
+MinBloomFilter::MinBloomFilter(uint64_t filterSize, int numHash, bool save, bool zero, bloomLayout layout)
 {
 	this->filterSize = filterSize;
 	this->numHash = numHash;
     saveAtExit = save;
-	bits = new FourBitArray(filterSize);
-	bits->FillMax();
+	this->layout = layout;
+	if (layout == kBlockedBloom)
+		LimitBlockedHashes(numHash);
+	bits = 0;
+	blocks = 0;
+	mapped = 0;
+	if (layout == kBlockedBloom)
+	{
+		AllocateBlocks();
+	}
+	else {
+		bits = new FourBitArray(filterSize);
+		bits->FillMax();
+	}
 }
 
-MinBloomFilter::MinBloomFilter(uint64_t filterSize, int numHash, const char *loadPrefix)
+MinBloomFilter::MinBloomFilter(uint64_t filterSize, int numHash, const char *loadPrefix, bloomLayout layout, bool useMMap)
 {
 	this->filterSize = filterSize;
 	this->numHash = numHash;
     saveAtExit = false;
-	bits = new FourBitArray(filterSize);
-	saveAtExit = false;
+	this->layout = layout;
+	if (layout == kBlockedBloom)
+		LimitBlockedHashes(numHash);
+	bits = 0;
+	blocks = 0;
+	mapped = 0;
 	
-	char name[127];
-	sprintf(name, "%smin-bloom-%llu-%d.dat", loadPrefix, filterSize, numHash);
+	char name[255];
+	GetFileName(name, loadPrefix);
 	printf("Loading '%s'\n", name);
-	bits->Read(name);
+	if (layout == kBlockedBloom)
+	{
+		LoadBlocks(name, useMMap);
+	}
+	else {
+		bits = new FourBitArray(filterSize);
+		bits->Read(name);
+	}
 }
 
-MinBloomFilter::MinBloomFilter(uint64_t numItems, double targetFalseRate, bool save, bool zero)
+MinBloomFilter::MinBloomFilter(uint64_t numItems, double targetFalseRate, bool save, bool zero, bloomLayout layout)
 {
 	double min_m = std::numeric_limits<double>::infinity();
 	double min_k = 0.0;
@@ -71,7 +98,15 @@ MinBloomFilter::MinBloomFilter(uint64_t numItems, double targetFalseRate, bool s
 	numHash = static_cast<unsigned int>(min_k);
 	filterSize = static_cast<unsigned long long int>(min_m);
 	saveAtExit = save;
-	if (0)
+	this->layout = layout;
+	bits = 0;
+	blocks = 0;
+	mapped = 0;
+	if (layout == kBlockedBloom)
+	{
+		AllocateBlocks();
+	}
+	else if (0)
 	{
 		//		char name[127];
 		//		sprintf(name, "/tmp/bloom-%llu-%d.dat", filterSize, numHash);
@@ -86,23 +121,104 @@ MinBloomFilter::~MinBloomFilter()
 {
 	if (saveAtExit)
 	{
-		char name[127];
-		sprintf(name, "min-bloom-%llu-%d.dat", filterSize, numHash);
+		char name[255];
+		GetFileName(name, "");
 		printf("Writing to '%s'\n", name);
-		bits->Write(name);
+		if (layout == kBlockedBloom)
+		{
+			FILE *f = fopen(name, "w+");
+			if (f == 0 || fwrite(blocks, bloomBlockBytes, numBlocks, f) != numBlocks)
+				printf("File write error (%s)\n", name);
+			if (f)
+				fclose(f);
+		}
+		else {
+			bits->Write(name);
+		}
 	}
 	delete bits;
 	bits = 0;
+	if (mapped)
+		CloseMMap(mapped, numBlocks*bloomBlockBytes, mapFD);
+	else
+		free(blocks);
+	blocks = 0;
+}
+
+void MinBloomFilter::GetFileName(char *name, const char *prefix)
+{
+	if (layout == kBlockedBloom)
+		sprintf(name, "%smin-bloom-blocked-%llu-%d.dat", prefix, (unsigned long long)filterSize, numHash);
+	else
+		sprintf(name, "%smin-bloom-%llu-%d.dat", prefix, (unsigned long long)filterSize, numHash);
+}
+
+/** Blocks are aligned to cache lines and start out with every entry at max **/
+void MinBloomFilter::AllocateBlocks()
+{
+	numBlocks = (filterSize+bloomBlockBytes*2-1)/(bloomBlockBytes*2);
+	void *mem = 0;
+	if (posix_memalign(&mem, bloomBlockBytes, numBlocks*bloomBlockBytes) != 0)
+	{
+		printf("Unable to allocate %llu bytes for bloom filter\n", (unsigned long long)(numBlocks*bloomBlockBytes));
+		exit(0);
+	}
+	blocks = (uint8_t*)mem;
+	memset(blocks, 0xFF, numBlocks*bloomBlockBytes);
+}
+
+void MinBloomFilter::LoadBlocks(const char *name, bool useMMap)
+{
+	numBlocks = (filterSize+bloomBlockBytes*2-1)/(bloomBlockBytes*2);
+	if (useMMap)
+	{
+		uint64_t fileSize = 0;
+		mapped = GetReadOnlyMMAP(name, fileSize, mapFD);
+		if (mapped != 0 && fileSize != numBlocks*bloomBlockBytes)
+		{
+			CloseMMap(mapped, fileSize, mapFD);
+			mapped = 0;
+		}
+		if (mapped == 0)
+		{
+			printf("File read error (%s)\n", name);
+			exit(0);
+		}
+		blocks = mapped;
+		return;
+	}
+	if (blocks == 0)
+		AllocateBlocks();
+	FILE *f = fopen(name, "r");
+	if (f == 0 || fread(blocks, bloomBlockBytes, numBlocks, f) != numBlocks)
+	{
+		printf("File read error (%s)\n", name);
+		exit(0);
+	}
+	fclose(f);
 }
 
 void MinBloomFilter::Analyze()
 {
-	uint64_t entries = bits->Size();
-	uint64_t setEntries = 0;
-	for (uint64_t x = 0; x < entries; x++)
+	uint64_t entries, setEntries = 0;
+	if (layout == kBlockedBloom)
 	{
-		if (bits->Get(x) != 0xF)
-			setEntries++;
+		entries = numBlocks*bloomBlockBytes*2;
+		for (uint64_t x = 0; x < numBlocks*bloomBlockBytes; x++)
+		{
+			if ((blocks[x]&0xF) != 0xF)
+				setEntries++;
+			if ((blocks[x]>>4) != 0xF)
+				setEntries++;
+		}
+	}
+	else {
+		entries = bits->Size();
+		for (uint64_t x = 0; x < entries; x++)
+		{
+			if (bits->Get(x) != 0xF)
+				setEntries++;
+		}
 	}
 	printf("%llu of %llu entries set. (%1.2f%%)\n", setEntries, entries, 100.0*double(setEntries)/double(entries));
 }
@@ -111,12 +227,33 @@ void MinBloomFilter::Load()
 {
 	saveAtExit = false;
 	char name[127];
+	if (layout == kBlockedBloom)
+	{
+		GetFileName(name, "");
+		if (mapped == 0)
+			LoadBlocks(name, false);
+		return;
+	}
 	sprintf(name, "bloom-%llu-%d.dat", filterSize, numHash);
 	bits->Read(name);
 }
 
 void MinBloomFilter::Insert(uint64_t item, int depth)
 {
+	if (layout == kBlockedBloom)
+	{
+		assert(mapped == 0);
+		uint8_t *block = &blocks[GetBloomBlock(item, numBlocks)*bloomBlockBytes];
+		for (int x = 0; x < numHash; x++)
+		{
+			uint64_t offset = GetBloomOffset(item, x, bloomBlockBitsPower-2);
+			int shift = 4*(offset&1);
+			int val = (block[offset>>1]>>shift)&0xF;
+			if (depth < val)
+				block[offset>>1] = (block[offset>>1]&~(0xF<<shift))|(depth<<shift);
+		}
+		return;
+	}
 	for (int x = 0; x < numHash; x++)
 	{
 		uint64_t hash = Hash(item, x)%filterSize;
@@ -128,6 +265,16 @@ void MinBloomFilter::Insert(uint64_t item, int depth)
 int MinBloomFilter::Contains(uint64_t item)
 {
 	uint8_t max = 0;
+	if (layout == kBlockedBloom)
+	{
+		const uint8_t *block = &blocks[GetBloomBlock(item, numBlocks)*bloomBlockBytes];
+		for (int x = 0; x < numHash; x++)
+		{
+			uint64_t offset = GetBloomOffset(item, x, bloomBlockBitsPower-2);
+			max = std::max(max, (uint8_t)((block[offset>>1]>>(4*(offset&1)))&0xF));
+		}
+		return max;
+	}
 	for (int x = 0; x < numHash; x++)
 	{
 		max = std::max(max, bits->Get(Hash(item, x)%filterSize));
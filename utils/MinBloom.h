@@ -11,25 +11,42 @@
 
 #include <iostream>
 #include "FourBitArray.h"
+#include "Bloom.h"
 
+/**
+ * A bloom filter of 4-bit depths which returns the maximum of the depths
+ * stored at the hashed locations. In the blocked layout all of the locations
+ * of an item are inside one 64-byte block (128 entries).
+ */
 class MinBloomFilter {
 public:
-	MinBloomFilter(uint64_t numItems, double targetHitRate, bool save, bool zero=true);
-	MinBloomFilter(uint64_t filterSize, int numHash, bool save, bool zero=true);
-	MinBloomFilter(uint64_t filterSize, int numHash, const char *loadPrefix);
+	MinBloomFilter(uint64_t numItems, double targetHitRate, bool save, bool zero=true, bloomLayout layout=kStandardBloom);
+	MinBloomFilter(uint64_t filterSize, int numHash, bool save, bool zero=true, bloomLayout layout=kStandardBloom);
+	MinBloomFilter(uint64_t filterSize, int numHash, const char *loadPrefix, bloomLayout layout=kStandardBloom, bool useMMap=false);
 	~MinBloomFilter();
 	void Analyze();
 	void Insert(uint64_t item, int depth);
 	int Contains(uint64_t item);
 	uint64_t GetStorage() { return filterSize; }
 	int GetNumHash() { return numHash; }
+	bloomLayout GetLayout() { return layout; }
 	void Load();
 private:
 	uint64_t Hash(uint64_t value, int which);
+	void GetFileName(char *name, const char *prefix);
+	void AllocateBlocks();
+	void LoadBlocks(const char *name, bool useMMap);
 	int numHash;
 	bool saveAtExit;
 	uint64_t filterSize;
 	FourBitArray *bits;
+
+	// blocked layout
+	bloomLayout layout;
+	uint64_t numBlocks;
+	uint8_t *blocks;
+	uint8_t *mapped; // 0 unless the blocks are memory mapped
+	int mapFD;
 };
 
 #endif /* defined(__hog2_glut__MinBloom__) */
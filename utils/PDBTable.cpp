@@ -0,0 +1,391 @@
+//
+//  PDBTable.cpp
+//  hog2 glut
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <utility>
+#include "PDBTable.h"
+#include "MMapUtil.h"
+#include "RangeCompression.h"
+
+static const char kPDBMagic[8] = {'H', 'O', 'G', 'P', 'D', 'B', 0, 0};
+
+PDBTable::mappedFile::~mappedFile()
+{
+	CloseMMap(mem, size, fd);
+}
+
+PDBTable::PDBTable()
+:mem(0), entries(0), storage(kPDB8Bit), decodableMod3(false)
+{
+	for (int x = 0; x < 16; x++)
+		valueMap[x] = x;
+}
+
+PDBTable::PDBTable(const PDBTable &t)
+:data(t.data), mapping(t.mapping), entries(t.entries), storage(t.storage), decodableMod3(t.decodableMod3)
+{
+	// copies of a mapped table share the mapping
+	mem = mapping?t.mem:data.data();
+	memcpy(valueMap, t.valueMap, sizeof(valueMap));
+}
+
+PDBTable &PDBTable::operator=(const PDBTable &t)
+{
+	if (this == &t)
+		return *this;
+	data = t.data;
+	mapping = t.mapping;
+	entries = t.entries;
+	storage = t.storage;
+	decodableMod3 = t.decodableMod3;
+	memcpy(valueMap, t.valueMap, sizeof(valueMap));
+	mem = mapping?t.mem:data.data();
+	return *this;
+}
+
+PDBTable::PDBTable(PDBTable &&t) noexcept
+:data(std::move(t.data)), mapping(std::move(t.mapping)), mem(t.mem), entries(t.entries), storage(t.storage),
+decodableMod3(t.decodableMod3)
+{
+	memcpy(valueMap, t.valueMap, sizeof(valueMap));
+	t.mem = 0;
+	t.entries = 0;
+}
+
+PDBTable &PDBTable::operator=(PDBTable &&t) noexcept
+{
+	if (this == &t)
+		return *this;
+	data = std::move(t.data);
+	mapping = std::move(t.mapping);
+	mem = t.mem;
+	entries = t.entries;
+	storage = t.storage;
+	decodableMod3 = t.decodableMod3;
+	memcpy(valueMap, t.valueMap, sizeof(valueMap));
+	t.mem = 0;
+	t.entries = 0;
+	return *this;
+}
+
+uint64_t PDBTable::StorageBytes(uint64_t entries, PDBStorageType t)
+{
+	switch (t)
+	{
+		case kPDB4Bit: return (entries+1)/2;
+		case kPDB2BitMod3: return (entries+3)/4;
+		default: return entries;
+	}
+}
+
+int PDBTable::GetBitsPerEntry() const
+{
+	switch (storage)
+	{
+		case kPDB4Bit: return 4;
+		case kPDB2BitMod3: return 2;
+		default: return 8;
+	}
+}
+
+void PDBTable::resize(uint64_t count)
+{
+	if (mapping)
+		MakeWritable();
+	data.resize(StorageBytes(count, storage));
+	entries = count;
+	mem = data.data();
+	decodableMod3 = false;
+}
+
+uint8_t *PDBTable::GetData()
+{
+	MakeWritable();
+	return data.data();
+}
+
+void PDBTable::MakeWritable()
+{
+	decodableMod3 = false;
+	if (!mapping)
+		return;
+	data.assign(mem, mem+StorageBytes(entries, storage));
+	mapping.reset();
+	mem = data.data();
+}
+
+/**
+ Neighboring entries share a byte, so it is cleared and set with atomic
+ operations; a plain read-modify-write would lose concurrent writes to the
+ other entries of the byte.
+ **/
+void PDBTable::SetPacked(uint64_t index, uint8_t val)
+{
+	if (storage == kPDB2BitMod3)
+	{
+		int shift = (index&3)<<1;
+		__atomic_fetch_and(&data[index>>2], (uint8_t)~(0x3<<shift), __ATOMIC_RELAXED);
+		__atomic_fetch_or(&data[index>>2], (uint8_t)((val%3)<<shift), __ATOMIC_RELAXED);
+		return;
+	}
+	// find the largest value in the table that doesn't exceed val
+	int code = 0;
+	for (int x = 1; x < 16; x++)
+		if (valueMap[x] <= val && valueMap[x] > valueMap[code])
+			code = x;
+	int shift = (index&1)<<2;
+	__atomic_fetch_and(&data[index>>1], (uint8_t)~(0xF<<shift), __ATOMIC_RELAXED);
+	__atomic_fetch_or(&data[index>>1], (uint8_t)(code<<shift), __ATOMIC_RELAXED);
+}
+
+bool PDBTable::Convert(PDBStorageType newType)
+{
+	if (newType == storage)
+		return true;
+	if (storage == kPDB2BitMod3)
+	{
+		printf("Error: cannot expand a mod 3 PDB without the domain\n");
+		return false;
+	}
+
+	std::vector<uint8_t> newData(StorageBytes(entries, newType));
+	uint8_t newMap[16];
+	for (int x = 0; x < 16; x++)
+		newMap[x] = x;
+
+	if (newType == kPDB4Bit)
+	{
+		std::vector<uint64_t> dist(256);
+		for (uint64_t x = 0; x < entries; x++)
+			dist[Get(x)]++;
+		std::vector<int> values;
+		for (int x = 0; x < 256; x++)
+			if (dist[x] != 0)
+				values.push_back(x);
+		if (values.size() > 16)
+		{
+			while (dist.back() == 0)
+				dist.pop_back();
+			GetOptimizedBoundaries(dist, 16, values);
+			decodableMod3 = false;
+			printf("PDB has more than 16 values; rounding down to:");
+			for (unsigned int x = 0; x < values.size(); x++)
+				printf(" %d", values[x]);
+			printf("\n");
+		}
+		// an empty table has no values and keeps the identity map
+		if (values.size() == 0)
+			for (int x = 0; x < 16; x++)
+				values.push_back(x);
+		// unused codes repeat the smallest value so rounding down never picks them
+		for (int x = 0; x < 16; x++)
+			newMap[x] = (x < (int)values.size())?values[x]:values[0];
+
+		// value -> code, rounding down to the nearest stored value
+		uint8_t codes[256];
+		int next = 0;
+		for (int v = 0; v < 256; v++)
+		{
+			while (next+1 < (int)values.size() && values[next+1] <= v)
+				next++;
+			codes[v] = next;
+		}
+		for (uint64_t x = 0; x < entries; x++)
+			newData[x>>1] |= codes[Get(x)]<<((x&1)<<2);
+	}
+	else if (newType == kPDB2BitMod3)
+	{
+		for (uint64_t x = 0; x < entries; x++)
+			newData[x>>2] |= (Get(x)%3)<<((x&3)<<1);
+	}
+	else {
+		for (uint64_t x = 0; x < entries; x++)
+			newData[x] = Get(x);
+	}
+
+	mapping.reset();
+	data.swap(newData);
+	mem = data.data();
+	storage = newType;
+	memcpy(valueMap, newMap, sizeof(valueMap));
+	return true;
+}
+
+void PDBTable::swap(PDBTable &t)
+{
+	data.swap(t.data);
+	mapping.swap(t.mapping);
+	std::swap(entries, t.entries);
+	std::swap(mem, t.mem);
+	std::swap(storage, t.storage);
+	std::swap(decodableMod3, t.decodableMod3);
+	for (int x = 0; x < 16; x++)
+		std::swap(valueMap[x], t.valueMap[x]);
+	// vector::swap keeps the element pointers valid, so mem is still correct
+}
+
+void PDBTable::swap(std::vector<uint8_t> &t)
+{
+	if (mapping)
+		MakeWritable();
+	data.swap(t);
+	entries = data.size();
+	mem = data.data();
+	storage = kPDB8Bit;
+	decodableMod3 = false;
+	for (int x = 0; x < 16; x++)
+		valueMap[x] = x;
+}
+
+bool PDBTable::Write(const char *fname, const PDBFileHeader &h, const std::vector<int> &pattern,
+					 const std::vector<int> &goal) const
+{
+	std::vector<uint8_t> header(kPDBHeaderSize);
+	PDBFileHeader out = h;
+	memcpy(out.magic, kPDBMagic, sizeof(kPDBMagic));
+	out.version = kPDBFileVersion;
+	out.headerSize = kPDBHeaderSize;
+	out.numDistinct = pattern.size();
+	out.puzzleSize = goal.size();
+	out.reserved = 0;
+	out.flags = (h.flags&~kPDBDecodableMod3)|(decodableMod3?kPDBDecodableMod3:0);
+	out.numEntries = entries;
+	out.bitsPerEntry = GetBitsPerEntry();
+	out.storage = storage;
+	memcpy(out.valueMap, valueMap, sizeof(valueMap));
+	if (sizeof(out)+(pattern.size()+goal.size())*sizeof(int32_t) > kPDBHeaderSize)
+	{
+		printf("Error: pattern too large for PDB header\n");
+		return false;
+	}
+	memcpy(&header[0], &out, sizeof(out));
+	for (unsigned int x = 0; x < pattern.size(); x++)
+	{
+		int32_t val = pattern[x];
+		memcpy(&header[sizeof(out)+x*sizeof(int32_t)], &val, sizeof(val));
+	}
+	for (unsigned int x = 0; x < goal.size(); x++)
+	{
+		int32_t val = goal[x];
+		memcpy(&header[sizeof(out)+(pattern.size()+x)*sizeof(int32_t)], &val, sizeof(val));
+	}
+
+	FILE *f = fopen(fname, "w");
+	if (f == 0)
+	{
+		printf("Failed to open pdb '%s' for writing\n", fname);
+		return false;
+	}
+	uint64_t bytes = StorageBytes(entries, storage);
+	bool success = (fwrite(&header[0], sizeof(uint8_t), header.size(), f) == header.size());
+	success = success && (fwrite(mem, sizeof(uint8_t), bytes, f) == bytes);
+	fclose(f);
+	return success;
+}
+
+bool PDBTable::CheckHeader(const uint8_t *mem, uint64_t fileSize, PDBFileHeader &header, std::vector<int> &pattern,
+						   std::vector<int> &goal)
+{
+	if (fileSize < sizeof(header))
+		return false;
+	memcpy(&header, mem, sizeof(header));
+	if (memcmp(header.magic, kPDBMagic, sizeof(kPDBMagic)) != 0)
+		return false;
+	if (header.version != kPDBFileVersion)
+	{
+		printf("PDB file version %u does not match expected version %u\n", header.version, kPDBFileVersion);
+		return false;
+	}
+	if (header.headerSize < sizeof(header)+((uint64_t)header.numDistinct+header.puzzleSize)*sizeof(int32_t) ||
+		header.headerSize > fileSize)
+		return false;
+	if (!(header.storage == kPDB8Bit && header.bitsPerEntry == 8) &&
+		!(header.storage == kPDB4Bit && header.bitsPerEntry == 4) &&
+		!(header.storage == kPDB2BitMod3 && header.bitsPerEntry == 2))
+	{
+		printf("Unsupported PDB entry width (%u bits, storage %u)\n", header.bitsPerEntry, header.storage);
+		return false;
+	}
+	pattern.resize(header.numDistinct);
+	for (unsigned int x = 0; x < header.numDistinct; x++)
+	{
+		int32_t val;
+		memcpy(&val, mem+sizeof(header)+x*sizeof(int32_t), sizeof(val));
+		pattern[x] = val;
+	}
+	goal.resize(header.puzzleSize);
+	for (unsigned int x = 0; x < header.puzzleSize; x++)
+	{
+		int32_t val;
+		memcpy(&val, mem+sizeof(header)+(header.numDistinct+x)*sizeof(int32_t), sizeof(val));
+		goal[x] = val;
+	}
+	return true;
+}
+
+bool PDBTable::ReadHeader(const char *fname, PDBFileHeader &header, std::vector<int> &pattern,
+						  std::vector<int> &goal)
+{
+	FILE *f = fopen(fname, "r");
+	if (f == 0)
+		return false;
+	std::vector<uint8_t> buffer(kPDBHeaderSize);
+	size_t count = fread(&buffer[0], sizeof(uint8_t), buffer.size(), f);
+	fseek(f, 0, SEEK_END);
+	long fileSize = ftell(f);
+	fclose(f);
+	if (count < sizeof(header))
+		return false;
+	buffer.resize(count);
+	return CheckHeader(&buffer[0], fileSize, header, pattern, goal);
+}
+
+bool PDBTable::IsPDBFile(const char *fname)
+{
+	// only the magic is checked, so that a file of another version is
+	// reported as such rather than read as a raw PDB
+	char magic[sizeof(kPDBMagic)];
+	FILE *f = fopen(fname, "r");
+	if (f == 0)
+		return false;
+	size_t count = fread(magic, sizeof(char), sizeof(magic), f);
+	fclose(f);
+	return count == sizeof(magic) && memcmp(magic, kPDBMagic, sizeof(kPDBMagic)) == 0;
+}
+
+bool PDBTable::Map(const char *fname, PDBFileHeader &header, std::vector<int> &pattern, std::vector<int> &goal)
+{
+	uint64_t fileSize;
+	int fd;
+	uint8_t *base = GetReadOnlyMMAP(fname, fileSize, fd);
+	if (base == 0)
+	{
+		printf("Failed to map pdb '%s'\n", fname);
+		return false;
+	}
+	std::shared_ptr<mappedFile> m(new mappedFile(base, fileSize, fd));
+	if (!CheckHeader(base, fileSize, header, pattern, goal))
+	{
+		printf("'%s' is not a valid mapped PDB file\n", fname);
+		return false;
+	}
+	PDBStorageType type = (PDBStorageType)header.storage;
+	if (header.headerSize+StorageBytes(header.numEntries, type) > fileSize)
+	{
+		printf("PDB '%s' is truncated (%llu entries expected)\n", fname, (unsigned long long)header.numEntries);
+		return false;
+	}
+	data.clear();
+	data.shrink_to_fit();
+	mapping = m;
+	mem = base+header.headerSize;
+	entries = header.numEntries;
+	storage = type;
+	decodableMod3 = (header.flags&kPDBDecodableMod3) != 0;
+	memcpy(valueMap, header.valueMap, sizeof(valueMap));
+	return true;
+}
@@ -0,0 +1,192 @@
+//
+//  PDBTable.h
+//  hog2 glut
+//
+//  Storage for a single pattern database. The table either owns its memory
+//  or is a read-only view of a memory-mapped PDB file, in which case lookups
+//  go directly to the (shared) OS page cache.
+//
+//  Entries can be stored with different widths:
+//    kPDB8Bit     one byte per entry
+//    kPDB4Bit     two entries per byte; each nibble indexes a table of up to
+//                 16 heuristic values
+//    kPDB2BitMod3 four entries per byte holding h mod 3. Only valid for
+//                 unit-cost, reversible abstract spaces; the true value has to
+//                 be recovered by the caller (see PermutationPuzzleEnvironment)
+//
+
+#ifndef PDBTABLE_H
+#define PDBTABLE_H
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include <cassert>
+
+const uint32_t kPDBFileVersion = 3;
+const uint32_t kPDBHeaderSize = 4096; // data starts page-aligned in the file
+
+// PDBFileHeader::flags
+const uint32_t kPDBAdditive = 0x1; // built with additive costs; its values are summed, not maxed
+const uint32_t kPDBDecodableMod3 = 0x2; // every value can be recovered from the values mod 3 (see kPDB2BitMod3)
+
+enum PDBStorageType {
+	kPDB8Bit = 0,
+	kPDB4Bit = 1,
+	kPDB2BitMod3 = 2
+};
+
+/**
+ Header at the start of every mapped PDB file. The fixed part is followed by
+ numDistinct 32-bit entries holding the pattern, and then puzzleSize 32-bit
+ entries holding the abstract goal the PDB was built for (-1 for every item
+ outside the pattern). The whole header is padded to kPDBHeaderSize bytes.
+ **/
+struct PDBFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t puzzleSize;
+	uint32_t numDistinct;
+	uint32_t bitsPerEntry;
+	uint32_t compression; // PDBTreeNodeType used to interpret the entries
+	uint32_t compressionFactor;
+	uint32_t storage; // PDBStorageType
+	uint32_t flags;
+	uint32_t reserved; // 0
+	uint64_t numEntries;
+	uint8_t valueMap[16]; // nibble -> value for kPDB4Bit
+};
+
+class PDBTable {
+public:
+	PDBTable();
+	PDBTable(const PDBTable &t);
+	PDBTable &operator=(const PDBTable &t);
+	PDBTable(PDBTable &&t) noexcept;
+	PDBTable &operator=(PDBTable &&t) noexcept;
+	uint64_t size() const { return entries; }
+	/**
+	 Resizes the table, keeping its storage type. A mapped table is first
+	 copied into private memory.
+	 **/
+	void resize(uint64_t count);
+	void clear() { resize(0); }
+	inline uint8_t Get(uint64_t index) const
+	{
+		switch (storage)
+		{
+			case kPDB4Bit: return valueMap[(mem[index>>1]>>((index&1)<<2))&0xF];
+			case kPDB2BitMod3: return (mem[index>>2]>>((index&3)<<1))&0x3;
+			default: return mem[index];
+		}
+	}
+	/**
+	 Issues a prefetch for the byte holding index so that a later Get()
+	 doesn't stall on the cache miss
+	 **/
+	inline void Prefetch(uint64_t index) const
+	{
+		if (index >= entries)
+			return;
+		switch (storage)
+		{
+			case kPDB4Bit: __builtin_prefetch(mem+(index>>1)); break;
+			case kPDB2BitMod3: __builtin_prefetch(mem+(index>>2)); break;
+			default: __builtin_prefetch(mem+index); break;
+		}
+	}
+	/**
+	 The table must be writable (see MakeWritable). Set can then be called
+	 from several threads at once for different indices; in packed tables
+	 the byte shared with neighboring entries is updated atomically.
+	 **/
+	inline void Set(uint64_t index, uint8_t val)
+	{
+		assert(!mapping);
+		if (storage == kPDB8Bit)
+			data[index] = val;
+		else
+			SetPacked(index, val);
+	}
+	/**
+	 Returns a pointer to the (writable) bytes of an 8-bit table, for bulk
+	 reads. A mapped table is first copied into private memory.
+	 **/
+	uint8_t *GetData();
+	/**
+	 Copies a mapped table into private memory so that it can be written;
+	 otherwise only clears the mod 3 flag. Call this before writing to the
+	 table from several threads.
+	 **/
+	void MakeWritable();
+	void swap(PDBTable &t);
+	void swap(std::vector<uint8_t> &t);
+	bool IsMapped() const { return mapping.get() != 0; }
+	/**
+	 True if the entries were checked to be recoverable from their values
+	 mod 3; the flag is stored in the file header. resize, swap, GetData and
+	 MakeWritable clear it, since the entries may change after them.
+	 **/
+	bool IsDecodableMod3() const { return decodableMod3; }
+	void SetDecodableMod3(bool decodable) { decodableMod3 = decodable; }
+	PDBStorageType GetStorageType() const { return storage; }
+	int GetBitsPerEntry() const;
+	/**
+	 Returns the memory used by the entries in bytes
+	 **/
+	uint64_t GetMemoryUsage() const { return StorageBytes(entries, storage); }
+	/**
+	 Changes the storage type of the table. Converting to 4 bits is exact
+	 if the table holds at most 16 distinct values; otherwise values are
+	 rounded down to the 16 values that maximize the average heuristic, which
+	 keeps the heuristic admissible. Converting to 2 bits stores values mod 3.
+	 A 2-bit table cannot be converted back without the domain, so that
+	 returns false.
+	 **/
+	bool Convert(PDBStorageType newType);
+
+	/**
+	 Writes the table with a versioned header so it can later be mapped.
+	 goal is the abstract goal, with one entry per item of the puzzle.
+	 **/
+	bool Write(const char *fname, const PDBFileHeader &header, const std::vector<int> &pattern,
+			   const std::vector<int> &goal) const;
+	/**
+	 Reads the header of a PDB file. Returns false if the file is not a
+	 mapped PDB of the current version.
+	 **/
+	static bool ReadHeader(const char *fname, PDBFileHeader &header, std::vector<int> &pattern,
+						   std::vector<int> &goal);
+	/**
+	 Maps the file read-only. Returns false and leaves the table unchanged
+	 if the header is missing, of another version, or the file is truncated.
+	 **/
+	bool Map(const char *fname, PDBFileHeader &header, std::vector<int> &pattern, std::vector<int> &goal);
+	/**
+	 True if the file starts with the mapped PDB header, of any version;
+	 otherwise it is a PDB in the older raw format.
+	 **/
+	static bool IsPDBFile(const char *fname);
+private:
+	struct mappedFile {
+		mappedFile(uint8_t *m, uint64_t s, int f) :mem(m), size(s), fd(f) {}
+		~mappedFile();
+		uint8_t *mem;
+		uint64_t size;
+		int fd;
+	};
+	static uint64_t StorageBytes(uint64_t entries, PDBStorageType t);
+	void SetPacked(uint64_t index, uint8_t val);
+	static bool CheckHeader(const uint8_t *mem, uint64_t fileSize, PDBFileHeader &header, std::vector<int> &pattern,
+							std::vector<int> &goal);
+	std::vector<uint8_t> data;
+	std::shared_ptr<mappedFile> mapping;
+	const uint8_t *mem;
+	uint64_t entries;
+	PDBStorageType storage;
+	uint8_t valueMap[16];
+	bool decodableMod3;
+};
+
+#endif
@@ -0,0 +1,236 @@
+//
+//  PermutationRanking.h
+//  hog2 glut
+//
+//  Ranking and unranking of permutations and partial permutations (k of n
+//  items), shared by the permutation environments, along with the binomial
+//  coefficients used to rank combinations.
+//
+//  The lexicographic (Lehmer code) functions keep the set of items already
+//  seen in a 64-bit mask, so the digit of each item is its value minus the
+//  popcount of the smaller items seen so far. Ranking is linear in the number
+//  of items instead of the quadratic decrement loop, and produces exactly the
+//  same ranks, so existing pattern databases remain valid. Unranking selects
+//  the d'th unused item from the mask with a branch-free broadword select.
+//  The tables of falling factorials, binomial coefficients and in-byte select
+//  positions are built once, on first use.
+//
+//  The Myrvold-Ruskey functions work on permutations packed four bits per item
+//  into a 64-bit word, as used by the Rubik's cube environments.
+//
+//  All functions are limited to at most 64 items (16 for the packed ones).
+//
+
+#ifndef PERMUTATIONRANKING_H
+#define PERMUTATIONRANKING_H
+
+#include <stdint.h>
+#include <cassert>
+
+const int maxRankItems = 64;
+
+/**
+ * Tables of n!/k! and (n choose k) for 0 <= k <= n <= maxRankItems, and of
+ * the position of the k'th set bit of every byte. Entries which don't fit in
+ * 64 bits wrap around; they are never needed for problems whose ranks fit in
+ * 64 bits.
+ */
+class PermutationRankTables {
+public:
+	static const PermutationRankTables &Get()
+	{
+		static const PermutationRankTables tables;
+		return tables;
+	}
+	uint64_t FallingFactorial(int n, int k) const
+	{
+		assert(k >= 0 && k <= n && n <= maxRankItems);
+		return falling[n][k];
+	}
+	uint64_t Binomial(int n, int k) const
+	{
+		if (k < 0 || k > n)
+			return 0;
+		assert(n <= maxRankItems);
+		return binomial[n][k];
+	}
+	/** Index of the k'th (from 0) set bit of byte, or 8 if there isn't one **/
+	uint8_t SelectInByte(int byte, int k) const
+	{
+		return selectInByte[byte|(k<<8)];
+	}
+private:
+	PermutationRankTables()
+	{
+		for (int n = 0; n <= maxRankItems; n++)
+		{
+			falling[n][n] = 1;
+			for (int k = n-1; k >= 0; k--)
+				falling[n][k] = falling[n][k+1]*(k+1);
+			binomial[n][0] = binomial[n][n] = 1;
+			for (int k = 1; k < n; k++)
+				binomial[n][k] = binomial[n-1][k-1]+binomial[n-1][k];
+		}
+		for (int byte = 0; byte < 256; byte++)
+		{
+			for (int k = 0, bit = 0; k < 8; k++)
+			{
+				while (bit < 8 && !(byte&(1<<bit)))
+					bit++;
+				selectInByte[byte|(k<<8)] = bit;
+				if (bit < 8)
+					bit++;
+			}
+		}
+	}
+	uint8_t selectInByte[256*8];
+	uint64_t falling[maxRankItems+1][maxRankItems+1];
+	uint64_t binomial[maxRankItems+1][maxRankItems+1];
+};
+
+/** Returns n!/k!, the number of ways to place n-k of n items in order **/
+inline uint64_t FallingFactorial(int n, int k)
+{
+	return PermutationRankTables::Get().FallingFactorial(n, k);
+}
+
+/** Returns n choose k, or 0 if k < 0 or k > n **/
+inline uint64_t BinomialCoefficient(int n, int k)
+{
+	return PermutationRankTables::Get().Binomial(n, k);
+}
+
+/**
+ * Returns the index of the k'th (from 0) set bit of bits, without branches:
+ * the prefix popcounts of all eight bytes are computed at once, the byte
+ * holding the bit is the number of prefixes <= k, and the bit within that
+ * byte comes from a table.
+ */
+inline int SelectRankBit(uint64_t bits, int k)
+{
+	const uint64_t ones = 0x0101010101010101ull;
+	const uint64_t highs = 0x8080808080808080ull;
+	uint64_t s = bits-((bits>>1)&0x5555555555555555ull);
+	s = (s&0x3333333333333333ull)+((s>>2)&0x3333333333333333ull);
+	s = (s+(s>>4))&0x0F0F0F0F0F0F0F0Full;
+	uint64_t prefix = s*ones;
+	int place = __builtin_popcountll((((k*ones)|highs)-prefix)&highs)*8;
+	int inByte = k-(int)(((prefix<<8)>>place)&0xFF);
+	return place+PermutationRankTables::Get().SelectInByte((bits>>place)&0xFF, inByte);
+}
+
+/**
+ * Lexicographic rank of the first k items of a permutation of n items. Each
+ * item is in [0, n). With k == n this is the rank of a full permutation,
+ * sum over x of digit(x)*(n-1-x)!; otherwise the digits are weighted by
+ * (n-1-x)!/(n-k)!, giving ranks in [0, n!/(n-k)!).
+ */
+template <typename T>
+inline uint64_t RankPartialPermutation(const T *items, int k, int n)
+{
+	assert(n <= maxRankItems && k <= n);
+	uint64_t seen = 0;
+	uint64_t rank = 0;
+	for (int x = 0; x < k; x++)
+	{
+		uint64_t bit = 1ull<<items[x];
+		rank = rank*(n-x)+(uint64_t)(items[x]-__builtin_popcountll(seen&(bit-1)));
+		seen |= bit;
+	}
+	return rank;
+}
+
+/** Inverse of RankPartialPermutation; writes k items in [0, n) **/
+template <typename T>
+inline void UnrankPartialPermutation(uint64_t rank, T *items, int k, int n)
+{
+	assert(n <= maxRankItems && k <= n);
+	int digits[maxRankItems];
+	int x = k-1;
+	// 32-bit division is much cheaper, and most ranks fit in 32 bits
+	for (; x >= 0 && (rank>>32) != 0; x--)
+	{
+		digits[x] = (int)(rank%(n-x));
+		rank /= (n-x);
+	}
+	uint32_t low = (uint32_t)rank;
+	for (; x >= 0; x--)
+	{
+		digits[x] = (int)(low%(uint32_t)(n-x));
+		low /= (uint32_t)(n-x);
+	}
+	uint64_t unused = (n == 64)?(~0ull):((1ull<<n)-1);
+	for (int y = 0; y < k; y++)
+	{
+		int which = SelectRankBit(unused, digits[y]);
+		items[y] = which;
+		unused ^= 1ull<<which;
+	}
+}
+
+/** Lexicographic rank of a permutation of [0, n), in [0, n!) **/
+template <typename T>
+inline uint64_t RankPermutation(const T *items, int n)
+{
+	return RankPartialPermutation(items, n, n);
+}
+
+/** Inverse of RankPermutation **/
+template <typename T>
+inline void UnrankPermutation(uint64_t rank, T *items, int n)
+{
+	UnrankPartialPermutation(rank, items, n, n);
+}
+
+/** Returns item which of a permutation packed four bits per item **/
+inline int GetPackedItem(uint64_t perm, int which)
+{
+	return (perm>>(which<<2))&0xF;
+}
+
+/** Sets item which of a permutation packed four bits per item **/
+inline void SetPackedItem(uint64_t &perm, int which, int item)
+{
+	perm = (perm&~(0xFull<<(which<<2)))|((uint64_t)item<<(which<<2));
+}
+
+/** Swaps two items of a permutation packed four bits per item **/
+inline void SwapPackedItems(uint64_t &perm, int loc1, int loc2)
+{
+	uint64_t diff = ((perm>>(loc1<<2))^(perm>>(loc2<<2)))&0xF;
+	perm ^= (diff<<(loc1<<2))|(diff<<(loc2<<2));
+}
+
+/**
+ * Myrvold-Ruskey rank of a packed permutation of n items, given the
+ * permutation and its inverse (dual). The rank is in [0, n!).
+ */
+inline uint64_t MRRankPacked(int n, uint64_t perm, uint64_t dual)
+{
+	assert(n <= 16);
+	int digits[16];
+	for (int i = n; i > 1; i--)
+	{
+		int s = GetPackedItem(perm, i-1);
+		digits[i-1] = s;
+		SwapPackedItems(perm, i-1, GetPackedItem(dual, i-1));
+		SwapPackedItems(dual, s, i-1);
+	}
+	uint64_t rank = 0;
+	for (int i = 1; i < n; i++)
+		rank = rank*(i+1)+digits[i];
+	return rank;
+}
+
+/** Inverse of MRRankPacked; perm must hold the identity permutation on entry **/
+inline void MRUnrankPacked(int n, uint64_t rank, uint64_t &perm)
+{
+	assert(n <= 16);
+	for (int i = n; i > 0; i--)
+	{
+		SwapPackedItems(perm, i-1, (int)(rank%i));
+		rank /= i;
+	}
+}
+
+#endif
@@ -46,35 +46,13 @@ StatCollection::StatCollection()
 :categories(), owners(), stats()
 {
 	printOutput = false;
+	streamFile = 0;
+	streamBinary = false;
 }
 
 StatCollection::~StatCollection()
 {
-	/*
-	for (unsigned int x = 0; x < categories.size(); x++)
-	{
-		delete [] categories[x];
-		categories[x] = 0;
-	}
-
-	for (unsigned int x = 0; x < owners.size(); x++)
-	{
-		delete [] owners[x];
-		owners[x] = 0;
-	}
-
-	for (unsigned int x = 0; x < excludeFilters.size(); x++)
-	{
-		delete [] excludeFilters[x];
-		excludeFilters[x] = 0;
-	}
-
-	for (unsigned int x = 0; x < includeFilters.size(); x++)
-	{
-		delete [] includeFilters[x];
-		includeFilters[x] = 0;
-	}
-	*/
+	StopStreaming();
 }
 
 /**
@@ -82,19 +60,13 @@ StatCollection::~StatCollection()
  */
 void StatCollection::AddStat(const char *category, const char *owner, double value)
 {
-	if (!passFilter(category))
+	std::lock_guard<std::mutex> l(lock);
+	int catID = addPassingCategory(category);
+	if (catID == -1)
 		return;
-	int catID, ownerID;
-	catID = addCategory(category);
-	ownerID = addOwner(owner);
-	stats.resize(stats.size()+1);
-	stats[stats.size()-1].category = catID;
-	stats[stats.size()-1].owner = ownerID;
-	stats[stats.size()-1].value.fval = value;
-	stats[stats.size()-1].sType = floatStored;
-	
-	if (printOutput)
-		printf("%s\t%s\t%1.2f\n", category, owner, value);
+	statValue v;
+	v.fval = value;
+	addStat(addSeries(catID, addOwner(owner)), v, floatStored);
 }
 
 /**
@@ -102,60 +74,275 @@ void StatCollection::AddStat(const char *category, const char *owner, double val
  */
 void StatCollection::AddStat(const char *category, const char *owner, long value)
 {
-	if (!passFilter(category))
+	std::lock_guard<std::mutex> l(lock);
+	int catID = addPassingCategory(category);
+	if (catID == -1)
 		return;
-	int catID, ownerID;
-	catID = addCategory(category);
-	ownerID = addOwner(owner);
-	stats.resize(stats.size()+1);
-	stats[stats.size()-1].category = catID;
-	stats[stats.size()-1].owner = ownerID;
-	stats[stats.size()-1].value.lval = value;
-	stats[stats.size()-1].sType = longStored;
-	if (printOutput)
-		printf("%s\t%s\t%ld\n", category, owner, value);
+	statValue v;
+	v.lval = value;
+	addStat(addSeries(catID, addOwner(owner)), v, longStored);
 }
 
 /**
-* Given stats for the category and owner, find an existing stat (chronologically
-																 * backwards search) with the same category and owner, and add this stat to the existing
- * value. If the stat doesn't exist with the same category and owner doesn't exist,
- * a new one will be initialized with the given value.
+* Given stats for the category and owner, find the latest stat with the same
+ * category and owner, and add this stat to the existing value. If the stat
+ * with the same category and owner doesn't exist, a new one will be
+ * initialized with the given value.
  */
 void StatCollection::SumStat(const char *category, const char *owner, double value)
 {
-	statValue *sv = getLastStat(category, owner);
-	if (sv)
+	std::lock_guard<std::mutex> l(lock);
+	int catID = addPassingCategory(category);
+	if (catID == -1)
+		return;
+	statValue v;
+	v.fval = value;
+	sumStat(addSeries(catID, addOwner(owner)), v, floatStored);
+}
+
+/**
+* Given stats for the category and owner, find the latest stat with the same
+ * category and owner, and add this stat to the existing value. If the stat
+ * with the same category and owner doesn't exist, a new one will be
+ * initialized with the given value.
+ */
+void StatCollection::SumStat(const char *category, const char *owner, long value)
+{
+	std::lock_guard<std::mutex> l(lock);
+	int catID = addPassingCategory(category);
+	if (catID == -1)
+		return;
+	statValue v;
+	v.lval = value;
+	sumStat(addSeries(catID, addOwner(owner)), v, longStored);
+}
+
+/**
+* Register a category and owner. The handle stays valid until the collection
+ * is destroyed; filters are checked each time it is used.
+ */
+StatHandle StatCollection::Register(const char *category, const char *owner)
+{
+	std::lock_guard<std::mutex> l(lock);
+	return addSeries(addCategory(category), addOwner(owner));
+}
+
+void StatCollection::Add(StatHandle h, double value)
+{
+	std::lock_guard<std::mutex> l(lock);
+	if ((h == kNoStatHandle) || (!passFilter(series[h].category)))
+		return;
+	statValue v;
+	v.fval = value;
+	addStat(h, v, floatStored);
+}
+
+void StatCollection::Add(StatHandle h, long value)
+{
+	std::lock_guard<std::mutex> l(lock);
+	if ((h == kNoStatHandle) || (!passFilter(series[h].category)))
+		return;
+	statValue v;
+	v.lval = value;
+	addStat(h, v, longStored);
+}
+
+void StatCollection::Sum(StatHandle h, double value)
+{
+	std::lock_guard<std::mutex> l(lock);
+	if ((h == kNoStatHandle) || (!passFilter(series[h].category)))
+		return;
+	statValue v;
+	v.fval = value;
+	sumStat(h, v, floatStored);
+}
+
+void StatCollection::Sum(StatHandle h, long value)
+{
+	std::lock_guard<std::mutex> l(lock);
+	if ((h == kNoStatHandle) || (!passFilter(series[h].category)))
+		return;
+	statValue v;
+	v.lval = value;
+	sumStat(h, v, longStored);
+}
+
+/**
+* Start a new entry for the category and owner of series which. When
+ * streaming, the latest entry is reused instead, after adding its value to
+ * the summary.
+ */
+void StatCollection::addStat(int which, statValue value, storedType sType)
+{
+	statSeries &s = series[which];
+	if (s.last != -1)
 	{
-//		if (sv->sType != floatStored)
-//			printf("Warning: Adding double to value previous stored as long\n");
-		sv->fval += value;
-		if (printOutput)
-			printf("%s\t%s\t%1.2f\n", category, owner, sv->fval);
+		const statistics &prev = stats[s.last];
+		double v = (prev.sType == floatStored)?prev.value.fval:(double)prev.value.lval;
+		if ((s.count == 0) || (v < s.minimum))
+			s.minimum = v;
+		if ((s.count == 0) || (v > s.maximum))
+			s.maximum = v;
+		s.total += v;
+		s.count++;
 	}
-	else
-		AddStat(category, owner, value);
+	if ((streamFile == 0) || (s.last == -1))
+	{
+		s.last = (int)stats.size();
+		stats.resize(stats.size()+1);
+	}
+	statistics &entry = stats[s.last];
+	entry.category = s.category;
+	entry.owner = s.owner;
+	entry.value = value;
+	entry.sType = sType;
+	writeStat(which);
 }
 
 /**
-* Given stats for the category and owner, find an existing stat (chronologically
-																 * backwards search) with the same category and owner, and add this stat to the existing
- * value. If the stat doesn't exist with the same category and owner doesn't exist,
- * a new one will be initialized with the given value.
+* Add value to the latest entry for the category and owner of series which,
+ * or start one if there is none.
  */
-void StatCollection::SumStat(const char *category, const char *owner, long value)
+void StatCollection::sumStat(int which, statValue value, storedType sType)
 {
-	statValue *sv = getLastStat(category, owner);
-	if (sv)
+	int last = series[which].last;
+	if (last == -1)
 	{
-//		if (sv->sType != floatStored)
-//			printf("Warning: Adding long to value previous stored as double\n");
-		sv->lval += value;
-		if (printOutput)
-			printf("%s\t%s\t%ld\n", category, owner, sv->lval);
+		addStat(which, value, sType);
+		return;
 	}
+//		if (stats[last].sType != sType)
+//			printf("Warning: Adding value to one previously stored as a different type\n");
+	if (sType == floatStored)
+		stats[last].value.fval += value.fval;
 	else
-		AddStat(category, owner, value);
+		stats[last].value.lval += value.lval;
+	writeStat(which);
+}
+
+/** Writes a name and a comma, quoting the name if it has a comma or quote **/
+static void writeCSVName(FILE *f, const std::string &name)
+{
+	if (name.find_first_of(",\"\n") == std::string::npos)
+	{
+		fprintf(f, "%s,", name.c_str());
+		return;
+	}
+	fputc('"', f);
+	for (unsigned int x = 0; x < name.size(); x++)
+	{
+		if (name[x] == '"')
+			fputc('"', f);
+		fputc(name[x], f);
+	}
+	fputs("\",", f);
+}
+
+/** Print and stream the latest entry of series which, as requested **/
+void StatCollection::writeStat(int which)
+{
+	if ((!printOutput) && (streamFile == 0))
+		return;
+	const statistics &entry = stats[series[which].last];
+	const std::string &category = categories[entry.category];
+	const std::string &owner = owners[entry.owner];
+	if (printOutput)
+	{
+		if (entry.sType == floatStored)
+			printf("%s\t%s\t%1.2f\n", category.c_str(), owner.c_str(), entry.value.fval);
+		else
+			printf("%s\t%s\t%ld\n", category.c_str(), owner.c_str(), entry.value.lval);
+	}
+	if (streamFile == 0)
+		return;
+	if (streamBinary)
+	{
+		int32_t ids[2] = { entry.category, entry.owner };
+		fputc((entry.sType == floatStored)?'F':'L', streamFile);
+		fwrite(ids, sizeof(ids), 1, streamFile);
+		if (entry.sType == floatStored)
+			fwrite(&entry.value.fval, sizeof(double), 1, streamFile);
+		else {
+			int64_t v = entry.value.lval;
+			fwrite(&v, sizeof(v), 1, streamFile);
+		}
+	}
+	else {
+		writeCSVName(streamFile, category);
+		writeCSVName(streamFile, owner);
+		if (entry.sType == floatStored)
+			fprintf(streamFile, "%1.6f\n", entry.value.fval);
+		else
+			fprintf(streamFile, "%ld\n", entry.value.lval);
+	}
+}
+
+/**
+* In a binary stream, names are given (as kind, 32-bit id, 32-bit length
+ * and the characters) before the first stat that uses them. Stats are 'F'
+ * or 'L', the category and owner ids, and a double or 64-bit integer.
+ */
+void StatCollection::writeName(char kind, int id, const std::string &name)
+{
+	if ((streamFile == 0) || (!streamBinary))
+		return;
+	int32_t header[2] = { id, (int32_t)name.size() };
+	fputc(kind, streamFile);
+	fwrite(header, sizeof(header), 1, streamFile);
+	fwrite(name.c_str(), 1, name.size(), streamFile);
+}
+
+bool StatCollection::StreamToFile(const char *file, bool binary)
+{
+	std::lock_guard<std::mutex> l(lock);
+	if (streamFile)
+		fclose(streamFile);
+	streamFile = fopen(file, binary?"wb":"w");
+	if (streamFile == 0)
+	{
+		printf("File write error (%s)\n", file);
+		return false;
+	}
+	streamBinary = binary;
+	for (unsigned int x = 0; x < categories.size(); x++)
+		writeName('C', x, categories[x]);
+	for (unsigned int x = 0; x < owners.size(); x++)
+		writeName('O', x, owners[x]);
+	return true;
+}
+
+void StatCollection::StopStreaming()
+{
+	std::lock_guard<std::mutex> l(lock);
+	if (streamFile)
+		fclose(streamFile);
+	streamFile = 0;
+}
+
+bool StatCollection::GetSummary(const char *category, const char *owner, statSummary &s) const
+{
+	std::lock_guard<std::mutex> l(lock);
+	return getSummary(lookupSeries(lookupCategory(category), lookupOwner(owner)), s);
+}
+
+bool StatCollection::GetSummary(StatHandle h, statSummary &s) const
+{
+	std::lock_guard<std::mutex> l(lock);
+	return getSummary(h, s);
+}
+
+bool StatCollection::getSummary(int which, statSummary &s) const
+{
+	if ((which == -1) || (series[which].last == -1))
+		return false;
+	const statSeries &ss = series[which];
+	const statistics &entry = stats[ss.last];
+	double v = (entry.sType == floatStored)?entry.value.fval:(double)entry.value.lval;
+	s.count = ss.count+1;
+	s.total = ss.total+v;
+	s.minimum = ((ss.count == 0) || (v < ss.minimum))?v:ss.minimum;
+	s.maximum = ((ss.count == 0) || (v > ss.maximum))?v:ss.maximum;
+	return true;
 }
 
 /**
@@ -163,7 +350,14 @@ void StatCollection::SumStat(const char *category, const char *owner, long value
  */
 void StatCollection::ClearAllStats()
 {
+	std::lock_guard<std::mutex> l(lock);
 	stats.resize(0);
+	for (unsigned int x = 0; x < series.size(); x++)
+	{
+		series[x].last = -1;
+		series[x].count = 0;
+		series[x].total = 0;
+	}
 }
 
 //void StatCollection::clearOwnerStats(char *owner);
@@ -173,6 +367,7 @@ void StatCollection::ClearAllStats()
  */
 int StatCollection::GetNumStats() const
 {
+	std::lock_guard<std::mutex> l(lock);
 	return (int)stats.size();
 }
 
@@ -189,6 +384,7 @@ const statistics *StatCollection::GetStatNum(int which) const
  */
 const char *StatCollection::lookupCategoryID(int id) const
 {
+	std::lock_guard<std::mutex> l(lock);
 	return categories[id].c_str();
 }
 
@@ -197,6 +393,7 @@ const char *StatCollection::lookupCategoryID(int id) const
  */
 const char *StatCollection::LookupOwnerID(int id) const
 {
+	std::lock_guard<std::mutex> l(lock);
 	return owners[id].c_str();
 }
 
@@ -212,22 +409,16 @@ void StatCollection::AddFilter(const char *category)
 
 void StatCollection::AddIncludeFilter(const char *category) // include only added categories
 {
+	std::lock_guard<std::mutex> l(lock);
 	includeFilters.push_back(category);
-	/*
-	char *str = new char [strlen(category)+1];
-	strcpy(str, category);
-	includeFilters.push_back(str);
-	*/
+	categoryFilter.assign(categoryFilter.size(), -1);
 }
 
 void StatCollection::AddExcludeFilter(const char *category) // exclude only added categories
 {
+	std::lock_guard<std::mutex> l(lock);
 	excludeFilters.push_back(category);
-	/*
-	char *str = new char [strlen(category)+1];
-	strcpy(str, category);
-	excludeFilters.push_back(str);
-	*/
+	categoryFilter.assign(categoryFilter.size(), -1);
 }
 
 /**
@@ -235,37 +426,28 @@ void StatCollection::AddExcludeFilter(const char *category) // exclude only adde
  */
 void StatCollection::ClearFilters()
 {
-	/*
-	for (unsigned int x = 0; x < excludeFilters.size(); x++)
-	{
-			delete [] excludeFilters[x];
-			excludeFilters[x] = 0;
-	}
-	for (unsigned int x = 0; x < includeFilters.size(); x++)
-	{
-			delete [] includeFilters[x];
-			includeFilters[x] = 0;
-	}
-	*/
+	std::lock_guard<std::mutex> l(lock);
 	excludeFilters.resize(0);
 	includeFilters.resize(0);
+	categoryFilter.assign(categoryFilter.size(), -1);
 }
 
 /**
-* Given a category, look up the ID. O(# categories) operation. If not found, returns -1.
+* Given a category, look up the ID. If not found, returns -1.
  */
 int StatCollection::LookupCategory(const char *category) const
 {
-	for (unsigned int x = 0; x < categories.size(); x++)
-	{
-		if (categories[x] == category)
-			return x;
-	}
-	//if (strcmp(category, categories[x]) == 0)
-	//return x;
-	return -1;
+	std::lock_guard<std::mutex> l(lock);
+	return lookupCategory(category);
 }
 
+int StatCollection::lookupCategory(const char *category) const
+{
+	std::unordered_map<std::string, int>::const_iterator i = categoryIDs.find(category);
+	if (i == categoryIDs.end())
+		return -1;
+	return i->second;
+}
 
 /**
 * Add a new category to the category list. If the category exists, returns the id.
@@ -273,29 +455,44 @@ int StatCollection::LookupCategory(const char *category) const
  */
 int StatCollection::addCategory(const char *category)
 {
-	int id = LookupCategory(category);
+	int id = lookupCategory(category);
 	if (id != -1)
 		return id;
+	id = (int)categories.size();
 	categories.push_back(category);
-	/*
-	char *str = new char [strlen(category)+1];
-	strcpy(str, category);
-	categories.push_back(str);
-	*/
-	return categories.size()-1;
+	categoryIDs[categories.back()] = id;
+	categoryFilter.push_back(-1);
+	writeName('C', id, categories.back());
+	return id;
 }
 
 /**
-* Given an owner, look up the ID. O(# owners) operation. If not found, returns -1.
+* Returns the id of a category that passes the filters, adding it if needed,
+ * or -1 if its stats aren't saved. Categories that don't pass aren't added.
+ */
+int StatCollection::addPassingCategory(const char *category)
+{
+	int id = lookupCategory(category);
+	if (id == -1)
+		return passFilter(category)?addCategory(category):-1;
+	return passFilter(id)?id:-1;
+}
+
+/**
+* Given an owner, look up the ID. If not found, returns -1.
  */
 int StatCollection::LookupOwner(const char *owner) const
 {
-	for (unsigned int x = 0; x < owners.size(); x++)
-		if (owners[x] == owner)
-			return x;
-		//if (strcmp(owner, owners[x]) == 0)
-		//return x;
-	return -1;
+	std::lock_guard<std::mutex> l(lock);
+	return lookupOwner(owner);
+}
+
+int StatCollection::lookupOwner(const char *owner) const
+{
+	std::unordered_map<std::string, int>::const_iterator i = ownerIDs.find(owner);
+	if (i == ownerIDs.end())
+		return -1;
+	return i->second;
 }
 
 /**
@@ -304,16 +501,45 @@ int StatCollection::LookupOwner(const char *owner) const
  */
 int StatCollection::addOwner(const char *owner)
 {
-	int id = LookupOwner(owner);
+	int id = lookupOwner(owner);
 	if (id != -1)
 		return id;
+	id = (int)owners.size();
 	owners.push_back(owner);
-	/*
-	char *str = new char [strlen(owner)+1];
-	strcpy(str, owner);
-	owners.push_back(str);
-	*/
-	return owners.size()-1;
+	ownerIDs[owners.back()] = id;
+	writeName('O', id, owners.back());
+	return id;
+}
+
+/**
+* The series for a category and owner, or -1 if either is -1 or no stat has
+ * been added for them.
+ */
+int StatCollection::lookupSeries(int category, int owner) const
+{
+	if ((category == -1) || (owner == -1))
+		return -1;
+	std::unordered_map<uint64_t, int>::const_iterator i = seriesIDs.find(((uint64_t)category<<32)|(uint32_t)owner);
+	if (i == seriesIDs.end())
+		return -1;
+	return i->second;
+}
+
+int StatCollection::addSeries(int category, int owner)
+{
+	int id = lookupSeries(category, owner);
+	if (id != -1)
+		return id;
+	statSeries s;
+	s.category = category;
+	s.owner = owner;
+	s.last = -1;
+	s.count = 0;
+	s.total = s.minimum = s.maximum = 0;
+	id = (int)series.size();
+	series.push_back(s);
+	seriesIDs[((uint64_t)category<<32)|(uint32_t)owner] = id;
+	return id;
 }
 
 /**
@@ -322,26 +548,21 @@ int StatCollection::addOwner(const char *owner)
  */
 bool StatCollection::LookupStat(const char *category, const char *owner, statValue &v) const
 {
+	std::lock_guard<std::mutex> l(lock);
 	if (!passFilter(category))
 	{
 		return false;
 	}
-	int catID, ownerID;
-	catID = LookupCategory(category);
-	ownerID = LookupOwner(owner);
-	for (int x = (int)stats.size()-1; x >= 0; x--)
-	{
-		if ((stats[x].category == catID) && (stats[x].owner == ownerID))
-		{
-			v = stats[x].value;
-			return true;
-		}
-	}
-	return false;
+	int which = lookupSeries(lookupCategory(category), lookupOwner(owner));
+	if ((which == -1) || (series[which].last == -1))
+		return false;
+	v = stats[series[which].last].value;
+	return true;
 }
 
 bool StatCollection::LookupStat(unsigned int index, statValue &v) const
 {
+	std::lock_guard<std::mutex> l(lock);
 	if (index < stats.size())
 	{
 		v = stats[index].value;
@@ -351,22 +572,13 @@ bool StatCollection::LookupStat(unsigned int index, statValue &v) const
 }
 
 /**
-* Find the last stat entered that matches the category and owner. Returns pointer
- * to entry.
+* Check (and remember) whether the stats of a category should be saved.
  */
-statValue *StatCollection::getLastStat(const char *category, const char *owner)
+bool StatCollection::passFilter(int category)
 {
-	if (!passFilter(category))
-		return 0;
-	int catID, ownerID;
-	catID = LookupCategory(category);
-	ownerID = LookupOwner(owner);
-	for (int x = (int)stats.size()-1; x >= 0; x--)
-	{
-		if ((stats[x].category == catID) && (stats[x].owner == ownerID))
-			return &stats[x].value;
-	}
-	return 0;
+	if (categoryFilter[category] == -1)
+		categoryFilter[category] = passFilter(categories[category].c_str())?1:0;
+	return (categoryFilter[category] == 1);
 }
 
 /**
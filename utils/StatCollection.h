@@ -27,6 +27,10 @@
 
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include <mutex>
+#include <stdio.h>
+#include <stdint.h>
 
 #ifndef STATCOLLECTION_H
 #define STATCOLLECTION_H
@@ -41,10 +45,27 @@ public:
 	storedType sType;
 };
 
+/** A category and owner registered with StatCollection::Register **/
+typedef int StatHandle;
+const StatHandle kNoStatHandle = -1;
+
+/** Totals over every entry of one category and owner **/
+struct statSummary {
+	long count;
+	double total, minimum, maximum;
+};
+
 /**
 * The StatCollection class is for collecting stats across different parts of
  * the simulation. This class aggregates results and allows access to the
  * collected information.
+ *
+ * Category and owner names are interned, and the latest entry and a summary
+ * of each category and owner are kept, so adding a stat takes constant time
+ * however many have been collected. Code that adds the same stat often can
+ * Register it once and use the handle. Stats can be added from several
+ * threads; the functions that return pointers into the collection
+ * (GetStatNum) should only be used while no stats are being added.
  */ 
 
 class StatCollection {
@@ -55,6 +76,25 @@ public:
 	void AddStat(const char *category, const char *owner, long value);
 	void SumStat(const char *category, const char *owner, double value);
 	void SumStat(const char *category, const char *owner, long value);
+
+	/** Interns the category and owner, for use with Add and Sum **/
+	StatHandle Register(const char *category, const char *owner);
+	void Add(StatHandle h, double value);
+	void Add(StatHandle h, long value);
+	void Sum(StatHandle h, double value);
+	void Sum(StatHandle h, long value);
+	/** Count, total, min and max of the entries; false if there are none **/
+	bool GetSummary(const char *category, const char *owner, statSummary &s) const;
+	bool GetSummary(StatHandle h, statSummary &s) const;
+
+	/**
+	 * Writes each stat to file as it is added (and the new total when one is
+	 * summed), as CSV lines of category,owner,value or as binary records,
+	 * and from then on keeps only the latest entry of each category and owner
+	 * in memory. Returns false if the file can't be opened.
+	 */
+	bool StreamToFile(const char *file, bool binary = false);
+	void StopStreaming();
 	
 	void ClearAllStats();
 	//	void clearOwnerStats(const char *owner); // not define for now; can be defined if needed
@@ -84,17 +124,46 @@ public:
 	void PrintStatsTable() const;
 	
 private:
-		int addCategory(const char *category);
+	StatCollection(const StatCollection &);
+	StatCollection &operator=(const StatCollection &);
+
+	struct statSeries {
+		int category, owner;
+		int last; // index in stats of the latest entry, or -1
+		// the entries before the latest one
+		long count;
+		double total, minimum, maximum;
+	};
+
+	int addCategory(const char *category);
+	int addPassingCategory(const char *category);
 	int addOwner(const char *owner);
+	int lookupCategory(const char *category) const;
+	int lookupOwner(const char *owner) const;
+	int lookupSeries(int category, int owner) const;
+	int addSeries(int category, int owner);
 	bool passFilter(const char *category) const;
-	statValue *getLastStat(const char *category, const char *owner);
+	bool passFilter(int category);
+	void addStat(int which, statValue value, storedType sType);
+	void sumStat(int which, statValue value, storedType sType);
+	bool getSummary(int which, statSummary &s) const;
+	void writeStat(int which);
+	void writeName(char kind, int id, const std::string &name);
 	
 	std::vector<std::string> categories;
 	std::vector<std::string> owners;
+	std::unordered_map<std::string, int> categoryIDs, ownerIDs;
+	std::vector<statSeries> series;
+	std::unordered_map<uint64_t, int> seriesIDs;
+	/** passFilter for each category: 1 pass, 0 fail, -1 not known since the filters changed */
+	std::vector<signed char> categoryFilter;
 	std::vector<std::string> includeFilters;
 	std::vector<std::string> excludeFilters;
 	std::vector<statistics> stats;
 	bool printOutput;
+	FILE *streamFile;
+	bool streamBinary;
+	mutable std::mutex lock;
 };
 
 #endif
@@ -155,81 +155,35 @@ void measureAverageRatio(StatCollection *stats)
  */
 double SumStatEntries(StatCollection *stats, const char *category, const char *owner)
 {
-	double sum = 0.0;
-	int catID, ownerID;
-	catID = stats->LookupCategory(category);
-	ownerID = stats->LookupOwner(owner);
-	
-	for (int x = 0; x < (int)stats->GetNumStats(); x++)
-	{
-		if ((stats->GetStatNum(x)->category == catID) && (stats->GetStatNum(x)->owner == ownerID))
-		{
-			if (stats->GetStatNum(x)->sType == floatStored)
-				sum += stats->GetStatNum(x)->value.fval;
-			else
-				sum += (double)stats->GetStatNum(x)->value.lval;
-		}
-	}
-	
-	return sum;
+	statSummary s;
+	if (stats->GetSummary(category, owner, s))
+		return s.total;
+	return 0.0;
 }
 
 double maxStatEntries(StatCollection *stats, const char *category, const char *owner)
 {
 	double maxval = -9999999999.9;
-	int catID, ownerID;
-	catID = stats->LookupCategory(category);
-	ownerID = stats->LookupOwner(owner);
-	
-	for (int x = 0; x < (int)stats->GetNumStats(); x++)
-	{
-		if ((stats->GetStatNum(x)->category == catID) && (stats->GetStatNum(x)->owner == ownerID))
-		{
-			if (stats->GetStatNum(x)->sType == floatStored)
-				maxval = max(maxval, stats->GetStatNum(x)->value.fval);
-			else
-				maxval = max(maxval, (double)stats->GetStatNum(x)->value.lval);
-		}
-	}
+	statSummary s;
+	if (stats->GetSummary(category, owner, s))
+		maxval = max(maxval, s.maximum);
 	return maxval;
 }
 
 /** Count the number of state instances in the stat collection */
 long unsigned countStatEntries(StatCollection *stats, const char *category, const char *owner)
 {
-	long unsigned count = 0;
-	int catID, ownerID;
-	catID = stats->LookupCategory(category);
-	ownerID = stats->LookupOwner(owner);
-	
-	for (int x = 0; x < (int)stats->GetNumStats(); x++)
-		if ((stats->GetStatNum(x)->category == catID) && (stats->GetStatNum(x)->owner == ownerID))
-			count++;
-				
-	return count;
+	statSummary s;
+	if (stats->GetSummary(category, owner, s))
+		return s.count;
+	return 0;
 }
 
 double averageStatEntries(StatCollection *stats, const char *category, const char *owner)
 {
-	double sum = 0.0;
-	double count = 0.0;
-	int catID, ownerID;
-	catID = stats->LookupCategory(category);
-	ownerID = stats->LookupOwner(owner);
-	
-	for (int x = 0; x < (int)stats->GetNumStats(); x++)
-	{
-		if ((stats->GetStatNum(x)->category == catID) && (stats->GetStatNum(x)->owner == ownerID))
-		{
-			if (stats->GetStatNum(x)->sType == floatStored)
-				sum += stats->GetStatNum(x)->value.fval;
-			else
-				sum += (double)stats->GetStatNum(x)->value.lval;
-			count++;
-		}
-	}
-	if (count > 0)
-		return sum/count;
+	statSummary s;
+	if (stats->GetSummary(category, owner, s))
+		return s.total/s.count;
 	return 0;
 }
 
@@ -0,0 +1,115 @@
+//
+//  WorkStealingQueue.h
+//  hog2 glut
+//
+//  A set of per-thread work deques. Each thread takes work from the front
+//  of its own deque; when it runs dry it steals from the back of the others.
+//
+
+#ifndef WORK_STEALING_QUEUE_H
+#define WORK_STEALING_QUEUE_H
+
+#include <vector>
+#include <deque>
+#include <mutex>
+
+template <typename T>
+class WorkStealingQueue {
+public:
+	WorkStealingQueue(int numThreads);
+	~WorkStealingQueue();
+	int NumThreads() const { return (int)queues.size(); }
+	/**
+	 Adds work to the deque belonging to thread
+	 **/
+	void Add(int thread, const T &item);
+	/**
+	 Splits items into contiguous runs, one per thread, so that each thread
+	 starts with a local range of the work. Not safe to call while threads
+	 are removing work.
+	 **/
+	void Distribute(const std::vector<T> &items);
+	/**
+	 Gets the next piece of work for thread; first from its own deque and
+	 then by stealing from the other threads. Returns false when all
+	 deques are empty.
+	 **/
+	bool Remove(int thread, T &item);
+	bool IsEmpty() const;
+private:
+	struct threadQueue {
+		std::deque<T> work;
+		std::mutex lock;
+	};
+	std::vector<threadQueue*> queues;
+};
+
+template <typename T>
+WorkStealingQueue<T>::WorkStealingQueue(int numThreads)
+{
+	queues.resize(numThreads);
+	for (int x = 0; x < numThreads; x++)
+		queues[x] = new threadQueue;
+}
+
+template <typename T>
+WorkStealingQueue<T>::~WorkStealingQueue()
+{
+	for (unsigned int x = 0; x < queues.size(); x++)
+		delete queues[x];
+}
+
+template <typename T>
+void WorkStealingQueue<T>::Add(int thread, const T &item)
+{
+	std::lock_guard<std::mutex> l(queues[thread]->lock);
+	queues[thread]->work.push_back(item);
+}
+
+template <typename T>
+void WorkStealingQueue<T>::Distribute(const std::vector<T> &items)
+{
+	size_t perThread = (items.size()+queues.size()-1)/queues.size();
+	for (size_t x = 0; x < items.size(); x++)
+		queues[x/perThread]->work.push_back(items[x]);
+}
+
+template <typename T>
+bool WorkStealingQueue<T>::Remove(int thread, T &item)
+{
+	{
+		std::lock_guard<std::mutex> l(queues[thread]->lock);
+		if (!queues[thread]->work.empty())
+		{
+			item = queues[thread]->work.front();
+			queues[thread]->work.pop_front();
+			return true;
+		}
+	}
+	for (unsigned int x = 1; x < queues.size(); x++)
+	{
+		threadQueue *victim = queues[(thread+x)%queues.size()];
+		std::lock_guard<std::mutex> l(victim->lock);
+		if (!victim->work.empty())
+		{
+			item = victim->work.back();
+			victim->work.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+template <typename T>
+bool WorkStealingQueue<T>::IsEmpty() const
+{
+	for (unsigned int x = 0; x < queues.size(); x++)
+	{
+		std::lock_guard<std::mutex> l(queues[x]->lock);
+		if (!queues[x]->work.empty())
+			return false;
+	}
+	return true;
+}
+
+#endif